@@ -0,0 +1,168 @@
+#pragma once
+
+#include "core/Exception.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+
+namespace sparkle
+{
+// A 2D array of pixels in one contiguous, cache-line-aligned allocation. Rows are padded to whole cache lines when
+// the element size allows it, so every row starts aligned and a tile row never straddles two allocations.
+// Resizing within the existing capacity does not touch the heap.
+// T is expected to be a plain value type (scalars, fixed-size Eigen vectors): elements are neither constructed nor
+// destroyed individually and hold garbage until written.
+template <typename T> class PixelBuffer2D
+{
+public:
+    static constexpr size_t Alignment = 64;
+
+    PixelBuffer2D() = default;
+
+    PixelBuffer2D(unsigned width, unsigned height)
+    {
+        Resize(width, height);
+    }
+
+    PixelBuffer2D(const PixelBuffer2D &) = delete;
+    PixelBuffer2D &operator=(const PixelBuffer2D &) = delete;
+
+    PixelBuffer2D(PixelBuffer2D &&) noexcept = default;
+    PixelBuffer2D &operator=(PixelBuffer2D &&) noexcept = default;
+
+    void Resize(unsigned width, unsigned height)
+    {
+        const size_t stride = GetPaddedStride(width);
+        const size_t size = stride * height;
+        if (size > capacity_)
+        {
+            data_.reset(static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t{Alignment})));
+            capacity_ = size;
+        }
+
+        width_ = width;
+        height_ = height;
+        stride_ = stride;
+    }
+
+    // frees the storage
+    void Clear()
+    {
+        data_.reset();
+        capacity_ = 0;
+        width_ = 0;
+        height_ = 0;
+        stride_ = 0;
+    }
+
+    void Fill(const T &value)
+    {
+        std::fill_n(data_.get(), GetStorageCount(), value);
+    }
+
+    // copies content of the same dimensions, padding included
+    void CopyFrom(const PixelBuffer2D &other)
+    {
+        ASSERT(other.width_ == width_ && other.height_ == height_);
+        std::copy_n(other.data_.get(), GetStorageCount(), data_.get());
+    }
+
+    [[nodiscard]] T &operator()(unsigned i, unsigned j)
+    {
+        return data_[GetIndex(i, j)];
+    }
+
+    [[nodiscard]] const T &operator()(unsigned i, unsigned j) const
+    {
+        return data_[GetIndex(i, j)];
+    }
+
+    [[nodiscard]] std::span<T> Row(unsigned j)
+    {
+        return {data_.get() + static_cast<size_t>(j) * stride_, width_};
+    }
+
+    [[nodiscard]] std::span<const T> Row(unsigned j) const
+    {
+        return {data_.get() + static_cast<size_t>(j) * stride_, width_};
+    }
+
+    // the part of row j in [x_begin, x_end), e.g. one row of a tile
+    [[nodiscard]] std::span<T> Row(unsigned j, unsigned x_begin, unsigned x_end)
+    {
+        return Row(j).subspan(x_begin, x_end - x_begin);
+    }
+
+    [[nodiscard]] std::span<const T> Row(unsigned j, unsigned x_begin, unsigned x_end) const
+    {
+        return Row(j).subspan(x_begin, x_end - x_begin);
+    }
+
+    [[nodiscard]] size_t GetIndex(unsigned i, unsigned j) const
+    {
+        return static_cast<size_t>(j) * stride_ + i;
+    }
+
+    [[nodiscard]] unsigned GetWidth() const
+    {
+        return width_;
+    }
+
+    [[nodiscard]] unsigned GetHeight() const
+    {
+        return height_;
+    }
+
+    // distance between rows, in elements
+    [[nodiscard]] size_t GetStride() const
+    {
+        return stride_;
+    }
+
+    [[nodiscard]] T *GetData()
+    {
+        return data_.get();
+    }
+
+    [[nodiscard]] const T *GetData() const
+    {
+        return data_.get();
+    }
+
+private:
+    struct AlignedDeleter
+    {
+        void operator()(T *data) const
+        {
+            ::operator delete(data, std::align_val_t{Alignment});
+        }
+    };
+
+    static size_t GetPaddedStride(unsigned width)
+    {
+        if constexpr (Alignment % sizeof(T) == 0)
+        {
+            constexpr size_t ElementsPerLine = Alignment / sizeof(T);
+            return (width + ElementsPerLine - 1) / ElementsPerLine * ElementsPerLine;
+        }
+        else
+        {
+            return width;
+        }
+    }
+
+    [[nodiscard]] size_t GetStorageCount() const
+    {
+        return stride_ * height_;
+    }
+
+    std::unique_ptr<T[], AlignedDeleter> data_;
+    size_t capacity_ = 0;
+    size_t stride_ = 0;
+    unsigned width_ = 0;
+    unsigned height_ = 0;
+};
+} // namespace sparkle
@@ -10,6 +10,9 @@ class PrimitiveRenderProxy;
 class Intersection
 {
 public:
+    // face of hits that did not land on a triangle, e.g. analytic spheres
+    static constexpr uint32_t NoFace = UINT32_MAX;
+
     [[nodiscard]] auto T() const
     {
         return t_;
@@ -35,6 +38,12 @@ public:
         return tex_coord_;
     }
 
+    // triangle of a mesh hit, NoFace for other primitives
+    [[nodiscard]] uint32_t GetFace() const
+    {
+        return face_;
+    }
+
     [[nodiscard]] const PrimitiveRenderProxy *GetPrimitive() const
     {
         return primitive_;
@@ -57,7 +66,7 @@ public:
     }
 
     void Update(const Ray &ray, const PrimitiveRenderProxy *primitive, float t, const Vector3 &normal,
-                const Vector3 &tangent, const Vector2 &tex_coord = Vector2::Zero())
+                const Vector3 &tangent, const Vector2 &tex_coord = Vector2::Zero(), uint32_t face = NoFace)
     {
         auto is_valid_setup = primitive_ == nullptr || t < t_;
         ASSERT(is_valid_setup);
@@ -67,6 +76,7 @@ public:
         normal_ = normal;
         tangent_ = tangent;
         tex_coord_ = tex_coord;
+        face_ = face;
 
         Update(ray, primitive);
     }
@@ -85,6 +95,7 @@ private:
     Vector3 normal_;
     Vector3 tangent_;
     Vector2 tex_coord_;
+    uint32_t face_ = NoFace;
     float t_ = 0.f;
 };
 
@@ -12,17 +12,21 @@ public:
     {
     }
 
-    void Reset(const Vector3 &origin, const Vector3 &direction)
+    // hits beyond max_distance are ignored, e.g. for shadow rays towards a light in the scene
+    void Reset(const Vector3 &origin, const Vector3 &direction,
+               Scalar max_distance = std::numeric_limits<Scalar>::max())
     {
         ASSERT(utilities::IsNormalized(direction));
 
         origin_ = origin;
         direction_ = direction;
+        max_distance_ = max_distance;
     }
 
+    // the direction is not renormalized, so distances stay comparable with world space
     [[nodiscard]] Ray TransformedBy(const Transform &transform) const
     {
-        return Ray(transform.TransformPoint(origin_), transform.TransformDirection(direction_));
+        return Ray(transform.TransformPoint(origin_), transform.TransformDirection(direction_), max_distance_);
     }
 
     [[nodiscard]] Vector3 Origin() const
@@ -35,6 +39,11 @@ public:
         return direction_;
     }
 
+    [[nodiscard]] Scalar MaxDistance() const
+    {
+        return max_distance_;
+    }
+
     [[nodiscard]] Vector3 At(float t) const
     {
         return origin_ + direction_ * t;
@@ -54,13 +63,15 @@ public:
     void Print() const;
 
 protected:
-    Ray(Vector3 origin, Vector3 direction) : origin_(std::move(origin)), direction_(std::move(direction))
+    Ray(Vector3 origin, Vector3 direction, Scalar max_distance)
+        : origin_(std::move(origin)), direction_(std::move(direction)), max_distance_(max_distance)
     {
     }
 
 private:
     Vector3 origin_;
     Vector3 direction_;
+    Scalar max_distance_ = std::numeric_limits<Scalar>::max();
     bool debug_;
 };
 } // namespace sparkle
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "core/math/BVH.h"
+#include "core/math/Ray.h"
+#include "core/math/RayStats.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <vector>
+
+// lanes per packet. the lane math is written with fixed-size eigen arrays, so it maps onto whatever simd width the
+// compiler targets (sse/avx/neon).
+#ifndef RAY_PACKET_WIDTH
+#define RAY_PACKET_WIDTH 8
+#endif
+
+namespace sparkle
+{
+using RayPacketMask = uint32_t;
+
+// A fixed-width bundle of rays in SoA layout, used to traverse a BVH with one box test for all lanes.
+// It only carries what traversal needs; primitive tests go back to the scalar Ray of each lane.
+template <unsigned Width> class RayPacket
+{
+public:
+    static_assert(Width == 4 || Width == 8 || Width == 16, "supported packet widths are 4, 8 and 16");
+
+    using Lanes = Eigen::Array<Scalar, Width, 1>;
+
+    static constexpr unsigned Size = Width;
+
+    RayPacket()
+    {
+        rays_.fill(nullptr);
+        t_max_.setConstant(std::numeric_limits<Scalar>::max());
+    }
+
+    // lanes must be set before traversal. a lane that is never set stays inactive.
+    void SetRay(unsigned lane, const Ray *ray)
+    {
+        ASSERT(lane < Width);
+
+        rays_[lane] = ray;
+        t_max_[lane] = ray->MaxDistance();
+
+        const Vector3 origin = ray->Origin();
+        const Vector3 direction = ray->Direction();
+        for (auto axis = 0u; axis < 3; axis++)
+        {
+            // same safe inverse as bvh::v2 so that axis-aligned rays never produce nan slabs
+            const Scalar d = direction[axis];
+            const Scalar inv_d = std::abs(d) <= std::numeric_limits<Scalar>::epsilon()
+                                     ? std::copysign(1.f / std::numeric_limits<Scalar>::epsilon(), d)
+                                     : 1.f / d;
+            inv_direction_[axis][lane] = inv_d;
+            scaled_origin_[axis][lane] = -origin[axis] * inv_d;
+        }
+
+        active_mask_ |= 1u << lane;
+    }
+
+    [[nodiscard]] const Ray &GetRay(unsigned lane) const
+    {
+        return *rays_[lane];
+    }
+
+    [[nodiscard]] RayPacketMask GetActiveMask() const
+    {
+        return active_mask_;
+    }
+
+    // a lane that is done (e.g. any-hit found) stops taking part in traversal
+    void Deactivate(unsigned lane)
+    {
+        active_mask_ &= ~(1u << lane);
+    }
+
+    // a closer hit shrinks the lane's interval so boxes behind it are culled
+    void SetMaxDistance(unsigned lane, Scalar t)
+    {
+        t_max_[lane] = t;
+    }
+
+    [[nodiscard]] Scalar GetMaxDistance(unsigned lane) const
+    {
+        return t_max_[lane];
+    }
+
+    // slab test of all lanes against one bvh node. returns the lanes in mask that overlap it and their entry distance.
+    RayPacketMask IntersectNode(const Node &node, RayPacketMask mask, Lanes &entry) const
+    {
+        // keep the test conservative w.r.t. the scalar traversal: a box touching the current hit must be visited
+        static constexpr Scalar ExitTolerance = 1.f + 4.f * std::numeric_limits<Scalar>::epsilon();
+
+        entry.setZero();
+        Lanes exit = t_max_ * ExitTolerance;
+        for (auto axis = 0u; axis < 3; axis++)
+        {
+            const Lanes t0 = inv_direction_[axis] * node.bounds[axis * 2] + scaled_origin_[axis];
+            const Lanes t1 = inv_direction_[axis] * node.bounds[axis * 2 + 1] + scaled_origin_[axis];
+            entry = entry.max(t0.min(t1));
+            exit = exit.min(t0.max(t1));
+        }
+
+        RayPacketMask hit = 0;
+        for (auto lane = 0u; lane < Width; lane++)
+        {
+            hit |= static_cast<RayPacketMask>(entry[lane] <= exit[lane]) << lane;
+        }
+        return hit & mask;
+    }
+
+private:
+    std::array<Lanes, 3> inv_direction_;
+    std::array<Lanes, 3> scaled_origin_;
+    Lanes t_max_;
+    std::array<const Ray *, Width> rays_;
+    RayPacketMask active_mask_ = 0;
+};
+
+using DefaultRayPacket = RayPacket<RAY_PACKET_WIDTH>;
+
+template <typename Func> inline void ForEachLane(RayPacketMask mask, Func &&func)
+{
+    while (mask)
+    {
+        func(static_cast<unsigned>(std::countr_zero(mask)));
+        mask &= mask - 1;
+    }
+}
+
+// entries of the packet traversal stack kept inline. a node pushes at most two children and pops itself, so a tree
+// needs one entry per level plus one. deeper trees spill the stack to the heap
+inline constexpr size_t RayPacketStackSize = 64;
+
+// Traverse a bvh::v2 tree with a whole packet. A child is descended if any active lane overlaps it, and the child that
+// most lanes enter first is visited first. leaf_fn(begin, end, mask) is called with prim_ids range and the lanes that
+// reached the leaf; it updates the packet (max distance, active lanes) itself.
+template <unsigned Width, typename LeafFn>
+void TraversePacket(const Bvh &bvh, RayPacket<Width> &packet, LeafFn &&leaf_fn)
+{
+    if (bvh.nodes.empty() || !packet.GetActiveMask())
+    {
+        return;
+    }
+
+    struct StackEntry
+    {
+        size_t node;
+        RayPacketMask mask;
+    };
+
+    std::array<StackEntry, RayPacketStackSize> inline_stack;
+    std::vector<StackEntry> heap_stack;
+    StackEntry *stack = inline_stack.data();
+    size_t stack_capacity = inline_stack.size();
+    size_t stack_size = 0;
+
+    stack[stack_size++] = {0, packet.GetActiveMask()};
+
+    auto &stats = RayStats::GetThreadLocal();
+
+    typename RayPacket<Width>::Lanes left_entry;
+    typename RayPacket<Width>::Lanes right_entry;
+
+    while (stack_size > 0)
+    {
+        auto [node_id, mask] = stack[--stack_size];
+
+        // lanes may have finished (any-hit) since this entry was pushed
+        mask &= packet.GetActiveMask();
+        if (!mask)
+        {
+            continue;
+        }
+
+        const auto &node = bvh.nodes[node_id];
+        if (node.is_leaf())
+        {
+            stats.leaf_visits += static_cast<uint64_t>(std::popcount(mask));
+            leaf_fn(node.index.first_id(), node.index.first_id() + node.index.prim_count(), mask);
+            continue;
+        }
+
+        stats.node_visits += static_cast<uint64_t>(std::popcount(mask));
+
+        const size_t left_id = node.index.first_id();
+        const size_t right_id = left_id + 1;
+
+        const auto left_mask = packet.IntersectNode(bvh.nodes[left_id], mask, left_entry);
+        const auto right_mask = packet.IntersectNode(bvh.nodes[right_id], mask, right_entry);
+
+        if (left_mask && right_mask)
+        {
+            int left_votes = 0;
+            ForEachLane(left_mask & right_mask,
+                        [&](unsigned lane) { left_votes += left_entry[lane] <= right_entry[lane] ? 1 : -1; });
+
+            if (stack_size + 2 > stack_capacity) [[unlikely]]
+            {
+                // resizing keeps what is already on the heap, the inline entries are copied over once
+                const bool on_heap = !heap_stack.empty();
+                heap_stack.resize(stack_capacity * 2);
+                if (!on_heap)
+                {
+                    std::copy_n(inline_stack.data(), stack_size, heap_stack.data());
+                }
+                stack = heap_stack.data();
+                stack_capacity = heap_stack.size();
+            }
+
+            if (left_votes >= 0)
+            {
+                stack[stack_size++] = {right_id, right_mask};
+                stack[stack_size++] = {left_id, left_mask};
+            }
+            else
+            {
+                stack[stack_size++] = {left_id, left_mask};
+                stack[stack_size++] = {right_id, right_mask};
+            }
+        }
+        else if (left_mask)
+        {
+            stack[stack_size++] = {left_id, left_mask};
+        }
+        else if (right_mask)
+        {
+            stack[stack_size++] = {right_id, right_mask};
+        }
+    }
+}
+} // namespace sparkle
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sparkle
+{
+// what the cpu ray tracer did. every thread counts into its own copy, so counting is a plain increment. whoever wants
+// totals takes the difference of a thread's counters around its work and sums those, see CPURenderer::RenderTile
+struct RayStats
+{
+    uint64_t camera_rays = 0;
+    uint64_t bounce_rays = 0;
+    uint64_t shadow_rays = 0;
+    // once per ray, also when a packet visits a node for several rays at once. traversals through bvh::v2 count inner
+    // nodes, not the children they test
+    uint64_t node_visits = 0;
+    uint64_t leaf_visits = 0;
+    uint64_t triangle_tests = 0;
+    // path vertices that went on to trace another ray, and paths that russian roulette ended
+    uint64_t bounces = 0;
+    uint64_t roulette_terminations = 0;
+
+    [[nodiscard]] uint64_t GetRayCount() const
+    {
+        return camera_rays + bounce_rays + shadow_rays;
+    }
+
+    // what DebugMode::TraversalCost shows
+    [[nodiscard]] uint64_t GetTraversalCost() const
+    {
+        return node_visits + leaf_visits + triangle_tests;
+    }
+
+    RayStats &operator+=(const RayStats &other)
+    {
+        camera_rays += other.camera_rays;
+        bounce_rays += other.bounce_rays;
+        shadow_rays += other.shadow_rays;
+        node_visits += other.node_visits;
+        leaf_visits += other.leaf_visits;
+        triangle_tests += other.triangle_tests;
+        bounces += other.bounces;
+        roulette_terminations += other.roulette_terminations;
+        return *this;
+    }
+
+    [[nodiscard]] RayStats operator-(const RayStats &other) const
+    {
+        return {.camera_rays = camera_rays - other.camera_rays,
+                .bounce_rays = bounce_rays - other.bounce_rays,
+                .shadow_rays = shadow_rays - other.shadow_rays,
+                .node_visits = node_visits - other.node_visits,
+                .leaf_visits = leaf_visits - other.leaf_visits,
+                .triangle_tests = triangle_tests - other.triangle_tests,
+                .bounces = bounces - other.bounces,
+                .roulette_terminations = roulette_terminations - other.roulette_terminations};
+    }
+
+    // counters of the calling thread. they only ever grow
+    static RayStats &GetThreadLocal()
+    {
+        static thread_local RayStats stats;
+        return stats;
+    }
+};
+} // namespace sparkle
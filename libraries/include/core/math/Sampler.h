@@ -10,14 +10,85 @@ namespace sparkle
 {
 namespace sampler
 {
+// what a thread draws from: white noise, or one sample of a low-discrepancy sequence addressed by dimension
+struct RngState
+{
+    XoshiroCpp::Xoshiro128Plus rng;
+    // decorrelates the sequences of different pixels
+    uint32_t sequence_seed = 0;
+    uint32_t sample_index = 0;
+    uint32_t dimension = 0;
+    bool low_discrepancy = false;
+};
+
 namespace detail
 {
-// Expose the default thread-local RNG so it can be reseeded externally.
-inline XoshiroCpp::Xoshiro128Plus &GetDefaultRng()
+inline RngState &GetCurrentState()
+{
+    static thread_local RngState state{
+        .rng = XoshiroCpp::Xoshiro128Plus(
+            static_cast<unsigned int>(std::hash<std::thread::id>{}(std::this_thread::get_id())))};
+    return state;
+}
+
+inline uint32_t HashCombine(uint32_t seed, uint32_t value)
+{
+    // https://nullprogram.com/blog/2018/07/31/
+    uint32_t x = seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u));
+    x ^= x >> 16u;
+    x *= 0x21f0aaadu;
+    x ^= x >> 15u;
+    x *= 0x735a2d97u;
+    x ^= x >> 15u;
+    return x;
+}
+
+inline uint32_t ReverseBits(uint32_t x)
+{
+    x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+    x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+    x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+    x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+    return (x >> 16u) | (x << 16u);
+}
+
+// nested uniform scrambling of the bits of x, from most to least significant. Burley, "Practical Hash-based Owen
+// Scrambling", 2020, with the improved constants of Vegdahl
+inline uint32_t OwenScramble(uint32_t x, uint32_t seed)
+{
+    x = ReverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16u) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return ReverseBits(x);
+}
+
+// the first two dimensions of the sobol sequence, which together form a (0, 2)-sequence
+inline uint32_t Sobol(uint32_t index, uint32_t dimension)
+{
+    if (dimension == 0)
+    {
+        return ReverseBits(index);
+    }
+
+    uint32_t result = 0;
+    for (uint32_t direction = 1u << 31u; index != 0; index >>= 1u, direction ^= direction >> 1u)
+    {
+        result ^= (index & 1u) ? direction : 0u;
+    }
+    return result;
+}
+
+// padded sobol: dimensions are taken in pairs, each pair a (0, 2)-sequence of its own whose index is shuffled by
+// another seed, so pairs do not correlate. prefixes of 2^k samples stay stratified in every pair.
+inline float SobolSample(uint32_t sequence_seed, uint32_t sample_index, uint32_t dimension)
 {
-    static thread_local XoshiroCpp::Xoshiro128Plus rng(
-        static_cast<unsigned int>(std::hash<std::thread::id>{}(std::this_thread::get_id())));
-    return rng;
+    const uint32_t pair_seed = HashCombine(sequence_seed, dimension >> 1u);
+    const uint32_t index = OwenScramble(sample_index, pair_seed);
+    const uint32_t value = OwenScramble(Sobol(index, dimension & 1u), HashCombine(pair_seed, dimension & 1u));
+    return static_cast<float>(value >> 8u) * 0x1p-24f;
 }
 } // namespace detail
 
@@ -26,7 +97,37 @@ inline XoshiroCpp::Xoshiro128Plus &GetDefaultRng()
 // reproducible output regardless of which thread pool worker runs the task.
 inline void ReseedCurrentThread(unsigned int seed)
 {
-    detail::GetDefaultRng() = XoshiroCpp::Xoshiro128Plus(seed);
+    detail::GetCurrentState() = {.rng = XoshiroCpp::Xoshiro128Plus(seed)};
+}
+
+// Draw the sample_index-th point of the sequence identified by sequence_seed from now on, starting at dimension 0.
+// Nothing is seeded: every value is computed from (sequence_seed, sample_index, dimension) alone.
+inline void StartSequenceSample(uint32_t sequence_seed, uint32_t sample_index)
+{
+    auto &state = detail::GetCurrentState();
+    state.sequence_seed = sequence_seed;
+    state.sample_index = sample_index;
+    state.dimension = 0;
+    state.low_discrepancy = true;
+}
+
+// Jump to a dimension, so that a decision always reads the same dimensions whatever the ones before it consumed.
+// White noise has no dimensions and ignores this.
+inline void SetDimension(uint32_t dimension)
+{
+    detail::GetCurrentState().dimension = dimension;
+}
+
+// Snapshot and restore the calling thread's RNG. Lets one thread interleave several work units (e.g. paths advanced
+// bounce by bounce) while each keeps the exact sequence it would get if run alone.
+inline RngState SaveCurrentThreadState()
+{
+    return detail::GetCurrentState();
+}
+
+inline void RestoreCurrentThreadState(const RngState &state)
+{
+    detail::GetCurrentState() = state;
 }
 
 template <bool FixSeed = false> inline float RandomUnit()
@@ -37,15 +138,36 @@ template <bool FixSeed = false> inline float RandomUnit()
         static thread_local XoshiroCpp::Xoshiro128Plus rng(FixedSeed);
         return static_cast<float>(rng()) / static_cast<float>(std::numeric_limits<uint32_t>::max());
     }
-    return static_cast<float>(detail::GetDefaultRng()()) / static_cast<float>(std::numeric_limits<uint32_t>::max());
+
+    auto &state = detail::GetCurrentState();
+    if (state.low_discrepancy)
+    {
+        return detail::SobolSample(state.sequence_seed, state.sample_index, state.dimension++);
+    }
+    return static_cast<float>(state.rng()) / static_cast<float>(std::numeric_limits<uint32_t>::max());
 }
 
-template <bool FixSeed = false> inline Vector2 UnitDisk()
+// a 2d sample point. low-discrepancy draws start at an even dimension, so that both values come from one pair.
+template <bool FixSeed = false> inline Vector2 Random2D()
+{
+    if constexpr (!FixSeed)
+    {
+        auto &state = detail::GetCurrentState();
+        state.dimension += state.dimension & 1u;
+    }
+
+    auto x = RandomUnit<FixSeed>();
+    auto y = RandomUnit<FixSeed>();
+    return {x, y};
+}
+
+// the warps below map sample points in [0, 1)^2 to their domain. they draw nothing themselves.
+
+inline Vector2 UnitDisk(const Vector2 &u)
 {
-    auto rand = RandomUnit<FixSeed>();
-    auto theta = RandomUnit<FixSeed>() * 2.0f * Pi;
+    auto theta = u.y() * 2.0f * Pi;
 
-    auto r = std::sqrt(rand);
+    auto r = std::sqrt(u.x());
     auto x = r * std::cos(theta);
     auto y = r * std::sin(theta);
 
@@ -54,12 +176,12 @@ template <bool FixSeed = false> inline Vector2 UnitDisk()
 
 struct UniformHemiSphere
 {
-    static Vector3 Sample()
+    static Vector3 Sample(const Vector2 &u)
     {
         // https://alexanderameye.github.io/notes/sampling-the-hemisphere/
 
-        auto cos_theta = RandomUnit();
-        auto epsilon = RandomUnit();
+        auto cos_theta = u.x();
+        auto epsilon = u.y();
 
         auto sin_theta = sqrt(1 - cos_theta * cos_theta);
 
@@ -78,9 +200,9 @@ struct UniformHemiSphere
 
 struct CosineWeightedHemiSphere
 {
-    static Vector3 Sample()
+    static Vector3 Sample(const Vector2 &u)
     {
-        Vector2 unit_disk = UnitDisk();
+        Vector2 unit_disk = UnitDisk(u);
 
         // Project z up to the unit hemisphere
         auto z = std::sqrt(std::max(0.f, 1.0f - unit_disk.squaredNorm()));
@@ -96,10 +218,10 @@ struct CosineWeightedHemiSphere
 
 struct DistributionGGX
 {
-    static Vector3 Sample(float roughness)
+    static Vector3 Sample(const Vector2 &u, float roughness)
     {
-        auto u_1 = RandomUnit();
-        auto u_2 = RandomUnit();
+        auto u_1 = u.x();
+        auto u_2 = u.y();
 
         auto a = roughness * roughness;
         auto a2 = a * a;
@@ -132,12 +254,12 @@ struct DistributionGGX
 
 struct DistributionVn
 {
-    static Vector3 Sample(const Vector3 &w_o, float roughness)
+    static Vector3 Sample(const Vector2 &u, const Vector3 &w_o, float roughness)
     {
         float a = roughness * roughness;
 
-        auto u1 = RandomUnit();
-        auto u2 = RandomUnit();
+        auto u1 = u.x();
+        auto u2 = u.y();
 
         // -- Stretch the view vector so we are sampling as though
         // -- roughness==1
@@ -165,14 +287,14 @@ struct DistributionVn
 };
 
 // sample a mircro-facet normal given a surface normal
-inline Vector3 SampleMicroFacetNormal(float roughness)
+inline Vector3 SampleMicroFacetNormal(const Vector2 &u, float roughness)
 {
-    return DistributionGGX::Sample(roughness);
+    return DistributionGGX::Sample(u, roughness);
 }
 
-inline Vector3 SampleMicroFacetNormal(const Vector3 &w_o, float roughness)
+inline Vector3 SampleMicroFacetNormal(const Vector2 &u, const Vector3 &w_o, float roughness)
 {
-    return DistributionVn::Sample(w_o, roughness);
+    return DistributionVn::Sample(u, w_o, roughness);
 }
 }; // namespace sampler
 } // namespace sparkle
@@ -132,6 +132,20 @@ inline Vector3 VisualizeVectorLength(const Vector3 &v)
     return Ones * v.squaredNorm();
 }
 
+// blue (0) through green to red (1)
+inline Vector3 VisualizeHeat(Scalar value)
+{
+    const Scalar t = std::clamp(value, 0.f, 1.f);
+    return Vector3(std::clamp(2.f * t - 1.f, 0.f, 1.f), 1.f - std::abs(2.f * t - 1.f),
+                   std::clamp(1.f - 2.f * t, 0.f, 1.f));
+}
+
+// rec. 709 luminance of a linear color
+inline Scalar Luminance(const Vector3 &color)
+{
+    return color.dot(Vector3(0.2126f, 0.7152f, 0.0722f));
+}
+
 inline Scalar CosTheta(const Vector3 &w)
 {
     return w.z();
@@ -0,0 +1,424 @@
+#pragma once
+
+#include "core/math/BVH.h"
+#include "core/math/Ray.h"
+#include "core/math/RayStats.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <vector>
+
+// branching factor of mesh BLAS on the cpu path: 2 keeps the binary bvh, 4 or 8 collapse it into a WideTriangleBVH.
+// normally set by the CPU_BVH_WIDTH cmake cache variable.
+#ifndef CPU_BVH_WIDTH
+#define CPU_BVH_WIDTH 2
+#endif
+
+namespace sparkle
+{
+// A Width-ary BVH over triangles, collapsed from a binary bvh::v2 tree.
+// Child bounds of a node are stored in SoA so one ray is tested against all children at once, and leaves are clusters
+// of Width triangles in SoA so they are intersected together. All lane math uses fixed-size eigen arrays.
+template <unsigned Width> class WideTriangleBVH
+{
+public:
+    static_assert(Width == 4 || Width == 8, "supported widths are 4 and 8");
+
+    using Lanes = Eigen::Array<Scalar, Width, 1>;
+    using LaneMask = uint32_t;
+
+    struct Triangle
+    {
+        Vector3 p0;
+        Vector3 e1;
+        Vector3 e2;
+    };
+
+    struct alignas(64) WideNode
+    {
+        std::array<Lanes, 3> min;
+        std::array<Lanes, 3> max;
+        // inner child: index of the node. leaf child: index of the first cluster.
+        std::array<uint32_t, Width> child;
+        // 0 for an inner child, number of clusters for a leaf child
+        std::array<uint32_t, Width> cluster_count;
+        uint32_t num_children = 0;
+    };
+
+    struct alignas(64) TriangleCluster
+    {
+        std::array<Lanes, 3> p0;
+        std::array<Lanes, 3> e1;
+        std::array<Lanes, 3> e2;
+        std::array<uint32_t, Width> face_idx;
+    };
+
+    // get_triangle(prim_id) returns the Triangle that binary.prim_ids refer to
+    template <typename GetTriangle> void Build(const Bvh &binary, GetTriangle &&get_triangle)
+    {
+        nodes_.clear();
+        clusters_.clear();
+
+        if (binary.nodes.empty())
+        {
+            return;
+        }
+
+        subtree_prim_count_.assign(binary.nodes.size(), 0);
+        CountPrimitives(binary, 0);
+
+        nodes_.emplace_back();
+        const auto &root = binary.nodes[0];
+        if (root.is_leaf())
+        {
+            // a single leaf still needs an inner root to hold its bounds
+            auto &node = nodes_[0];
+            SetChildBounds(node, 0, root);
+            node.child[0] = EmitLeaf(binary, 0, get_triangle);
+            node.cluster_count[0] = static_cast<uint32_t>(clusters_.size()) - node.child[0];
+            node.num_children = 1;
+        }
+        else
+        {
+            CollapseNode(binary, 0, 0, get_triangle);
+        }
+
+        subtree_prim_count_.clear();
+        subtree_prim_count_.shrink_to_fit();
+    }
+
+    // on_hit(t, u, v, face_idx) decides whether a hit is taken; taken hits shrink the search interval, which starts at
+    // (0, t_max). returns true if any hit was taken.
+    template <bool AnyHit, typename HitFn>
+    bool Intersect(const Ray &ray, HitFn &&on_hit, Scalar t_max = std::numeric_limits<Scalar>::max()) const
+    {
+        if (nodes_.empty())
+        {
+            return false;
+        }
+
+        const Vector3 origin = ray.Origin();
+        const Vector3 direction = ray.Direction();
+
+        std::array<Scalar, 3> inv_direction;
+        std::array<Scalar, 3> scaled_origin;
+        for (auto axis = 0u; axis < 3; axis++)
+        {
+            // same safe inverse as bvh::v2 so that axis-aligned rays never produce nan slabs
+            const Scalar d = direction[axis];
+            inv_direction[axis] = std::abs(d) <= std::numeric_limits<Scalar>::epsilon()
+                                      ? std::copysign(1.f / std::numeric_limits<Scalar>::epsilon(), d)
+                                      : 1.f / d;
+            scaled_origin[axis] = -origin[axis] * inv_direction[axis];
+        }
+
+        struct StackEntry
+        {
+            uint32_t index;
+            uint32_t cluster_count;
+            Scalar entry;
+        };
+
+        static constexpr size_t StackSize = 64 * (Width - 1) + 1;
+        std::array<StackEntry, StackSize> stack;
+        size_t stack_size = 0;
+        stack[stack_size++] = {0, 0, 0.f};
+
+        Scalar closest_t = t_max;
+        bool any_hit = false;
+
+        auto &stats = RayStats::GetThreadLocal();
+
+        while (stack_size > 0)
+        {
+            const auto [index, cluster_count, entry_t] = stack[--stack_size];
+            if (entry_t > closest_t)
+            {
+                continue;
+            }
+
+            if (cluster_count > 0)
+            {
+                stats.leaf_visits++;
+                // padding lanes of a cluster are tested too
+                stats.triangle_tests += static_cast<uint64_t>(cluster_count) * Width;
+                for (auto cluster = index; cluster < index + cluster_count; cluster++)
+                {
+                    if (IntersectCluster<AnyHit>(clusters_[cluster], origin, direction, closest_t, on_hit))
+                    {
+                        any_hit = true;
+                        if constexpr (AnyHit)
+                        {
+                            return true;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            stats.node_visits++;
+            const auto &node = nodes_[index];
+
+            Lanes entry = Lanes::Zero();
+            Lanes exit = Lanes::Constant(closest_t);
+            for (auto axis = 0u; axis < 3; axis++)
+            {
+                const Lanes t0 = node.min[axis] * inv_direction[axis] + scaled_origin[axis];
+                const Lanes t1 = node.max[axis] * inv_direction[axis] + scaled_origin[axis];
+                entry = entry.max(t0.min(t1));
+                exit = exit.min(t0.max(t1));
+            }
+
+            // push the farthest child first so the nearest one is popped next
+            std::array<uint32_t, Width> hit_children;
+            uint32_t num_hits = 0;
+            for (auto lane = 0u; lane < node.num_children; lane++)
+            {
+                if (entry[lane] <= exit[lane])
+                {
+                    hit_children[num_hits++] = lane;
+                }
+            }
+
+            std::sort(hit_children.begin(), hit_children.begin() + num_hits,
+                      [&entry](uint32_t a, uint32_t b) { return entry[a] > entry[b]; });
+
+            ASSERT(stack_size + num_hits <= StackSize);
+            for (auto k = 0u; k < num_hits; k++)
+            {
+                const auto lane = hit_children[k];
+                stack[stack_size++] = {node.child[lane], node.cluster_count[lane], entry[lane]};
+            }
+        }
+
+        return any_hit;
+    }
+
+    [[nodiscard]] size_t GetNodeCount() const
+    {
+        return nodes_.size();
+    }
+
+    [[nodiscard]] size_t GetClusterCount() const
+    {
+        return clusters_.size();
+    }
+
+    [[nodiscard]] size_t GetMemorySize() const
+    {
+        return nodes_.size() * sizeof(WideNode) + clusters_.size() * sizeof(TriangleCluster);
+    }
+
+private:
+    uint32_t CountPrimitives(const Bvh &binary, size_t node_id)
+    {
+        const auto &node = binary.nodes[node_id];
+        const auto count = node.is_leaf() ? static_cast<uint32_t>(node.index.prim_count())
+                                          : CountPrimitives(binary, node.index.first_id()) +
+                                                CountPrimitives(binary, node.index.first_id() + 1);
+        subtree_prim_count_[node_id] = count;
+        return count;
+    }
+
+    static void SetChildBounds(WideNode &node, uint32_t lane, const Node &binary_node)
+    {
+        for (auto axis = 0u; axis < 3; axis++)
+        {
+            node.min[axis][lane] = binary_node.bounds[axis * 2];
+            node.max[axis][lane] = binary_node.bounds[axis * 2 + 1];
+        }
+    }
+
+    static Scalar HalfArea(const Node &node)
+    {
+        const Scalar dx = node.bounds[1] - node.bounds[0];
+        const Scalar dy = node.bounds[3] - node.bounds[2];
+        const Scalar dz = node.bounds[5] - node.bounds[4];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    // a binary subtree becomes a leaf once it fits in one cluster, or when the binary tree made it a leaf
+    [[nodiscard]] bool ShouldBecomeLeaf(const Bvh &binary, size_t node_id) const
+    {
+        return binary.nodes[node_id].is_leaf() || subtree_prim_count_[node_id] <= Width;
+    }
+
+    // fill nodes_[wide_id] with up to Width descendants of binary node_id, opening the largest inner child first
+    template <typename GetTriangle>
+    void CollapseNode(const Bvh &binary, size_t node_id, size_t wide_id, GetTriangle &get_triangle)
+    {
+        std::array<size_t, Width> children;
+        uint32_t num_children = 0;
+        children[num_children++] = binary.nodes[node_id].index.first_id();
+        children[num_children++] = binary.nodes[node_id].index.first_id() + 1;
+
+        while (num_children < Width)
+        {
+            int best = -1;
+            Scalar best_area = -1.f;
+            for (auto k = 0u; k < num_children; k++)
+            {
+                if (ShouldBecomeLeaf(binary, children[k]))
+                {
+                    continue;
+                }
+
+                const auto area = HalfArea(binary.nodes[children[k]]);
+                if (area > best_area)
+                {
+                    best_area = area;
+                    best = static_cast<int>(k);
+                }
+            }
+
+            if (best < 0)
+            {
+                break;
+            }
+
+            const auto opened = children[static_cast<unsigned>(best)];
+            children[static_cast<unsigned>(best)] = binary.nodes[opened].index.first_id();
+            children[num_children++] = binary.nodes[opened].index.first_id() + 1;
+        }
+
+        nodes_[wide_id].num_children = num_children;
+
+        for (auto lane = 0u; lane < num_children; lane++)
+        {
+            const auto child_id = children[lane];
+            SetChildBounds(nodes_[wide_id], lane, binary.nodes[child_id]);
+
+            if (ShouldBecomeLeaf(binary, child_id))
+            {
+                const auto first_cluster = EmitLeaf(binary, child_id, get_triangle);
+                nodes_[wide_id].child[lane] = first_cluster;
+                nodes_[wide_id].cluster_count[lane] = static_cast<uint32_t>(clusters_.size()) - first_cluster;
+            }
+            else
+            {
+                // nodes_ may reallocate while recursing, so never hold a reference across this call
+                const auto child_wide_id = static_cast<uint32_t>(nodes_.size());
+                nodes_.emplace_back();
+                nodes_[wide_id].child[lane] = child_wide_id;
+                nodes_[wide_id].cluster_count[lane] = 0;
+                CollapseNode(binary, child_id, child_wide_id, get_triangle);
+            }
+        }
+    }
+
+    // pack all triangles below a binary node into clusters. returns the index of the first cluster.
+    template <typename GetTriangle> uint32_t EmitLeaf(const Bvh &binary, size_t node_id, GetTriangle &get_triangle)
+    {
+        const auto first_cluster = static_cast<uint32_t>(clusters_.size());
+        uint32_t lane = Width;
+
+        auto emit = [&](size_t prim_index) {
+            if (lane == Width)
+            {
+                auto &cluster = clusters_.emplace_back();
+                // padding lanes are degenerate triangles that the determinant test rejects
+                for (auto axis = 0u; axis < 3; axis++)
+                {
+                    cluster.p0[axis].setZero();
+                    cluster.e1[axis].setZero();
+                    cluster.e2[axis].setZero();
+                }
+                cluster.face_idx.fill(UINT_MAX);
+                lane = 0;
+            }
+
+            auto &cluster = clusters_.back();
+            const auto face_idx = static_cast<uint32_t>(binary.prim_ids[prim_index]);
+            const Triangle triangle = get_triangle(face_idx);
+            for (auto axis = 0u; axis < 3; axis++)
+            {
+                cluster.p0[axis][lane] = triangle.p0[axis];
+                cluster.e1[axis][lane] = triangle.e1[axis];
+                cluster.e2[axis][lane] = triangle.e2[axis];
+            }
+            cluster.face_idx[lane] = face_idx;
+            lane++;
+        };
+
+        VisitLeaves(binary, node_id, emit);
+
+        return first_cluster;
+    }
+
+    template <typename Func> static void VisitLeaves(const Bvh &binary, size_t node_id, Func &func)
+    {
+        const auto &node = binary.nodes[node_id];
+        if (node.is_leaf())
+        {
+            for (size_t i = node.index.first_id(); i < node.index.first_id() + node.index.prim_count(); i++)
+            {
+                func(i);
+            }
+            return;
+        }
+
+        VisitLeaves(binary, node.index.first_id(), func);
+        VisitLeaves(binary, node.index.first_id() + 1, func);
+    }
+
+    // Möller-Trumbore on all lanes, the same arithmetic as the scalar triangle test
+    template <bool AnyHit, typename HitFn>
+    static bool IntersectCluster(const TriangleCluster &cluster, const Vector3 &origin, const Vector3 &direction,
+                                 Scalar &closest_t, HitFn &on_hit)
+    {
+        const Lanes hx = direction.y() * cluster.e2[2] - direction.z() * cluster.e2[1];
+        const Lanes hy = direction.z() * cluster.e2[0] - direction.x() * cluster.e2[2];
+        const Lanes hz = direction.x() * cluster.e2[1] - direction.y() * cluster.e2[0];
+
+        const Lanes a = cluster.e1[0] * hx + cluster.e1[1] * hy + cluster.e1[2] * hz;
+        const Lanes f = a.inverse();
+
+        const Lanes sx = origin.x() - cluster.p0[0];
+        const Lanes sy = origin.y() - cluster.p0[1];
+        const Lanes sz = origin.z() - cluster.p0[2];
+
+        const Lanes u = f * (sx * hx + sy * hy + sz * hz);
+
+        const Lanes qx = sy * cluster.e1[2] - sz * cluster.e1[1];
+        const Lanes qy = sz * cluster.e1[0] - sx * cluster.e1[2];
+        const Lanes qz = sx * cluster.e1[1] - sy * cluster.e1[0];
+
+        const Lanes v = f * (direction.x() * qx + direction.y() * qy + direction.z() * qz);
+        const Lanes t = f * (cluster.e2[0] * qx + cluster.e2[1] * qy + cluster.e2[2] * qz);
+
+        LaneMask valid = 0;
+        for (auto lane = 0u; lane < Width; lane++)
+        {
+            const bool is_hit = std::abs(a[lane]) >= Eps && u[lane] >= 0.f && u[lane] <= 1.f && v[lane] >= 0.f &&
+                                u[lane] + v[lane] <= 1.f && t[lane] > Eps && t[lane] < closest_t;
+            valid |= static_cast<LaneMask>(is_hit) << lane;
+        }
+
+        bool taken = false;
+        while (valid)
+        {
+            const auto lane = static_cast<unsigned>(std::countr_zero(valid));
+            valid &= valid - 1;
+
+            if (on_hit(t[lane], u[lane], v[lane], cluster.face_idx[lane]))
+            {
+                taken = true;
+                if constexpr (AnyHit)
+                {
+                    return true;
+                }
+                closest_t = std::min(closest_t, t[lane]);
+            }
+        }
+
+        return taken;
+    }
+
+    std::vector<WideNode> nodes_;
+    std::vector<TriangleCluster> clusters_;
+
+    // build scratch
+    std::vector<uint32_t> subtree_prim_count_;
+};
+} // namespace sparkle
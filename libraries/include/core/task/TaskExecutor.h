@@ -0,0 +1,80 @@
+#pragma once
+
+#include "core/task/TaskManager.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace sparkle
+{
+// Adapter that runs bvh::v2 style loops on the engine worker pool, so bvh builds do not spin up a thread pool of
+// their own. It follows the bvh::v2 executor interface (for_each / reduce over [begin, end) blocks), hence the naming.
+// It blocks until the pool finishes, so it must not be used from a pool worker; use bvh::v2::SequentialExecutor there.
+class TaskExecutor
+{
+public:
+    explicit TaskExecutor(size_t parallel_threshold = 1024) : parallel_threshold_(parallel_threshold)
+    {
+    }
+
+    // NOLINTBEGIN(readability-identifier-naming)
+    template <typename Loop> void for_each(size_t begin, size_t end, const Loop &loop)
+    {
+        const auto block_count = GetBlockCount(begin, end);
+        if (block_count <= 1)
+        {
+            loop(begin, end);
+            return;
+        }
+
+        TaskManager::ParallelFor(0u, block_count, [&](unsigned block) {
+            loop(GetBlockBegin(begin, end, block, block_count), GetBlockBegin(begin, end, block + 1, block_count));
+        }).wait();
+    }
+
+    template <typename T, typename Reduce, typename Join>
+    T reduce(size_t begin, size_t end, const T &init, const Reduce &reduce_fn, const Join &join_fn)
+    {
+        const auto block_count = GetBlockCount(begin, end);
+        if (block_count <= 1)
+        {
+            T result(init);
+            reduce_fn(result, begin, end);
+            return result;
+        }
+
+        std::vector<T> results(block_count, init);
+        TaskManager::ParallelFor(0u, block_count, [&](unsigned block) {
+            reduce_fn(results[block], GetBlockBegin(begin, end, block, block_count),
+                      GetBlockBegin(begin, end, block + 1, block_count));
+        }).wait();
+
+        for (auto block = 1u; block < block_count; block++)
+        {
+            join_fn(results[0], std::move(results[block]));
+        }
+        return std::move(results[0]);
+    }
+    // NOLINTEND(readability-identifier-naming)
+
+private:
+    [[nodiscard]] unsigned GetBlockCount(size_t begin, size_t end) const
+    {
+        const size_t count = end > begin ? end - begin : 0;
+        if (count < parallel_threshold_)
+        {
+            return 1;
+        }
+
+        const auto thread_count = TaskDispatcher::Instance().GetThreadPool().get_thread_count();
+        return static_cast<unsigned>(std::min(count, thread_count));
+    }
+
+    static size_t GetBlockBegin(size_t begin, size_t end, unsigned block, unsigned block_count)
+    {
+        return begin + (end - begin) * block / block_count;
+    }
+
+    size_t parallel_threshold_;
+};
+} // namespace sparkle
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "core/task/TaskManager.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace sparkle
+{
+// Splits a 2D domain into square tiles and processes them on the worker pool.
+// Every lane owns a contiguous range of tile indices and pops from its front. A lane that runs dry steals from the
+// back of another lane. Both ends of a range live in one atomic word, so claiming a tile is a single cas and a frame
+// does no heap allocation once the lanes exist.
+class TileScheduler
+{
+public:
+    static constexpr unsigned DefaultTileSize = 16;
+
+    struct Tile
+    {
+        unsigned x_begin;
+        unsigned y_begin;
+        unsigned x_end;
+        unsigned y_end;
+        unsigned index;
+    };
+
+    TileScheduler() = default;
+
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+
+    // must be called before Dispatch and whenever the domain changes. not thread-safe.
+    void Resize(unsigned width, unsigned height, unsigned tile_size = DefaultTileSize);
+
+    // process every tile once and block until all are done. func is called as func(const Tile &).
+    template <typename Func> void Dispatch(Func &&func)
+    {
+        DispatchItems(GetTileCount(), [this, &func](unsigned item) { func(GetTile(item)); });
+    }
+
+    // same as above, but only for the listed tiles, e.g. the ones that still need samples
+    template <typename Func> void Dispatch(std::span<const unsigned> tile_indices, Func &&func)
+    {
+        DispatchItems(static_cast<unsigned>(tile_indices.size()),
+                      [this, tile_indices, &func](unsigned item) { func(GetTile(tile_indices[item])); });
+    }
+
+    [[nodiscard]] Tile GetTile(unsigned tile_index) const;
+
+    [[nodiscard]] unsigned GetTileCount() const
+    {
+        return tile_count_x_ * tile_count_y_;
+    }
+
+    [[nodiscard]] unsigned GetTileSize() const
+    {
+        return tile_size_;
+    }
+
+    [[nodiscard]] unsigned GetLaneCount() const
+    {
+        return lane_count_;
+    }
+
+    // progress of the current (or last) dispatch. safe to read from any thread.
+    [[nodiscard]] unsigned GetFinishedTileCount() const
+    {
+        return finished_tile_count_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] unsigned GetStolenTileCount() const
+    {
+        return stolen_tile_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // [head, tail) of item indices. head in the high half, tail in the low half.
+    struct alignas(64) Lane
+    {
+        std::atomic<uint64_t> range{0};
+    };
+
+    // lanes hand out item indices in [0, item_count), which the caller maps to tiles
+    template <typename Func> void DispatchItems(unsigned item_count, Func &&func)
+    {
+        ASSERT(lane_count_ > 0);
+
+        ResetLanes(item_count);
+
+        if (item_count == 0)
+        {
+            return;
+        }
+
+        TaskManager::ParallelFor(0u, lane_count_, [this, &func](unsigned lane) {
+            unsigned item;
+            while (PopFront(lane, item) || Steal(lane, item))
+            {
+                func(item);
+                finished_tile_count_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }).wait();
+    }
+
+    void ResetLanes(unsigned item_count);
+
+    bool PopFront(unsigned lane, unsigned &item);
+
+    bool Steal(unsigned thief, unsigned &item);
+
+    std::unique_ptr<Lane[]> lanes_;
+    unsigned lane_count_ = 0;
+
+    unsigned width_ = 0;
+    unsigned height_ = 0;
+    unsigned tile_size_ = DefaultTileSize;
+    unsigned tile_count_x_ = 0;
+    unsigned tile_count_y_ = 0;
+
+    std::atomic<unsigned> finished_tile_count_ = 0;
+    std::atomic<unsigned> stolen_tile_count_ = 0;
+};
+} // namespace sparkle
@@ -2,19 +2,45 @@
 
 #include "core/math/Utilities.h"
 #include "io/ImageTypes.h"
+#include "io/TextureBlockCache.h"
 
+#include <array>
 #include <atomic>
+#include <bit>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <vector>
 
 namespace sparkle
 {
 struct Path;
 
+// where a texture is looked up, and how wide the lookup is in uv units. a zero width samples the finest level.
+struct TextureCoordinate
+{
+    TextureCoordinate(const Vector2 &in_uv, Scalar in_width = 0.f) : uv(in_uv), width(in_width) // NOLINT
+    {
+    }
+
+    Vector2 uv;
+    Scalar width;
+};
+
+// how the texels of an uncompressed image are ordered in memory. Tiled keeps 8x8 blocks contiguous and z-orders the
+// texels inside, so the 2x2 texels of a bilinear lookup usually share a cache line whatever the texel size.
+// uploads, io and hashing read raw bytes and expect Linear, so only images private to cpu sampling are tiled.
+enum class TexelLayout : uint8_t
+{
+    Linear,
+    Tiled,
+};
+
 class Image2D
 {
 public:
+    static constexpr unsigned TexelBlockSize = 8;
+
     Image2D() = default;
 
     Image2D(unsigned width, unsigned height, PixelFormat format)
@@ -32,7 +58,7 @@ public:
     }
 
     // block-compressed image owning a full mip chain (mip-major, tightly packed blocks).
-    // per-pixel access decodes lazily through EnsureDecoded
+    // it stays compressed: per-pixel access and sampling decode the blocks they touch through TextureBlockCache
     Image2D(unsigned width, unsigned height, PixelFormat format, unsigned mip_count, std::vector<uint8_t> payload,
             std::string name)
         : pixel_format_(format), width_(width), height_(height), mip_count_(mip_count),
@@ -78,12 +104,12 @@ public:
 
     [[nodiscard]] const uint8_t *GetRawData() const
     {
-        return pixels_.data();
+        return GetPayload().data();
     }
 
     [[nodiscard]] size_t GetStorageSize() const
     {
-        return pixels_.size();
+        return GetPayload().size();
     }
 
     [[nodiscard]] PixelFormat GetFormat() const
@@ -96,9 +122,22 @@ public:
         return GetImageRowByteSize(pixel_format_, width_);
     }
 
+    [[nodiscard]] TexelLayout GetTexelLayout() const
+    {
+        return texel_layout_;
+    }
+
+    // reorders the texels in place. uncompressed images only.
+    void SetTexelLayout(TexelLayout layout);
+
+    // let Sample read a tiled copy of the texels. for images that are sampled a lot on the cpu, e.g. by the cpu
+    // renderer; the copy costs as much memory as the decoded image. the image itself keeps its layout.
+    void EnableTiledSampling() const;
+
     [[nodiscard]] bool IsValid() const
     {
-        return !pixels_.empty() && pixels_.size() == GetExpectedStorageSize() && pixel_format_ != PixelFormat::Count;
+        const auto payload = GetPayload();
+        return !payload.empty() && payload.size() == GetExpectedStorageSize() && pixel_format_ != PixelFormat::Count;
     }
 
     [[nodiscard]] bool WriteToFile(const Path &file_path) const;
@@ -106,17 +145,63 @@ public:
     // content identity over pixels, dimensions and format
     [[nodiscard]] uint32_t GetContentHash() const;
 
-    // decoded view of a block-compressed image, built once on first use
+    // decoded view of a block-compressed image, built once on first use. for consumers that need all of it at once;
+    // sampling does not go through it
     [[nodiscard]] const Image2D &EnsureDecoded() const;
 
+    // level 0 is the image itself. the rest of the chain is built once on first use: taken from the payload of a
+    // block-compressed image, box filtered otherwise. those levels are only sampled on the cpu, so they are tiled.
+    // writes to the image drop it, see SamplingCache.
+    [[nodiscard]] const Image2D &GetLevel(unsigned level) const;
+
+    [[nodiscard]] unsigned GetLevelCount() const
+    {
+        return static_cast<unsigned>(std::bit_width(std::max(width_, height_)));
+    }
+
+    // trilinear lookup on the level whose texels match the width of the lookup
+    [[nodiscard]] Vector3 Sample(const TextureCoordinate &coordinate) const
+    {
+        const auto texel_width = coordinate.width * static_cast<Scalar>(std::max(width_, height_));
+        [[likely]] if (texel_width <= 1.f)
+        {
+            return Sample(coordinate.uv);
+        }
+
+        // level 0 goes through Sample so that it picks up the tiled copy
+        auto sample_level = [this, &coordinate](unsigned level) {
+            return level == 0 ? Sample(coordinate.uv) : GetLevel(level).Sample(coordinate.uv);
+        };
+
+        const auto lod = std::min(std::log2(texel_width), static_cast<Scalar>(GetLevelCount() - 1));
+        const auto level = static_cast<unsigned>(lod);
+        const auto fine = sample_level(level);
+        if (level + 1 == GetLevelCount())
+        {
+            return fine;
+        }
+
+        return utilities::Lerp(fine, sample_level(level + 1), lod - static_cast<Scalar>(level));
+    }
+
     [[nodiscard]] Vector3 Sample(const Vector2 &uv) const
     {
+        if (const auto *tiled = sampling_cache_->tiled.load(std::memory_order_acquire))
+        {
+            return tiled->Sample(uv);
+        }
+
         if (IsCompressedFormat(pixel_format_))
         {
-            return EnsureDecoded().Sample(uv);
+            return SampleBilinear(uv, [this](unsigned x, unsigned y) { return FetchCompressedTexel(x, y); });
         }
 
-        // a simple bilinear interpolation with uv wrapping
+        return SampleBilinear(uv, [this](unsigned x, unsigned y) { return AccessPixel(x, y); });
+    }
+
+    // a simple bilinear interpolation with uv wrapping. fetch(x, y) returns the stored texel
+    template <typename Fetch> [[nodiscard]] Vector3 SampleBilinear(const Vector2 &uv, const Fetch &fetch) const
+    {
         using utilities::Lerp;
         using utilities::WrapMod;
 
@@ -128,10 +213,10 @@ public:
         utilities::Decompose(pixel_position.x(), u_pixel, u_cell);
         utilities::Decompose(pixel_position.y(), v_pixel, v_cell);
 
-        const auto &sample_00 = AccessPixel(WrapMod(u_pixel, width_), WrapMod(v_pixel, height_));
-        const auto &sample_10 = AccessPixel(WrapMod(u_pixel + 1, width_), WrapMod(v_pixel, height_));
-        const auto &sample_01 = AccessPixel(WrapMod(u_pixel, width_), WrapMod(v_pixel + 1, height_));
-        const auto &sample_11 = AccessPixel(WrapMod(u_pixel + 1, width_), WrapMod(v_pixel + 1, height_));
+        const Vector4 sample_00 = fetch(WrapMod(u_pixel, width_), WrapMod(v_pixel, height_));
+        const Vector4 sample_10 = fetch(WrapMod(u_pixel + 1, width_), WrapMod(v_pixel, height_));
+        const Vector4 sample_01 = fetch(WrapMod(u_pixel, width_), WrapMod(v_pixel + 1, height_));
+        const Vector4 sample_11 = fetch(WrapMod(u_pixel + 1, width_), WrapMod(v_pixel + 1, height_));
 
         // lerp u direction
         const auto &lerp_0 = Lerp(sample_00, sample_10, u_cell);
@@ -187,7 +272,7 @@ public:
     {
         if (IsCompressedFormat(pixel_format_))
         {
-            return EnsureDecoded().AccessPixel(x, y);
+            return FetchCompressedTexel(x, y);
         }
 
         switch (pixel_format_)
@@ -209,21 +294,49 @@ public:
     }
 
 private:
+    // mip of a block-compressed chain that reads its blocks from the chain's payload instead of a copy of them.
+    // it owns no texels, so it must not outlive the chain. GetLevel keeps it in the chain's sampling cache.
+    Image2D(const Image2D &chain, unsigned mip, size_t payload_offset);
+
+    // the stored bytes, owned or viewed
+    [[nodiscard]] std::span<const uint8_t> GetPayload() const
+    {
+        return payload_view_.empty() ? std::span<const uint8_t>(pixels_) : payload_view_;
+    }
+
     template <typename T> void SetPixel(unsigned x, unsigned y, const T &value)
     {
+        sampling_cache_.Reset();
         AccessPixel<T>(x, y) = value;
     }
 
     template <typename T> [[nodiscard]] const T &AccessPixel(unsigned x, unsigned y) const
     {
-        return AccessRow<T>(y)[x];
+        return reinterpret_cast<const T *>(pixels_.data())[GetTexelIndex(texel_layout_, width_, x, y)];
     }
 
     template <typename T> T &AccessPixel(unsigned x, unsigned y)
     {
-        return AccessRow<T>(y)[x];
+        return reinterpret_cast<T *>(pixels_.data())[GetTexelIndex(texel_layout_, width_, x, y)];
     }
 
+    static size_t GetTexelIndex(TexelLayout layout, unsigned width, unsigned x, unsigned y)
+    {
+        [[likely]] if (layout == TexelLayout::Linear)
+        {
+            return static_cast<size_t>(y) * width + x;
+        }
+
+        // spreads 3 bits to the even bit positions
+        static constexpr std::array<uint8_t, TexelBlockSize> Spread{0, 1, 4, 5, 16, 17, 20, 21};
+        constexpr unsigned Mask = TexelBlockSize - 1;
+
+        const auto block_count_x = (width + Mask) / TexelBlockSize;
+        const size_t block = static_cast<size_t>(y / TexelBlockSize) * block_count_x + x / TexelBlockSize;
+        return block * TexelBlockSize * TexelBlockSize + (Spread[x & Mask] | (Spread[y & Mask] << 1u));
+    }
+
+    // linear layout only
     template <typename T> [[nodiscard]] const T *AccessRow(unsigned y) const
     {
         return reinterpret_cast<const T *>(pixels_.data() + y * width_ * GetPixelSize(pixel_format_));
@@ -245,6 +358,13 @@ private:
             }
             return total;
         }
+        if (texel_layout_ == TexelLayout::Tiled)
+        {
+            // whole blocks, padding included
+            const size_t block_count = static_cast<size_t>(utilities::DivideAndRoundUp(width_, TexelBlockSize)) *
+                                       utilities::DivideAndRoundUp(height_, TexelBlockSize);
+            return block_count * TexelBlockSize * TexelBlockSize * GetPixelSize(pixel_format_);
+        }
         return static_cast<size_t>(width_) * height_ * GetPixelSize(pixel_format_);
     }
 
@@ -253,20 +373,94 @@ private:
     unsigned height_ = 0;
     unsigned channel_count_ = 0;
     unsigned mip_count_ = 1;
+    TexelLayout texel_layout_ = TexelLayout::Linear;
 
     Vector2 size_vector_ = Vector2::Zero();
 
     std::vector<uint8_t> pixels_;
 
+    // set instead of pixels_ on a mip level that views the payload of its chain
+    std::span<const uint8_t> payload_view_;
+
+    // a texel of mip 0 of a block-compressed image, as Decode would store it
+    [[nodiscard]] Vector4 FetchCompressedTexel(unsigned x, unsigned y) const;
+
     struct DecodeCache
     {
         std::once_flag once;
         std::shared_ptr<Image2D> image;
+        // names this image's blocks in TextureBlockCache
+        uint32_t block_cache_id = TextureBlockCache::AllocateImageId();
     };
 
     // copies share the cache: decoding is deterministic, so a shared result is benign
     mutable std::shared_ptr<DecodeCache> decode_cache_;
 
+    // data derived for cpu sampling. unlike the decode cache it goes stale when the texels change, so every image
+    // has its own and every write or layout change drops it. writes must not race with sampling.
+    struct SamplingCache
+    {
+        std::once_flag levels_once;
+        // level 1 onwards
+        std::vector<Image2D> levels;
+
+        std::once_flag tiled_once;
+        std::unique_ptr<Image2D> tiled_image;
+        // published once tiled_image is complete, so Sample does not have to go through the once flag
+        std::atomic<const Image2D *> tiled{nullptr};
+
+        [[nodiscard]] bool IsEmpty() const
+        {
+            return levels.empty() && tiled.load(std::memory_order_relaxed) == nullptr;
+        }
+    };
+
+    // copies start out empty instead of taking the cache along. a moved-from image only takes assignments.
+    class SamplingCacheHolder
+    {
+    public:
+        SamplingCacheHolder() = default;
+
+        SamplingCacheHolder(const SamplingCacheHolder & /*other*/) : SamplingCacheHolder()
+        {
+        }
+
+        SamplingCacheHolder &operator=(const SamplingCacheHolder &other)
+        {
+            if (this != &other)
+            {
+                cache_ = std::make_unique<SamplingCache>();
+            }
+            return *this;
+        }
+
+        SamplingCacheHolder(SamplingCacheHolder &&) noexcept = default;
+
+        SamplingCacheHolder &operator=(SamplingCacheHolder &&) noexcept = default;
+
+        ~SamplingCacheHolder() = default;
+
+        SamplingCache *operator->() const
+        {
+            return cache_.get();
+        }
+
+        // writes call this per texel, so it only allocates when there is something to drop. while the cache is
+        // empty, concurrent writers to different texels only read it
+        void Reset()
+        {
+            if (!cache_ || !cache_->IsEmpty())
+            {
+                cache_ = std::make_unique<SamplingCache>();
+            }
+        }
+
+    private:
+        std::unique_ptr<SamplingCache> cache_ = std::make_unique<SamplingCache>();
+    };
+
+    SamplingCacheHolder sampling_cache_;
+
     std::string name_ = "Image2D";
 };
 
@@ -368,6 +562,15 @@ public:
 
     [[nodiscard]] Vector3 Sample(const Vector3 &direction) const;
 
+    // see Image2D::EnableTiledSampling
+    void EnableTiledSampling() const
+    {
+        for (const auto &face : faces_)
+        {
+            face->EnableTiledSampling();
+        }
+    }
+
 private:
     std::array<std::unique_ptr<Image2D>, 6> faces_;
 
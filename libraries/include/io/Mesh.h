@@ -133,6 +133,22 @@ struct Mesh
         return utilities::Lerp(t0, t1, t2, u, v);
     }
 
+    // twice the area of the face in uv space
+    [[nodiscard]] Scalar GetTexCoordArea(uint32_t face_idx) const
+    {
+        if (uvs.empty())
+        {
+            return 0.f;
+        }
+
+        auto idx_offset = face_idx * 3;
+
+        const Vector2 e1 = uvs[indices[idx_offset + 1]] - uvs[indices[idx_offset + 0]];
+        const Vector2 e2 = uvs[indices[idx_offset + 2]] - uvs[indices[idx_offset + 0]];
+
+        return std::abs(e1.x() * e2.y() - e1.y() * e2.x());
+    }
+
     [[nodiscard]] bool Validate() const
     {
         return !vertices.empty() && !indices.empty() && vertices.size() == normals.size() &&
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "core/math/Types.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace sparkle
+{
+// decoded blocks of block-compressed images, so that cpu sampling can leave textures compressed in memory.
+// every thread keeps its own bounded lru, so lookups take no locks. stats are summed over all threads.
+class TextureBlockCache
+{
+public:
+    // about 7000 decoded blocks per thread
+    static constexpr size_t DefaultCapacity = 4u << 20u;
+
+    // the largest block is 6x6
+    static constexpr unsigned MaxBlockTexelCount = 36;
+
+    // texels of one block, row-major with a stride of the format's block dim
+    using BlockTexels = std::array<Vector4, MaxBlockTexelCount>;
+
+    struct Stats
+    {
+        uint64_t hit_count = 0;
+        uint64_t miss_count = 0;
+        // decoded blocks held by all threads
+        size_t memory_size = 0;
+    };
+
+    // identifies an image in cache keys. ids are never reused, so blocks of a destroyed image simply age out
+    static uint32_t AllocateImageId();
+
+    // capacity of each thread's cache. threads apply a new capacity on their next fetch, dropping what they hold
+    static void SetCapacity(size_t bytes_per_thread)
+    {
+        capacity_per_thread_.store(bytes_per_thread, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] static Stats GetStats();
+
+    // decode(BlockTexels &) fills the block on a miss. the result is valid until the calling thread's next fetch
+    template <typename Decode>
+    static const BlockTexels &Fetch(uint32_t image_id, uint32_t block_index, const Decode &decode)
+    {
+        auto &cache = GetThreadCache();
+        const uint64_t key = (static_cast<uint64_t>(image_id) << 32u) | block_index;
+
+        if (const auto *texels = cache.Find(key))
+        {
+            return *texels;
+        }
+
+        auto &texels = cache.Insert(key);
+        decode(texels);
+        return texels;
+    }
+
+private:
+    class ThreadCache
+    {
+    public:
+        ThreadCache() = default;
+        ~ThreadCache();
+
+        ThreadCache(const ThreadCache &) = delete;
+        ThreadCache &operator=(const ThreadCache &) = delete;
+        ThreadCache(ThreadCache &&) = delete;
+        ThreadCache &operator=(ThreadCache &&) = delete;
+
+        const BlockTexels *Find(uint64_t key)
+        {
+            [[unlikely]] if (const auto capacity = capacity_per_thread_.load(std::memory_order_relaxed);
+                             capacity != capacity_bytes_)
+            {
+                Reset(capacity);
+            }
+
+            // the taps of a bilinear lookup mostly share a block
+            if (last_used_ != InvalidEntry && entries_[last_used_].key == key)
+            {
+                CountLookup(true);
+                return &entries_[last_used_].texels;
+            }
+
+            auto found = index_.find(key);
+            CountLookup(found != index_.end());
+            if (found == index_.end())
+            {
+                return nullptr;
+            }
+
+            Touch(found->second);
+            return &entries_[found->second].texels;
+        }
+
+        BlockTexels &Insert(uint64_t key);
+
+    private:
+        static constexpr uint32_t InvalidEntry = UINT32_MAX;
+        // lookups between two stats updates
+        static constexpr uint32_t StatsBatchSize = 1024;
+
+        struct Entry
+        {
+            uint64_t key;
+            // neighbours in recency order
+            uint32_t newer;
+            uint32_t older;
+            BlockTexels texels;
+        };
+
+        void CountLookup(bool hit)
+        {
+            hit_count_ += hit ? 1 : 0;
+            if (++lookup_count_ == StatsBatchSize)
+            {
+                FlushStats();
+            }
+        }
+
+        void FlushStats();
+
+        void Touch(uint32_t entry);
+
+        void Unlink(uint32_t entry);
+
+        void Reset(size_t capacity_bytes);
+
+        std::vector<Entry> entries_;
+        std::unordered_map<uint64_t, uint32_t> index_;
+        // what capacity_ was derived from
+        size_t capacity_bytes_ = 0;
+        size_t capacity_ = 0;
+
+        uint32_t newest_ = InvalidEntry;
+        uint32_t oldest_ = InvalidEntry;
+        uint32_t last_used_ = InvalidEntry;
+
+        uint32_t lookup_count_ = 0;
+        uint32_t hit_count_ = 0;
+    };
+
+    static ThreadCache &GetThreadCache();
+
+    static inline std::atomic<size_t> capacity_per_thread_{DefaultCapacity};
+};
+} // namespace sparkle
@@ -3,6 +3,7 @@
 #include "io/Image.h"
 
 #include <memory>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -83,5 +84,9 @@ public:
 
     // decodes one mip of a block-compressed image into RGBA8, preserving sRGB-ness
     [[nodiscard]] static Image2D Decode(const Image2D &compressed, unsigned mip_level = 0);
+
+    // decodes a single block into its texels, row-major with a stride of the block dim. values match what Decode
+    // stores for them, e.g. sRGB formats stay sRGB-encoded
+    static void DecodeBlock(PixelFormat format, const uint8_t *block, std::span<Vector4> texels);
 };
 } // namespace sparkle
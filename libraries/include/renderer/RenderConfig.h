@@ -44,6 +44,14 @@ struct RenderConfig : public ConfigCollection
         Albedo = 9,
         Emissive = 10,
         Depth = 11,
+        SampleDensity = 12, // samples accumulated per pixel, only valid for cpu mode
+        TraversalCost = 13, // bvh nodes, leaves and triangles the rays of a pixel touched, only valid for cpu mode
+    };
+
+    enum class CpuSampler : uint8_t
+    {
+        Sobol,  // owen-scrambled sobol, stateless and stratified per pixel
+        Random, // white noise, reseeded per pixel
     };
 
     [[nodiscard]] bool IsCPURenderMode() const
@@ -101,10 +109,31 @@ struct RenderConfig : public ConfigCollection
     bool render_ui = false;
     bool use_dynamic_spp;
     bool enable_nee;
+    bool adaptive_sampling;
+    // trace the next cpu frame while the current one is presented, at the cost of one frame of latency
+    bool cpu_pipelining;
+    // cpu paths advance in large waves whose hits are shaded material by material
+    bool cpu_wavefront;
+    // sequence the cpu path tracer draws its samples from
+    CpuSampler cpu_sampler;
+    // cpu output goes through an edge-avoiding a-trous filter, for usable images at a few spp
+    bool cpu_atrous;
+    // cpu paths learn where light comes from and sample those directions more, for hard indirect lighting
+    bool cpu_path_guiding;
+    // after the cpu accumulation is cleared, show a few coarse frames before full resolution takes over
+    bool progressive_preview;
+    // cpu texture lookups pick a level from the ray cone and filter trilinearly
+    bool texture_lod;
+    // cpu-sampled textures keep a copy in 8x8 z-ordered blocks, trading memory for fewer cache misses
+    bool tiled_textures;
+    // per-thread budget for decoded blocks of compressed textures sampled on the cpu
+    uint32_t texture_block_cache_mb;
     bool clear_screenshots;
     bool manual_accumulation;
     float target_framerate;
     float gpu_time_budget_ratio;
+    float cpu_time_budget_ratio;
+    float adaptive_sampling_threshold;
     float render_scale;
 
     // manual-accumulation hold states. Not ConfigValues: the app layer rewrites them every frame
@@ -22,6 +22,13 @@ struct RenderResolution
         return scene != output;
     }
 
+    // scene resolution divided by an integer factor, e.g. for coarse previews
+    [[nodiscard]] Vector2UInt GetReducedScene(uint32_t divisor) const
+    {
+        const auto scale = 1.f / static_cast<float>(divisor);
+        return {ScaleDimension(scene.x(), scale), ScaleDimension(scene.y(), scale)};
+    }
+
     [[nodiscard]] float AspectRatio() const
     {
         return static_cast<float>(output.x()) / static_cast<float>(output.y());
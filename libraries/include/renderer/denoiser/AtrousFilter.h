@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core/PixelBuffer.h"
+#include "core/math/Types.h"
+
+#include <array>
+
+namespace sparkle
+{
+struct CPUGBuffer;
+
+// edge-avoiding a-trous wavelet filter for the cpu pipeline. Dammertz et al., 2010, with the variance-guided luminance
+// weight of SVGF. a 5x5 b3-spline kernel is applied IterationCount times with doubling gaps, and every tap is weighed
+// by how alike its first-hit normal, depth and albedo are. the luminance weight scales with the remaining noise, so
+// the filter fades out by itself as an accumulation converges.
+class AtrousFilter
+{
+public:
+    // gaps of 1 to 16 pixels, a 61x61 footprint
+    static constexpr unsigned IterationCount = 5;
+
+    void Resize(unsigned width, unsigned height);
+
+    // to be filled before Apply: rgb, and in w the variance of the pixel's mean luminance. pixels with a negative
+    // variance (no samples yet) are left alone and never used as taps.
+    [[nodiscard]] PixelBuffer2D<Vector4> &GetInput()
+    {
+        return buffers_[0];
+    }
+
+    // filters the input, guided by the normal, depth and albedo of gbuffer. sky pixels are not filtered.
+    void Apply(const CPUGBuffer &gbuffer);
+
+    // rgb of the last Apply, with the variance left after filtering in w
+    [[nodiscard]] const PixelBuffer2D<Vector4> &GetOutput() const
+    {
+        return buffers_[IterationCount % 2];
+    }
+
+private:
+    std::array<PixelBuffer2D<Vector4>, 2> buffers_;
+};
+} // namespace sparkle
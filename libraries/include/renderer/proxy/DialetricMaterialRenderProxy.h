@@ -14,7 +14,7 @@ public:
     using MaterialRenderProxy::MaterialRenderProxy;
 
     Vector3 SampleSurface(const Ray &ray, Vector3 &w_i, const Vector3 &normal, const Vector3 &tangent,
-                          const Vector2 &uv) const override
+                          const TextureCoordinate &uv) const override
     {
         SurfaceAttribute surface{
             .normal = normal,
@@ -36,5 +36,23 @@ public:
 
         return sample.throughput;
     }
+
+    // reflection and refraction are both delta lobes
+    Vector3 EvaluateSurface(const Ray & /*ray*/, const Vector3 & /*w_i*/, const Vector3 & /*normal*/,
+                            const Vector3 & /*tangent*/, const TextureCoordinate & /*uv*/) const override
+    {
+        return Zeros;
+    }
+
+    Scalar SurfacePdf(const Ray & /*ray*/, const Vector3 & /*w_i*/, const Vector3 & /*normal*/,
+                      const Vector3 & /*tangent*/, const TextureCoordinate & /*uv*/) const override
+    {
+        return 0.f;
+    }
+
+    bool HasDeltaLobe(const TextureCoordinate & /*uv*/) const override
+    {
+        return true;
+    }
 };
 } // namespace sparkle
@@ -112,9 +112,22 @@ public:
 
     // all directions should be in world space
     virtual Vector3 SampleSurface(const Ray &ray, Vector3 &w_i, const Vector3 &normal, const Vector3 &tangent,
-                                  const Vector2 &uv) const = 0;
+                                  const TextureCoordinate &uv) const = 0;
 
-    [[nodiscard]] Vector3 GetBaseColor(const Vector2 &uv) const
+    // bsdf times cosine towards w_i, i.e. what SampleSurface returns on average for that direction.
+    // used by next event estimation. zero for directions only a delta lobe can reach.
+    [[nodiscard]] virtual Vector3 EvaluateSurface(const Ray &ray, const Vector3 &w_i, const Vector3 &normal,
+                                                  const Vector3 &tangent, const TextureCoordinate &uv) const = 0;
+
+    // solid angle density of SampleSurface picking w_i. zero for directions only a delta lobe can reach.
+    [[nodiscard]] virtual Scalar SurfacePdf(const Ray &ray, const Vector3 &w_i, const Vector3 &normal,
+                                            const Vector3 &tangent, const TextureCoordinate &uv) const = 0;
+
+    // whether SampleSurface can pick a direction that EvaluateSurface and SurfacePdf know nothing of. only surfaces
+    // without one can mix other sampling strategies with their own.
+    [[nodiscard]] virtual bool HasDeltaLobe(const TextureCoordinate &uv) const = 0;
+
+    [[nodiscard]] Vector3 GetBaseColor(const TextureCoordinate &uv) const
     {
         if (raw_material_.base_color_texture)
         {
@@ -123,7 +136,7 @@ public:
         return raw_material_.base_color;
     }
 
-    [[nodiscard]] float GetMetallic(const Vector2 &uv) const
+    [[nodiscard]] float GetMetallic(const TextureCoordinate &uv) const
     {
         if (raw_material_.metallic_roughness_texture)
         {
@@ -132,7 +145,7 @@ public:
         return raw_material_.metallic;
     }
 
-    [[nodiscard]] float GetRoughness(const Vector2 &uv) const
+    [[nodiscard]] float GetRoughness(const TextureCoordinate &uv) const
     {
         if (raw_material_.metallic_roughness_texture)
         {
@@ -141,7 +154,7 @@ public:
         return raw_material_.roughness;
     }
 
-    [[nodiscard]] Vector3 GetNormal(const Vector2 &uv) const
+    [[nodiscard]] Vector3 GetNormal(const TextureCoordinate &uv) const
     {
         if (!HasNormalTexture())
         {
@@ -151,7 +164,7 @@ public:
         return raw_material_.normal_texture->Sample(uv) * 2 - Ones;
     }
 
-    [[nodiscard]] Vector3 GetEmissive(const Vector2 &uv) const
+    [[nodiscard]] Vector3 GetEmissive(const TextureCoordinate &uv) const
     {
         if (raw_material_.emissive_texture)
         {
@@ -161,6 +174,12 @@ public:
         return raw_material_.emissive_color;
     }
 
+    // an emissive texture only ever scales the emissive color
+    [[nodiscard]] bool IsEmissive() const
+    {
+        return raw_material_.emissive_color.maxCoeff() > 0.f;
+    }
+
     [[nodiscard]] bool HasNormalTexture() const
     {
         return raw_material_.normal_texture != nullptr;
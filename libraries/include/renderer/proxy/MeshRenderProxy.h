@@ -26,6 +26,20 @@ public:
         Mat4 model_matrix_inv_transpose;
     };
 
+    // cpu BLASes currently alive, over all mesh proxies
+    struct BLASStats
+    {
+        uint32_t blas_count = 0;
+        // BLASes shared between proxies of the same mesh, and how many proxies refer to them
+        uint32_t shared_blas_count = 0;
+        uint32_t shared_reference_count = 0;
+        size_t memory_size = 0;
+        // what the shared references would have cost as private copies
+        size_t saved_memory_size = 0;
+        // accumulated over every build so far
+        float build_time_ms = 0.f;
+    };
+
     explicit MeshRenderProxy(const std::shared_ptr<const Mesh> &raw_mesh, std::string_view name,
                              const AABB &local_bound);
 
@@ -60,6 +74,11 @@ public:
         return blas_;
     }
 
+    [[nodiscard]] const std::shared_ptr<const Mesh> &GetRawMesh() const
+    {
+        return raw_mesh_;
+    }
+
     [[nodiscard]] uint32_t GetNumFaces() const;
 
     [[nodiscard]] uint32_t GetNumVertices() const;
@@ -70,16 +89,33 @@ public:
 
     bool IntersectAnyHit(const Ray &ray, IntersectionCandidate &candidate) const override;
 
+    RayPacketMask IntersectPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                  std::span<IntersectionCandidate> candidates) const override;
+
+    RayPacketMask IntersectAnyHitPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                        std::span<IntersectionCandidate> candidates) const override;
+
     void GetIntersection(const Ray &ray, const IntersectionCandidate &candidate, Intersection &intersection) override;
 
+    [[nodiscard]] Scalar GetTexCoordDensity(uint32_t face) const override;
+
     template <bool AnyHit> bool IntersectInternal(const Ray &ray, IntersectionCandidate &candidate) const;
 
     template <bool AnyHit>
-    bool IntersectTriangle(const Ray &ray, const Ray &local_ray, const Transform &inv_transform,
-                           IntersectionCandidate &candidate, uint32_t face_idx) const;
+    RayPacketMask IntersectPacketInternal(const DefaultRayPacket &packet, RayPacketMask mask,
+                                          std::span<IntersectionCandidate> candidates) const;
 
     void BuildBVH() override;
 
+    static BLASStats GetBLASStats();
+
+    // static meshes keep their cpu BLAS in world space, which saves transforming every ray into object space.
+    // meshes that move after their initial placement use an object-space BLAS instead.
+    [[nodiscard]] bool IsWorldSpaceBLAS() const
+    {
+        return is_world_space_blas_;
+    }
+
 protected:
     void UpdateMatrix(RHIContext *rhi);
 
@@ -95,6 +131,12 @@ private:
 
     RHIResourceRef<RHIBLAS> blas_;
 
-    std::unique_ptr<BLAS> accleration_structure_;
+    // shared with other proxies of the same mesh when it is in object space
+    std::shared_ptr<BLAS> accleration_structure_;
+
+    // cached for object-space intersection
+    Transform inverse_transform_;
+    uint32_t transform_change_count_ = 0;
+    bool is_world_space_blas_ = true;
 };
 } // namespace sparkle
@@ -13,7 +13,7 @@ public:
     using MaterialRenderProxy::MaterialRenderProxy;
 
     Vector3 SampleSurface(const Ray &ray, Vector3 &w_i, const Vector3 &normal, const Vector3 &tangent,
-                          const Vector2 &uv) const override
+                          const TextureCoordinate &uv) const override
     {
         /*
             According to PBR theory, the outward light will present in 3 forms:
@@ -27,11 +27,7 @@ public:
             3. no subsurface reflection, which means dieletric refraction behaves like diffuse reflection.
         */
 
-        SurfaceAttribute surface{.normal = normal,
-                                 .tangent = tangent,
-                                 .base_color = GetBaseColor(uv),
-                                 .roughness = GetRoughness(uv),
-                                 .metallic = GetMetallic(uv)};
+        const auto surface = GetSurfaceAttribute(normal, tangent, uv);
 
         // enter tangent space
         Vector3 w_o = -ray.Direction();
@@ -49,5 +45,51 @@ public:
 
         return sample.throughput;
     }
+
+    Vector3 EvaluateSurface(const Ray &ray, const Vector3 &w_i, const Vector3 &normal, const Vector3 &tangent,
+                            const TextureCoordinate &uv) const override
+    {
+        const auto surface = GetSurfaceAttribute(normal, tangent, uv);
+        const Vector3 &local_w_o = utilities::TransformBasisToLocal(-ray.Direction(), normal, tangent);
+        const Vector3 &local_w_i = utilities::TransformBasisToLocal(w_i, normal, tangent);
+
+        // light that the specular lobe does not keep goes to the diffuse lobe. the diffuse fallback that SampleSurface
+        // takes when a reflection ends up below the horizon is not accounted for.
+        const Vector3 local_w_m = (local_w_o + local_w_i).normalized();
+        auto diffuse_weight = 1.f - SpecularBxDF::SelectProbability(local_w_i.dot(local_w_m), surface);
+
+        return SpecularBxDF::Evaluate(local_w_o, local_w_i, surface) +
+               LambertianBxDF::Evaluate(local_w_o, local_w_i, surface) * diffuse_weight;
+    }
+
+    Scalar SurfacePdf(const Ray &ray, const Vector3 &w_i, const Vector3 &normal, const Vector3 &tangent,
+                      const TextureCoordinate &uv) const override
+    {
+        const auto surface = GetSurfaceAttribute(normal, tangent, uv);
+        const Vector3 &local_w_o = utilities::TransformBasisToLocal(-ray.Direction(), normal, tangent);
+        const Vector3 &local_w_i = utilities::TransformBasisToLocal(w_i, normal, tangent);
+
+        const Vector3 local_w_m = (local_w_o + local_w_i).normalized();
+        auto specular_probability = SpecularBxDF::SelectProbability(local_w_i.dot(local_w_m), surface);
+
+        return SpecularBxDF::Pdf(local_w_o, local_w_i, surface.roughness) * specular_probability +
+               LambertianBxDF::Pdf(local_w_i) * (1.f - specular_probability);
+    }
+
+    bool HasDeltaLobe(const TextureCoordinate &uv) const override
+    {
+        return SpecularBxDF::IsDelta(GetRoughness(uv));
+    }
+
+private:
+    [[nodiscard]] SurfaceAttribute GetSurfaceAttribute(const Vector3 &normal, const Vector3 &tangent,
+                                                       const TextureCoordinate &uv) const
+    {
+        return {.normal = normal,
+                .tangent = tangent,
+                .base_color = GetBaseColor(uv),
+                .roughness = GetRoughness(uv),
+                .metallic = GetMetallic(uv)};
+    }
 };
 } // namespace sparkle
@@ -3,10 +3,12 @@
 #include "core/RenderProxy.h"
 
 #include "core/math/AABB.h"
+#include "core/math/RayPacket.h"
+
+#include <span>
 
 namespace sparkle
 {
-class Ray;
 class Intersection;
 struct IntersectionCandidate;
 class MaterialRenderProxy;
@@ -51,10 +53,31 @@ public:
 
     virtual bool IntersectAnyHit(const Ray &ray, IntersectionCandidate &candidate) const = 0;
 
+    // packet versions of the above. candidates are indexed by lane and only lanes in mask are tested.
+    // returns the lanes that reported a hit. the default falls back to the scalar test per lane.
+    virtual RayPacketMask IntersectPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                          std::span<IntersectionCandidate> candidates) const;
+
+    virtual RayPacketMask IntersectAnyHitPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                                std::span<IntersectionCandidate> candidates) const;
+
     virtual void BuildBVH()
     {
     }
 
+    // uv units per world unit around a face, which turns a ray cone width into a texture footprint. 0 if unknown.
+    // only asked for when texture lod is on, so hits do not pay for it
+    [[nodiscard]] virtual Scalar GetTexCoordDensity([[maybe_unused]] uint32_t face) const
+    {
+        return 0.f;
+    }
+
+    // hits are solved analytically, not on the triangles of a mesh, so they report no face
+    [[nodiscard]] virtual bool IsAnalytic() const
+    {
+        return false;
+    }
+
     virtual void GetIntersection([[maybe_unused]] const Ray &ray,
                                  [[maybe_unused]] const IntersectionCandidate &candidate,
                                  [[maybe_unused]] Intersection &intersection)
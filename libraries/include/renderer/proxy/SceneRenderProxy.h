@@ -1,7 +1,9 @@
 #pragma once
 
 #include "core/RenderProxy.h"
+#include "core/task/TaskFuture.h"
 
+#include <span>
 #include <unordered_set>
 #include <vector>
 
@@ -12,6 +14,7 @@ class PrimitiveRenderProxy;
 class MaterialRenderProxy;
 class Scene;
 class TLAS;
+class LightTree;
 class Ray;
 class Intersection;
 class SkyRenderProxy;
@@ -59,6 +62,12 @@ public:
         return primitive_changes_;
     }
 
+    // bumped whenever primitives change. camera moves leave it alone
+    [[nodiscard]] uint32_t GetContentVersion() const
+    {
+        return content_version_;
+    }
+
     [[nodiscard]] const auto &GetMaterialProxies() const
     {
         return materials_;
@@ -118,8 +127,26 @@ public:
 
     template <bool AnyHit> void Intersect(const Ray &ray, Intersection &intersection) const;
 
+    // up to one packet of coherent rays (e.g. primary or shadow rays) traversed together.
+    // results are the same as calling Intersect per ray. intersections must be invalidated by the caller.
+    template <bool AnyHit> void IntersectPacket(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+
+    // any number of rays. they are grouped by direction octant and traversed as packets, which recovers some coherence
+    // for secondary bounces.
+    template <bool AnyHit> void IntersectStream(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+
     void UpdateBVH();
 
+    // ms spent building BLASes and TLASes in UpdateBVH since startup, for benchmarks. safe to read from any thread.
+    // tlas rebuilds in the background are not counted
+    [[nodiscard]] static double GetBVHBuildTime();
+
+    // emissive mesh triangles for next event estimation. only kept for the cpu renderer
+    [[nodiscard]] const LightTree *GetLightTree() const
+    {
+        return light_tree_.get();
+    }
+
 #pragma endregion
 
 #pragma region RenderProxy interface
@@ -137,6 +164,12 @@ private:
 
     void UnregisterPrimitive(PrimitiveRenderProxy *primitive);
 
+    void ScheduleTLASRebuild();
+
+    void ApplyTLASRebuild();
+
+    void UpdateLightTree();
+
     CameraRenderProxy *camera_ = nullptr;
     SkyRenderProxy *sky_proxy_ = nullptr;
     DirectionalLightRenderProxy *directional_light_ = nullptr;
@@ -156,10 +189,29 @@ private:
 
     std::unique_ptr<TLAS> tlas_;
 
+    // a full rebuild running in the background once refits have degraded tlas_ too much
+    std::shared_ptr<TLAS> pending_tlas_;
+    std::shared_ptr<TaskFuture<>> tlas_rebuild_task_;
+    // bumped whenever primitives are added or removed, so a rebuild of a stale primitive set is dropped
+    uint32_t tlas_generation_ = 0;
+    uint32_t pending_tlas_generation_ = 0;
+
+    // follows primitive_changes_ the way tlas_ does
+    std::unique_ptr<LightTree> light_tree_;
+
+    uint32_t content_version_ = 0;
+
     bool need_bvh_ = false;
-    bool need_bvh_update_ = true;
 };
 
 extern template void SceneRenderProxy::Intersect<true>(const Ray &ray, Intersection &intersection) const;
 extern template void SceneRenderProxy::Intersect<false>(const Ray &ray, Intersection &intersection) const;
+extern template void SceneRenderProxy::IntersectPacket<true>(std::span<const Ray> rays,
+                                                             std::span<Intersection> intersections) const;
+extern template void SceneRenderProxy::IntersectPacket<false>(std::span<const Ray> rays,
+                                                              std::span<Intersection> intersections) const;
+extern template void SceneRenderProxy::IntersectStream<true>(std::span<const Ray> rays,
+                                                             std::span<Intersection> intersections) const;
+extern template void SceneRenderProxy::IntersectStream<false>(std::span<const Ray> rays,
+                                                              std::span<Intersection> intersections) const;
 } // namespace sparkle
@@ -4,10 +4,14 @@
 
 #include "rhi/RHIImage.h"
 
+#include <atomic>
+
 namespace sparkle
 {
+class CookHandle;
 class Image2DCube;
 class ImageBasedLighting;
+class SkySamplingTable;
 
 class SkyRenderProxy : public LightRenderProxy
 {
@@ -56,14 +60,27 @@ public:
 
     [[nodiscard]] Vector3 Evaluate(const Ray &ray) const override;
 
-    void Sample(const Vector3 & /*origin*/, Vector3 & /*direction*/) const override
+    // draws its sample points from the calling thread's sampler
+    void Sample(const Vector3 &origin, Vector3 &direction) const override;
+
+    // the sky map is sampled by luminance once its sampling table is cooked, which only the cpu pipeline requests.
+    // otherwise directions are uniform over the sphere.
+    [[nodiscard]] bool IsImportanceSampled() const
     {
-        UnImplemented();
+        return sampling_table_ != nullptr;
     }
 
+    // a direction towards the sky, and its solid angle pdf. see SkySamplingTable::Sample for the two sample points;
+    // a sky without a table takes a uniform direction from u_point
+    Vector3 SampleDirection(const Vector2 &u_cell, const Vector2 &u_point, Scalar &pdf) const;
+
+    [[nodiscard]] Scalar Pdf(const Vector3 &direction) const;
+
 #pragma endregion
 
 private:
+    void RequestSamplingTable();
+
     UniformBufferData ubo_;
 
     RHIResourceRef<RHIImage> sky_map_;
@@ -71,5 +88,11 @@ private:
     std::shared_ptr<const Image2DCube> sky_map_raw_;
 
     std::unique_ptr<ImageBasedLighting> image_based_lighting_;
+
+    std::unique_ptr<SkySamplingTable> sampling_table_;
+
+    std::unique_ptr<CookHandle> sampling_cook_handle_;
+
+    std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
 };
 } // namespace sparkle
@@ -19,6 +19,29 @@ public:
 
     bool IntersectAnyHit(const Ray &ray, IntersectionCandidate &canidate) const override;
 
+    // analytic test per lane, the triangulated blas of the mesh is not used
+    RayPacketMask IntersectPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                  std::span<IntersectionCandidate> candidates) const override
+    {
+        return PrimitiveRenderProxy::IntersectPacket(packet, mask, candidates);
+    }
+
+    RayPacketMask IntersectAnyHitPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                        std::span<IntersectionCandidate> candidates) const override
+    {
+        return PrimitiveRenderProxy::IntersectAnyHitPacket(packet, mask, candidates);
+    }
+
+    // intersection is analytic, so the triangulated mesh never needs a cpu BLAS
+    void BuildBVH() override
+    {
+    }
+
+    [[nodiscard]] bool IsAnalytic() const override
+    {
+        return true;
+    }
+
     void GetIntersection(const Ray &ray, const IntersectionCandidate &candidate, Intersection &intersection) override
     {
         Vector3 center = GetTransform().GetTranslation();
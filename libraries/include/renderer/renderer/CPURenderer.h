@@ -2,12 +2,22 @@
 
 #include "renderer/renderer/Renderer.h"
 
-#include "io/Image.h"
+#include "core/PixelBuffer.h"
+#include "core/Timer.h"
+#include "core/math/RayStats.h"
+#include "core/task/TaskFuture.h"
+#include "core/task/TileScheduler.h"
+#include "io/ImageTypes.h"
+#include "renderer/denoiser/AtrousFilter.h"
 #include "renderer/resource/GBuffer.h"
+#include "renderer/resource/PathGuide.h"
 #include "rhi/RHIBuffer.h"
 #include "rhi/RHIImage.h"
 #include "rhi/RHIRenderTarget.h"
 
+#include <array>
+#include <span>
+
 namespace sparkle
 {
 class CPURenderer : public Renderer
@@ -28,20 +38,80 @@ public:
 
     [[nodiscard]] bool IsReadyForAutoScreenshot() const override;
 
+    void FinishFrameWork() override;
+
     ~CPURenderer() override;
 
+    // totals over every cpu renderer since startup, for benchmarks. safe to read from any thread
+    struct Stats
+    {
+        // full resolution frames traced
+        uint64_t frame_count = 0;
+        // what the rays of those frames did
+        RayStats rays;
+        // wall time of every pass, summed over frames
+        double base_pass_ms = 0.0;
+        double denoise_pass_ms = 0.0;
+        double filter_pass_ms = 0.0;
+        double tone_mapping_pass_ms = 0.0;
+    };
+
+    [[nodiscard]] static Stats GetStats();
+
+    // samples a full resolution frame traces per pixel when pixels accumulate uniformly. sample n of a frame reads
+    // index frame_seed + n of every pixel's sequence, so consecutive frames read consecutive indices
+    static constexpr unsigned UniformSamplesPerFrame = 1;
+
+    // exposure, ACES and the fp16 conversion over a row of pixels, with alpha set to 1
+    static void ToneMapRow(std::span<const Vector4> pixels, Vector4h *output, float exposure);
+
 private:
-    void RenderPixel(unsigned i, unsigned j, Scalar pixel_width, Scalar pixel_height, const SceneRenderProxy &scene,
-                     const RenderConfig &config, const Vector2UInt &debug_point);
+    // returns what the rays of the tile did
+    RayStats RenderTile(const TileScheduler::Tile &tile, Scalar pixel_width, Scalar pixel_height, uint32_t frame_seed,
+                        unsigned sample_count, const SceneRenderProxy &scene, const RenderConfig &config,
+                        const Vector2UInt &debug_point);
+
+    // handles clears, picks trace_preview_level_ and returns the seed of this frame's samples
+    uint32_t BeginAccumulation();
+
+    // drops what the path guide learnt and fits its grid to the current scene
+    void ResetPathGuide();
 
-    void BasePass(const SceneRenderProxy &scene, const RenderConfig &config, const Vector2UInt &debug_point);
+    // base pass, denoise and convergence. may run on a dedicated thread, see RenderConfig::cpu_pipelining
+    void TraceFrame(const RenderConfig &config, uint32_t frame_seed, const Vector2UInt &debug_point);
+
+    void BasePass(const SceneRenderProxy &scene, const RenderConfig &config, uint32_t frame_seed,
+                  const Vector2UInt &debug_point);
 
     void DenoisePass(const RenderConfig &config, const Vector2UInt &debug_point);
 
-    void ToneMappingPass(Image2D &image);
+    // a-trous filter of the accumulated image, see RenderConfig::cpu_atrous. leaves frame_buffer_ as it is
+    void FilterPass();
+
+    // one sample per pixel at a preview level, into the top-left corner of the gbuffer
+    void PreviewPass(const RenderConfig &config, unsigned level);
+
+    void ResetPixelAccumulation();
+
+    void PlanTiles(const RenderConfig &config);
+
+    void UpdateConvergence(const RenderConfig &config);
+
+    void MeasurePerformance();
+
+    // what the rays of the accumulation did so far, per camera ray
+    void LogRayStats() const;
+
+    // writes the final fp16 image straight into the mapped upload buffer
+    void ToneMappingPass(const RenderConfig &config, Vector4h *output);
 
     CameraRenderProxy *camera_;
 
+    static constexpr PixelFormat OutputFormat = PixelFormat::RGBAFloat16;
+
+    // tiles are the waves of RenderConfig::cpu_wavefront, so that mode wants them large
+    static constexpr unsigned WavefrontTileSize = 64;
+
     RHIResourceRef<RHIBuffer> image_buffer_;
     RHIResourceRef<RHIImage> screen_texture_;
     RHIResourceRef<RHIRenderTarget> screen_rt_;
@@ -50,24 +120,82 @@ private:
     // screen_rt_ unless sub-resolution rendering makes upsample_pass_ fill a dedicated target.
     RHIResourceRef<RHIImage> composite_texture_;
     RHIResourceRef<RHIRenderTarget> composite_rt_;
+    // scales screen_texture_ or a preview up to composite_rt_
     std::unique_ptr<class ScreenQuadPass> upsample_pass_;
 
+    // progressive preview: the first frames after a clear trace at a fraction of the scene resolution
+    static constexpr std::array<uint32_t, 3> PreviewDivisors{8, 4, 2};
+    static constexpr unsigned FullResolutionLevel = PreviewDivisors.size();
+    static constexpr uint32_t MinPreviewSize = 2;
+    struct PreviewLevel
+    {
+        Vector2UInt size;
+        RHIResourceRef<RHIImage> texture;
+    };
+    std::array<PreviewLevel, PreviewDivisors.size()> preview_levels_;
+    // the level the next frame traces, the level of the last traced image, and the level of the image tone mapped
+    // this frame. FullResolutionLevel once the accumulation has taken over.
+    unsigned next_preview_level_ = FullResolutionLevel;
+    unsigned trace_preview_level_ = FullResolutionLevel;
+    unsigned shown_preview_level_ = FullResolutionLevel;
+
     std::unique_ptr<class ScreenQuadPass> screen_quad_pass_;
     std::unique_ptr<class UiPass> ui_pass_;
 
-    Image2D output_image_;
-
     // output of rendering passes. cleared every frame.
     CPUGBuffer gbuffer_;
 
     // cleared every frame
-    std::vector<std::vector<Vector4>> ping_pong_buffer_;
+    PixelBuffer2D<Vector4> ping_pong_buffer_;
 
     // accumulate all frame's results after temporal denoising. cleared on dirty
-    std::vector<std::vector<Vector4>> frame_buffer_;
+    PixelBuffer2D<Vector4> frame_buffer_;
+
+    AtrousFilter atrous_filter_;
+    // whether the last traced frame was filtered, so that tone mapping reads the filter output
+    bool image_filtered_ = false;
+
+    // learnt by the paths of every frame, see RenderConfig::cpu_path_guiding
+    PathGuide path_guide_;
+    // scene content the guide has learnt
+    uint32_t guide_content_version_ = UINT32_MAX;
+
+    TileScheduler tile_scheduler_;
+    // what the rays of every tile did this frame. a tile is traced by one lane, which writes its slot alone
+    std::vector<RayStats> tile_ray_stats_;
+    // since the accumulation was last cleared
+    RayStats accumulation_ray_stats_;
+
+    // the frame traced while the previous one is presented, in pipelined mode
+    std::shared_ptr<TaskFuture<>> frame_work_;
+    // whether the image shown this frame has all the samples it will get
+    bool output_converged_ = false;
 
     unsigned sub_pixel_count_;
     unsigned actual_sample_per_pixel_;
     uint32_t dispatched_sample_count_ = 0;
+
+    // per-pixel accumulation, used when adaptive sampling or dynamic spp make pixels advance at different rates.
+    // per pixel: samples accumulated, and the running mean of luminance and squared luminance
+    PixelBuffer2D<uint32_t> pixel_sample_count_;
+    PixelBuffer2D<Vector2> luminance_moments_;
+    // tiles that still need samples. a finished tile stays out until the accumulation is cleared.
+    std::vector<unsigned> active_tiles_;
+    std::vector<uint8_t> tile_finished_;
+    // what this frame traces: some or all of active_tiles_, each with tile_sample_count_ samples per pixel
+    std::vector<unsigned> dispatched_tiles_;
+    unsigned tile_sample_count_ = 1;
+    // where the next partial frame starts in active_tiles_
+    size_t tile_cursor_ = 0;
+    uint64_t accumulated_pixel_sample_count_ = 0;
+    bool per_pixel_accumulation_ = false;
+
+    // base pass time of one sample over the whole image, in ms
+    float running_time_per_spp_ = 0.f;
+    float last_frame_spp_ = 0.f;
+    float last_second_total_spp_ = 0.f;
+    uint32_t last_second_frame_count_ = 0;
+    RayStats last_second_ray_stats_;
+    TimerCaller spp_logger_;
 };
 } // namespace sparkle
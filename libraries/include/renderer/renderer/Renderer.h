@@ -36,6 +36,12 @@ public:
 
     virtual void Render() = 0;
 
+    // called at the start of every frame, before the render thread changes the scene. a renderer that keeps working
+    // on the scene after Render() returns must finish here.
+    virtual void FinishFrameWork()
+    {
+    }
+
     [[nodiscard]] virtual RenderConfig::Pipeline GetRenderMode() const = 0;
 
     void Tick();
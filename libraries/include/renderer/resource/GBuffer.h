@@ -1,5 +1,6 @@
 #pragma once
 
+#include "core/PixelBuffer.h"
 #include "rhi/RHIImage.h"
 #include "rhi/RHIRenderTarget.h"
 
@@ -19,30 +20,54 @@ struct GBuffer
 struct CPUGBuffer
 {
     // holds one frame's color output. alpha channel: whether this pixel is valid
-    std::vector<std::vector<Vector4>> color;
+    PixelBuffer2D<Vector4> color;
 
-    std::vector<std::vector<Vector3>> world_normal;
+    PixelBuffer2D<Vector3> world_normal;
+
+    // first-hit distance and base color, guides of the a-trous filter
+    PixelBuffer2D<float> depth;
+    PixelBuffer2D<Vector3> albedo;
+
+    // per-pixel accumulation only: samples taken this frame (0 where the tile was skipped), and the mean luminance and
+    // mean squared luminance over them
+    PixelBuffer2D<uint32_t> sample_count;
+    PixelBuffer2D<Vector2> luminance_moments;
 
     [[nodiscard]] bool IsValid(unsigned i, unsigned j) const
     {
-        return color[j][i].w() > 0;
+        return color(i, j).w() > 0;
     }
 
     [[nodiscard]] bool IsSky(unsigned i, unsigned j) const
     {
-        return IsValid(i, j) && world_normal[j][i].isZero();
+        return IsValid(i, j) && world_normal(i, j).isZero();
     }
 
     void Resize(unsigned width, unsigned height)
     {
-        color.resize(height, std::vector<Vector4>(width));
-        world_normal.resize(height, std::vector<Vector3>(width));
+        color.Resize(width, height);
+        world_normal.Resize(width, height);
+        depth.Resize(width, height);
+        albedo.Resize(width, height);
+        sample_count.Resize(width, height);
+        luminance_moments.Resize(width, height);
+
+        color.Fill(Vector4::Zero());
+        world_normal.Fill(Vector3::Zero());
+        depth.Fill(0.f);
+        albedo.Fill(Vector3::Zero());
+        sample_count.Fill(0);
+        luminance_moments.Fill(Vector2::Zero());
     }
 
     void Clear()
     {
-        color.clear();
-        world_normal.clear();
+        color.Clear();
+        world_normal.Clear();
+        depth.Clear();
+        albedo.Clear();
+        sample_count.Clear();
+        luminance_moments.Clear();
     }
 };
 } // namespace sparkle
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "core/math/Types.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace sparkle
+{
+class PrimitiveRenderProxy;
+
+// emissive triangles of the scene in world space, under a bvh that stores the emitted power of every subtree.
+// next event estimation walks it from the root and picks a child by an estimate of what it contributes to the
+// shading point, so lights that are close, bright and facing the surface are sampled more.
+// triangles are kept per primitive, so a scene change only recollects the primitives it touched.
+class LightTree
+{
+public:
+    static constexpr uint32_t InvalidLight = UINT32_MAX;
+
+    // one-sided geometry, two-sided emission: emissive surfaces glow on both sides
+    struct Triangle
+    {
+        Vector3 v0;
+        Vector3 edge1;
+        Vector3 edge2;
+        // luminance of the emission, over the whole triangle
+        Scalar radiance = 0.f;
+    };
+
+    struct Light
+    {
+        Vector3 v0;
+        Vector3 edge1;
+        Vector3 edge2;
+        Vector3 normal;
+        Scalar area;
+        // radiance times area
+        Scalar power;
+        const PrimitiveRenderProxy *primitive;
+        uint32_t face;
+        // child taken at every level on the way down from the root, lowest bit first
+        uint64_t trail;
+    };
+
+    // replaces the triangles of primitive, one per face in face order. an empty list removes it
+    void SetTriangles(const PrimitiveRenderProxy *primitive, std::vector<Triangle> &&triangles);
+
+    void RemoveTriangles(const PrimitiveRenderProxy *primitive);
+
+    // rebuilds the tree if triangles changed since the last build
+    void Build();
+
+    [[nodiscard]] bool IsEmpty() const
+    {
+        return nodes_.empty();
+    }
+
+    [[nodiscard]] uint32_t GetLightCount() const
+    {
+        return static_cast<uint32_t>(lights_.size());
+    }
+
+    [[nodiscard]] const Light &GetLight(uint32_t light) const
+    {
+        return lights_[light];
+    }
+
+    // the light a hit on face of primitive landed on. InvalidLight for Intersection::NoFace and faces of no light
+    [[nodiscard]] uint32_t FindLight(const PrimitiveRenderProxy *primitive, uint32_t face) const;
+
+    // picks a light for a shading point. normal may be zero for points that receive from every direction.
+    // returns InvalidLight if no light can reach the point, otherwise outputs the probability of the pick.
+    [[nodiscard]] uint32_t Select(const Vector3 &position, const Vector3 &normal, Scalar u, Scalar &pmf) const;
+
+    // probability of Select picking light for the same shading point
+    [[nodiscard]] Scalar Pmf(const Vector3 &position, const Vector3 &normal, uint32_t light) const;
+
+private:
+    struct Node
+    {
+        Vector3 min;
+        Vector3 max;
+        Scalar power;
+        // inner node: index of the first of two consecutive children. leaf: index of its light
+        uint32_t index;
+        bool is_leaf;
+    };
+
+    // the deepest trail a 64 bit mask can record, far beyond what a median split reaches
+    static constexpr unsigned MaxDepth = 64;
+
+    void BuildNode(uint32_t node_index, std::vector<uint32_t> &order, uint32_t begin, uint32_t end, uint64_t trail,
+                   unsigned depth);
+
+    [[nodiscard]] static Scalar Importance(const Node &node, const Vector3 &position, const Vector3 &normal);
+
+    struct Emitter
+    {
+        const PrimitiveRenderProxy *primitive;
+        std::vector<Triangle> triangles;
+    };
+
+    // in the order primitives arrived, so that the same scene builds the same tree
+    std::vector<Emitter> emitters_;
+    std::unordered_map<const PrimitiveRenderProxy *, uint32_t> emitter_slots_;
+    bool dirty_ = false;
+
+    std::vector<Light> lights_;
+    std::vector<Node> nodes_;
+    // first light of every primitive, lights of a primitive are stored by face
+    std::unordered_map<const PrimitiveRenderProxy *, uint32_t> first_lights_;
+};
+} // namespace sparkle
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core/math/AABB.h"
+#include "core/math/Types.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace sparkle
+{
+// online path guiding for the cpu path tracer: a spatial hash of directional radiance histograms, learnt from the
+// radiance that paths bring back and sampled in one-sample mis with the bsdf. the histograms have equal-area bins of
+// cos(theta) x phi over the whole sphere.
+// workers train lock-free into atomic bins while they sample a snapshot taken by Update, so a frame samples one fixed
+// distribution and Sample always agrees with Pdf.
+class PathGuide
+{
+public:
+    static constexpr unsigned CosThetaBinCount = 8;
+    static constexpr unsigned PhiBinCount = 16;
+    static constexpr unsigned BinCount = CosThetaBinCount * PhiBinCount;
+
+    // hashed, so distant cells may share a slot
+    static constexpr unsigned CellCount = 1u << 14u;
+    // cells along the longest axis of the scene bounds
+    static constexpr Scalar GridResolution = 64.f;
+
+    // records a cell needs before it guides
+    static constexpr uint32_t MinTrainingCount = 64;
+    // share of the guide spread uniformly over the sphere, for directions it has not seen bring anything yet
+    static constexpr Scalar UniformShare = 0.1f;
+
+    // drops everything learnt and sizes the cells after the scene bounds
+    void Reset(const AABB &bounds);
+
+    [[nodiscard]] bool IsValid() const
+    {
+        return training_ != nullptr;
+    }
+
+    [[nodiscard]] uint32_t GetCell(const Vector3 &position) const;
+
+    // training, from any thread. weight is the luminance that arrived from direction over the pdf it was sampled with
+    void Record(uint32_t cell, const Vector3 &direction, Scalar weight);
+
+    // publishes what was recorded so far to the sampling side. must not run concurrently with anything else
+    void Update();
+
+    // sampling. every cell that is not trained must be left to the bsdf
+    [[nodiscard]] bool IsTrained(uint32_t cell) const
+    {
+        return sampling_[cell].trained;
+    }
+
+    // direction with probability proportional to the learnt radiance. outputs its solid angle pdf
+    [[nodiscard]] Vector3 Sample(uint32_t cell, Scalar u_bin, const Vector2 &u, Scalar &pdf) const;
+
+    // solid angle pdf of Sample producing direction
+    [[nodiscard]] Scalar Pdf(uint32_t cell, const Vector3 &direction) const;
+
+    [[nodiscard]] static unsigned GetBin(const Vector3 &direction);
+
+private:
+    struct TrainingCell
+    {
+        std::array<std::atomic<float>, BinCount> bins{};
+        std::atomic<uint32_t> count{0};
+    };
+
+    struct SamplingCell
+    {
+        // inclusive and normalized, so the last entry is 1
+        std::array<float, BinCount> cdf;
+        bool trained = false;
+    };
+
+    std::unique_ptr<TrainingCell[]> training_;
+    std::vector<SamplingCell> sampling_;
+
+    Vector3 grid_origin_ = Zeros;
+    Scalar inv_cell_size_ = 1.f;
+};
+} // namespace sparkle
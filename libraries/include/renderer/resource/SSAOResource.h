@@ -17,7 +17,7 @@ struct SSAOConfig
     {
         for (auto &sample : samples)
         {
-            sample.head<3>() = sampler::UniformHemiSphere::Sample();
+            sample.head<3>() = sampler::UniformHemiSphere::Sample(sampler::Random2D());
         }
     }
 };
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "core/cook/CookJob.h"
+#include "renderer/resource/SkySamplingTable.h"
+
+#include <atomic>
+#include <memory>
+
+namespace sparkle
+{
+class Image2DCube;
+
+// CPU producer of the SkySamplingTable payload of a sky cube
+class SkySamplingCookJob : public CookJob
+{
+public:
+    static constexpr const char *Type = "sky_sampling";
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t Resolution = SkySamplingTable::Resolution;
+
+    explicit SkySamplingCookJob(std::shared_ptr<const Image2DCube> sky_map);
+
+    [[nodiscard]] const char *GetType() const override
+    {
+        return Type;
+    }
+
+    [[nodiscard]] uint32_t GetVersion() const override
+    {
+        return Version;
+    }
+
+    [[nodiscard]] std::string GetSourceName() const override;
+
+    [[nodiscard]] uint32_t GetSourceHash() const override
+    {
+        return sky_map_hash_;
+    }
+
+    [[nodiscard]] float GetProgress() const override
+    {
+        return static_cast<float>(cooked_rows_.load()) / (6 * Resolution);
+    }
+
+    [[nodiscard]] CookJobResult Execute() override;
+
+private:
+    std::shared_ptr<const Image2DCube> sky_map_;
+
+    uint32_t sky_map_hash_ = 0;
+
+    std::atomic<uint32_t> cooked_rows_{0};
+};
+} // namespace sparkle
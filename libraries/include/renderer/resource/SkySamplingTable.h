@@ -0,0 +1,53 @@
+#pragma once
+
+#include "core/cook/CookArtifact.h"
+#include "core/math/Types.h"
+
+#include <vector>
+
+namespace sparkle
+{
+// luminance based importance sampling of a sky cube. every face is split into Resolution x Resolution cells that form
+// one alias table, so drawing a direction and evaluating its pdf are both O(1). cooked by SkySamplingCookJob.
+class SkySamplingTable
+{
+public:
+    static constexpr uint32_t Resolution = 128;
+
+    struct PayloadHeader
+    {
+        uint32_t resolution;
+        uint32_t cell_count;
+    };
+
+    struct Cell
+    {
+        // chance to keep this cell once the alias table picked it, otherwise alias is taken
+        float keep_probability;
+        uint32_t alias;
+        // chance that the table ends up at this cell
+        float probability;
+    };
+
+    // false if the payload does not match the table layout
+    bool LoadFromPayload(const CookPayload &payload);
+
+    // direction with probability proportional to sky luminance. u_cell picks a cell of the alias table, u_point the
+    // point in it, so the caller decides where in its sample sequence they come from. outputs its solid angle pdf.
+    [[nodiscard]] Vector3 Sample(const Vector2 &u_cell, const Vector2 &u_point, Scalar &pdf) const;
+
+    // solid angle pdf of Sample producing direction
+    [[nodiscard]] Scalar Pdf(const Vector3 &direction) const;
+
+    [[nodiscard]] bool IsValid() const
+    {
+        return !cells_.empty();
+    }
+
+    // solid angle covered by the cube face area du * dv around (u, v), both in [-1, 1]
+    [[nodiscard]] static Scalar GetSolidAngleScale(Scalar u, Scalar v);
+
+private:
+    std::vector<Cell> cells_;
+};
+} // namespace sparkle
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "core/math/AABB.h"
+#include "core/math/BVH.h"
+#include "core/math/RayPacket.h"
+
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace sparkle
+{
+class PrimitiveRenderProxy;
+class Intersection;
+
+// bvh over the world bounds of the primitives of a scene, for the cpu renderer. after a full build it follows the
+// scene with insertions, removals and refits, which are cheap but let the tree degrade. NeedsRebuild tells when the
+// incremental updates have gone too far for traversal to stay safe.
+class TLAS
+{
+public:
+    // depth the inline traversal stacks cover. traversal keeps at most one pending node per level, so deeper trees,
+    // which a build over a skewed scene may produce, traverse with stacks on the heap instead
+    static constexpr size_t MaxDepth = 32;
+
+    // levels insertions may add below the depth of the last build before the tree is rebuilt
+    static constexpr size_t MaxInsertedDepth = 16;
+
+    // bounds are captured here, so Build only touches data owned by the TLAS and may run on any thread that is not a
+    // pool worker
+    explicit TLAS(const std::vector<PrimitiveRenderProxy *> &primitives);
+
+    void Build();
+
+    // add a primitive without rebuilding: it becomes a new leaf next to the leaf whose bounds grow the least.
+    // bounds of the tree are stale until the next Refit.
+    void Insert(PrimitiveRenderProxy *primitive);
+
+    // drop a primitive without rebuilding. a leaf that ends up empty is unlinked and its sibling takes the parent's
+    // place. bounds of the tree are stale until the next Refit.
+    void Remove(PrimitiveRenderProxy *primitive);
+
+    // recompute all bounds bottom-up from the primitives' current world bounds, keeping the topology
+    void Refit();
+
+    // sah cost relative to the tree right after its last full build. refit and incremental updates only make it worse
+    [[nodiscard]] Scalar GetCostRatio() const
+    {
+        return built_cost_ > 0 ? cost_ / built_cost_ : 1.f;
+    }
+
+    // upper bound of the depth of the tree. removals may leave it higher than the real depth
+    [[nodiscard]] size_t GetDepth() const
+    {
+        return depth_;
+    }
+
+    // depth of the tree right after its last full build
+    [[nodiscard]] size_t GetBuiltDepth() const
+    {
+        return built_depth_;
+    }
+
+    // insertions never rebalance, so a tree that keeps growing is rebuilt once they deepen it by MaxInsertedDepth. it is
+    // also rebuilt once it has taken as many updates as it was built with, which keeps the rebuilds amortized. the depth
+    // of a build itself never asks for another one: a rebuild would make the same tree
+    [[nodiscard]] bool NeedsRebuild() const;
+
+    void Intersect(const Ray &ray, Intersection &intersection) const;
+
+    void IntersectAnyHit(const Ray &ray, Intersection &intersection) const;
+
+    // up to one packet of coherent rays (e.g. primary or shadow rays) traversed together.
+    // results are the same as calling Intersect per ray. intersections must be invalidated by the caller.
+    template <bool AnyHit> void IntersectPacket(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+
+    // any number of rays. they are grouped by direction octant and traversed as packets, which recovers some coherence
+    // for secondary bounces.
+    template <bool AnyHit> void IntersectStream(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+
+private:
+    static constexpr size_t InvalidNode = std::numeric_limits<size_t>::max();
+
+    // rays and intersections are indexed by lane
+    template <bool AnyHit>
+    void IntersectPacketInternal(DefaultRayPacket &packet,
+                                 std::span<Intersection *, DefaultRayPacket::Size> intersections) const;
+
+    template <bool AnyHit> void IntersectInternal(const Ray &ray, Intersection &intersection) const;
+
+    void RefitNode(size_t node_id);
+
+    // surface area heuristic with equal traversal and intersection cost
+    [[nodiscard]] Scalar ComputeCost() const;
+
+    // parents_, leaves_ and depth_ of a freshly built tree
+    void LinkNodes();
+
+    // in leaf order. removed primitives leave a null slot until the next build
+    std::vector<PrimitiveRenderProxy *> primitives_;
+    std::unordered_map<PrimitiveRenderProxy *, uint32_t> slots_;
+    Bvh bvh_;
+
+    // parent of every node, and the leaf holding every slot, so updates never search the tree
+    std::vector<size_t> parents_;
+    std::vector<size_t> leaves_;
+
+    size_t depth_ = 0;
+    size_t built_depth_ = 0;
+    size_t built_count_ = 0;
+    size_t updates_since_build_ = 0;
+
+    // input of a pending Build
+    std::vector<AABB> build_bounds_;
+
+    Scalar built_cost_ = 0.f;
+    Scalar cost_ = 0.f;
+};
+
+extern template void TLAS::IntersectPacket<true>(std::span<const Ray> rays,
+                                                 std::span<Intersection> intersections) const;
+extern template void TLAS::IntersectPacket<false>(std::span<const Ray> rays,
+                                                  std::span<Intersection> intersections) const;
+extern template void TLAS::IntersectStream<true>(std::span<const Ray> rays,
+                                                 std::span<Intersection> intersections) const;
+extern template void TLAS::IntersectStream<false>(std::span<const Ray> rays,
+                                                  std::span<Intersection> intersections) const;
+} // namespace sparkle
@@ -138,6 +138,10 @@ public:
     // the cost is higher memory footprint
     void Upload(RHIContext *rhi, const void *data);
 
+    // this frame's copy of a dynamic buffer, for producers that write their output in place instead of calling Upload.
+    // the same guarantee as Upload holds: the GPU no longer reads it
+    [[nodiscard]] void *GetDynamicMappedAddress(RHIContext *rhi) const;
+
     virtual void CopyToBuffer(const RHIBuffer *buffer) const = 0;
 
     virtual void CopyToImage(const RHIImage *image) const = 0;
@@ -36,13 +36,24 @@ public:
     {
         SampleResult result;
         result.is_valid = true;
-        auto local_w_i = sampler::CosineWeightedHemiSphere::Sample();
+        auto local_w_i = sampler::CosineWeightedHemiSphere::Sample(sampler::Random2D());
         result.local_w_i = local_w_i;
 
         result.throughput = surface.base_color;
 
         return result;
     }
+
+    // bsdf times cosine for a given pair of directions
+    static Vector3 Evaluate(const Vector3 & /*local_w_o*/, const Vector3 &local_w_i, const SurfaceAttribute &surface)
+    {
+        return surface.base_color * Pdf(local_w_i);
+    }
+
+    static Scalar Pdf(const Vector3 &local_w_i)
+    {
+        return utilities::Saturate(utilities::CosTheta(local_w_i)) * InvPi;
+    }
 };
 
 class SpecularBxDF : public BxDF
@@ -54,7 +65,7 @@ public:
 
         // enter tangent space
 
-        const auto &local_w_m = sampler::SampleMicroFacetNormal(local_w_o, surface.roughness);
+        const auto &local_w_m = sampler::SampleMicroFacetNormal(sampler::Random2D(), local_w_o, surface.roughness);
         Vector3 local_w_i = utilities::Reflect(local_w_o, local_w_m);
 
         Vector3 fresnel_color;
@@ -80,9 +91,6 @@ public:
             {
                 // if non-metal, fresnel tells how much light is reflected
 
-                // F0: reflection rate when view direction is parallel to the surface (fully reflective).
-                // this value is empirical and widely adopted.
-                static const Scalar F0 = 0.04f;
                 auto fresnel = utilities::SchlickApproximation(local_cos_i, F0);
 
                 // we want to sample only one light per run, even if specular and diffuse reflection coexists.
@@ -107,6 +115,62 @@ public:
 
         return result;
     }
+
+    // chance that Sample keeps the specular lobe for a micro-facet, instead of leaving the light to the diffuse lobe
+    static Scalar SelectProbability(Scalar local_cos_i, const SurfaceAttribute &surface)
+    {
+        return utilities::Lerp(utilities::SchlickApproximation(local_cos_i, F0), 1.f, surface.metallic);
+    }
+
+    // what Sample returns on average for a given pair of directions, i.e. bsdf times cosine with the metal / dieletric
+    // selection folded in. near-mirror surfaces are treated as a delta lobe, which only Sample can hit.
+    static Vector3 Evaluate(const Vector3 &local_w_o, const Vector3 &local_w_i, const SurfaceAttribute &surface)
+    {
+        auto cos_o = utilities::CosTheta(local_w_o);
+        auto cos_i = utilities::CosTheta(local_w_i);
+        if (cos_o <= Eps || cos_i <= Eps || IsDelta(surface.roughness))
+        {
+            return Zeros;
+        }
+
+        const Vector3 local_w_m = (local_w_o + local_w_i).normalized();
+        auto local_cos_i = local_w_i.dot(local_w_m);
+
+        Vector3 fresnel_color = utilities::SchlickApproximation(local_cos_i, surface.base_color) * surface.metallic +
+                                Ones * (utilities::SchlickApproximation(local_cos_i, F0) * (1.f - surface.metallic));
+
+        auto ndf = sampler::DistributionGGX::Ndf(utilities::CosTheta(local_w_m), surface.roughness);
+        auto occlusion = utilities::SmithGGXCorrelated(cos_o, cos_i, surface.roughness);
+        return fresnel_color * (ndf * occlusion / (4.f * cos_o));
+    }
+
+    // density of the visible normal sampling in Sample, regardless of which lobe is selected afterwards
+    static Scalar Pdf(const Vector3 &local_w_o, const Vector3 &local_w_i, float roughness)
+    {
+        auto cos_o = utilities::CosTheta(local_w_o);
+        auto cos_i = utilities::CosTheta(local_w_i);
+        if (cos_o <= Eps || cos_i <= Eps || IsDelta(roughness))
+        {
+            return 0.f;
+        }
+
+        const Vector3 local_w_m = (local_w_o + local_w_i).normalized();
+        auto ndf = sampler::DistributionGGX::Ndf(utilities::CosTheta(local_w_m), roughness);
+        return utilities::GeometrySchlickGGX(cos_o, roughness) * ndf / (4.f * cos_o);
+    }
+
+    // so smooth that only Sample can hit the reflection
+    static bool IsDelta(float roughness)
+    {
+        auto a = roughness * roughness;
+        return a * a < Eps;
+    }
+
+private:
+
+    // F0: reflection rate when view direction is parallel to the surface (fully reflective).
+    // this value is empirical and widely adopted.
+    constexpr static Scalar F0 = 0.04f;
 };
 
 class DieletricBxDF : public BxDF
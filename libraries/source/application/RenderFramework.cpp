@@ -324,6 +324,12 @@ bool RenderFramework::BeginFrame()
 {
     PROFILE_SCOPE("RenderFramework::BeginFrame");
 
+    // render thread tasks may change the scene
+    if (renderer_)
+    {
+        renderer_->FinishFrameWork();
+    }
+
     ConsumeRenderThreadTasks();
 
     if (should_stop_)
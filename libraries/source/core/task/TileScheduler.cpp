@@ -0,0 +1,124 @@
+#include "core/task/TileScheduler.h"
+
+#include "core/task/TaskDispatcher.h"
+
+namespace sparkle
+{
+static constexpr uint64_t PackRange(unsigned head, unsigned tail)
+{
+    return (static_cast<uint64_t>(head) << 32u) | tail;
+}
+
+static constexpr unsigned RangeHead(uint64_t range)
+{
+    return static_cast<unsigned>(range >> 32u);
+}
+
+static constexpr unsigned RangeTail(uint64_t range)
+{
+    return static_cast<unsigned>(range & 0xffffffffu);
+}
+
+void TileScheduler::Resize(unsigned width, unsigned height, unsigned tile_size)
+{
+    ASSERT(tile_size > 0);
+
+    width_ = width;
+    height_ = height;
+    tile_size_ = tile_size;
+    tile_count_x_ = (width + tile_size - 1) / tile_size;
+    tile_count_y_ = (height + tile_size - 1) / tile_size;
+
+    // one lane per worker so that every lane starts on its own thread
+    auto lane_count = static_cast<unsigned>(TaskDispatcher::Instance().GetThreadPool().get_thread_count());
+    lane_count = std::max(1u, std::min(lane_count, GetTileCount()));
+
+    if (lane_count != lane_count_)
+    {
+        lanes_ = std::make_unique<Lane[]>(lane_count);
+        lane_count_ = lane_count;
+    }
+}
+
+TileScheduler::Tile TileScheduler::GetTile(unsigned tile_index) const
+{
+    const unsigned tile_x = tile_index % tile_count_x_;
+    const unsigned tile_y = tile_index / tile_count_x_;
+
+    return {
+        .x_begin = tile_x * tile_size_,
+        .y_begin = tile_y * tile_size_,
+        .x_end = std::min(width_, (tile_x + 1) * tile_size_),
+        .y_end = std::min(height_, (tile_y + 1) * tile_size_),
+        .index = tile_index,
+    };
+}
+
+void TileScheduler::ResetLanes(unsigned item_count)
+{
+    finished_tile_count_.store(0, std::memory_order_relaxed);
+    stolen_tile_count_.store(0, std::memory_order_relaxed);
+
+    // contiguous ranges keep neighbouring tiles (and their cache lines) on the same lane until stealing kicks in
+    for (auto lane = 0u; lane < lane_count_; lane++)
+    {
+        const unsigned head = item_count * lane / lane_count_;
+        const unsigned tail = item_count * (lane + 1) / lane_count_;
+        lanes_[lane].range.store(PackRange(head, tail), std::memory_order_relaxed);
+    }
+
+    // published to the workers by the submission of the loop
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+bool TileScheduler::PopFront(unsigned lane, unsigned &item)
+{
+    auto &range = lanes_[lane].range;
+    uint64_t current = range.load(std::memory_order_relaxed);
+    while (true)
+    {
+        const unsigned head = RangeHead(current);
+        const unsigned tail = RangeTail(current);
+        if (head >= tail)
+        {
+            return false;
+        }
+
+        if (range.compare_exchange_weak(current, PackRange(head + 1, tail), std::memory_order_acq_rel,
+                                        std::memory_order_relaxed))
+        {
+            item = head;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::Steal(unsigned thief, unsigned &item)
+{
+    for (auto offset = 1u; offset < lane_count_; offset++)
+    {
+        auto &range = lanes_[(thief + offset) % lane_count_].range;
+        uint64_t current = range.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const unsigned head = RangeHead(current);
+            const unsigned tail = RangeTail(current);
+            if (head >= tail)
+            {
+                break;
+            }
+
+            // take from the back: the victim keeps walking its own range front to back
+            if (range.compare_exchange_weak(current, PackRange(head, tail - 1), std::memory_order_acq_rel,
+                                            std::memory_order_relaxed))
+            {
+                item = tail - 1;
+                stolen_tile_count_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+} // namespace sparkle
@@ -211,10 +211,174 @@ const Image2D &Image2D::EnsureDecoded() const
     return *decode_cache_->image;
 }
 
+Image2D::Image2D(const Image2D &chain, unsigned mip, size_t payload_offset)
+    : pixel_format_(chain.pixel_format_), width_(std::max(chain.width_ >> mip, 1u)),
+      height_(std::max(chain.height_ >> mip, 1u)), channel_count_(chain.channel_count_),
+      size_vector_{(width_ - 1), (height_ - 1)}, decode_cache_(std::make_shared<DecodeCache>()), name_(chain.name_)
+{
+    ASSERT(IsCompressedFormat(pixel_format_));
+    payload_view_ = chain.GetPayload().subspan(payload_offset, GetImageMipByteSize(pixel_format_, width_, height_));
+}
+
+Vector4 Image2D::FetchCompressedTexel(unsigned x, unsigned y) const
+{
+    ASSERT(IsCompressedFormat(pixel_format_) && decode_cache_);
+
+    const auto block_dim = GetBlockDim(pixel_format_);
+    const auto block_index = (y / block_dim) * utilities::DivideAndRoundUp(width_, block_dim) + x / block_dim;
+
+    const auto &texels = TextureBlockCache::Fetch(
+        decode_cache_->block_cache_id, block_index, [this, block_index](TextureBlockCache::BlockTexels &decoded) {
+            // mip 0 comes first in the payload
+            const auto block_offset = static_cast<size_t>(block_index) * GetBlockByteSize(pixel_format_);
+            const auto *block = GetPayload().data() + block_offset;
+            TextureCompression::DecodeBlock(pixel_format_, block, decoded);
+        });
+
+    return texels[(y % block_dim) * block_dim + x % block_dim];
+}
+
+namespace
+{
+// 2x2 box filter in linear space. odd texels at the border fold into the last output texel.
+// single threaded: it may run on a worker that looks up a level for the first time.
+Image2D Downsample(const Image2D &source)
+{
+    const auto width = std::max(source.GetWidth() / 2, 1u);
+    const auto height = std::max(source.GetHeight() / 2, 1u);
+    const bool is_srgb = IsSRGBFormat(source.GetFormat());
+
+    // a compressed source shrinks into the format Decode would give it
+    auto format = source.GetFormat();
+    if (IsCompressedFormat(format))
+    {
+        format = IsHDRCompressedFormat(format) ? PixelFormat::RGBAFloat16
+                 : is_srgb                     ? PixelFormat::R8G8B8A8Srgb
+                                               : PixelFormat::R8G8B8A8Unorm;
+    }
+
+    Image2D result(width, height, format);
+    for (auto j = 0u; j < height; j++)
+    {
+        const auto y_end = j + 1 == height ? source.GetHeight() : j * 2 + 2;
+        for (auto i = 0u; i < width; i++)
+        {
+            const auto x_end = i + 1 == width ? source.GetWidth() : i * 2 + 2;
+
+            Vector3 sum = Zeros;
+            for (auto y = j * 2; y < y_end; y++)
+            {
+                for (auto x = i * 2; x < x_end; x++)
+                {
+                    const Vector3 texel = source.AccessPixel(x, y).head<3>();
+                    sum += is_srgb ? utilities::SRGBtoLinear(texel) : texel;
+                }
+            }
+
+            const Vector3 average = sum / static_cast<Scalar>((x_end - i * 2) * (y_end - j * 2));
+            result.SetPixel(i, j, average);
+        }
+    }
+
+    result.SetName(source.GetName());
+    return result;
+}
+} // namespace
+
+const Image2D &Image2D::GetLevel(unsigned level) const
+{
+    if (level == 0)
+    {
+        return *this;
+    }
+
+    ASSERT(level < GetLevelCount());
+    std::call_once(sampling_cache_->levels_once, [this] {
+        auto &levels = sampling_cache_->levels;
+        levels.reserve(GetLevelCount() - 1);
+
+        const bool is_compressed = IsCompressedFormat(pixel_format_);
+        size_t mip_offset = is_compressed ? GetImageMipByteSize(pixel_format_, width_, height_) : 0;
+        for (auto mip = 1u; mip < GetLevelCount(); mip++)
+        {
+            if (is_compressed && mip < mip_count_)
+            {
+                // a compressed single-mip view of the payload, so that it is sampled block by block as well
+                levels.push_back(Image2D(*this, mip, mip_offset));
+                mip_offset += levels.back().GetStorageSize();
+            }
+            else
+            {
+                levels.push_back(Downsample(mip == 1 ? GetLevel(0) : levels.back()));
+            }
+        }
+
+        for (auto &mip : levels)
+        {
+            if (!IsCompressedFormat(mip.pixel_format_))
+            {
+                mip.SetTexelLayout(TexelLayout::Tiled);
+            }
+        }
+    });
+
+    return sampling_cache_->levels[level - 1];
+}
+
+void Image2D::SetTexelLayout(TexelLayout layout)
+{
+    ASSERT(!IsCompressedFormat(pixel_format_));
+    if (layout == texel_layout_)
+    {
+        return;
+    }
+
+    sampling_cache_.Reset();
+
+    const auto source_layout = texel_layout_;
+    const auto source = std::move(pixels_);
+
+    texel_layout_ = layout;
+    pixels_.assign(GetExpectedStorageSize(), 0);
+
+    const auto pixel_size = GetPixelSize(pixel_format_);
+    for (auto y = 0u; y < height_; y++)
+    {
+        for (auto x = 0u; x < width_; x++)
+        {
+            std::memcpy(pixels_.data() + GetTexelIndex(layout, width_, x, y) * pixel_size,
+                        source.data() + GetTexelIndex(source_layout, width_, x, y) * pixel_size, pixel_size);
+        }
+    }
+}
+
+void Image2D::EnableTiledSampling() const
+{
+    // compressed images are sampled block by block and stay compressed
+    if (IsCompressedFormat(pixel_format_))
+    {
+        return;
+    }
+
+    std::call_once(sampling_cache_->tiled_once, [this] {
+        const auto &source = GetLevel(0);
+
+        // built from scratch rather than copied, so that it does not share this image's caches
+        auto tiled = std::make_unique<Image2D>(source.width_, source.height_, source.pixel_format_);
+        tiled->pixels_ = source.pixels_;
+        tiled->texel_layout_ = source.texel_layout_;
+        tiled->name_ = source.name_;
+        tiled->SetTexelLayout(TexelLayout::Tiled);
+
+        sampling_cache_->tiled_image = std::move(tiled);
+        sampling_cache_->tiled.store(sampling_cache_->tiled_image.get(), std::memory_order_release);
+    });
+}
+
 uint32_t Image2D::GetContentHash() const
 {
     CRC32 hasher;
-    hasher.add(pixels_.data(), pixels_.size());
+    hasher.add(GetRawData(), GetStorageSize());
     return FinishContentHash(hasher, width_, height_, pixel_format_);
 }
 
@@ -225,6 +389,13 @@ bool Image2D::WriteToFile(const Path &file_path) const
         return EnsureDecoded().WriteToFile(file_path);
     }
 
+    if (texel_layout_ != TexelLayout::Linear)
+    {
+        auto linear = *this;
+        linear.SetTexelLayout(TexelLayout::Linear);
+        return linear.WriteToFile(file_path);
+    }
+
     std::vector<char> buffer;
     auto *custom_data = static_cast<void *>(&buffer);
 
@@ -283,6 +454,9 @@ bool Image2D::CopyFrom(const Image2D &other)
         return false;
     }
 
+    // drops the sampling cache up front, so that the parallel writes below find it empty
+    sampling_cache_.Reset();
+
     TaskManager::ParallelFor(0u, height_, [this, &other](unsigned j) {
         for (auto i = 0u; i < width_; i++)
         {
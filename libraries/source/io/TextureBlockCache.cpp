@@ -0,0 +1,139 @@
+#include "io/TextureBlockCache.h"
+
+#include <algorithm>
+
+namespace sparkle
+{
+namespace
+{
+std::atomic<uint32_t> next_image_id{0};
+
+std::atomic<uint64_t> total_hit_count{0};
+std::atomic<uint64_t> total_miss_count{0};
+std::atomic<size_t> total_memory_size{0};
+} // namespace
+
+uint32_t TextureBlockCache::AllocateImageId()
+{
+    return next_image_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+TextureBlockCache::Stats TextureBlockCache::GetStats()
+{
+    return {.hit_count = total_hit_count.load(std::memory_order_relaxed),
+            .miss_count = total_miss_count.load(std::memory_order_relaxed),
+            .memory_size = total_memory_size.load(std::memory_order_relaxed)};
+}
+
+TextureBlockCache::ThreadCache &TextureBlockCache::GetThreadCache()
+{
+    static thread_local ThreadCache cache;
+    return cache;
+}
+
+TextureBlockCache::ThreadCache::~ThreadCache()
+{
+    FlushStats();
+    total_memory_size.fetch_sub(entries_.size() * sizeof(Entry), std::memory_order_relaxed);
+}
+
+TextureBlockCache::BlockTexels &TextureBlockCache::ThreadCache::Insert(uint64_t key)
+{
+    uint32_t entry;
+    if (entries_.size() < capacity_)
+    {
+        entry = static_cast<uint32_t>(entries_.size());
+        entries_.emplace_back();
+        total_memory_size.fetch_add(sizeof(Entry), std::memory_order_relaxed);
+    }
+    else
+    {
+        // recycle the least recently used block
+        entry = oldest_;
+        Unlink(entry);
+        index_.erase(entries_[entry].key);
+    }
+
+    entries_[entry].key = key;
+    index_.emplace(key, entry);
+
+    entries_[entry].older = newest_;
+    entries_[entry].newer = InvalidEntry;
+    if (newest_ != InvalidEntry)
+    {
+        entries_[newest_].newer = entry;
+    }
+    newest_ = entry;
+    if (oldest_ == InvalidEntry)
+    {
+        oldest_ = entry;
+    }
+
+    last_used_ = entry;
+    return entries_[entry].texels;
+}
+
+void TextureBlockCache::ThreadCache::FlushStats()
+{
+    total_hit_count.fetch_add(hit_count_, std::memory_order_relaxed);
+    total_miss_count.fetch_add(lookup_count_ - hit_count_, std::memory_order_relaxed);
+    lookup_count_ = 0;
+    hit_count_ = 0;
+}
+
+void TextureBlockCache::ThreadCache::Touch(uint32_t entry)
+{
+    last_used_ = entry;
+    if (entry == newest_)
+    {
+        return;
+    }
+
+    Unlink(entry);
+
+    entries_[entry].older = newest_;
+    entries_[entry].newer = InvalidEntry;
+    entries_[newest_].newer = entry;
+    newest_ = entry;
+}
+
+void TextureBlockCache::ThreadCache::Unlink(uint32_t entry)
+{
+    auto &node = entries_[entry];
+    if (node.newer != InvalidEntry)
+    {
+        entries_[node.newer].older = node.older;
+    }
+    else
+    {
+        newest_ = node.older;
+    }
+
+    if (node.older != InvalidEntry)
+    {
+        entries_[node.older].newer = node.newer;
+    }
+    else
+    {
+        oldest_ = node.newer;
+    }
+}
+
+void TextureBlockCache::ThreadCache::Reset(size_t capacity_bytes)
+{
+    total_memory_size.fetch_sub(entries_.size() * sizeof(Entry), std::memory_order_relaxed);
+
+    capacity_bytes_ = capacity_bytes;
+    capacity_ = std::max<size_t>(capacity_bytes / sizeof(Entry), 1);
+
+    // entries are handed out by reference, so the storage must never move once in use
+    std::vector<Entry>().swap(entries_);
+    entries_.reserve(capacity_);
+    index_.clear();
+    index_.reserve(capacity_);
+
+    newest_ = InvalidEntry;
+    oldest_ = InvalidEntry;
+    last_used_ = InvalidEntry;
+}
+} // namespace sparkle
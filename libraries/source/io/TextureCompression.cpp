@@ -3,6 +3,7 @@
 #include "core/Exception.h"
 #include "core/Logger.h"
 #include "core/task/TaskManager.h"
+#include "io/TextureBlockCache.h"
 
 #include <ConvectionKernels.h>
 #include <astcenc.h>
@@ -21,6 +22,7 @@
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
 
 namespace sparkle
 {
@@ -214,11 +216,11 @@ astcenc_profile GetAstcProfile(PixelFormat format)
 class AstcContext
 {
 public:
-    AstcContext(PixelFormat format, float quality)
+    AstcContext(PixelFormat format, float quality, unsigned flags = 0)
     {
         astcenc_config config;
         const unsigned block_dim = GetBlockDim(format);
-        auto status = astcenc_config_init(GetAstcProfile(format), block_dim, block_dim, 1, quality, 0, &config);
+        auto status = astcenc_config_init(GetAstcProfile(format), block_dim, block_dim, 1, quality, flags, &config);
         if (status == ASTCENC_SUCCESS)
         {
             status = astcenc_context_alloc(&config, 1, &context_, nullptr);
@@ -659,6 +661,59 @@ bool DecodeAstcHdrMip(const uint8_t *blocks, size_t blocks_size, unsigned width,
     return true;
 }
 
+// decode-only context of the calling thread for a format. DecodeBlock runs once per block on every worker, far too
+// often to set up a context per call
+astcenc_context *GetThreadAstcDecoder(PixelFormat format)
+{
+    static thread_local std::array<std::unique_ptr<AstcContext>, static_cast<size_t>(PixelFormat::Count)> decoders;
+
+    auto &decoder = decoders[static_cast<size_t>(format)];
+    if (!decoder)
+    {
+        decoder = std::make_unique<AstcContext>(format, ASTCENC_PRE_MEDIUM, ASTCENC_FLG_DECOMPRESS_ONLY);
+    }
+    return decoder->Get();
+}
+
+bool DecodeAstcBlock(const uint8_t *block, PixelFormat format, std::span<Vector4> texels)
+{
+    auto *context = GetThreadAstcDecoder(format);
+    if (context == nullptr)
+    {
+        return false;
+    }
+
+    const unsigned block_dim = GetBlockDim(format);
+    const unsigned texel_count = block_dim * block_dim;
+    const bool is_hdr = IsHDRCompressedFormat(format);
+
+    std::array<uint8_t, TextureBlockCache::MaxBlockTexelCount * 4> ldr;
+    std::array<Half, TextureBlockCache::MaxBlockTexelCount * 4> hdr;
+
+    void *slice = is_hdr ? static_cast<void *>(hdr.data()) : static_cast<void *>(ldr.data());
+    astcenc_image image{.dim_x = block_dim,
+                        .dim_y = block_dim,
+                        .dim_z = 1,
+                        .data_type = is_hdr ? ASTCENC_TYPE_F16 : ASTCENC_TYPE_U8,
+                        .data = &slice};
+    const astcenc_swizzle swizzle{ASTCENC_SWZ_R, ASTCENC_SWZ_G, ASTCENC_SWZ_B, ASTCENC_SWZ_A};
+
+    const auto status = astcenc_decompress_image(context, block, GetBlockByteSize(format), &image, &swizzle, 0);
+    astcenc_decompress_reset(context);
+    if (status != ASTCENC_SUCCESS)
+    {
+        Log(Error, "astc block decode failed: {}", astcenc_get_error_string(status));
+        return false;
+    }
+
+    for (auto i = 0u; i < texel_count; i++)
+    {
+        texels[i] = is_hdr ? Vector4(Vector4h(hdr[i * 4], hdr[i * 4 + 1], hdr[i * 4 + 2], hdr[i * 4 + 3]).cast<float>())
+                           : utilities::ColorToVec(Color4(ldr[i * 4], ldr[i * 4 + 1], ldr[i * 4 + 2], ldr[i * 4 + 3]));
+    }
+    return true;
+}
+
 void DecodeBc7Mip(const uint8_t *blocks, unsigned width, unsigned height, uint8_t *out_rgba)
 {
     const unsigned blocks_x = (width + 3) / 4;
@@ -1126,4 +1181,47 @@ Image2D TextureCompression::Decode(const Image2D &compressed, unsigned mip_level
     decoded.SetName(compressed.GetName());
     return decoded;
 }
+
+void TextureCompression::DecodeBlock(PixelFormat format, const uint8_t *block, std::span<Vector4> texels)
+{
+    ASSERT(IsCompressedFormat(format));
+    const unsigned texel_count = GetBlockDim(format) * GetBlockDim(format);
+    ASSERT(texels.size() >= texel_count);
+
+    switch (format)
+    {
+    case PixelFormat::BC7Srgb:
+    case PixelFormat::BC7Unorm: {
+        std::array<bc7decomp::color_rgba, 16> rgba;
+        bc7decomp::unpack_bc7(block, rgba.data());
+        for (auto i = 0u; i < texel_count; i++)
+        {
+            const auto *comps = rgba[i].m_comps;
+            texels[i] = utilities::ColorToVec(Color4(comps[0], comps[1], comps[2], comps[3]));
+        }
+        break;
+    }
+    case PixelFormat::BC6HUfloat: {
+        // cvtt decodes whole batches. the rest of this one stays zero
+        std::array<uint8_t, cvtt::NumParallelBlocks * 16> input{};
+        std::memcpy(input.data(), block, 16);
+        std::array<cvtt::PixelBlockF16, cvtt::NumParallelBlocks> decoded{};
+        cvtt::Kernels::DecodeBC6HU(decoded.data(), input.data());
+        for (auto i = 0u; i < texel_count; i++)
+        {
+            const auto *texel = decoded[0].m_pixels[i];
+            texels[i] = Vector4(static_cast<float>(std::bit_cast<Half>(texel[0])),
+                                static_cast<float>(std::bit_cast<Half>(texel[1])),
+                                static_cast<float>(std::bit_cast<Half>(texel[2])), 1.f);
+        }
+        break;
+    }
+    default:
+        if (!DecodeAstcBlock(block, format, texels))
+        {
+            std::fill_n(texels.begin(), texel_count, Vector4::Zero());
+        }
+        break;
+    }
+}
 } // namespace sparkle
@@ -40,7 +40,41 @@ static ConfigValue<bool> config_spatial_denoise("spatial_denoise", "use spatial
 static ConfigValue<float> config_target_framerate("target_framerate", "target frame rate", "renderer", 60.f);
 static ConfigValue<float> config_gpu_budget_ratio("gpu_time_budget_ratio", "GPU time budget ratio for ray tracing",
                                                   "renderer", 0.8f);
+static ConfigValue<float> config_cpu_budget_ratio("cpu_time_budget_ratio",
+                                                  "CPU time budget ratio for path tracing with dynamic spp",
+                                                  "renderer", 0.8f);
 static ConfigValue<bool> config_enable_nee("enable_nee", "enable next event estimation", "renderer", false, true);
+static ConfigValue<bool> config_adaptive_sampling("adaptive_sampling",
+                                                  "stop sampling converged tiles and spend their budget on noisy ones",
+                                                  "renderer", false, true);
+static ConfigValue<float> config_adaptive_sampling_threshold(
+    "adaptive_sampling_threshold", "relative standard error below which a pixel counts as converged", "renderer",
+    0.01f, true);
+static ConfigValue<bool> config_cpu_pipelining("cpu_pipelining",
+                                               "trace the next cpu frame while the current one is presented",
+                                               "renderer", false, true);
+static ConfigValue<bool> config_cpu_wavefront("cpu_wavefront",
+                                              "cpu paths advance in large waves with hits shaded in material order",
+                                              "renderer", false);
+static ConfigValue<std::string> config_cpu_sampler("cpu_sampler", "sample sequence of the cpu path tracer", "renderer",
+                                                   Enum2Str<RenderConfig::CpuSampler::Sobol>(), true);
+static ConfigValue<bool> config_cpu_atrous("cpu_atrous", "filter the cpu image with a guided a-trous wavelet",
+                                           "renderer", false, true);
+static ConfigValue<bool> config_cpu_path_guiding("cpu_path_guiding",
+                                                 "guide cpu bounces with radiance learnt from previous paths",
+                                                 "renderer", false, true);
+static ConfigValue<bool> config_progressive_preview(
+    "progressive_preview", "trace 1/8, 1/4 and 1/2 resolution previews after the cpu accumulation is cleared",
+    "renderer", false, true);
+static ConfigValue<bool> config_texture_lod("texture_lod",
+                                            "cpu texture lookups pick a mip level from the ray cone footprint",
+                                            "renderer", false, true);
+static ConfigValue<bool> config_tiled_textures("tiled_textures",
+                                               "cpu-sampled textures are stored in z-ordered blocks for cache locality",
+                                               "renderer", false, true);
+static ConfigValue<uint32_t> config_texture_block_cache_mb(
+    "texture_block_cache_mb", "per-thread cache of decoded compressed texture blocks for cpu sampling, in MB",
+    "renderer", 4);
 static ConfigValue<bool> config_clear_screenshots("clear_screenshots", "clear all existing screenshots", "renderer",
                                                   false);
 static ConfigValue<bool> config_manual_accumulation(
@@ -68,7 +102,19 @@ void RenderConfig::Init()
     ConfigCollectionHelper::RegisterConfig(this, config_dynamic_spp, use_dynamic_spp);
     ConfigCollectionHelper::RegisterConfig(this, config_target_framerate, target_framerate);
     ConfigCollectionHelper::RegisterConfig(this, config_gpu_budget_ratio, gpu_time_budget_ratio);
+    ConfigCollectionHelper::RegisterConfig(this, config_cpu_budget_ratio, cpu_time_budget_ratio);
     ConfigCollectionHelper::RegisterConfig(this, config_enable_nee, enable_nee);
+    ConfigCollectionHelper::RegisterConfig(this, config_adaptive_sampling, adaptive_sampling);
+    ConfigCollectionHelper::RegisterConfig(this, config_adaptive_sampling_threshold, adaptive_sampling_threshold);
+    ConfigCollectionHelper::RegisterConfig(this, config_cpu_pipelining, cpu_pipelining);
+    ConfigCollectionHelper::RegisterConfig(this, config_cpu_wavefront, cpu_wavefront);
+    ConfigCollectionHelper::RegisterConfig(this, config_cpu_sampler, cpu_sampler);
+    ConfigCollectionHelper::RegisterConfig(this, config_cpu_atrous, cpu_atrous);
+    ConfigCollectionHelper::RegisterConfig(this, config_cpu_path_guiding, cpu_path_guiding);
+    ConfigCollectionHelper::RegisterConfig(this, config_progressive_preview, progressive_preview);
+    ConfigCollectionHelper::RegisterConfig(this, config_texture_lod, texture_lod);
+    ConfigCollectionHelper::RegisterConfig(this, config_tiled_textures, tiled_textures);
+    ConfigCollectionHelper::RegisterConfig(this, config_texture_block_cache_mb, texture_block_cache_mb);
     ConfigCollectionHelper::RegisterConfig(this, config_clear_screenshots, clear_screenshots);
     ConfigCollectionHelper::RegisterConfig(this, config_manual_accumulation, manual_accumulation);
 
@@ -0,0 +1,159 @@
+#include "renderer/denoiser/AtrousFilter.h"
+
+#include "core/Profiler.h"
+#include "core/math/Utilities.h"
+#include "core/task/TaskManager.h"
+#include "renderer/resource/GBuffer.h"
+
+#include <array>
+
+namespace sparkle
+{
+namespace
+{
+constexpr std::array<Scalar, 5> Kernel{1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+
+// cosine between normals, to the power of 2^NormalPowerLog2
+constexpr unsigned NormalPowerLog2 = 7;
+// relative depth change tolerated per pixel of offset
+constexpr Scalar DepthSigma = 0.01f;
+// summed over rgb
+constexpr Scalar AlbedoSigma = 0.1f;
+// in standard deviations of the center pixel
+constexpr Scalar LuminanceSigma = 4.f;
+
+bool IsFilterable(const PixelBuffer2D<Vector4> &image, const CPUGBuffer &gbuffer, unsigned i, unsigned j)
+{
+    return image(i, j).w() >= 0.f && !gbuffer.world_normal(i, j).isZero();
+}
+
+// 3x3 gaussian of the variance around a pixel. a single pixel's estimate is too noisy to steer the luminance weight.
+Scalar GetBlurredVariance(const PixelBuffer2D<Vector4> &image, const CPUGBuffer &gbuffer, unsigned i, unsigned j)
+{
+    constexpr std::array<Scalar, 3> Gaussian{0.25f, 0.5f, 0.25f};
+
+    Scalar sum = 0.f;
+    Scalar weight_sum = 0.f;
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        const auto y = static_cast<int>(j) + dy;
+        if (y < 0 || y >= static_cast<int>(image.GetHeight()))
+        {
+            continue;
+        }
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            const auto x = static_cast<int>(i) + dx;
+            if (x < 0 || x >= static_cast<int>(image.GetWidth()) ||
+                !IsFilterable(image, gbuffer, static_cast<unsigned>(x), static_cast<unsigned>(y)))
+            {
+                continue;
+            }
+
+            const auto weight = Gaussian[dx + 1] * Gaussian[dy + 1];
+            sum += image(static_cast<unsigned>(x), static_cast<unsigned>(y)).w() * weight;
+            weight_sum += weight;
+        }
+    }
+    return sum / weight_sum;
+}
+
+void FilterPixel(const PixelBuffer2D<Vector4> &input, const CPUGBuffer &gbuffer, unsigned i, unsigned j, int step,
+                 Vector4 &output)
+{
+    const auto &center = input(i, j);
+    if (!IsFilterable(input, gbuffer, i, j))
+    {
+        output = center;
+        return;
+    }
+
+    const Vector3 &normal = gbuffer.world_normal(i, j);
+    const float depth = gbuffer.depth(i, j);
+    const Vector3 &albedo = gbuffer.albedo(i, j);
+    const Scalar luminance = utilities::Luminance(center.head<3>());
+    const Scalar inv_luminance_sigma =
+        1.f / (LuminanceSigma * std::sqrt(GetBlurredVariance(input, gbuffer, i, j)) + Eps);
+    const Scalar inv_depth_sigma = 1.f / (DepthSigma * depth + Eps);
+
+    Vector3 color_sum = Zeros;
+    Scalar variance_sum = 0.f;
+    Scalar weight_sum = 0.f;
+    for (int dy = -2; dy <= 2; dy++)
+    {
+        const auto y = static_cast<int>(j) + dy * step;
+        if (y < 0 || y >= static_cast<int>(input.GetHeight()))
+        {
+            continue;
+        }
+        for (int dx = -2; dx <= 2; dx++)
+        {
+            const auto x = static_cast<int>(i) + dx * step;
+            if (x < 0 || x >= static_cast<int>(input.GetWidth()))
+            {
+                continue;
+            }
+
+            const auto tap_i = static_cast<unsigned>(x);
+            const auto tap_j = static_cast<unsigned>(y);
+            if (!IsFilterable(input, gbuffer, tap_i, tap_j))
+            {
+                continue;
+            }
+
+            const auto &tap = input(tap_i, tap_j);
+
+            Scalar normal_weight = std::max(normal.dot(gbuffer.world_normal(tap_i, tap_j)), 0.f);
+            for (auto k = 0u; k < NormalPowerLog2; k++)
+            {
+                normal_weight *= normal_weight;
+            }
+
+            // in pixels. the center tap has no depth difference to scale
+            const auto offset = std::max(std::sqrt(static_cast<Scalar>(dx * dx + dy * dy)) * static_cast<Scalar>(step),
+                                         1.f);
+            const Scalar distance = std::abs(depth - gbuffer.depth(tap_i, tap_j)) * inv_depth_sigma / offset +
+                                    (albedo - gbuffer.albedo(tap_i, tap_j)).cwiseAbs().sum() / AlbedoSigma +
+                                    std::abs(luminance - utilities::Luminance(tap.head<3>())) * inv_luminance_sigma;
+
+            const Scalar weight = Kernel[dx + 2] * Kernel[dy + 2] * normal_weight * std::exp(-distance);
+            color_sum += tap.head<3>() * weight;
+            variance_sum += tap.w() * weight * weight;
+            weight_sum += weight;
+        }
+    }
+
+    // the center tap always counts, with a weight of 9/64
+    output.head<3>() = color_sum / weight_sum;
+    output.w() = variance_sum / (weight_sum * weight_sum);
+}
+} // namespace
+
+void AtrousFilter::Resize(unsigned width, unsigned height)
+{
+    for (auto &buffer : buffers_)
+    {
+        buffer.Resize(width, height);
+    }
+}
+
+void AtrousFilter::Apply(const CPUGBuffer &gbuffer)
+{
+    PROFILE_SCOPE("AtrousFilter::Apply");
+
+    for (auto iteration = 0u; iteration < IterationCount; iteration++)
+    {
+        const auto &input = buffers_[iteration % 2];
+        auto &output = buffers_[(iteration + 1) % 2];
+        const int step = 1 << iteration;
+
+        TaskManager::ParallelFor(0u, input.GetHeight(), [&input, &output, &gbuffer, step](unsigned j) {
+            const auto row = output.Row(j);
+            for (auto i = 0u; i < input.GetWidth(); i++)
+            {
+                FilterPixel(input, gbuffer, i, j, step, row[i]);
+            }
+        }).wait();
+    }
+}
+} // namespace sparkle
@@ -1,5 +1,6 @@
 #include "renderer/proxy/MaterialRenderProxy.h"
 
+#include "core/task/TaskManager.h"
 #include "io/Material.h"
 #include "renderer/BindlessManager.h"
 #include "renderer/proxy/SceneRenderProxy.h"
@@ -84,6 +85,29 @@ void MaterialRenderProxy::InitRenderResources(RHIContext *rhi, const RenderConfi
                           "MaterialParameters_" + name);
     parameter_buffer_->UploadImmediate(&render_data_);
 
+    // build the mip chains and tiled copies now rather than on the first hit. the mip chains are built lazily if
+    // texture_lod is turned on later.
+    if (config.IsCPURenderMode() && (config.texture_lod || config.tiled_textures))
+    {
+        const std::array textures{raw_material_.base_color_texture.get(), raw_material_.normal_texture.get(),
+                                  raw_material_.emissive_texture.get(),
+                                  raw_material_.metallic_roughness_texture.get()};
+        TaskManager::ParallelFor(0u, static_cast<unsigned>(textures.size()), [&textures, &config](unsigned i) {
+            if (!textures[i])
+            {
+                return;
+            }
+            if (config.texture_lod)
+            {
+                (void)textures[i]->GetLevel(textures[i]->GetLevelCount() - 1);
+            }
+            if (config.tiled_textures)
+            {
+                textures[i]->EnableTiledSampling();
+            }
+        }).wait();
+    }
+
     rhi_initialized_ = true;
 }
 
@@ -1,10 +1,14 @@
 #include "renderer/proxy/MeshRenderProxy.h"
 
 #include "core/Profiler.h"
+#include "core/Timer.h"
 #include "core/math/BVH.h"
 #include "core/math/Intersection.h"
 #include "core/math/Ray.h"
+#include "core/math/RayPacket.h"
+#include "core/math/RayStats.h"
 #include "core/math/Utilities.h"
+#include "core/math/WideBVH.h"
 #include "io/Mesh.h"
 #include "renderer/proxy/MaterialRenderProxy.h"
 #include "renderer/proxy/PrimitiveRenderProxy.h"
@@ -16,24 +20,123 @@
 #include <bvh/v2/default_builder.h>
 #include <bvh/v2/executor.h>
 #include <bvh/v2/stack.h>
-#include <bvh/v2/thread_pool.h>
 #pragma GCC diagnostic pop
 
+#include <mutex>
+#include <unordered_map>
+
 namespace sparkle
 {
+static_assert(CPU_BVH_WIDTH == 2 || CPU_BVH_WIDTH == 4 || CPU_BVH_WIDTH == 8, "CPU_BVH_WIDTH must be 2, 4 or 8");
+
+class BLAS;
+
+// Object-space BLASes shared by all proxies of the same mesh, so instanced meshes are built and stored once.
+// Per-instance state (transform, material) stays on the proxy, which is what the TLAS leaf refers to.
+// World-space BLASes of static meshes are per proxy and only show up in the stats.
+class BLASRegistry
+{
+public:
+    static BLASRegistry &Instance()
+    {
+        // never destroyed: proxies may outlive static destruction order at exit
+        static auto *registry = new BLASRegistry();
+        return *registry;
+    }
+
+    void AddUser(const Mesh *mesh)
+    {
+        std::scoped_lock lock(mutex_);
+        users_[mesh]++;
+    }
+
+    void RemoveUser(const Mesh *mesh)
+    {
+        std::scoped_lock lock(mutex_);
+        auto found = users_.find(mesh);
+        ASSERT(found != users_.end());
+        if (--found->second == 0)
+        {
+            users_.erase(found);
+            shared_.erase(mesh);
+        }
+    }
+
+    // true if more than one proxy draws this mesh
+    [[nodiscard]] bool IsShared(const Mesh *mesh) const
+    {
+        std::scoped_lock lock(mutex_);
+        auto found = users_.find(mesh);
+        return found != users_.end() && found->second > 1;
+    }
+
+    // the object-space BLAS of a mesh, built by whichever caller asks first
+    std::shared_ptr<BLAS> AcquireShared(const Mesh *mesh);
+
+    void OnBuilt(size_t memory_size, float build_time_ms)
+    {
+        std::scoped_lock lock(mutex_);
+        stats_.blas_count++;
+        stats_.memory_size += memory_size;
+        stats_.build_time_ms += build_time_ms;
+    }
+
+    void OnReleased(size_t memory_size)
+    {
+        std::scoped_lock lock(mutex_);
+        stats_.blas_count--;
+        stats_.memory_size -= memory_size;
+    }
+
+    MeshRenderProxy::BLASStats GetStats() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<const Mesh *, uint32_t> users_;
+    std::unordered_map<const Mesh *, std::weak_ptr<BLAS>> shared_;
+    MeshRenderProxy::BLASStats stats_;
+};
+
 class BLAS
 {
+    // with a wide bvh the binary tree is only a build intermediate and is collapsed into wide_bvh_
+    static constexpr bool UseWideBvh = CPU_BVH_WIDTH > 2;
+    using WideBvh = WideTriangleBVH<UseWideBvh ? CPU_BVH_WIDTH : 4>;
+
 public:
     explicit BLAS(const Mesh *raw_mesh) : mesh_(raw_mesh)
     {
     }
 
-    void Build()
+    ~BLAS()
     {
+        if (is_built_)
+        {
+            BLASRegistry::Instance().OnReleased(memory_size_);
+        }
+    }
+
+    BLAS(const BLAS &) = delete;
+    BLAS &operator=(const BLAS &) = delete;
+
+    // Build for a BLAS that several threads may ask for at the same time. all of them return once it is built.
+    void BuildOnce(const Transform *bake_transform)
+    {
+        std::call_once(build_flag_, [this, bake_transform]() { Build(bake_transform); });
+    }
+
+    // bake_transform: if set, triangles are stored in the space it maps to (world space for static meshes).
+    // otherwise they stay in object space. rays passed to intersection must be in the same space.
+    void Build(const Transform *bake_transform)
+    {
+        Timer timer;
+
         using Vec3 = bvh::v2::Vec<Scalar, 3>;
         using BBox = bvh::v2::BBox<Scalar, 3>;
-        bvh::v2::ThreadPool thread_pool;
-        bvh::v2::ParallelExecutor executor(thread_pool);
+
+        // BLASes are built in parallel with each other on the worker pool (see SceneRenderProxy::UpdateBVH), so a
+        // single build stays on its own thread
+        bvh::v2::SequentialExecutor executor;
 
         auto num_triangles = static_cast<uint32_t>(mesh_->indices.size()) / 3;
         triangles_.resize(num_triangles);
@@ -43,96 +146,178 @@ public:
         executor.for_each(0, num_triangles, [&](uint32_t begin, uint32_t end) {
             for (uint32_t i = begin; i < end; ++i)
             {
-                Vector3 min;
-                Vector3 max;
-                mesh_->GetTriangleMinMax(i, min, max);
-
-                bboxes[i] = BBox(ToBVHVec3(min), ToBVHVec3(max));
-                centers[i] = ToBVHVec3((min + max) / 2);
-
                 Vector3 v0;
                 Vector3 v1;
                 Vector3 v2;
                 mesh_->GetTriangle(i, v0, v1, v2);
 
+                if (bake_transform)
+                {
+                    v0 = bake_transform->TransformPoint(v0);
+                    v1 = bake_transform->TransformPoint(v1);
+                    v2 = bake_transform->TransformPoint(v2);
+                }
+
+                const Vector3 min = v0.cwiseMin(v1).cwiseMin(v2);
+                const Vector3 max = v0.cwiseMax(v1).cwiseMax(v2);
+
+                bboxes[i] = BBox(ToBVHVec3(min), ToBVHVec3(max));
+                centers[i] = ToBVHVec3((min + max) / 2);
+
                 triangles_[i].Set(v0, v1, v2);
             }
         });
 
         bvh::v2::DefaultBuilder<Node>::Config config;
         config.quality = bvh::v2::DefaultBuilder<Node>::Quality::High;
-        bvh_ = bvh::v2::DefaultBuilder<Node>::build(thread_pool, bboxes, centers, config);
-    }
+        bvh_ = bvh::v2::DefaultBuilder<Node>::build(bboxes, centers, config);
 
-    bool Intersect(const Ray &ray, const Transform &transform, IntersectionCandidate &candidate)
-    {
-        return IntersectInternal<false>(ray, transform, candidate);
+        if constexpr (UseWideBvh)
+        {
+            wide_bvh_.Build(bvh_, [this](uint32_t face_idx) {
+                const auto &triangle = triangles_[face_idx];
+                return WideBvh::Triangle{.p0 = triangle.p0, .e1 = triangle.e1, .e2 = triangle.e2};
+            });
+
+            // triangles now live in the wide leaves
+            bvh_ = Bvh();
+            triangles_ = {};
+        }
+
+        ASSERT(!is_built_);
+        is_built_ = true;
+        memory_size_ = GetMemorySize();
+        BLASRegistry::Instance().OnBuilt(memory_size_, static_cast<float>(timer.ElapsedMicroSecond()) * 1e-3f);
     }
 
-    bool IntersectAnyHit(const Ray &ray, const Transform &transform, IntersectionCandidate &candidate)
+    [[nodiscard]] size_t GetMemorySize() const
     {
-        return IntersectInternal<true>(ray, transform, candidate);
+        return triangles_.size() * sizeof(Triangle) + bvh_.nodes.size() * sizeof(Node) +
+               bvh_.prim_ids.size() * sizeof(size_t) + wide_bvh_.GetMemorySize();
     }
 
-private:
-    struct Triangle
+    // the ray is in the space the blas was built in. its direction is not renormalized by the caller, so t in that
+    // space is also the world-space t and is compared against candidate.t directly.
+    template <bool AnyHit> bool Intersect(const Ray &ray, IntersectionCandidate &candidate) const
     {
-        void Set(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2)
+        if constexpr (UseWideBvh)
         {
-            p0 = v0;
-            e1 = v1 - v0;
-            e2 = v2 - v0;
-            n = e1.cross(e2);
+            return wide_bvh_.template Intersect<AnyHit>(
+                ray,
+                [&candidate](Scalar t, Scalar u, Scalar v, uint32_t face_idx) {
+                    return AcceptHit<AnyHit>(candidate, t, u, v, face_idx);
+                },
+                candidate.t);
         }
 
-        Vector3 p0;
-        Vector3 e1;
-        Vector3 e2;
-        Vector3 n;
-    };
-
-    template <bool AnyHit>
-    bool IntersectInternal(const Ray &world_ray, const Transform &transform, IntersectionCandidate &candidate)
-    {
-        // all intersection tests are done in local space so we don't update mesh data when transform changes
-        // the cost is higher intersection test cost
-        auto inverse_transform = transform.GetInverse();
-        auto local_ray = world_ray.TransformedBy(inverse_transform);
-
-        static constexpr size_t InvalidId = std::numeric_limits<size_t>::max();
         static constexpr size_t StackSize = 32;
         static constexpr bool UseRobustTraversal = false;
 
-        auto prim_id = InvalidId;
+        bool found = false;
+
+        bvh::v2::Ray<Scalar, 3> bvh_ray(ToBVHVec3(ray.Origin()), ToBVHVec3(ray.Direction()), 0.f, candidate.t);
 
-        bvh::v2::Ray<Scalar, 3> bvh_ray(ToBVHVec3(local_ray.Origin()), ToBVHVec3(local_ray.Direction()));
+        auto &stats = RayStats::GetThreadLocal();
 
         bvh::v2::SmallStack<Bvh::Index, StackSize> stack;
-        auto leaf_fn = [this, &world_ray, &local_ray, &prim_id, &candidate, &transform](size_t begin, size_t end) {
+        auto leaf_fn = [this, &ray, &bvh_ray, &found, &candidate, &stats](size_t begin, size_t end) {
+            stats.leaf_visits++;
             for (size_t i = begin; i < end; ++i)
             {
-                if (IntersectTriangle<AnyHit>(world_ray, local_ray, transform, candidate,
-                                              static_cast<uint32_t>(bvh_.prim_ids[i])))
+                if (IntersectTriangle<AnyHit>(ray, candidate, static_cast<uint32_t>(bvh_.prim_ids[i])))
                 {
-                    prim_id = i;
+                    found = true;
+                    bvh_ray.tmax = candidate.t;
                 }
             }
-            return prim_id != InvalidId;
+            return found;
         };
 
-        bvh_.intersect<AnyHit, UseRobustTraversal>(bvh_ray, bvh_.get_root().index, stack, leaf_fn);
+        auto inner_fn = [&stats](auto &&...) { stats.node_visits++; };
 
-        return prim_id != InvalidId;
+        bvh_.intersect<AnyHit, UseRobustTraversal>(bvh_ray, bvh_.get_root().index, stack, leaf_fn, inner_fn);
+
+        return found;
     }
 
+    // rays of the packet are in the space the blas was built in, see Intersect
     template <bool AnyHit>
-    bool IntersectTriangle(const Ray &world_ray, const Ray &local_ray, const Transform &transform,
-                           IntersectionCandidate &candidate, uint32_t face_idx) const
+    RayPacketMask IntersectPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                  std::span<IntersectionCandidate> candidates) const
+    {
+        RayPacketMask hit_mask = 0;
+
+        if constexpr (UseWideBvh)
+        {
+            // wide nodes already test all children of a node at once, so lanes are traversed one by one
+            ForEachLane(mask, [&](unsigned lane) {
+                if (Intersect<AnyHit>(packet.GetRay(lane), candidates[lane]))
+                {
+                    hit_mask |= 1u << lane;
+                }
+            });
+            return hit_mask;
+        }
+
+        // a private copy, since traversal narrows lanes (max distance, finished any-hit lanes)
+        DefaultRayPacket local_packet;
+        ForEachLane(mask, [&](unsigned lane) {
+            local_packet.SetRay(lane, &packet.GetRay(lane));
+            local_packet.SetMaxDistance(lane, candidates[lane].t);
+        });
+
+        auto leaf_fn = [&](size_t begin, size_t end, RayPacketMask leaf_mask) {
+            ForEachLane(leaf_mask, [&](unsigned lane) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (IntersectTriangle<AnyHit>(local_packet.GetRay(lane), candidates[lane],
+                                                  static_cast<uint32_t>(bvh_.prim_ids[i])))
+                    {
+                        hit_mask |= 1u << lane;
+
+                        if constexpr (AnyHit)
+                        {
+                            local_packet.Deactivate(lane);
+                            break;
+                        }
+
+                        local_packet.SetMaxDistance(lane, candidates[lane].t);
+                    }
+                }
+            });
+        };
+
+        TraversePacket(bvh_, local_packet, leaf_fn);
+
+        return hit_mask;
+    }
+
+private:
+    struct Triangle
+    {
+        void Set(const Vector3 &v0, const Vector3 &v1, const Vector3 &v2)
+        {
+            p0 = v0;
+            e1 = v1 - v0;
+            e2 = v2 - v0;
+            n = e1.cross(e2);
+        }
+
+        Vector3 p0;
+        Vector3 e1;
+        Vector3 e2;
+        Vector3 n;
+    };
+
+    template <bool AnyHit>
+    bool IntersectTriangle(const Ray &ray, IntersectionCandidate &candidate, uint32_t face_idx) const
     {
         // https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
 
-        const Vector3 direction = local_ray.Direction();
-        const Vector3 origin = local_ray.Origin();
+        RayStats::GetThreadLocal().triangle_tests++;
+
+        const Vector3 direction = ray.Direction();
+        const Vector3 origin = ray.Origin();
 
         const auto &triangle = triangles_[face_idx];
 
@@ -169,35 +354,85 @@ private:
         auto t = f * e2.dot(q);
         if (t > Eps)
         {
-            if constexpr (AnyHit)
-            {
-                // any way it must be a hit
-                return true;
-            }
+            return AcceptHit<AnyHit>(candidate, t, u, v, face_idx);
+        }
+
+        return false;
+    }
 
-            // check closest point in world space
-            Vector3 world_p = transform.TransformPoint(local_ray.At(t));
-            auto world_t = world_ray.InverseAt(world_p);
+    // a triangle hit at t. decides whether it is the closest one so far.
+    template <bool AnyHit>
+    static bool AcceptHit(IntersectionCandidate &candidate, Scalar t, Scalar u, Scalar v, uint32_t face_idx)
+    {
+        if constexpr (AnyHit)
+        {
+            // any hit short of the ray's end will do
+            return candidate.IsCloserHit(t);
+        }
 
-            if (world_t > 0 && candidate.IsCloserHit(world_t))
-            {
-                candidate.t = world_t;
-                candidate.u = u;
-                candidate.v = v;
-                candidate.face_idx = face_idx;
+        if (candidate.IsCloserHit(t))
+        {
+            candidate.t = t;
+            candidate.u = u;
+            candidate.v = v;
+            candidate.face_idx = face_idx;
 
-                return true;
-            }
+            return true;
         }
 
         return false;
     }
 
     const Mesh *mesh_;
+    std::once_flag build_flag_;
+    size_t memory_size_ = 0;
+    bool is_built_ = false;
     std::vector<Triangle> triangles_;
     Bvh bvh_;
+    WideBvh wide_bvh_;
 };
 
+std::shared_ptr<BLAS> BLASRegistry::AcquireShared(const Mesh *mesh)
+{
+    std::shared_ptr<BLAS> blas;
+    {
+        std::scoped_lock lock(mutex_);
+        auto &entry = shared_[mesh];
+        blas = entry.lock();
+        if (!blas)
+        {
+            blas = std::make_shared<BLAS>(mesh);
+            entry = blas;
+        }
+    }
+
+    // built outside the lock so different meshes build concurrently
+    blas->BuildOnce(nullptr);
+    return blas;
+}
+
+MeshRenderProxy::BLASStats BLASRegistry::GetStats() const
+{
+    std::scoped_lock lock(mutex_);
+
+    auto stats = stats_;
+    for (const auto &[mesh, weak_blas] : shared_)
+    {
+        auto blas = weak_blas.lock();
+        if (!blas)
+        {
+            continue;
+        }
+
+        // minus the local copy above
+        const auto references = static_cast<uint32_t>(blas.use_count() - 1);
+        stats.shared_blas_count++;
+        stats.shared_reference_count += references;
+        stats.saved_memory_size += (references - 1) * blas->GetMemorySize();
+    }
+    return stats;
+}
+
 MeshRenderProxy::MeshRenderProxy(const std::shared_ptr<const Mesh> &raw_mesh, std::string_view name,
                                  const AABB &local_bound)
     : PrimitiveRenderProxy(name, local_bound), raw_mesh_(raw_mesh)
@@ -205,9 +440,17 @@ MeshRenderProxy::MeshRenderProxy(const std::shared_ptr<const Mesh> &raw_mesh, st
     ASSERT(raw_mesh_);
 
     is_mesh_ = true;
+
+    BLASRegistry::Instance().AddUser(raw_mesh_.get());
 }
 
-MeshRenderProxy::~MeshRenderProxy() = default;
+MeshRenderProxy::~MeshRenderProxy()
+{
+    // release the BLAS first, its entry goes away with the last user
+    accleration_structure_.reset();
+
+    BLASRegistry::Instance().RemoveUser(raw_mesh_.get());
+}
 
 void MeshRenderProxy::InitRenderResources(RHIContext *rhi, const RenderConfig &config)
 {
@@ -309,22 +552,59 @@ uint32_t MeshRenderProxy::GetNumVertices() const
 
 void MeshRenderProxy::BuildBVH()
 {
-    accleration_structure_ = std::make_unique<BLAS>(raw_mesh_.get());
+    // instances of one mesh share an object-space BLAS instead of baking a world-space copy each
+    if (is_world_space_blas_ && BLASRegistry::Instance().IsShared(raw_mesh_.get()))
+    {
+        is_world_space_blas_ = false;
+    }
+
+    if (!is_world_space_blas_)
+    {
+        accleration_structure_ = BLASRegistry::Instance().AcquireShared(raw_mesh_.get());
+        return;
+    }
 
-    accleration_structure_->Build();
+    auto blas = std::make_shared<BLAS>(raw_mesh_.get());
+    blas->Build(&transform_);
+    accleration_structure_ = std::move(blas);
+}
+
+MeshRenderProxy::BLASStats MeshRenderProxy::GetBLASStats()
+{
+    return BLASRegistry::Instance().GetStats();
 }
 
 template <bool AnyHit> bool MeshRenderProxy::IntersectInternal(const Ray &ray, IntersectionCandidate &candidate) const
 {
     ASSERT(accleration_structure_);
-    if constexpr (AnyHit)
+
+    [[likely]] if (is_world_space_blas_)
     {
-        return accleration_structure_->IntersectAnyHit(ray, GetTransform(), candidate);
+        return accleration_structure_->Intersect<AnyHit>(ray, candidate);
     }
-    else
+
+    return accleration_structure_->Intersect<AnyHit>(ray.TransformedBy(inverse_transform_), candidate);
+}
+
+template <bool AnyHit>
+RayPacketMask MeshRenderProxy::IntersectPacketInternal(const DefaultRayPacket &packet, RayPacketMask mask,
+                                                       std::span<IntersectionCandidate> candidates) const
+{
+    ASSERT(accleration_structure_);
+
+    [[likely]] if (is_world_space_blas_)
     {
-        return accleration_structure_->Intersect(ray, GetTransform(), candidate);
+        return accleration_structure_->IntersectPacket<AnyHit>(packet, mask, candidates);
     }
+
+    std::array<Ray, DefaultRayPacket::Size> local_rays;
+    DefaultRayPacket local_packet;
+    ForEachLane(mask, [&](unsigned lane) {
+        local_rays[lane] = packet.GetRay(lane).TransformedBy(inverse_transform_);
+        local_packet.SetRay(lane, &local_rays[lane]);
+    });
+
+    return accleration_structure_->IntersectPacket<AnyHit>(local_packet, mask, candidates);
 }
 
 bool MeshRenderProxy::IntersectAnyHit(const Ray &ray, IntersectionCandidate &candidate) const
@@ -332,6 +612,18 @@ bool MeshRenderProxy::IntersectAnyHit(const Ray &ray, IntersectionCandidate &can
     return IntersectInternal<true>(ray, candidate);
 }
 
+RayPacketMask MeshRenderProxy::IntersectPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                               std::span<IntersectionCandidate> candidates) const
+{
+    return IntersectPacketInternal<false>(packet, mask, candidates);
+}
+
+RayPacketMask MeshRenderProxy::IntersectAnyHitPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                                     std::span<IntersectionCandidate> candidates) const
+{
+    return IntersectPacketInternal<true>(packet, mask, candidates);
+}
+
 bool MeshRenderProxy::Intersect(const Ray &ray, IntersectionCandidate &candidate) const
 {
     return IntersectInternal<false>(ray, candidate);
@@ -340,7 +632,7 @@ bool MeshRenderProxy::Intersect(const Ray &ray, IntersectionCandidate &candidate
 void MeshRenderProxy::GetIntersection(const Ray &ray, const IntersectionCandidate &candidate,
                                       Intersection &intersection)
 {
-    auto inv_transform = GetTransform().GetInverse();
+    const auto &inv_transform = inverse_transform_;
 
     Vector2 tex_coord = raw_mesh_->GetTexCoord(candidate.face_idx, candidate.u, candidate.v);
     Vector3 surface_normal =
@@ -357,7 +649,25 @@ void MeshRenderProxy::GetIntersection(const Ray &ray, const IntersectionCandidat
 
     Vector3 world_normal = inv_transform.TransformDirectionTangentSpace(surface_normal).normalized();
     Vector3 world_tangent = inv_transform.TransformDirectionTangentSpace(tangent.head<3>());
-    intersection.Update(ray, this, candidate.t, world_normal, world_tangent, tex_coord);
+
+    intersection.Update(ray, this, candidate.t, world_normal, world_tangent, tex_coord, candidate.face_idx);
+}
+
+Scalar MeshRenderProxy::GetTexCoordDensity(uint32_t face) const
+{
+    const auto tex_coord_area = raw_mesh_->GetTexCoordArea(face);
+    if (tex_coord_area <= 0.f)
+    {
+        return 0.f;
+    }
+
+    Vector3 v0;
+    Vector3 v1;
+    Vector3 v2;
+    raw_mesh_->GetTriangle(face, v0, v1, v2);
+
+    const auto world_area = transform_.TransformDirection(v1 - v0).cross(transform_.TransformDirection(v2 - v0)).norm();
+    return world_area > 0.f ? std::sqrt(tex_coord_area / world_area) : 0.f;
 }
 
 void MeshRenderProxy::OnTransformDirty(RHIContext *rhi)
@@ -365,5 +675,20 @@ void MeshRenderProxy::OnTransformDirty(RHIContext *rhi)
     PrimitiveRenderProxy::OnTransformDirty(rhi);
 
     UpdateMatrix(rhi);
+
+    inverse_transform_ = GetTransform().GetInverse();
+
+    // the first transform is the initial placement. any later one means the mesh moves, so it falls back to object
+    // space for good instead of re-baking every time it moves.
+    transform_change_count_++;
+    if (is_world_space_blas_ && transform_change_count_ > 1)
+    {
+        is_world_space_blas_ = false;
+
+        if (accleration_structure_)
+        {
+            accleration_structure_ = BLASRegistry::Instance().AcquireShared(raw_mesh_.get());
+        }
+    }
 }
 } // namespace sparkle
@@ -1,5 +1,7 @@
 #include "renderer/proxy/PrimitiveRenderProxy.h"
 
+#include "core/math/Intersection.h"
+
 namespace sparkle
 {
 PrimitiveRenderProxy::PrimitiveRenderProxy(std::string_view name, AABB local_bound)
@@ -27,4 +29,30 @@ void PrimitiveRenderProxy::OnTransformDirty(RHIContext *rhi)
     RenderProxy::OnTransformDirty(rhi);
     world_bound_ = local_bound_.TransformTo(transform_);
 }
+
+RayPacketMask PrimitiveRenderProxy::IntersectPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                                    std::span<IntersectionCandidate> candidates) const
+{
+    RayPacketMask hit_mask = 0;
+    ForEachLane(mask, [&](unsigned lane) {
+        if (Intersect(packet.GetRay(lane), candidates[lane]))
+        {
+            hit_mask |= 1u << lane;
+        }
+    });
+    return hit_mask;
+}
+
+RayPacketMask PrimitiveRenderProxy::IntersectAnyHitPacket(const DefaultRayPacket &packet, RayPacketMask mask,
+                                                          std::span<IntersectionCandidate> candidates) const
+{
+    RayPacketMask hit_mask = 0;
+    ForEachLane(mask, [&](unsigned lane) {
+        if (IntersectAnyHit(packet.GetRay(lane), candidates[lane]))
+        {
+            hit_mask |= 1u << lane;
+        }
+    });
+    return hit_mask;
+}
 } // namespace sparkle
@@ -2,132 +2,29 @@
 
 #include "core/Container.h"
 #include "core/Profiler.h"
-#include "core/math/BVH.h"
+#include "core/Timer.h"
 #include "core/math/Intersection.h"
+#include "core/task/TaskManager.h"
+#include "io/Mesh.h"
 #include "renderer/BindlessManager.h"
 #include "renderer/proxy/CameraRenderProxy.h"
 #include "renderer/proxy/MaterialRenderProxy.h"
+#include "renderer/proxy/MeshRenderProxy.h"
 #include "renderer/proxy/PrimitiveRenderProxy.h"
 #include "renderer/proxy/SkyRenderProxy.h"
+#include "renderer/resource/LightTree.h"
+#include "renderer/resource/TLAS.h"
 #include "rhi/RHI.h"
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wall"
-#include <bvh/v2/default_builder.h>
-#include <bvh/v2/executor.h>
-#include <bvh/v2/stack.h>
-#include <bvh/v2/thread_pool.h>
-#pragma GCC diagnostic pop
+#include <atomic>
 
 namespace sparkle
 {
-class TLAS
+namespace
 {
-public:
-    explicit TLAS(const std::vector<PrimitiveRenderProxy *> &primitives) : primitives_(primitives)
-    {
-    }
-
-    void Build()
-    {
-        auto num_primitives = primitives_.size();
-        if (num_primitives == 0)
-        {
-            return;
-        }
-
-        using Vec3 = bvh::v2::Vec<Scalar, 3>;
-        using BBox = bvh::v2::BBox<Scalar, 3>;
-        bvh::v2::ThreadPool thread_pool;
-        bvh::v2::ParallelExecutor executor(thread_pool);
-
-        std::vector<BBox> bboxes(num_primitives);
-        std::vector<Vec3> centers(num_primitives);
-        executor.for_each(0, num_primitives, [&](size_t begin, size_t end) {
-            for (size_t i = begin; i < end; ++i)
-            {
-                auto aabb = primitives_[i]->GetWorldBoundingBox();
-                bboxes[i] = BBox(ToBVHVec3(aabb.Min()), ToBVHVec3(aabb.Max()));
-                centers[i] = ToBVHVec3(aabb.Center());
-            }
-        });
-
-        bvh::v2::DefaultBuilder<Node>::Config config;
-        config.quality = bvh::v2::DefaultBuilder<Node>::Quality::High;
-        bvh_ = bvh::v2::DefaultBuilder<Node>::build(thread_pool, bboxes, centers, config);
-
-        std::vector<PrimitiveRenderProxy *> reordered_geometries(num_primitives);
-        executor.for_each(0, num_primitives, [this, &reordered_geometries](size_t begin, size_t end) {
-            for (size_t i = begin; i < end; ++i)
-            {
-                auto j = bvh_.prim_ids[i];
-                reordered_geometries[i] = primitives_[j];
-            }
-        });
-
-        std::swap(reordered_geometries, primitives_);
-    }
-
-    void Intersect(const Ray &ray, Intersection &intersection)
-    {
-        IntersectInternal<false>(ray, intersection);
-    }
-
-    void IntersectAnyHit(const Ray &ray, Intersection &intersection)
-    {
-        IntersectInternal<true>(ray, intersection);
-    }
-
-private:
-    template <bool AnyHit> void IntersectInternal(const Ray &ray, Intersection &intersection) const
-    {
-        if (bvh_.nodes.empty())
-        {
-            return;
-        }
-
-        static constexpr size_t InvalidId = std::numeric_limits<size_t>::max();
-        static constexpr size_t StackSize = 32;
-        static constexpr bool UseRobustTraversal = false;
-
-        auto prim_id = InvalidId;
-
-        bvh::v2::Ray<Scalar, 3> bvh_ray(ToBVHVec3(ray.Origin()), ToBVHVec3(ray.Direction()));
-
-        IntersectionCandidate candidate;
-
-        bvh::v2::SmallStack<Bvh::Index, StackSize> stack;
-        auto leaf_fn = [this, &ray, &prim_id, &candidate](size_t begin, size_t end) {
-            for (size_t i = begin; i < end; ++i)
-            {
-                if (AnyHit ? primitives_[i]->IntersectAnyHit(ray, candidate)
-                           : primitives_[i]->Intersect(ray, candidate))
-                {
-                    prim_id = i;
-                    candidate.primitive = primitives_[i];
-                }
-            }
-            return prim_id != InvalidId;
-        };
-
-        bvh_.intersect<AnyHit, UseRobustTraversal>(bvh_ray, bvh_.get_root().index, stack, leaf_fn);
-
-        if (candidate.primitive)
-        {
-            if constexpr (AnyHit)
-            {
-                intersection.Update(ray, candidate.primitive);
-            }
-            else
-            {
-                candidate.primitive->GetIntersection(ray, candidate, intersection);
-            }
-        }
-    }
-
-    std::vector<PrimitiveRenderProxy *> primitives_;
-    Bvh bvh_;
-};
+// see SceneRenderProxy::GetBVHBuildTime
+std::atomic<int64_t> total_bvh_build_us{0};
+} // namespace
 
 SceneRenderProxy::SceneRenderProxy() = default;
 
@@ -202,6 +99,7 @@ void SceneRenderProxy::Update(RHIContext *rhi, const CameraRenderProxy &camera,
     if (!GetPrimitiveChangeList().empty())
     {
         camera_->MarkPixelDirty();
+        content_version_++;
     }
 
     for (auto *material : new_materials_)
@@ -232,6 +130,7 @@ void SceneRenderProxy::Update(RHIContext *rhi, const CameraRenderProxy &camera,
     if (primitive_changes_.size() != changes_before_update)
     {
         camera_->MarkPixelDirty();
+        content_version_++;
     }
 
     if (bindless_manager_->IsValid())
@@ -266,22 +165,141 @@ void SceneRenderProxy::EndUpdate(RHIContext *rhi)
     });
 }
 
+// emission at the centroid stands in for the whole face when lights are picked. analytic primitives are left to bsdf
+// sampling: points on their tessellation lie inside the real surface, and their hits name no face to weigh by
+static std::vector<LightTree::Triangle> CollectEmissiveTriangles(const PrimitiveRenderProxy &primitive)
+{
+    std::vector<LightTree::Triangle> triangles;
+
+    const auto *material = primitive.GetMaterialRenderProxy();
+    if (!primitive.IsMesh() || primitive.IsAnalytic() || material == nullptr || !material->IsEmissive())
+    {
+        return triangles;
+    }
+
+    const auto &mesh = *static_cast<const MeshRenderProxy &>(primitive).GetRawMesh();
+    const auto transform = primitive.GetTransform();
+
+    triangles.reserve(mesh.GetNumFaces());
+    for (auto face = 0u; face < mesh.GetNumFaces(); face++)
+    {
+        Vector3 v0;
+        Vector3 v1;
+        Vector3 v2;
+        mesh.GetTriangle(face, v0, v1, v2);
+        v0 = transform.TransformPoint(v0);
+        v1 = transform.TransformPoint(v1);
+        v2 = transform.TransformPoint(v2);
+
+        const TextureCoordinate centroid(mesh.GetTexCoord(face, 1.f / 3.f, 1.f / 3.f));
+        triangles.push_back({.v0 = v0,
+                             .edge1 = v1 - v0,
+                             .edge2 = v2 - v0,
+                             .radiance = utilities::Luminance(material->GetEmissive(centroid))});
+    }
+
+    return triangles;
+}
+
+void SceneRenderProxy::UpdateLightTree()
+{
+    if (!light_tree_)
+    {
+        light_tree_ = std::make_unique<LightTree>();
+        for (const auto *primitive : primitives_)
+        {
+            if (primitive)
+            {
+                light_tree_->SetTriangles(primitive, CollectEmissiveTriangles(*primitive));
+            }
+        }
+    }
+    else
+    {
+        for (const auto &[type, primitive, from, to] : primitive_changes_)
+        {
+            switch (type)
+            {
+            case PrimitiveChangeType::New:
+            case PrimitiveChangeType::Update:
+                light_tree_->SetTriangles(primitive, CollectEmissiveTriangles(*primitive));
+                break;
+            case PrimitiveChangeType::Remove:
+                light_tree_->RemoveTriangles(primitive);
+                break;
+            case PrimitiveChangeType::Move:
+                break;
+            default:
+                UnImplemented(type);
+                break;
+            }
+        }
+    }
+
+    light_tree_->Build();
+}
+
 void SceneRenderProxy::UpdateBVH()
 {
     PROFILE_SCOPE("SceneRenderProxy::UpdateBVH");
 
+    ApplyTLASRebuild();
+
+    const bool has_tlas = tlas_ != nullptr;
+    bool need_refit = false;
+
+    // BLASes of all new primitives are built at once, one per worker
+    std::vector<PrimitiveRenderProxy *> new_primitives;
+    for (const auto &change : primitive_changes_)
+    {
+        if (change.type == PrimitiveChangeType::New)
+        {
+            new_primitives.push_back(change.primitive);
+        }
+    }
+
+    if (!new_primitives.empty())
+    {
+        Timer timer;
+
+        TaskManager::ParallelFor(0u, static_cast<unsigned>(new_primitives.size()),
+                                 [&new_primitives](unsigned i) { new_primitives[i]->BuildBVH(); })
+            .wait();
+
+        total_bvh_build_us.fetch_add(timer.ElapsedMicroSecond(), std::memory_order_relaxed);
+
+        const auto stats = MeshRenderProxy::GetBLASStats();
+        Log(Info, "BLAS: {} new primitives in {} ms. {} alive ({} shared by {} proxies), {:.1f} MB, {:.1f} MB saved",
+            new_primitives.size(), timer.ElapsedMilliSecond(), stats.blas_count, stats.shared_blas_count,
+            stats.shared_reference_count, static_cast<float>(stats.memory_size) / (1024.f * 1024.f),
+            static_cast<float>(stats.saved_memory_size) / (1024.f * 1024.f));
+    }
+
     for (const auto &[type, primitive, from, to] : primitive_changes_)
     {
         switch (type)
         {
         case PrimitiveChangeType::New:
-            primitive->BuildBVH();
-            need_bvh_update_ = true;
+            if (has_tlas)
+            {
+                tlas_->Insert(primitive);
+            }
+            tlas_generation_++;
+            need_refit = true;
             break;
         case PrimitiveChangeType::Remove:
+            if (has_tlas)
+            {
+                tlas_->Remove(primitive);
+            }
+            tlas_generation_++;
+            need_refit = true;
+            break;
         case PrimitiveChangeType::Move:
+            // only the dense index changed. the tlas refers to primitives directly
+            break;
         case PrimitiveChangeType::Update:
-            need_bvh_update_ = true;
+            need_refit = true;
             break;
         default:
             UnImplemented(type);
@@ -289,11 +307,73 @@ void SceneRenderProxy::UpdateBVH()
         }
     }
 
-    if (need_bvh_update_)
+    UpdateLightTree();
+
+    // a tree that insertions keep deepening cannot wait for a background rebuild, which is dropped anyway while
+    // primitives keep coming and going
+    if (!has_tlas || tlas_->NeedsRebuild())
     {
+        Timer timer;
+
         tlas_ = std::make_unique<TLAS>(primitives_);
         tlas_->Build();
+
+        total_bvh_build_us.fetch_add(timer.ElapsedMicroSecond(), std::memory_order_relaxed);
+        return;
+    }
+
+    if (!need_refit)
+    {
+        return;
     }
+
+    tlas_->Refit();
+
+    // refits keep the topology, so the tree slowly loses quality as things move
+    static constexpr Scalar MaxCostRatio = 1.5f;
+    if (tlas_->GetCostRatio() > MaxCostRatio)
+    {
+        ScheduleTLASRebuild();
+    }
+}
+
+double SceneRenderProxy::GetBVHBuildTime()
+{
+    return static_cast<double>(total_bvh_build_us.load(std::memory_order_relaxed)) * 1e-3;
+}
+
+void SceneRenderProxy::ScheduleTLASRebuild()
+{
+    if (tlas_rebuild_task_)
+    {
+        return;
+    }
+
+    // bounds are captured now, the build itself runs off the render thread
+    pending_tlas_ = std::make_shared<TLAS>(primitives_);
+    pending_tlas_generation_ = tlas_generation_;
+
+    tlas_rebuild_task_ = TaskManager::RunInDedicatedThread([tlas = pending_tlas_]() { tlas->Build(); });
+}
+
+void SceneRenderProxy::ApplyTLASRebuild()
+{
+    if (!tlas_rebuild_task_ || !tlas_rebuild_task_->IsReady())
+    {
+        return;
+    }
+
+    // primitives added or removed meanwhile are not in the new tree. drop it, the next refit will ask again
+    if (pending_tlas_generation_ == tlas_generation_)
+    {
+        tlas_ = std::make_unique<TLAS>(std::move(*pending_tlas_));
+
+        // things may have moved while it was being built
+        tlas_->Refit();
+    }
+
+    pending_tlas_.reset();
+    tlas_rebuild_task_.reset();
 }
 
 template <bool AnyHit> void SceneRenderProxy::Intersect(const Ray &ray, Intersection &intersection) const
@@ -311,6 +391,27 @@ template <bool AnyHit> void SceneRenderProxy::Intersect(const Ray &ray, Intersec
 template void SceneRenderProxy::Intersect<true>(const Ray &ray, Intersection &intersection) const;
 template void SceneRenderProxy::Intersect<false>(const Ray &ray, Intersection &intersection) const;
 
+template <bool AnyHit>
+void SceneRenderProxy::IntersectPacket(std::span<const Ray> rays, std::span<Intersection> intersections) const
+{
+    tlas_->IntersectPacket<AnyHit>(rays, intersections);
+}
+
+template <bool AnyHit>
+void SceneRenderProxy::IntersectStream(std::span<const Ray> rays, std::span<Intersection> intersections) const
+{
+    tlas_->IntersectStream<AnyHit>(rays, intersections);
+}
+
+template void SceneRenderProxy::IntersectPacket<true>(std::span<const Ray> rays,
+                                                      std::span<Intersection> intersections) const;
+template void SceneRenderProxy::IntersectPacket<false>(std::span<const Ray> rays,
+                                                       std::span<Intersection> intersections) const;
+template void SceneRenderProxy::IntersectStream<true>(std::span<const Ray> rays,
+                                                      std::span<Intersection> intersections) const;
+template void SceneRenderProxy::IntersectStream<false>(std::span<const Ray> rays,
+                                                       std::span<Intersection> intersections) const;
+
 RenderProxy *SceneRenderProxy::AddRenderProxy(std::unique_ptr<RenderProxy> &&proxy)
 {
     proxy->SetIndex(static_cast<uint32_t>(proxies_.size()));
@@ -1,8 +1,13 @@
 #include "renderer/proxy/SkyRenderProxy.h"
 
+#include "core/cook/Cooker.h"
 #include "core/math/Ray.h"
+#include "core/math/Sampler.h"
+#include "core/task/TaskManager.h"
 #include "io/Image.h"
 #include "renderer/resource/ImageBasedLighting.h"
+#include "renderer/resource/SkySamplingCookJob.h"
+#include "renderer/resource/SkySamplingTable.h"
 #include "rhi/RHI.h"
 
 namespace sparkle
@@ -12,7 +17,10 @@ SkyRenderProxy::SkyRenderProxy(std::shared_ptr<const Image2DCube> sky_map) : sky
 {
 }
 
-SkyRenderProxy::~SkyRenderProxy() = default;
+SkyRenderProxy::~SkyRenderProxy()
+{
+    alive_->store(false);
+}
 
 void SkyRenderProxy::Update(RHIContext *rhi, const CameraRenderProxy &camera, const RenderConfig &config)
 {
@@ -42,11 +50,83 @@ void SkyRenderProxy::InitRenderResources(RHIContext *rhi, const RenderConfig &co
             image_based_lighting_ = std::make_unique<ImageBasedLighting>(sky_map_, sky_map_raw_);
             image_based_lighting_->InitRenderResources(rhi, config);
         }
+
+        if (config.pipeline == RenderConfig::Pipeline::Cpu && !sampling_table_)
+        {
+            RequestSamplingTable();
+        }
+
+        if (config.pipeline == RenderConfig::Pipeline::Cpu && config.tiled_textures)
+        {
+            sky_map_raw_->EnableTiledSampling();
+        }
     }
 
     ubo_.has_sky_map = sky_map_ ? 1 : 0;
 }
 
+void SkyRenderProxy::RequestSamplingTable()
+{
+    auto job = std::make_unique<SkySamplingCookJob>(sky_map_raw_);
+    sampling_cook_handle_ = std::make_unique<CookHandle>(
+        Cooker::Request(std::move(job), [this, alive = alive_](CookResult result) {
+            if (!result.HasPayload())
+            {
+                Log(Error, "failed to cook the sky sampling table. sky light falls back to uniform sampling");
+                return;
+            }
+
+            auto table = std::make_shared<SkySamplingTable>();
+            if (!table->LoadFromPayload(result.payload))
+            {
+                Log(Error, "sky sampling payload does not match the table layout");
+                return;
+            }
+
+            // the cpu renderer samples the sky from the render thread's workers, so swap it in between frames
+            TaskManager::RunInRenderThread([this, alive, table]() {
+                // the render thread also destroys this object, so the check cannot race
+                if (alive->load())
+                {
+                    sampling_table_ = std::make_unique<SkySamplingTable>(std::move(*table));
+                }
+            });
+        }));
+}
+
+void SkyRenderProxy::Sample(const Vector3 & /*origin*/, Vector3 &direction) const
+{
+    const Vector2 u_cell = sampler::Random2D();
+    const Vector2 u_point = sampler::Random2D();
+    Scalar pdf;
+    direction = SampleDirection(u_cell, u_point, pdf);
+}
+
+Vector3 SkyRenderProxy::SampleDirection(const Vector2 &u_cell, const Vector2 &u_point, Scalar &pdf) const
+{
+    if (sampling_table_)
+    {
+        return sampling_table_->Sample(u_cell, u_point, pdf);
+    }
+
+    const auto cos_theta = 1.f - 2.f * u_point.x();
+    const auto sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+    const auto phi = 2.f * Pi * u_point.y();
+
+    pdf = InvPi * 0.25f;
+    return utilities::SphericalToCartesian(cos_theta, sin_theta, std::cos(phi), std::sin(phi));
+}
+
+Scalar SkyRenderProxy::Pdf(const Vector3 &direction) const
+{
+    if (sampling_table_)
+    {
+        return sampling_table_->Pdf(direction);
+    }
+
+    return InvPi * 0.25f;
+}
+
 Vector3 SkyRenderProxy::Evaluate(const Ray &ray) const
 {
     auto d = ray.Direction();
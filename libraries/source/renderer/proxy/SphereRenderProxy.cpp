@@ -19,15 +19,15 @@ template <bool AnyHit> bool SphereRenderProxy::IntersectInternal(const Ray &ray,
         return false;
     }
 
+    float sqrt_discriminant = std::sqrt(discriminant);
+    float t = (-half_b + (c >= 0 ? -sqrt_discriminant : sqrt_discriminant)) / a;
+
+    // a shadow ray is only blocked by a sphere in front of it and short of its end
     if constexpr (AnyHit)
     {
-        // any way it must be a hit
-        return true;
+        return t > 0 && canidate.IsCloserHit(t);
     }
 
-    float sqrt_discriminant = std::sqrt(discriminant);
-    float t = (-half_b + (c >= 0 ? -sqrt_discriminant : sqrt_discriminant)) / a;
-
     if (t > 0 && canidate.IsCloserHit(t))
     {
         canidate.t = t;
@@ -4,35 +4,93 @@
 #include "core/Profiler.h"
 #include "core/math/Intersection.h"
 #include "core/math/Ray.h"
+#include "core/math/RayStats.h"
 #include "core/math/Sampler.h"
 #include "core/task/TaskManager.h"
+#include "core/task/TileScheduler.h"
+#include "io/Mesh.h"
+#include "io/TextureBlockCache.h"
 #include "renderer/pass/ScreenQuadPass.h"
 #include "renderer/pass/UiPass.h"
 #include "renderer/proxy/CameraRenderProxy.h"
+#include "renderer/proxy/DirectionalLightRenderProxy.h"
 #include "renderer/proxy/MaterialRenderProxy.h"
+#include "renderer/proxy/MeshRenderProxy.h"
 #include "renderer/proxy/PrimitiveRenderProxy.h"
 #include "renderer/proxy/SceneRenderProxy.h"
 #include "renderer/proxy/SkyRenderProxy.h"
+#include "renderer/resource/LightTree.h"
 #include "rhi/RHI.h"
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <span>
 #include <utility>
 
 namespace sparkle
 {
+namespace
+{
+// see CPURenderer::Stats
+std::atomic<uint64_t> total_frame_count{0};
+std::atomic<int64_t> total_base_pass_us{0};
+std::atomic<int64_t> total_denoise_pass_us{0};
+std::atomic<int64_t> total_filter_pass_us{0};
+std::atomic<int64_t> total_tone_mapping_pass_us{0};
+// added once per frame
+std::mutex total_ray_stats_mutex;
+RayStats total_ray_stats;
+
+// runs a pass and adds its wall time to a total
+template <typename Pass> void TimePass(std::atomic<int64_t> &total_us, Pass &&pass)
+{
+    Timer timer;
+    pass();
+    total_us.fetch_add(timer.ElapsedMicroSecond(), std::memory_order_relaxed);
+}
+
+double ToMilliSecond(const std::atomic<int64_t> &total_us)
+{
+    return static_cast<double>(total_us.load(std::memory_order_relaxed)) * 1e-3;
+}
+} // namespace
+
 CPURenderer::CPURenderer(const RenderConfig &render_config, RHIContext *rhi_context,
                          SceneRenderProxy *scene_render_proxy)
     : Renderer(render_config, rhi_context, scene_render_proxy),
-      output_image_(resolution_.scene.x(), resolution_.scene.y(), PixelFormat::RGBAFloat16)
+      spp_logger_(1.f, false, [this](float) { MeasurePerformance(); })
 {
     ASSERT_EQUAL(render_config.pipeline, RenderConfig::Pipeline::Cpu);
+
+    TextureBlockCache::SetCapacity(static_cast<size_t>(render_config.texture_block_cache_mb) << 20u);
+}
+
+CPURenderer::~CPURenderer()
+{
+    FinishFrameWork();
 }
 
-CPURenderer::~CPURenderer() = default;
+CPURenderer::Stats CPURenderer::GetStats()
+{
+    std::lock_guard lock(total_ray_stats_mutex);
+    return {.frame_count = total_frame_count.load(std::memory_order_relaxed),
+            .rays = total_ray_stats,
+            .base_pass_ms = ToMilliSecond(total_base_pass_us),
+            .denoise_pass_ms = ToMilliSecond(total_denoise_pass_us),
+            .filter_pass_ms = ToMilliSecond(total_filter_pass_us),
+            .tone_mapping_pass_ms = ToMilliSecond(total_tone_mapping_pass_us)};
+}
 
 bool CPURenderer::IsReadyForAutoScreenshot() const
 {
-    return Renderer::IsReadyForAutoScreenshot() &&
-           scene_render_proxy_->GetCamera()->GetCumulatedSampleCount() >= render_config_.max_sample_per_pixel;
+    if (!Renderer::IsReadyForAutoScreenshot())
+    {
+        return false;
+    }
+
+    return output_converged_;
 }
 
 void CPURenderer::InitRenderResources()
@@ -41,15 +99,20 @@ void CPURenderer::InitRenderResources()
 
     camera_ = scene_render_proxy_->GetCamera();
 
-    image_buffer_ = rhi_->CreateBuffer({.size = output_image_.GetStorageSize(),
+    // large outputs (4k fp16 is 64 MB) would not fit the shared dynamic buffer, so they get a pool of their own
+    const auto image_size = static_cast<size_t>(resolution_.scene.x()) * resolution_.scene.y() * sizeof(Vector4h);
+    const auto dynamic_capacity = static_cast<uint32_t>(
+        std::max<size_t>(RHIBufferSubAllocation::DynamicBufferCapacity, utilities::AlignAddress(image_size, 1u << 16)));
+    image_buffer_ = rhi_->CreateBuffer({.size = image_size,
                                         .usages = RHIBuffer::BufferUsage::TransferSrc,
                                         .mem_properties = RHIMemoryProperty::None,
-                                        .is_dynamic = true},
+                                        .is_dynamic = true,
+                                        .dynamic_buffer_capacity = dynamic_capacity},
                                        "RayTracingOutputBuffer");
 
     auto color_buffer_attribute = [this](const Vector2UInt &size, RHIImage::ImageUsage usages) {
         return RHIImage::Attribute{
-            .format = output_image_.GetFormat(),
+            .format = OutputFormat,
             .sampler = {.address_mode = RHISampler::SamplerAddressMode::ClampToEdge,
                         .filtering_method_min = RHISampler::FilteringMethod::Linear,
                         .filtering_method_mag = RHISampler::FilteringMethod::Linear,
@@ -69,6 +132,20 @@ void CPURenderer::InitRenderResources()
 
     screen_rt_ = rhi_->CreateRenderTarget({}, screen_texture_, nullptr, "CpuPipelineRenderTarget");
 
+    // a few small textures, so they exist whenever progressive_preview is turned on
+    for (auto level = 0u; level < FullResolutionLevel; level++)
+    {
+        auto &preview = preview_levels_[level];
+        // camera rays spread over size - 1 pixels, so a level needs 2 of them per axis. it never outgrows the scene,
+        // whose gbuffer it is traced into
+        preview.size = resolution_.GetReducedScene(PreviewDivisors[level])
+                           .cwiseMax(Vector2UInt::Constant(MinPreviewSize))
+                           .cwiseMin(resolution_.scene);
+        preview.texture = rhi_->CreateImage(
+            color_buffer_attribute(preview.size, RHIImage::ImageUsage::Texture | RHIImage::ImageUsage::TransferDst),
+            "CpuPipelinePreviewBuffer");
+    }
+
     if (resolution_.NeedUpsample())
     {
         composite_texture_ =
@@ -78,8 +155,6 @@ void CPURenderer::InitRenderResources()
                               "CpuPipelineCompositeBuffer");
 
         composite_rt_ = rhi_->CreateRenderTarget({}, composite_texture_, nullptr, "CpuPipelineCompositeRenderTarget");
-
-        upsample_pass_ = PipelinePass::Create<ScreenQuadPass>(render_config_, rhi_, screen_texture_, composite_rt_);
     }
     else
     {
@@ -87,6 +162,10 @@ void CPURenderer::InitRenderResources()
         composite_rt_ = screen_rt_;
     }
 
+    // without render_scale it only ever upsamples previews, and must not read its own target
+    upsample_pass_ = PipelinePass::Create<ScreenQuadPass>(
+        render_config_, rhi_, resolution_.NeedUpsample() ? screen_texture_ : preview_levels_[0].texture, composite_rt_);
+
     screen_quad_pass_ = PipelinePass::Create<ScreenQuadPass>(render_config_, rhi_, composite_texture_,
                                                              rhi_->GetBackBufferRenderTarget());
 
@@ -96,12 +175,24 @@ void CPURenderer::InitRenderResources()
     }
 
     gbuffer_.Resize(resolution_.scene.x(), resolution_.scene.y());
-    ping_pong_buffer_.resize(resolution_.scene.y(), std::vector<Vector4>(resolution_.scene.x()));
-    frame_buffer_.resize(resolution_.scene.y(), std::vector<Vector4>(resolution_.scene.x()));
+    ping_pong_buffer_.Resize(resolution_.scene.x(), resolution_.scene.y());
+    frame_buffer_.Resize(resolution_.scene.x(), resolution_.scene.y());
+    frame_buffer_.Fill(Vector4::Zero());
+    atrous_filter_.Resize(resolution_.scene.x(), resolution_.scene.y());
+
+    tile_scheduler_.Resize(resolution_.scene.x(), resolution_.scene.y(),
+                           render_config_.cpu_wavefront ? WavefrontTileSize : TileScheduler::DefaultTileSize);
+
+    pixel_sample_count_.Resize(resolution_.scene.x(), resolution_.scene.y());
+    luminance_moments_.Resize(resolution_.scene.x(), resolution_.scene.y());
+    tile_finished_.resize(tile_scheduler_.GetTileCount());
+    ResetPixelAccumulation();
 
     sub_pixel_count_ =
         static_cast<unsigned>(std::lround(std::sqrt(static_cast<float>(render_config_.sample_per_pixel))));
     actual_sample_per_pixel_ = sub_pixel_count_ * sub_pixel_count_;
+
+    running_time_per_spp_ = 1000.f / render_config_.target_framerate / static_cast<float>(actual_sample_per_pixel_);
 }
 
 void CPURenderer::Update()
@@ -123,52 +214,56 @@ void CPURenderer::Render()
     // re-fetch every frame: a loaded scene may bring its own main camera and replace the proxy
     camera_ = scene_render_proxy_->GetCamera();
 
-    // CPU workload: software ray tracing
-    {
-        if (camera_->NeedClear())
-        {
-            TaskManager::ParallelFor(0u, resolution_.scene.y(), [this](unsigned j) {
-                auto &row = frame_buffer_[j];
-                std::ranges::fill(row, Vector4::Zero());
-            }).wait();
+    // debug_point_ arrives in output space; the buffers below are indexed in scene space
+    const Vector2UInt debug_point{
+        debug_point_.x() == UINT_MAX ? UINT_MAX : debug_point_.x() * resolution_.scene.x() / resolution_.output.x(),
+        debug_point_.y() == UINT_MAX ? UINT_MAX : debug_point_.y() * resolution_.scene.y() / resolution_.output.y()};
 
-            camera_->ClearPixels();
-            dispatched_sample_count_ = 0;
-        }
+    auto *output = static_cast<Vector4h *>(image_buffer_->GetDynamicMappedAddress(rhi_));
 
-        // debug_point_ arrives in output space; the buffers below are indexed in scene space
-        const Vector2UInt debug_point{
-            debug_point_.x() == UINT_MAX ? UINT_MAX : debug_point_.x() * resolution_.scene.x() / resolution_.output.x(),
-            debug_point_.y() == UINT_MAX ? UINT_MAX
-                                         : debug_point_.y() * resolution_.scene.y() / resolution_.output.y()};
+    // CPU workload: software ray tracing
+    if (render_config_.cpu_pipelining)
+    {
+        ASSERT(!frame_work_);
 
-        BasePass(*scene_render_proxy_, render_config_, debug_point);
+        // show what was traced while the previous frame was presented. this frame is traced on the workers meanwhile
+        // and must be done before the next frame touches the scene, see FinishFrameWork.
+        TimePass(total_tone_mapping_pass_us, [&]() { ToneMappingPass(render_config_, output); });
 
-        DenoisePass(render_config_, debug_point);
+        const auto frame_seed = BeginAccumulation();
+        frame_work_ = TaskManager::RunInDedicatedThread(
+            [this, frame_seed, debug_point]() { TraceFrame(render_config_, frame_seed, debug_point); });
+    }
+    else
+    {
+        const auto frame_seed = BeginAccumulation();
+        TraceFrame(render_config_, frame_seed, debug_point);
 
-        ToneMappingPass(output_image_);
+        TimePass(total_tone_mapping_pass_us, [&]() { ToneMappingPass(render_config_, output); });
     }
 
     // GPU workload: copy the image to a texture
+    const auto &source_texture = shown_preview_level_ < FullResolutionLevel
+                                     ? preview_levels_[shown_preview_level_].texture
+                                     : screen_texture_;
     {
-        image_buffer_->Upload(rhi_, output_image_.GetRawData());
+        source_texture->Transition({.target_layout = RHIImageLayout::TransferDst,
+                                    .after_stage = RHIPipelineStage::Top,
+                                    .before_stage = RHIPipelineStage::Transfer});
 
-        screen_texture_->Transition({.target_layout = RHIImageLayout::TransferDst,
-                                     .after_stage = RHIPipelineStage::Top,
-                                     .before_stage = RHIPipelineStage::Transfer});
-
-        image_buffer_->CopyToImage(screen_texture_.get());
+        image_buffer_->CopyToImage(source_texture.get());
     }
 
     // the stage that last wrote composite_texture_, driving downstream transitions
     auto composite_stage = RHIPipelineStage::Transfer;
 
-    if (upsample_pass_)
+    if (source_texture.get() != composite_texture_.get())
     {
-        screen_texture_->Transition({.target_layout = RHIImageLayout::Read,
-                                     .after_stage = RHIPipelineStage::Transfer,
-                                     .before_stage = RHIPipelineStage::PixelShader});
+        source_texture->Transition({.target_layout = RHIImageLayout::Read,
+                                    .after_stage = RHIPipelineStage::Transfer,
+                                    .before_stage = RHIPipelineStage::PixelShader});
 
+        upsample_pass_->SetInput(source_texture);
         upsample_pass_->Render();
 
         composite_stage = RHIPipelineStage::ColorOutput;
@@ -202,308 +297,1300 @@ void CPURenderer::Render()
     {
         screen_quad_pass_->Render();
     }
-
-    dispatched_sample_count_ += actual_sample_per_pixel_;
-    camera_->AccumulateSample(actual_sample_per_pixel_);
 }
 
-namespace
-{
-struct PixelSampleResult
-{
-    Vector3 color = Zeros;
-    Vector3 world_normal = Zeros;
-    float valid_flag = 1.f;
-};
-} // namespace
-
-static void SetupViewRay(CameraRenderProxy *camera, Ray &ray, float u, float v)
+void CPURenderer::FinishFrameWork()
 {
-    // lens plane: centered at position_ and perpendicular to front_
-    // image plane: (u, v)
-    // focus plane: (u * max_u, v * max_v)
-    // pixels on image plane are one-to-one mapped to focus plane
-
-    // use a noise at lens plane to simulate aperture
-    const Vector2 aperture_noise = sampler::UnitDisk() * camera->GetAttribute().aperture_radius;
-    const Vector3 lens_offset =
-        aperture_noise.x() * camera->GetPosture().right + aperture_noise.y() * camera->GetPosture().up;
+    if (!frame_work_)
+    {
+        return;
+    }
 
-    const Vector3 ray_origin = camera->GetPosture().position + lens_offset;
-    const Vector3 location_on_focus_plane =
-        camera->GetFocusPlane().lower_left + u * camera->GetFocusPlane().max_u + v * camera->GetFocusPlane().max_v;
-    const Vector3 ray_direction = (location_on_focus_plane - ray_origin).normalized();
+    PROFILE_SCOPE("CPURenderer wait for frame work");
 
-    ray.Reset(ray_origin, ray_direction);
+    frame_work_->Wait();
+    frame_work_ = nullptr;
 }
 
-static PixelSampleResult SamplePixel(const SceneRenderProxy &scene, const RenderConfig &config,
-                                     CameraRenderProxy *camera, float u, float v, bool debug)
+uint32_t CPURenderer::BeginAccumulation()
 {
-    Ray ray(debug);
-    SetupViewRay(camera, ray, u, v);
+    // the two ways of accumulating weigh the history differently, so switching restarts the accumulation
+    const bool per_pixel_accumulation = render_config_.adaptive_sampling || render_config_.use_dynamic_spp;
+    if (per_pixel_accumulation != per_pixel_accumulation_)
+    {
+        per_pixel_accumulation_ = per_pixel_accumulation;
+        camera_->MarkPixelDirty();
+    }
 
-    Vector3 throughput = Ones;
-    Intersection intersection;
+    if (camera_->NeedClear())
+    {
+        TaskManager::ParallelFor(0u, resolution_.scene.y(), [this](unsigned j) {
+            std::ranges::fill(frame_buffer_.Row(j), Vector4::Zero());
+        }).wait();
 
-    PixelSampleResult result;
+        camera_->ClearPixels();
+        dispatched_sample_count_ = 0;
+        accumulation_ray_stats_ = {};
 
-    const auto *sky_light = scene.GetSkyLight();
+        if (per_pixel_accumulation_)
+        {
+            ResetPixelAccumulation();
+        }
 
-    Vector3 debug_color = Zeros;
+        next_preview_level_ = render_config_.progressive_preview ? 0 : FullResolutionLevel;
+    }
 
-    auto camera_posture = camera->GetPosture();
+    // the guide learns the scene, not the view, so only content changes make it start over
+    if (render_config_.cpu_path_guiding &&
+        (!path_guide_.IsValid() || guide_content_version_ != scene_render_proxy_->GetContentVersion()))
+    {
+        ResetPathGuide();
+    }
 
-    auto max_bounce = static_cast<unsigned>(config.max_bounce);
-    unsigned bounce = 0;
-    for (; bounce < max_bounce; bounce++)
+    // previews do not add to the accumulation. the 1/2 preview has a quarter of the samples that the first full
+    // resolution frame spreads over the same area, so the takeover never looks noisier than what it replaces.
+    trace_preview_level_ = next_preview_level_;
+    if (trace_preview_level_ < FullResolutionLevel)
     {
-        scene.Intersect<false>(ray, intersection);
+        next_preview_level_++;
+        return 0;
+    }
 
-        // terminal condition: hit nothing
-        if (!intersection.IsHit())
-        {
-            if (sky_light)
-            {
-                result.color += sky_light->Evaluate(ray).cwiseProduct(throughput);
-            }
+    // Use a per-frame seed that advances every dispatch so fresh samples are generated
+    // even after cumulated_sample_count is capped. It advances by the samples the frame traces, not by the spp the
+    // camera counts, as skipping indices would break the stratification of the sobol sequence.
+    const auto frame_seed = dispatched_sample_count_ + render_config_.random_seed_offset;
 
-            break;
-        }
+    dispatched_sample_count_ += UniformSamplesPerFrame;
+    camera_->AccumulateSample(actual_sample_per_pixel_);
 
-        const auto *primitive = intersection.GetPrimitive();
-        const auto *material = primitive->GetMaterialRenderProxy();
-        Vector2 tex_coord = intersection.GetTexCoord();
-        Vector3 hit_normal = intersection.GetNormal();
-        Vector3 hit_tangent = intersection.GetTangent();
+    return frame_seed;
+}
 
-        if (bounce == 0)
+void CPURenderer::ResetPathGuide()
+{
+    AABB bounds;
+    for (const auto *primitive : scene_render_proxy_->GetPrimitives())
+    {
+        if (primitive == nullptr)
         {
-            result.world_normal = hit_normal;
+            continue;
         }
 
-        // terminal condition: emissive
-        Vector3 emissive_color = material->GetEmissive(tex_coord);
-        [[unlikely]] if (emissive_color.norm() > Eps)
-        {
-            result.color += emissive_color.cwiseProduct(throughput);
-            break;
-        }
+        // the sum of an invalid box and a valid one is not the valid one
+        bounds = bounds.IsValid() ? bounds + primitive->GetWorldBoundingBox() : primitive->GetWorldBoundingBox();
+    }
+
+    path_guide_.Reset(bounds);
+    guide_content_version_ = scene_render_proxy_->GetContentVersion();
+}
 
-        // core procedure: surface sampling
-        Vector3 next_direction = Zeros;
-        Vector3 this_throughput = material->SampleSurface(ray, next_direction, hit_normal, hit_tangent, tex_coord);
+void CPURenderer::TraceFrame(const RenderConfig &config, uint32_t frame_seed, const Vector2UInt &debug_point)
+{
+    if (trace_preview_level_ < FullResolutionLevel)
+    {
+        PreviewPass(config, trace_preview_level_);
+        return;
+    }
 
-        // terminal condition: debug output
-        switch (config.debug_mode)
-        {
-        case RenderConfig::DebugMode::Debug:
-            result.color = debug_color;
-            return result;
-        case RenderConfig::DebugMode::Normal:
-            result.color = utilities::VisualizeVector(hit_normal);
-            return result;
-        case RenderConfig::DebugMode::RayDirection:
-            result.color = utilities::VisualizeVector(next_direction);
-            return result;
-        case RenderConfig::DebugMode::Metallic:
-            result.color = Ones * material->GetMetallic(tex_coord);
-            return result;
-        case RenderConfig::DebugMode::Roughness:
-            result.color = Ones * material->GetRoughness(tex_coord);
-            return result;
-        case RenderConfig::DebugMode::Albedo:
-            result.color = material->GetBaseColor(tex_coord);
-            return result;
-        case RenderConfig::DebugMode::Emissive:
-            result.color = material->GetEmissive(tex_coord);
-            return result;
-        case RenderConfig::DebugMode::Depth:
-            result.color = Ones * (intersection.GetLocation() - camera_posture.position).dot(camera_posture.front) /
-                           camera->GetFar();
-            return result;
-        [[likely]] default:
-            break;
-        }
+    // what was learnt last frame guides this one
+    if (config.cpu_path_guiding && path_guide_.IsValid())
+    {
+        path_guide_.Update();
+    }
 
-        // core procedure: radiance decay every bounce
-        throughput = throughput.cwiseProduct(this_throughput);
+    TimePass(total_base_pass_us, [&]() { BasePass(*scene_render_proxy_, config, frame_seed, debug_point); });
 
-        [[unlikely]] if (ray.IsDebug())
-        {
-            Log(Warn, "Hit bounce {}. This throughput {}. Throughput {}. Next direction {}", bounce,
-                utilities::VectorToString(this_throughput), utilities::VectorToString(throughput),
-                utilities::VectorToString(next_direction));
-            ray.Print();
-            intersection.Print();
-            material->PrintSample(tex_coord);
-        }
+    TimePass(total_denoise_pass_us, [&]() { DenoisePass(config, debug_point); });
 
-        // terminal condition: early out
-        if (throughput.squaredNorm() < Eps)
-        {
-            result.valid_flag = -1.f;
-            break;
-        }
+    if (per_pixel_accumulation_)
+    {
+        UpdateConvergence(config);
+    }
 
-        // Russian roulette
-        if (bounce >= 3)
-        {
-            Scalar p = throughput.maxCoeff();
+    // the guides are only written for the color output
+    image_filtered_ = config.cpu_atrous && config.debug_mode == RenderConfig::DebugMode::Color;
+    if (image_filtered_)
+    {
+        TimePass(total_filter_pass_us, [this]() { FilterPass(); });
+    }
 
-            // Avoid too low probability. It will introduce a small bias.
-            p = std::clamp(p, 0.05f, 1.0f);
+    total_frame_count.fetch_add(1, std::memory_order_relaxed);
 
-            if (sampler::RandomUnit() > p)
-            {
-                break;
-            }
+    last_second_total_spp_ += last_frame_spp_;
+    last_second_frame_count_++;
+    spp_logger_.Tick();
+}
 
-            // Compensate for survival probability
-            throughput /= p;
-        }
+void CPURenderer::MeasurePerformance()
+{
+    const auto average_spp = last_second_total_spp_ / static_cast<float>(std::max(last_second_frame_count_, 1u));
+
+    Logger::LogToScreen("SPP", std::format("SPP: {: .1f} ({:.2f} ms per spp)", average_spp, running_time_per_spp_));
 
-        // next ray
-        ray.Reset(intersection.GetLocation() + next_direction * Tolerance, next_direction);
-        intersection.Invalidate();
+    // only scenes with compressed textures use the block cache
+    const auto block_stats = TextureBlockCache::GetStats();
+    if (const auto lookup_count = block_stats.hit_count + block_stats.miss_count; lookup_count > 0)
+    {
+        const auto hit_rate = static_cast<double>(block_stats.hit_count) / static_cast<double>(lookup_count);
+        Logger::LogToScreen("TextureBlockCache",
+                            std::format("Texture blocks: {:.1f}% hit, {:.1f} MB decoded", hit_rate * 100.0,
+                                        static_cast<double>(block_stats.memory_size) / (1024.0 * 1024.0)));
     }
 
-    switch (config.debug_mode)
+    if (const auto &rays = last_second_ray_stats_; rays.camera_rays > 0)
     {
-    case RenderConfig::DebugMode::RayDepth:
-        result.color = utilities::VisualizeInteger(bounce);
-        break;
-    case RenderConfig::DebugMode::Debug:
-        result.color = debug_color;
-        break;
-    case RenderConfig::DebugMode::IndirectLighting:
-        if (bounce <= 1)
-        {
-            result.color = Zeros;
-        }
-        break;
-    case RenderConfig::DebugMode::DirectionalLighting:
-        if (bounce > 1)
-        {
-            result.color = Zeros;
-        }
-        break;
-    [[likely]] default:
-        break;
+        const auto frame_count = static_cast<double>(std::max(last_second_frame_count_, 1u));
+        const auto per_camera_ray = [&rays](uint64_t count) {
+            return static_cast<double>(count) / static_cast<double>(rays.camera_rays);
+        };
+        const auto per_ray = [&rays](uint64_t count) {
+            return static_cast<double>(count) / static_cast<double>(rays.GetRayCount());
+        };
+
+        Logger::LogToScreen("CpuRays", std::format("Rays per frame: {:.0f} camera, {:.0f} bounce, {:.0f} shadow",
+                                                   static_cast<double>(rays.camera_rays) / frame_count,
+                                                   static_cast<double>(rays.bounce_rays) / frame_count,
+                                                   static_cast<double>(rays.shadow_rays) / frame_count));
+        Logger::LogToScreen("CpuTraversal",
+                            std::format("Per ray: {:.1f} nodes, {:.1f} leaves, {:.1f} triangles",
+                                        per_ray(rays.node_visits), per_ray(rays.leaf_visits),
+                                        per_ray(rays.triangle_tests)));
+        Logger::LogToScreen("CpuPaths", std::format("Per camera ray: {:.2f} bounces, {:.2f} roulette terminations",
+                                                    per_camera_ray(rays.bounces),
+                                                    per_camera_ray(rays.roulette_terminations)));
     }
 
-    return result;
+    last_second_total_spp_ = 0.f;
+    last_second_frame_count_ = 0;
+    last_second_ray_stats_ = {};
 }
 
-void CPURenderer::RenderPixel(unsigned i, unsigned j, Scalar pixel_width, Scalar pixel_height,
-                              const SceneRenderProxy &scene, const RenderConfig &config, const Vector2UInt &debug_point)
+void CPURenderer::LogRayStats() const
 {
-    const bool is_debug = i == debug_point.x() && j == debug_point.y();
+    const auto &rays = accumulation_ray_stats_;
+    if (rays.camera_rays == 0)
+    {
+        return;
+    }
 
-    auto u = (static_cast<float>(i) + sampler::RandomUnit()) * pixel_width;
-    auto v = (static_cast<float>(j) + sampler::RandomUnit()) * pixel_height;
+    const auto per_camera_ray = [&rays](uint64_t count) {
+        return static_cast<double>(count) / static_cast<double>(rays.camera_rays);
+    };
+    const auto per_ray = [&rays](uint64_t count) {
+        return static_cast<double>(count) / static_cast<double>(rays.GetRayCount());
+    };
 
-    auto result = SamplePixel(scene, config, camera_, u, v, is_debug);
+    Log(Info, "CPURenderer rays: {} camera, {} bounce, {} shadow", rays.camera_rays, rays.bounce_rays,
+        rays.shadow_rays);
+    Log(Info, "CPURenderer per ray: {:.2f} nodes, {:.2f} leaves, {:.2f} triangles", per_ray(rays.node_visits),
+        per_ray(rays.leaf_visits), per_ray(rays.triangle_tests));
+    Log(Info, "CPURenderer per camera ray: {:.3f} bounces, {:.3f} roulette terminations", per_camera_ray(rays.bounces),
+        per_camera_ray(rays.roulette_terminations));
+}
 
-    result.color = result.color.cwiseMin(Ones * CameraRenderProxy::OutputLimit);
+namespace
+{
+// where the decisions of a path read their sample dimensions. every bounce has a block of its own and every decision a
+// fixed offset in it, so that a decision stays stratified over the samples of a pixel whatever the others consumed.
+struct PathDimension
+{
+    // 2d each
+    static constexpr uint32_t PixelJitter = 0;
+    static constexpr uint32_t Lens = 2;
+
+    static constexpr uint32_t FirstBounce = 4;
+    // direction, lobe selection, and the diffuse fallback direction
+    static constexpr uint32_t Bsdf = 0;
+    // the sky: a 2d cell of its sampling table, then a 2d point in the cell
+    static constexpr uint32_t Light = 6;
+    // 1d light tree descent, then a 2d point on the triangle
+    static constexpr uint32_t EmissiveLight = 10;
+    static constexpr uint32_t Roulette = 14;
+    // 1d choice between the bsdf and the path guide, then the guided direction
+    static constexpr uint32_t Guiding = 16;
+    static constexpr uint32_t GuidingDirection = 18;
+    static constexpr uint32_t BounceCount = 20;
+
+    static uint32_t GetBounce(unsigned bounce, uint32_t offset)
+    {
+        return FirstBounce + bounce * BounceCount + offset;
+    }
+};
 
-    gbuffer_.color[j][i].head<3>() = result.color;
-    gbuffer_.color[j][i].w() = result.valid_flag;
+struct PixelSampleResult
+{
+    Vector3 color = Zeros;
+    Vector3 world_normal = Zeros;
+    // first-hit guides of the a-trous filter
+    float depth = 0.f;
+    Vector3 albedo = Zeros;
+    float valid_flag = 1.f;
+};
 
-    if (config.debug_mode == RenderConfig::DebugMode::Color && config.spatial_denoise)
+// a camera path in flight. the paths of a tile advance bounce by bounce so that every bounce queries the scene with
+// one batch of rays. each path carries its own rng so the result does not depend on the interleaving.
+struct PathState
+{
+    void Reset(unsigned i, unsigned j, bool is_debug)
     {
-        gbuffer_.world_normal[j][i] = result.world_normal;
+        ray = Ray(is_debug);
+        throughput = Ones;
+        result = {};
+        bounce = 0;
+        sky_mis_weight = 1.f;
+        light_bsdf_pdf = -1.f;
+        cone_width = 0.f;
+        cone_spread = 0.f;
+        pixel_x = i;
+        pixel_y = j;
+        resolved = false;
+        guiding_vertex_count = 0;
+        traversal_cost = 0;
     }
-}
 
-void CPURenderer::BasePass(const SceneRenderProxy &scene, const RenderConfig &config, const Vector2UInt &debug_point)
+    // a bounce the path guide learns from once the path knows what came back along its direction
+    struct GuidingVertex
+    {
+        uint32_t cell;
+        Vector3 direction;
+        // solid angle pdf the direction was sampled with
+        Scalar pdf;
+        // luminance of the path's result and throughput on arrival at the next hit. throughput stays 0 until then
+        Scalar radiance;
+        Scalar throughput;
+    };
+
+    static constexpr unsigned MaxGuidingVertexCount = 8;
+
+    Ray ray;
+    Vector3 throughput = Ones;
+    PixelSampleResult result;
+    sampler::RngState rng;
+    unsigned bounce = 0;
+    // weight of the sky if the current ray escapes, against the sky sample taken at the previous hit
+    Scalar sky_mis_weight = 1.f;
+    // the hit that last sampled emissive triangles, and the pdf of its bsdf sample. a bsdf sample that hits an
+    // emissive triangle is weighed against that light sample. negative if the last hit sampled none
+    Vector3 light_origin;
+    Vector3 light_normal;
+    Scalar light_bsdf_pdf = -1.f;
+    // ray cone for texture filtering: width at the current ray origin and spread angle, both in world units
+    Scalar cone_width = 0.f;
+    Scalar cone_spread = 0.f;
+    unsigned pixel_x = 0;
+    unsigned pixel_y = 0;
+    // debug views that return at the first hit skip the final debug resolve
+    bool resolved = false;
+    std::array<GuidingVertex, MaxGuidingVertexCount> guiding_vertices;
+    unsigned guiding_vertex_count = 0;
+    // nodes, leaves and triangles its rays touched, only counted for DebugMode::TraversalCost
+    uint64_t traversal_cost = 0;
+};
+
+// how one bounce mixes the path guide into bsdf sampling
+struct GuidingState
 {
-    PROFILE_SCOPE("CPURenderer base pass");
+    // chance of sampling the guide instead of the bsdf in a trained cell
+    static constexpr Scalar TrainedFraction = 0.5f;
 
-    const float pixel_width = 1.f / static_cast<float>(resolution_.scene.x() - 1);
-    const float pixel_height = 1.f / static_cast<float>(resolution_.scene.y() - 1);
+    // null if the bounce neither samples nor trains the guide
+    const PathGuide *guide = nullptr;
+    uint32_t cell = 0;
+    // 0 leaves the bounce to the bsdf alone
+    Scalar fraction = 0.f;
 
-    static std::vector<std::shared_ptr<TaskFuture<>>> row_tasks;
-    row_tasks.resize(resolution_.scene.y());
+    // balance heuristic: the density of the mixture for a direction the bsdf samples with bsdf_pdf
+    [[nodiscard]] Scalar MixPdf(Scalar bsdf_pdf, const Vector3 &w_i) const
+    {
+        if (fraction <= 0.f)
+        {
+            return bsdf_pdf;
+        }
 
-    // Use a per-frame seed that advances every dispatch so fresh samples are generated
-    // even after cumulated_sample_count is capped. Stays identical to GetCumulatedSampleCount()
-    // before the cap, preserving determinism for functional tests.
-    const auto frame_seed = dispatched_sample_count_;
+        return fraction * guide->Pdf(cell, w_i) + (1.f - fraction) * bsdf_pdf;
+    }
+};
 
-    // parallel by row
-    for (auto j = 0u; j < resolution_.scene.y(); j++)
+// light samples of one bounce, waiting for their shadow rays. they are traced together once every path has extended.
+struct ShadowBatch
+{
+    void Clear()
     {
-        row_tasks[j] = TaskManager::RunInWorkerThread([=, this, &scene]() {
-            for (auto i = 0u; i < resolution_.scene.x(); i++)
-            {
-                // Per-pixel seed: each pixel gets an independent, deterministic
-                // random sequence regardless of which thread processes this row.
-                sampler::ReseedCurrentThread(j * resolution_.scene.x() + i +
-                                             frame_seed * resolution_.scene.x() * resolution_.scene.y());
-                RenderPixel(i, j, pixel_width, pixel_height, scene, config, debug_point);
-            }
-        });
+        rays.clear();
+        paths.clear();
+        radiance.clear();
     }
 
-    TaskManager::OnAll(row_tasks)->Wait();
-}
+    // max_distance stops the ray short of a light in the scene
+    void Add(PathState &path, const Vector3 &location, const Vector3 &w_i, const Vector3 &sample_radiance,
+             Scalar max_distance = std::numeric_limits<Scalar>::max())
+    {
+        if (sample_radiance.maxCoeff() <= 0.f)
+        {
+            return;
+        }
 
-static void SpatialDenoisePixel(unsigned i, unsigned j, unsigned width, unsigned height, unsigned num_samples,
-                                const CPUGBuffer &gbuffer, std::vector<std::vector<Vector4>> &output_buffer)
+        auto &shadow_ray = rays.emplace_back(path.ray.IsDebug());
+        shadow_ray.Reset(location + w_i * Tolerance, w_i, max_distance);
+        paths.push_back(&path);
+        radiance.push_back(sample_radiance);
+    }
+
+    std::vector<Ray> rays;
+    std::vector<PathState *> paths;
+    // what an unoccluded sample adds to its path
+    std::vector<Vector3> radiance;
+};
+} // namespace
+
+static void SetupViewRay(CameraRenderProxy *camera, Ray &ray, float u, float v)
 {
-    const static std::array<std::tuple<int, int>, 8> Directions{
-        std::tuple<int, int>{1, 0},  std::tuple<int, int>{0, 1},   std::tuple<int, int>{-1, 0},
-        std::tuple<int, int>{0, -1}, std::tuple<int, int>{-1, -1}, std::tuple<int, int>{1, -1},
-        std::tuple<int, int>{-1, 1}, std::tuple<int, int>{1, 1}};
+    // lens plane: centered at position_ and perpendicular to front_
+    // image plane: (u, v)
+    // focus plane: (u * max_u, v * max_v)
+    // pixels on image plane are one-to-one mapped to focus plane
 
-    const Vector3 &world_normal = gbuffer.world_normal[j][i];
-    const Vector3 &color = gbuffer.color[j][i].head<3>();
+    // use a noise at lens plane to simulate aperture
+    const Vector2 aperture_noise = sampler::UnitDisk(sampler::Random2D()) * camera->GetAttribute().aperture_radius;
+    const Vector3 lens_offset =
+        aperture_noise.x() * camera->GetPosture().right + aperture_noise.y() * camera->GetPosture().up;
 
-    // only a valid non-sky intersection may be used as reference
-    if (!gbuffer.IsValid(i, j) || gbuffer.IsSky(i, j))
+    const Vector3 ray_origin = camera->GetPosture().position + lens_offset;
+    const Vector3 location_on_focus_plane =
+        camera->GetFocusPlane().lower_left + u * camera->GetFocusPlane().max_u + v * camera->GetFocusPlane().max_v;
+    const Vector3 ray_direction = (location_on_focus_plane - ray_origin).normalized();
+
+    ray.Reset(ray_origin, ray_direction);
+}
+
+// power heuristic. a strategy is trusted alone when the other one can not produce the direction.
+static Scalar GetMISWeight(Scalar current_pdf, Scalar compensation_pdf)
+{
+    if (current_pdf < Eps || compensation_pdf < Eps)
     {
-        return;
+        return 1.f;
     }
 
-    // fill surrounding invalid samples with current sample
-    for (auto k = 0u; k < std::min(num_samples, static_cast<unsigned>(Directions.size())); k++)
+    const auto current_pdf_sqr = current_pdf * current_pdf;
+    return current_pdf_sqr / (current_pdf_sqr + compensation_pdf * compensation_pdf);
+}
+
+// a sky map is sampled by its luminance. a flat sky, or a sky map whose table is not cooked yet, takes a cosine lobe
+// around the normal from u_cell instead.
+static Vector3 SampleSkyLight(const SkyRenderProxy &sky_light, const Vector3 &normal, const Vector3 &tangent,
+                              const Vector2 &u_cell, const Vector2 &u_point, Scalar &pdf)
+{
+    if (sky_light.IsImportanceSampled())
     {
-        auto [dx, dy] = Directions[k];
-        int sample_i = static_cast<int>(i) + dx;
-        int sample_j = static_cast<int>(j) + dy;
-        if (sample_i < 0 || std::cmp_greater_equal(sample_i, width) || sample_j < 0 ||
-            std::cmp_greater_equal(sample_j, height))
+        const Vector3 w_i = sky_light.SampleDirection(u_cell, u_point, pdf);
+        if (w_i.dot(normal) <= 0.f)
         {
-            continue;
+            pdf = 0.f;
         }
+        return w_i;
+    }
 
-        auto new_i = static_cast<unsigned>(sample_i);
-        auto new_j = static_cast<unsigned>(sample_j);
+    const Vector3 local_w_i = sampler::CosineWeightedHemiSphere::Sample(u_cell);
+    pdf = sampler::CosineWeightedHemiSphere::Pdf(local_w_i);
+    return utilities::TransformBasisToWorld(local_w_i, normal, tangent).normalized();
+}
 
-        const Vector3 &neighbour_normal = gbuffer.world_normal[new_j][new_i];
-        float neighbour_valid_flag = gbuffer.color[new_j][new_i].w();
-        if (neighbour_valid_flag > 0)
-        {
-            continue;
-        }
+static Scalar GetSkyLightPdf(const SkyRenderProxy &sky_light, const Vector3 &normal, const Vector3 &w_i)
+{
+    if (sky_light.IsImportanceSampled())
+    {
+        return w_i.dot(normal) > 0.f ? sky_light.Pdf(w_i) : 0.f;
+    }
 
-        auto similarity = neighbour_normal.dot(world_normal);
-        if (similarity < 0.99f)
+    return utilities::SaturateDot(normal, w_i) * InvPi;
+}
+
+// next event estimation: sample the directional light and the sky explicitly from this hit.
+// only the unshadowed radiance is computed here, visibility is resolved later by ShadowBatch.
+static void SampleLights(const SceneRenderProxy &scene, PathState &path, const MaterialRenderProxy &material,
+                         const GuidingState &guiding, const Intersection &intersection, const Vector3 &normal,
+                         const Vector3 &tangent, const TextureCoordinate &tex_coord, ShadowBatch &shadows)
+{
+    const auto &ray = path.ray;
+    const Vector3 location = intersection.GetLocation();
+
+    // a delta light: bsdf sampling never hits it, so there is nothing to weigh against
+    if (const auto *directional_light = scene.GetDirectionalLight())
+    {
+        Vector3 w_i;
+        directional_light->Sample(location, w_i);
+        w_i.normalize();
+
+        const Vector3 bsdf = material.EvaluateSurface(ray, w_i, normal, tangent, tex_coord);
+        shadows.Add(path, location, w_i,
+                    bsdf.cwiseProduct(directional_light->GetRenderData().color).cwiseProduct(path.throughput));
+    }
+
+    if (const auto *sky_light = scene.GetSkyLight())
+    {
+        // the light block of the bounce, see PathDimension
+        const Vector2 u_cell = sampler::Random2D();
+        const Vector2 u_point = sampler::Random2D();
+
+        Scalar light_pdf = 0.f;
+        const Vector3 w_i = SampleSkyLight(*sky_light, normal, tangent, u_cell, u_point, light_pdf);
+        if (light_pdf < Eps)
         {
-            continue;
+            return;
         }
 
-        output_buffer[new_j][new_i].head<3>() = color;
+        Ray light_ray;
+        light_ray.Reset(location, w_i);
 
-        // this channel is reserved for future use
-        output_buffer[new_j][new_i].w() = 1.f;
+        const Vector3 bsdf = material.EvaluateSurface(ray, w_i, normal, tangent, tex_coord);
+        const auto bsdf_pdf = guiding.MixPdf(material.SurfacePdf(ray, w_i, normal, tangent, tex_coord), w_i);
+        const auto weight = GetMISWeight(light_pdf, bsdf_pdf) / light_pdf;
 
-        break;
+        shadows.Add(path, location, w_i,
+                    sky_light->Evaluate(light_ray).cwiseProduct(bsdf).cwiseProduct(path.throughput) * weight);
     }
 }
 
-void CPURenderer::DenoisePass(const RenderConfig &config, const Vector2UInt &debug_point)
+// next event estimation on emissive triangles: the light tree picks a triangle, then a point is taken uniformly on it
+static void SampleEmissiveLights(const LightTree &lights, PathState &path, const MaterialRenderProxy &material,
+                                 const GuidingState &guiding, const Intersection &intersection, const Vector3 &normal,
+                                 const Vector3 &tangent, const TextureCoordinate &tex_coord, ShadowBatch &shadows)
+{
+    const auto &ray = path.ray;
+    const Vector3 location = intersection.GetLocation();
+
+    Scalar select_pdf;
+    const auto index = lights.Select(location, normal, sampler::RandomUnit(), select_pdf);
+    if (index == LightTree::InvalidLight)
+    {
+        return;
+    }
+
+    const auto &light = lights.GetLight(index);
+    const Vector2 u = sampler::Random2D();
+    const Scalar sqrt_u = std::sqrt(u.x());
+    const Scalar b1 = sqrt_u * (1.f - u.y());
+    const Scalar b2 = sqrt_u * u.y();
+
+    Vector3 w_i = light.v0 + light.edge1 * b1 + light.edge2 * b2 - location;
+    const Scalar distance = w_i.norm();
+    if (distance < Tolerance * 4.f)
+    {
+        return;
+    }
+    w_i /= distance;
+
+    const Scalar cos_light = std::abs(light.normal.dot(w_i));
+    if (cos_light < Eps)
+    {
+        return;
+    }
+
+    // solid angle pdf
+    const Scalar light_pdf = select_pdf * distance * distance / (light.area * cos_light);
+
+    const Vector3 bsdf = material.EvaluateSurface(ray, w_i, normal, tangent, tex_coord);
+    if (bsdf.maxCoeff() <= 0.f)
+    {
+        return;
+    }
+
+    const auto &mesh = static_cast<const MeshRenderProxy &>(*light.primitive);
+    const TextureCoordinate light_tex_coord(mesh.GetRawMesh()->GetTexCoord(light.face, b1, b2));
+    const Vector3 emission = mesh.GetMaterialRenderProxy()->GetEmissive(light_tex_coord);
+
+    const auto bsdf_pdf = guiding.MixPdf(material.SurfacePdf(ray, w_i, normal, tangent, tex_coord), w_i);
+    const auto weight = GetMISWeight(light_pdf, bsdf_pdf) / light_pdf;
+
+    shadows.Add(path, location, w_i, emission.cwiseProduct(bsdf).cwiseProduct(path.throughput) * weight,
+                distance - Tolerance * 2.f);
+}
+
+// a bsdf sample that hit an emissive triangle, against the light tree sample taken at the previous hit
+static Scalar GetEmissiveMISWeight(const LightTree *lights, const PathState &path, const Intersection &intersection)
+{
+    if (lights == nullptr || path.light_bsdf_pdf < 0.f)
+    {
+        return 1.f;
+    }
+
+    const auto index = lights->FindLight(intersection.GetPrimitive(), intersection.GetFace());
+    if (index == LightTree::InvalidLight)
+    {
+        return 1.f;
+    }
+
+    const auto &light = lights->GetLight(index);
+    const Scalar cos_light = std::abs(light.normal.dot(path.ray.Direction()));
+    if (cos_light < Eps)
+    {
+        return 1.f;
+    }
+
+    const Scalar distance = intersection.T();
+    const Scalar light_pdf = lights->Pmf(path.light_origin, path.light_normal, index) * distance * distance /
+                             (light.area * cos_light);
+    return GetMISWeight(path.light_bsdf_pdf, light_pdf);
+}
+
+// delta lobes are left to the bsdf: the guide can neither sample nor evaluate them
+static GuidingState GetGuiding(const PathGuide *guide, const MaterialRenderProxy &material, const Vector3 &location,
+                               const TextureCoordinate &tex_coord)
+{
+    GuidingState guiding;
+    if (guide == nullptr || material.HasDeltaLobe(tex_coord))
+    {
+        return guiding;
+    }
+
+    guiding.guide = guide;
+    guiding.cell = guide->GetCell(location);
+    guiding.fraction = guide->IsTrained(guiding.cell) ? GuidingState::TrainedFraction : 0.f;
+    return guiding;
+}
+
+// one-sample mis of the bsdf and the path guide. outputs the pdf the direction was sampled with, or -1 if the bounce
+// does not guide and nobody asked for it
+static Vector3 SampleDirection(const MaterialRenderProxy &material, const Ray &ray, const GuidingState &guiding,
+                               unsigned bounce, const Vector3 &normal, const Vector3 &tangent,
+                               const TextureCoordinate &tex_coord, Vector3 &w_i, Scalar &pdf)
+{
+    pdf = -1.f;
+
+    if (guiding.fraction > 0.f)
+    {
+        sampler::SetDimension(PathDimension::GetBounce(bounce, PathDimension::Guiding));
+        const Scalar u_choice = sampler::RandomUnit();
+        if (u_choice < guiding.fraction)
+        {
+            sampler::SetDimension(PathDimension::GetBounce(bounce, PathDimension::GuidingDirection));
+            Scalar guide_pdf;
+            w_i = guiding.guide->Sample(guiding.cell, u_choice / guiding.fraction, sampler::Random2D(), guide_pdf);
+
+            pdf = guiding.MixPdf(material.SurfacePdf(ray, w_i, normal, tangent, tex_coord), w_i);
+            if (pdf < Eps)
+            {
+                return Zeros;
+            }
+            return material.EvaluateSurface(ray, w_i, normal, tangent, tex_coord) / pdf;
+        }
+    }
+
+    sampler::SetDimension(PathDimension::GetBounce(bounce, PathDimension::Bsdf));
+    Vector3 throughput = material.SampleSurface(ray, w_i, normal, tangent, tex_coord);
+    if (guiding.guide == nullptr)
+    {
+        return throughput;
+    }
+
+    const auto bsdf_pdf = material.SurfacePdf(ray, w_i, normal, tangent, tex_coord);
+    pdf = guiding.MixPdf(bsdf_pdf, w_i);
+    if (guiding.fraction > 0.f)
+    {
+        // only the bsdf produces directions it has no pdf for, such as its below-horizon fallback
+        throughput *= bsdf_pdf > 0.f ? bsdf_pdf / pdf : 1.f / (1.f - guiding.fraction);
+    }
+    return throughput;
+}
+
+// the previous bounce's direction brought back everything the path gathers from here on, so it learns the result as
+// it stands now
+static void MarkGuidingVertex(PathState &path)
+{
+    if (path.guiding_vertex_count == 0)
+    {
+        return;
+    }
+
+    auto &vertex = path.guiding_vertices[path.guiding_vertex_count - 1];
+    if (vertex.throughput == 0.f)
+    {
+        vertex.radiance = utilities::Luminance(path.result.color);
+        vertex.throughput = utilities::Luminance(path.throughput);
+    }
+}
+
+// process the hit (or miss) of the current bounce. returns true if the path continues with path.ray.
+static bool ExtendPath(const SceneRenderProxy &scene, const RenderConfig &config, CameraRenderProxy *camera,
+                       const PathGuide *guide, PathState &path, const Intersection &intersection,
+                       ShadowBatch &shadows)
+{
+    auto &ray = path.ray;
+    auto &result = path.result;
+    auto &throughput = path.throughput;
+    const auto bounce = path.bounce;
+
+    MarkGuidingVertex(path);
+
+    // terminal condition: hit nothing
+    if (!intersection.IsHit())
+    {
+        if (const auto *sky_light = scene.GetSkyLight())
+        {
+            result.color += sky_light->Evaluate(ray).cwiseProduct(throughput) * path.sky_mis_weight;
+        }
+
+        return false;
+    }
+
+    const auto *primitive = intersection.GetPrimitive();
+    const auto *material = primitive->GetMaterialRenderProxy();
+    Vector3 hit_normal = intersection.GetNormal();
+    Vector3 hit_tangent = intersection.GetTangent();
+
+    // curvature and roughness would widen the cone after a bounce. ignoring them errs on the sharp side.
+    Scalar texture_width = 0.f;
+    if (config.texture_lod)
+    {
+        path.cone_width += path.cone_spread * intersection.T();
+
+        const auto cos_theta = std::max(std::abs(hit_normal.dot(ray.Direction())), 0.05f);
+        texture_width = path.cone_width * primitive->GetTexCoordDensity(intersection.GetFace()) / cos_theta;
+    }
+    const TextureCoordinate tex_coord(intersection.GetTexCoord(), texture_width);
+
+    if (bounce == 0)
+    {
+        result.world_normal = hit_normal;
+        if (config.cpu_atrous)
+        {
+            result.depth = intersection.T();
+            result.albedo = material->GetBaseColor(tex_coord);
+        }
+    }
+
+    // terminal condition: emissive
+    Vector3 emissive_color = material->GetEmissive(tex_coord);
+    [[unlikely]] if (emissive_color.norm() > Eps)
+    {
+        result.color += emissive_color.cwiseProduct(throughput) *
+                        GetEmissiveMISWeight(scene.GetLightTree(), path, intersection);
+        return false;
+    }
+
+    // core procedure: surface sampling
+    const auto guiding = GetGuiding(guide, *material, intersection.GetLocation(), tex_coord);
+    Vector3 next_direction = Zeros;
+    Scalar sampling_pdf;
+    Vector3 this_throughput = SampleDirection(*material, ray, guiding, bounce, hit_normal, hit_tangent, tex_coord,
+                                              next_direction, sampling_pdf);
+
+    // terminal condition: debug output
+    const auto camera_posture = camera->GetPosture();
+    path.resolved = true;
+    switch (config.debug_mode)
+    {
+    case RenderConfig::DebugMode::Debug:
+        result.color = Zeros;
+        return false;
+    case RenderConfig::DebugMode::Normal:
+        result.color = utilities::VisualizeVector(hit_normal);
+        return false;
+    case RenderConfig::DebugMode::RayDirection:
+        result.color = utilities::VisualizeVector(next_direction);
+        return false;
+    case RenderConfig::DebugMode::Metallic:
+        result.color = Ones * material->GetMetallic(tex_coord);
+        return false;
+    case RenderConfig::DebugMode::Roughness:
+        result.color = Ones * material->GetRoughness(tex_coord);
+        return false;
+    case RenderConfig::DebugMode::Albedo:
+        result.color = material->GetBaseColor(tex_coord);
+        return false;
+    case RenderConfig::DebugMode::Emissive:
+        result.color = material->GetEmissive(tex_coord);
+        return false;
+    case RenderConfig::DebugMode::Depth:
+        result.color = Ones * (intersection.GetLocation() - camera_posture.position).dot(camera_posture.front) /
+                       camera->GetFar();
+        return false;
+    [[likely]] default:
+        path.resolved = false;
+        break;
+    }
+
+    path.light_bsdf_pdf = -1.f;
+    if (config.enable_nee)
+    {
+        sampler::SetDimension(PathDimension::GetBounce(bounce, PathDimension::Light));
+        SampleLights(scene, path, *material, guiding, intersection, hit_normal, hit_tangent, tex_coord, shadows);
+
+        // a delta lobe gets nothing from a light sample
+        const auto *lights = scene.GetLightTree();
+        const bool sample_emissive = lights != nullptr && !lights->IsEmpty() && !material->HasDeltaLobe(tex_coord);
+        if (sample_emissive)
+        {
+            sampler::SetDimension(PathDimension::GetBounce(bounce, PathDimension::EmissiveLight));
+            SampleEmissiveLights(*lights, path, *material, guiding, intersection, hit_normal, hit_tangent, tex_coord,
+                                 shadows);
+        }
+
+        // the lights may also be reached by the bsdf sample, so that one is weighed against the light samples
+        const auto *sky_light = scene.GetSkyLight();
+        if (sky_light || sample_emissive)
+        {
+            const auto bsdf_pdf = sampling_pdf >= 0.f
+                                      ? sampling_pdf
+                                      : material->SurfacePdf(ray, next_direction, hit_normal, hit_tangent, tex_coord);
+            if (sky_light)
+            {
+                path.sky_mis_weight = GetMISWeight(bsdf_pdf, GetSkyLightPdf(*sky_light, hit_normal, next_direction));
+            }
+            if (sample_emissive)
+            {
+                path.light_origin = intersection.GetLocation();
+                path.light_normal = hit_normal;
+                path.light_bsdf_pdf = bsdf_pdf;
+            }
+        }
+    }
+
+    // core procedure: radiance decay every bounce
+    throughput = throughput.cwiseProduct(this_throughput);
+
+    [[unlikely]] if (ray.IsDebug())
+    {
+        Log(Warn, "Hit bounce {}. This throughput {}. Throughput {}. Next direction {}", bounce,
+            utilities::VectorToString(this_throughput), utilities::VectorToString(throughput),
+            utilities::VectorToString(next_direction));
+        ray.Print();
+        intersection.Print();
+        material->PrintSample(tex_coord.uv);
+    }
+
+    // terminal condition: early out
+    if (throughput.squaredNorm() < Eps)
+    {
+        result.valid_flag = -1.f;
+        return false;
+    }
+
+    // Russian roulette
+    if (bounce >= 3)
+    {
+        Scalar p = throughput.maxCoeff();
+
+        // Avoid too low probability. It will introduce a small bias.
+        p = std::clamp(p, 0.05f, 1.0f);
+
+        sampler::SetDimension(PathDimension::GetBounce(bounce, PathDimension::Roulette));
+        if (sampler::RandomUnit() > p)
+        {
+            RayStats::GetThreadLocal().roulette_terminations++;
+            return false;
+        }
+
+        // Compensate for survival probability
+        throughput /= p;
+    }
+
+    if (guiding.guide != nullptr && sampling_pdf > 0.f && path.guiding_vertex_count < PathState::MaxGuidingVertexCount)
+    {
+        path.guiding_vertices[path.guiding_vertex_count++] = {.cell = guiding.cell,
+                                                              .direction = next_direction,
+                                                              .pdf = sampling_pdf,
+                                                              .radiance = 0.f,
+                                                              .throughput = 0.f};
+    }
+
+    // next ray
+    ray.Reset(intersection.GetLocation() + next_direction * Tolerance, next_direction);
+    path.bounce++;
+
+    const bool alive = path.bounce < static_cast<unsigned>(config.max_bounce);
+    RayStats::GetThreadLocal().bounces += alive ? 1 : 0;
+    return alive;
+}
+
+// counting sort of the hits of one bounce by material, misses first. stable, so the hits of a material keep their
+// screen-space order, which mostly keeps hits on the same primitive together as well.
+static void SortHitsByMaterial(std::span<const Intersection> intersections, std::vector<uint32_t> &order)
+{
+    static thread_local std::vector<uint32_t> keys;
+    static thread_local std::vector<uint32_t> offsets;
+
+    keys.resize(intersections.size());
+    uint32_t key_count = 1;
+    for (auto n = 0u; n < intersections.size(); n++)
+    {
+        const auto &intersection = intersections[n];
+        keys[n] = intersection.IsHit()
+                      ? intersection.GetPrimitive()->GetMaterialRenderProxy()->GetRenderIndex() + 1
+                      : 0;
+        key_count = std::max(key_count, keys[n] + 1);
+    }
+
+    offsets.assign(key_count + 1, 0);
+    for (auto key : keys)
+    {
+        offsets[key + 1]++;
+    }
+    for (auto key = 0u; key < key_count; key++)
+    {
+        offsets[key + 1] += offsets[key];
+    }
+
+    order.resize(intersections.size());
+    for (auto n = 0u; n < intersections.size(); n++)
+    {
+        order[offsets[keys[n]]++] = n;
+    }
+}
+
+// every marked bounce learns what the path gathered after it, brought back to its own direction
+static void TrainPathGuide(PathGuide &guide, const PathState &path)
+{
+    // a sample through a grazing direction must not drown a whole cell
+    constexpr Scalar MinTrainingPdf = 0.05f;
+
+    const auto radiance = utilities::Luminance(path.result.color);
+    for (auto k = 0u; k < path.guiding_vertex_count; k++)
+    {
+        const auto &vertex = path.guiding_vertices[k];
+        if (vertex.throughput <= 0.f)
+        {
+            continue;
+        }
+
+        const auto incident = std::clamp((radiance - vertex.radiance) / vertex.throughput, 0.f,
+                                         CameraRenderProxy::OutputLimit);
+        guide.Record(vertex.cell, vertex.direction, incident / std::max(vertex.pdf, MinTrainingPdf));
+    }
+}
+
+// traversal cost of a path that DebugMode::TraversalCost shows as the hottest
+static constexpr float MaxTraversalCost = 4096.f;
+
+// the traversal cost heatmap needs the cost of every ray, which packets would share between their lanes. it traces the
+// rays one by one and hands add_cost(n, cost) what ray n touched
+template <bool AnyHit, typename AddCost>
+static void TraceRays(const SceneRenderProxy &scene, std::span<const Ray> rays, std::span<Intersection> intersections,
+                      bool per_ray_cost, AddCost &&add_cost)
+{
+    if (!per_ray_cost)
+    {
+        scene.IntersectStream<AnyHit>(rays, intersections);
+        return;
+    }
+
+    const auto &stats = RayStats::GetThreadLocal();
+    for (auto n = 0u; n < rays.size(); n++)
+    {
+        const auto cost = stats.GetTraversalCost();
+        scene.IntersectPacket<AnyHit>(rays.subspan(n, 1), intersections.subspan(n, 1));
+        add_cost(n, stats.GetTraversalCost() - cost);
+    }
+}
+
+static void FinishPath(const RenderConfig &config, PathState &path)
+{
+    if (path.resolved)
+    {
+        return;
+    }
+
+    auto &result = path.result;
+    switch (config.debug_mode)
+    {
+    case RenderConfig::DebugMode::RayDepth:
+        result.color = utilities::VisualizeInteger(path.bounce);
+        break;
+    case RenderConfig::DebugMode::Debug:
+        result.color = Zeros;
+        break;
+    case RenderConfig::DebugMode::IndirectLighting:
+        if (path.bounce <= 1)
+        {
+            result.color = Zeros;
+        }
+        break;
+    case RenderConfig::DebugMode::DirectionalLighting:
+        if (path.bounce > 1)
+        {
+            result.color = Zeros;
+        }
+        break;
+    case RenderConfig::DebugMode::TraversalCost: {
+        // on a log scale, as a mirror or a leaf canopy costs orders of magnitude more than the sky. tone mapping turns
+        // it into a heatmap
+        const auto cost = std::log2(1.f + static_cast<float>(path.traversal_cost)) / std::log2(1.f + MaxTraversalCost);
+        result.color = Ones * std::min(cost, 1.f);
+        break;
+    }
+    [[likely]] default:
+        break;
+    }
+}
+
+RayStats CPURenderer::RenderTile(const TileScheduler::Tile &tile, Scalar pixel_width, Scalar pixel_height,
+                                 uint32_t frame_seed, unsigned sample_count, const SceneRenderProxy &scene,
+                                 const RenderConfig &config, const Vector2UInt &debug_point)
+{
+    // scratch space lives as long as the worker, so a tile does not allocate once it is warm
+    static thread_local std::vector<PathState> paths;
+    static thread_local std::vector<uint32_t> active_paths;
+    static thread_local std::vector<uint32_t> next_active_paths;
+    static thread_local std::vector<uint32_t> shade_order;
+    static thread_local std::vector<Ray> rays;
+    static thread_local std::vector<Intersection> intersections;
+    static thread_local ShadowBatch shadows;
+
+    const auto tile_width = tile.x_end - tile.x_begin;
+    const auto tile_height = tile.y_end - tile.y_begin;
+    paths.resize(static_cast<size_t>(tile_width) * tile_height);
+
+    // guided paths sample a snapshot that only changes between frames, and train the live histograms. debug views
+    // would teach it their own colors
+    PathGuide *guide = config.cpu_path_guiding && path_guide_.IsValid() &&
+                               config.debug_mode == RenderConfig::DebugMode::Color
+                           ? &path_guide_
+                           : nullptr;
+
+    // angle one pixel subtends, the spread of primary ray cones
+    const Scalar pixel_spread = pixel_height * camera_->GetFocusPlane().height / camera_->GetAttribute().focus_distance;
+
+    auto &stats = RayStats::GetThreadLocal();
+    const auto tile_begin_stats = stats;
+    const bool per_ray_cost = config.debug_mode == RenderConfig::DebugMode::TraversalCost;
+
+    for (auto pass = 0u; pass < sample_count; pass++)
+    {
+        active_paths.clear();
+
+        // generate camera rays. they are consumed in this order, so primary rays form coherent packets.
+        for (auto k = 0u; k < paths.size(); k++)
+        {
+            const auto i = tile.x_begin + k % tile_width;
+            const auto j = tile.y_begin + k / tile_width;
+
+            // Per-pixel sequence: each pixel gets an independent, deterministic
+            // random sequence regardless of which thread processes this tile.
+            // Under per-pixel accumulation pixels advance at different rates, so they count their own samples.
+            const uint32_t sample_index = per_pixel_accumulation_
+                                              ? pixel_sample_count_(i, j) + pass + config.random_seed_offset
+                                              : frame_seed + pass;
+            const uint32_t pixel_index = j * resolution_.scene.x() + i;
+            if (config.cpu_sampler == RenderConfig::CpuSampler::Sobol)
+            {
+                sampler::StartSequenceSample(pixel_index, sample_index);
+            }
+            else
+            {
+                sampler::ReseedCurrentThread(pixel_index +
+                                             sample_index * resolution_.scene.x() * resolution_.scene.y());
+            }
+
+            auto &path = paths[k];
+            path.Reset(i, j, i == debug_point.x() && j == debug_point.y());
+
+            sampler::SetDimension(PathDimension::PixelJitter);
+            const Vector2 jitter = sampler::Random2D();
+            auto u = (static_cast<float>(i) + jitter.x()) * pixel_width;
+            auto v = (static_cast<float>(j) + jitter.y()) * pixel_height;
+            sampler::SetDimension(PathDimension::Lens);
+            SetupViewRay(camera_, path.ray, u, v);
+            path.cone_spread = pixel_spread;
+
+            path.rng = sampler::SaveCurrentThreadState();
+
+            if (config.max_bounce > 0)
+            {
+                active_paths.push_back(k);
+            }
+        }
+
+        // extend all live paths one bounce at a time. the scene sorts the rays into packets.
+        for (bool camera_rays = true; !active_paths.empty(); camera_rays = false)
+        {
+            rays.clear();
+            for (auto k : active_paths)
+            {
+                rays.push_back(paths[k].ray);
+            }
+
+            intersections.assign(active_paths.size(), Intersection{});
+            TraceRays<false>(scene, rays, intersections, per_ray_cost,
+                             [&](uint32_t n, uint64_t cost) { paths[active_paths[n]].traversal_cost += cost; });
+            (camera_rays ? stats.camera_rays : stats.bounce_rays) += rays.size();
+
+            shadows.Clear();
+
+            // paths carry their own rng, so the shading order does not change the image
+            if (config.cpu_wavefront)
+            {
+                SortHitsByMaterial(intersections, shade_order);
+            }
+            else
+            {
+                shade_order.resize(active_paths.size());
+                std::iota(shade_order.begin(), shade_order.end(), 0u);
+            }
+
+            next_active_paths.clear();
+            for (auto n : shade_order)
+            {
+                auto &path = paths[active_paths[n]];
+
+                sampler::RestoreCurrentThreadState(path.rng);
+                const bool alive = ExtendPath(scene, config, camera_, guide, path, intersections[n], shadows);
+                path.rng = sampler::SaveCurrentThreadState();
+
+                if (alive)
+                {
+                    next_active_paths.push_back(active_paths[n]);
+                }
+            }
+            std::swap(active_paths, next_active_paths);
+
+            // shadow rays end short of their light, so any hit occludes
+            if (!shadows.rays.empty())
+            {
+                intersections.assign(shadows.rays.size(), Intersection{});
+                TraceRays<true>(scene, shadows.rays, intersections, per_ray_cost,
+                                [&](uint32_t n, uint64_t cost) { shadows.paths[n]->traversal_cost += cost; });
+                stats.shadow_rays += shadows.rays.size();
+
+                for (auto n = 0u; n < shadows.rays.size(); n++)
+                {
+                    if (!intersections[n].IsHit())
+                    {
+                        shadows.paths[n]->result.color += shadows.radiance[n];
+                    }
+                }
+            }
+        }
+
+        for (auto &path : paths)
+        {
+            if (guide != nullptr)
+            {
+                TrainPathGuide(*guide, path);
+            }
+
+            FinishPath(config, path);
+
+            auto &result = path.result;
+            const auto i = path.pixel_x;
+            const auto j = path.pixel_y;
+
+            result.color = result.color.cwiseMin(Ones * CameraRenderProxy::OutputLimit);
+
+            auto &pixel = gbuffer_.color(i, j);
+            if (pass == 0)
+            {
+                pixel.head<3>() = result.color;
+                pixel.w() = result.valid_flag;
+            }
+            else
+            {
+                // a pixel is valid if any of its samples is
+                pixel.head<3>() += result.color;
+                pixel.w() = std::max(pixel.w(), result.valid_flag);
+            }
+
+            if (per_pixel_accumulation_ || config.cpu_atrous)
+            {
+                const auto luminance = utilities::Luminance(result.color);
+                const Vector2 moments(luminance, luminance * luminance);
+                auto &frame_moments = gbuffer_.luminance_moments(i, j);
+                frame_moments = pass == 0 ? moments : Vector2(frame_moments + moments);
+            }
+
+            if (config.debug_mode == RenderConfig::DebugMode::Color && (config.spatial_denoise || config.cpu_atrous))
+            {
+                gbuffer_.world_normal(i, j) = result.world_normal;
+                gbuffer_.depth(i, j) = result.depth;
+                gbuffer_.albedo(i, j) = result.albedo;
+            }
+        }
+    }
+
+    if (!per_pixel_accumulation_)
+    {
+        return stats - tile_begin_stats;
+    }
+
+    const auto inv_sample_count = 1.f / static_cast<float>(sample_count);
+    for (auto j = tile.y_begin; j < tile.y_end; j++)
+    {
+        for (auto &pixel : gbuffer_.color.Row(j, tile.x_begin, tile.x_end))
+        {
+            pixel.head<3>() *= inv_sample_count;
+        }
+        for (auto &moments : gbuffer_.luminance_moments.Row(j, tile.x_begin, tile.x_end))
+        {
+            moments *= inv_sample_count;
+        }
+        std::ranges::fill(gbuffer_.sample_count.Row(j, tile.x_begin, tile.x_end), sample_count);
+    }
+
+    return stats - tile_begin_stats;
+}
+
+void CPURenderer::BasePass(const SceneRenderProxy &scene, const RenderConfig &config, uint32_t frame_seed,
+                           const Vector2UInt &debug_point)
+{
+    PROFILE_SCOPE("CPURenderer base pass");
+
+    const float pixel_width = 1.f / static_cast<float>(resolution_.scene.x() - 1);
+    const float pixel_height = 1.f / static_cast<float>(resolution_.scene.y() - 1);
+
+    Timer timer;
+
+    tile_ray_stats_.assign(tile_scheduler_.GetTileCount(), RayStats{});
+
+    // parallel by tile. row costs differ a lot (sky vs geometry), so idle lanes steal the remaining tiles.
+    if (per_pixel_accumulation_)
+    {
+        PlanTiles(config);
+
+        // skipped tiles must not be blended, nor used as spatial denoise references
+        TaskManager::ParallelFor(0u, resolution_.scene.y(), [this](unsigned j) {
+            std::ranges::fill(gbuffer_.sample_count.Row(j), 0u);
+            for (auto &pixel : gbuffer_.color.Row(j))
+            {
+                pixel.w() = 0.f;
+            }
+        }).wait();
+
+        const auto sample_count = tile_sample_count_;
+        tile_scheduler_.Dispatch(dispatched_tiles_, [=, this, &scene](const TileScheduler::Tile &tile) {
+            tile_ray_stats_[tile.index] =
+                RenderTile(tile, pixel_width, pixel_height, frame_seed, sample_count, scene, config, debug_point);
+        });
+
+        uint64_t pixel_sample_count = 0;
+        for (auto tile_index : dispatched_tiles_)
+        {
+            const auto tile = tile_scheduler_.GetTile(tile_index);
+            pixel_sample_count +=
+                static_cast<uint64_t>(tile.x_end - tile.x_begin) * (tile.y_end - tile.y_begin) * sample_count;
+        }
+        accumulated_pixel_sample_count_ += pixel_sample_count;
+
+        const auto pixel_count = static_cast<float>(resolution_.scene.x()) * static_cast<float>(resolution_.scene.y());
+        last_frame_spp_ = static_cast<float>(pixel_sample_count) / pixel_count;
+    }
+    else
+    {
+        tile_scheduler_.Dispatch([=, this, &scene](const TileScheduler::Tile &tile) {
+            tile_ray_stats_[tile.index] =
+                RenderTile(tile, pixel_width, pixel_height, frame_seed, UniformSamplesPerFrame, scene, config,
+                           debug_point);
+        });
+
+        last_frame_spp_ = static_cast<float>(UniformSamplesPerFrame);
+    }
+
+    RayStats frame_ray_stats;
+    for (const auto &tile_stats : tile_ray_stats_)
+    {
+        frame_ray_stats += tile_stats;
+    }
+    accumulation_ray_stats_ += frame_ray_stats;
+    last_second_ray_stats_ += frame_ray_stats;
+    {
+        std::lock_guard lock(total_ray_stats_mutex);
+        total_ray_stats += frame_ray_stats;
+    }
+
+    // frames with nothing left to trace say nothing about the cost of a sample
+    if (last_frame_spp_ > 0.f)
+    {
+        const auto time_per_spp = timer.ElapsedMilliSecond() / last_frame_spp_;
+        running_time_per_spp_ = utilities::Lerp(running_time_per_spp_, time_per_spp, 0.5f);
+    }
+
+    Logger::LogToScreen("CpuTiles", std::format("Tiles: {} ({} stolen, {} lanes)",
+                                                tile_scheduler_.GetFinishedTileCount(),
+                                                tile_scheduler_.GetStolenTileCount(), tile_scheduler_.GetLaneCount()));
+}
+
+static void SpatialDenoisePixel(unsigned i, unsigned j, unsigned width, unsigned height, unsigned num_samples,
+                                const CPUGBuffer &gbuffer, PixelBuffer2D<Vector4> &output_buffer)
+{
+    const static std::array<std::tuple<int, int>, 8> Directions{
+        std::tuple<int, int>{1, 0},  std::tuple<int, int>{0, 1},   std::tuple<int, int>{-1, 0},
+        std::tuple<int, int>{0, -1}, std::tuple<int, int>{-1, -1}, std::tuple<int, int>{1, -1},
+        std::tuple<int, int>{-1, 1}, std::tuple<int, int>{1, 1}};
+
+    const Vector3 &world_normal = gbuffer.world_normal(i, j);
+    const Vector3 &color = gbuffer.color(i, j).head<3>();
+
+    // only a valid non-sky intersection may be used as reference
+    if (!gbuffer.IsValid(i, j) || gbuffer.IsSky(i, j))
+    {
+        return;
+    }
+
+    // fill surrounding invalid samples with current sample
+    for (auto k = 0u; k < std::min(num_samples, static_cast<unsigned>(Directions.size())); k++)
+    {
+        auto [dx, dy] = Directions[k];
+        int sample_i = static_cast<int>(i) + dx;
+        int sample_j = static_cast<int>(j) + dy;
+        if (sample_i < 0 || std::cmp_greater_equal(sample_i, width) || sample_j < 0 ||
+            std::cmp_greater_equal(sample_j, height))
+        {
+            continue;
+        }
+
+        auto new_i = static_cast<unsigned>(sample_i);
+        auto new_j = static_cast<unsigned>(sample_j);
+
+        const Vector3 &neighbour_normal = gbuffer.world_normal(new_i, new_j);
+        float neighbour_valid_flag = gbuffer.color(new_i, new_j).w();
+        if (neighbour_valid_flag > 0)
+        {
+            continue;
+        }
+
+        auto similarity = neighbour_normal.dot(world_normal);
+        if (similarity < 0.99f)
+        {
+            continue;
+        }
+
+        auto &output = output_buffer(new_i, new_j);
+        output.head<3>() = color;
+
+        // this channel is reserved for future use
+        output.w() = 1.f;
+
+        break;
+    }
+}
+
+void CPURenderer::PreviewPass(const RenderConfig &config, unsigned level)
+{
+    PROFILE_SCOPE("CPURenderer preview pass");
+
+    const auto &size = preview_levels_[level].size;
+    const float pixel_width = 1.f / static_cast<float>(size.x() - 1);
+    const float pixel_height = 1.f / static_cast<float>(size.y() - 1);
+
+    // the next full resolution frame overwrites the whole gbuffer, so the preview can borrow its corner
+    const auto tile_size = tile_scheduler_.GetTileSize();
+    const auto tile_count_x = (size.x() + tile_size - 1) / tile_size;
+    const auto tile_count_y = (size.y() + tile_size - 1) / tile_size;
+    const Vector2UInt no_debug_point(UINT_MAX, UINT_MAX);
+
+    TaskManager::ParallelFor(0u, tile_count_x * tile_count_y, [&, this](unsigned index) {
+        const auto x = index % tile_count_x * tile_size;
+        const auto y = index / tile_count_x * tile_size;
+        const TileScheduler::Tile tile{.x_begin = x,
+                                       .y_begin = y,
+                                       .x_end = std::min(x + tile_size, size.x()),
+                                       .y_end = std::min(y + tile_size, size.y()),
+                                       .index = index};
+        // previews stay out of the ray totals, see Stats
+        RenderTile(tile, pixel_width, pixel_height, 0, 1, *scene_render_proxy_, config, no_debug_point);
+    }).wait();
+}
+
+void CPURenderer::DenoisePass(const RenderConfig &config, const Vector2UInt &debug_point)
 {
     PROFILE_SCOPE("CPURenderer denoise pass");
 
@@ -511,10 +1598,7 @@ void CPURenderer::DenoisePass(const RenderConfig &config, const Vector2UInt &deb
     if (config.spatial_denoise)
     {
         TaskManager::ParallelFor(0u, resolution_.scene.y(), [this](unsigned j) {
-            for (auto i = 0u; i < resolution_.scene.x(); i++)
-            {
-                ping_pong_buffer_[j][i] = gbuffer_.color[j][i];
-            }
+            std::ranges::copy(gbuffer_.color.Row(j), ping_pong_buffer_.Row(j).begin());
         }).wait();
 
         TaskManager::ParallelFor(0u, resolution_.scene.y(), [this](unsigned j) {
@@ -525,53 +1609,321 @@ void CPURenderer::DenoisePass(const RenderConfig &config, const Vector2UInt &deb
         }).wait();
     }
 
-    const std::vector<std::vector<Vector4>> &pass_input = config.spatial_denoise ? ping_pong_buffer_ : gbuffer_.color;
+    const PixelBuffer2D<Vector4> &pass_input = config.spatial_denoise ? ping_pong_buffer_ : gbuffer_.color;
 
-    auto cumulated_sample_count = camera_->GetCumulatedSampleCount();
-    auto moving_average = static_cast<float>(cumulated_sample_count) /
-                          static_cast<float>(cumulated_sample_count + actual_sample_per_pixel_);
+    // every pixel is weighed by its own sample count, and skipped pixels keep their history
+    if (per_pixel_accumulation_)
+    {
+        TaskManager::ParallelFor(0u, resolution_.scene.y(), [this, &pass_input](unsigned j) {
+            const auto new_sample_counts = gbuffer_.sample_count.Row(j);
+            const auto new_pixels = pass_input.Row(j);
+            const auto new_moments = gbuffer_.luminance_moments.Row(j);
+            const auto sample_counts = pixel_sample_count_.Row(j);
+            const auto pixels = frame_buffer_.Row(j);
+            const auto moments = luminance_moments_.Row(j);
 
-    // temporal denoise
-    TaskManager::ParallelFor(0u, resolution_.scene.y(), [this, &pass_input, moving_average](unsigned j) {
-        for (auto i = 0u; i < resolution_.scene.x(); i++)
-        {
-            const Vector4 &new_pixel = pass_input[j][i];
+            for (auto i = 0u; i < resolution_.scene.x(); i++)
+            {
+                const auto new_sample_count = new_sample_counts[i];
+                if (new_sample_count == 0)
+                {
+                    continue;
+                }
+
+                const auto moving_average =
+                    static_cast<float>(sample_counts[i]) / static_cast<float>(sample_counts[i] + new_sample_count);
+
+                pixels[i] = utilities::Lerp(new_pixels[i], pixels[i], moving_average);
+                moments[i] = utilities::Lerp(new_moments[i], moments[i], moving_average);
+                sample_counts[i] += new_sample_count;
+            }
+        }).wait();
+    }
+    else
+    {
+        auto cumulated_sample_count = camera_->GetCumulatedSampleCount();
+        auto moving_average = static_cast<float>(cumulated_sample_count) /
+                              static_cast<float>(cumulated_sample_count + actual_sample_per_pixel_);
 
-            auto &accumulated_pixel = frame_buffer_[j][i];
+        // temporal denoise
+        TaskManager::ParallelFor(0u, resolution_.scene.y(), [this, &pass_input, moving_average](unsigned j) {
+            const auto new_pixels = pass_input.Row(j);
+            const auto accumulated_pixels = frame_buffer_.Row(j);
+
+            for (auto i = 0u; i < resolution_.scene.x(); i++)
+            {
+                accumulated_pixels[i] = utilities::Lerp(new_pixels[i], accumulated_pixels[i], moving_average);
+            }
+        }).wait();
 
-            accumulated_pixel = utilities::Lerp(new_pixel, accumulated_pixel, moving_average);
+        // the a-trous filter weighs its taps by the noise left, which it gets from the luminance moments
+        if (config.cpu_atrous)
+        {
+            TaskManager::ParallelFor(0u, resolution_.scene.y(), [this, moving_average](unsigned j) {
+                const auto new_moments = gbuffer_.luminance_moments.Row(j);
+                const auto moments = luminance_moments_.Row(j);
+
+                for (auto i = 0u; i < resolution_.scene.x(); i++)
+                {
+                    moments[i] = utilities::Lerp(new_moments[i], moments[i], moving_average);
+                }
+            }).wait();
         }
-    }).wait();
+    }
 
     [[unlikely]] if (debug_point.x() < resolution_.scene.x() && debug_point.y() < resolution_.scene.y())
     {
         Log(Info, "frame buffer {}. new pixel {}",
-            utilities::VectorToString(frame_buffer_[debug_point.y()][debug_point.x()]),
-            utilities::VectorToString(pass_input[debug_point.y()][debug_point.x()]));
+            utilities::VectorToString(frame_buffer_(debug_point.x(), debug_point.y())),
+            utilities::VectorToString(pass_input(debug_point.x(), debug_point.y())));
     }
 }
 
-static Vector3 ACESFilm(const Vector3 &hdr_color, float exposure)
+void CPURenderer::FilterPass()
+{
+    PROFILE_SCOPE("CPURenderer filter pass");
+
+    const auto uniform_sample_count = camera_->GetCumulatedSampleCount();
+
+    // variance of each pixel's mean, from the luminance moments of its samples
+    auto &input = atrous_filter_.GetInput();
+    TaskManager::ParallelFor(0u, resolution_.scene.y(), [this, &input, uniform_sample_count](unsigned j) {
+        const auto pixels = frame_buffer_.Row(j);
+        const auto moments = luminance_moments_.Row(j);
+        const auto filter_input = input.Row(j);
+
+        for (auto i = 0u; i < resolution_.scene.x(); i++)
+        {
+            const auto sample_count = per_pixel_accumulation_ ? pixel_sample_count_(i, j) : uniform_sample_count;
+            const auto variance = sample_count == 0 ? -1.f
+                                                    : std::max(moments[i].y() - moments[i].x() * moments[i].x(), 0.f) /
+                                                          static_cast<float>(sample_count);
+            const Vector3 color = pixels[i].head<3>();
+            filter_input[i] = utilities::ConcatVector(color, variance);
+        }
+    }).wait();
+
+    atrous_filter_.Apply(gbuffer_);
+}
+
+void CPURenderer::ResetPixelAccumulation()
 {
-    Scalar a = 2.51f;
-    Scalar b = 0.03f;
-    Scalar c = 2.43f;
-    Scalar d = 0.59f;
-    Scalar e = 0.14f;
-    auto color = hdr_color.array() * exposure;
-    return utilities::Clamp((color * (color * a + b)) / (color * (color * c + d) + e), 0, 1);
+    TaskManager::ParallelFor(0u, resolution_.scene.y(), [this](unsigned j) {
+        std::ranges::fill(pixel_sample_count_.Row(j), 0u);
+        std::ranges::fill(luminance_moments_.Row(j), Vector2::Zero());
+    }).wait();
+
+    active_tiles_.resize(tile_scheduler_.GetTileCount());
+    std::iota(active_tiles_.begin(), active_tiles_.end(), 0u);
+    std::ranges::fill(tile_finished_, 0);
+
+    tile_cursor_ = 0;
+    accumulated_pixel_sample_count_ = 0;
 }
 
-void CPURenderer::ToneMappingPass(Image2D &image)
+void CPURenderer::PlanTiles(const RenderConfig &config)
 {
-    PROFILE_SCOPE("CPURenderer tonemapping pass");
+    // adaptive sampling alone keeps the frame cost of a full frame: converged tiles pass their share to the rest.
+    // a single tile never takes more than this many samples per pixel in one frame, which bounds the frame time
+    constexpr unsigned MaxSamplesPerTile = 8;
 
-    TaskManager::ParallelFor(0u, resolution_.scene.y(), [&image, this](unsigned j) {
-        for (auto i = 0u; i < resolution_.scene.x(); i++)
+    dispatched_tiles_.clear();
+    tile_sample_count_ = 1;
+
+    if (active_tiles_.empty())
+    {
+        return;
+    }
+
+    if (!config.use_dynamic_spp)
+    {
+        dispatched_tiles_ = active_tiles_;
+        tile_sample_count_ = std::clamp(tile_scheduler_.GetTileCount() / static_cast<unsigned>(active_tiles_.size()),
+                                        1u, MaxSamplesPerTile);
+        return;
+    }
+
+    // dynamic spp: spend what the time budget affords, measured in samples over the whole image
+    uint64_t active_pixel_count = 0;
+    for (auto tile_index : active_tiles_)
+    {
+        const auto tile = tile_scheduler_.GetTile(tile_index);
+        active_pixel_count += static_cast<uint64_t>(tile.x_end - tile.x_begin) * (tile.y_end - tile.y_begin);
+    }
+
+    const auto pixel_count = static_cast<float>(resolution_.scene.x()) * static_cast<float>(resolution_.scene.y());
+    const float time_budget = 1000.f / config.target_framerate * config.cpu_time_budget_ratio;
+    const float affordable_spp = time_budget / std::max(running_time_per_spp_, Eps);
+    const float samples_per_active_pixel = affordable_spp * pixel_count / static_cast<float>(active_pixel_count);
+
+    if (samples_per_active_pixel >= 1.f)
+    {
+        dispatched_tiles_ = active_tiles_;
+        tile_sample_count_ = std::clamp(static_cast<unsigned>(samples_per_active_pixel), 1u,
+                                        std::max(config.max_sample_per_pixel, 1u));
+        return;
+    }
+
+    // not even one sample per pixel fits: trace a window of tiles that moves on every frame
+    const auto tile_count = std::max(
+        static_cast<size_t>(samples_per_active_pixel * static_cast<float>(active_tiles_.size())), size_t{1});
+    tile_cursor_ %= active_tiles_.size();
+    for (auto n = 0u; n < tile_count; n++)
+    {
+        dispatched_tiles_.push_back(active_tiles_[(tile_cursor_ + n) % active_tiles_.size()]);
+    }
+    tile_cursor_ += tile_count;
+}
+
+void CPURenderer::UpdateConvergence(const RenderConfig &config)
+{
+    PROFILE_SCOPE("CPURenderer convergence");
+
+    // too few samples make the variance estimate itself unreliable: a pixel whose first samples all missed a small
+    // light would look converged
+    constexpr uint32_t MinSampleCount = 16;
+    // below this luminance the error is measured in absolute terms, or dark pixels would never converge
+    constexpr Scalar DarkLuminance = 0.1f;
+
+    const bool adaptive = config.adaptive_sampling;
+    const auto threshold = config.adaptive_sampling_threshold;
+    const auto max_sample_count = config.max_sample_per_pixel;
+
+    TaskManager::ParallelFor(0u, static_cast<unsigned>(active_tiles_.size()), [=, this](unsigned n) {
+        const auto tile = tile_scheduler_.GetTile(active_tiles_[n]);
+
+        bool finished = true;
+        for (auto j = tile.y_begin; j < tile.y_end && finished; j++)
         {
-            const Vector3 &pixel = ACESFilm(frame_buffer_[j][i].head<3>(), camera_->GetAttribute().exposure);
-            image.SetPixel(i, resolution_.scene.y() - 1 - j, pixel);
+            for (auto i = tile.x_begin; i < tile.x_end && finished; i++)
+            {
+                const auto sample_count = pixel_sample_count_(i, j);
+                if (sample_count >= max_sample_count)
+                {
+                    continue;
+                }
+
+                if (!adaptive || sample_count < MinSampleCount)
+                {
+                    finished = false;
+                    continue;
+                }
+
+                // standard error of the mean luminance
+                const Vector2 &moments = luminance_moments_(i, j);
+                const auto variance = std::max(moments.y() - moments.x() * moments.x(), 0.f);
+                const auto error = std::sqrt(variance / static_cast<float>(sample_count));
+                finished = error <= threshold * std::max(moments.x(), DarkLuminance);
+            }
         }
+
+        tile_finished_[tile.index] = finished ? 1 : 0;
+    }).wait();
+
+    std::erase_if(active_tiles_, [this](unsigned tile_index) { return tile_finished_[tile_index] != 0; });
+
+    const auto pixel_count = static_cast<double>(resolution_.scene.x()) * resolution_.scene.y();
+    Logger::LogToScreen("CpuAccumulation",
+                        std::format("Accumulation: {} / {} tiles active, {} spp each. average {:.1f} spp",
+                                    active_tiles_.size(), tile_scheduler_.GetTileCount(), tile_sample_count_,
+                                    static_cast<double>(accumulated_pixel_sample_count_) / pixel_count));
+}
+
+// every channel of the row is one flat array, so eigen vectorizes across pixels. alpha goes through the curve as well
+// and is overwritten afterwards.
+void CPURenderer::ToneMapRow(std::span<const Vector4> pixels, Vector4h *output, float exposure)
+{
+    constexpr Scalar A = 2.51f;
+    constexpr Scalar B = 0.03f;
+    constexpr Scalar C = 2.43f;
+    constexpr Scalar D = 0.59f;
+    constexpr Scalar E = 0.14f;
+
+    const auto channel_count = static_cast<Eigen::Index>(pixels.size() * 4);
+    const Eigen::Map<const Eigen::ArrayXf> hdr(pixels.data()->data(), channel_count);
+    Eigen::Map<Eigen::Array<Half, Eigen::Dynamic, 1>> ldr(output->data(), channel_count);
+
+    const auto color = hdr * exposure;
+    ldr = ((color * (color * A + B)) / (color * (color * C + D) + E)).cwiseMax(0.f).cwiseMin(1.f).cast<Half>();
+
+    for (auto i = 0u; i < pixels.size(); i++)
+    {
+        output[i].w() = Half(1.f);
+    }
+}
+
+void CPURenderer::ToneMappingPass(const RenderConfig &config, Vector4h *output)
+{
+    PROFILE_SCOPE("CPURenderer tonemapping pass");
+
+    shown_preview_level_ = trace_preview_level_;
+
+    // the camera's count does not follow pixels that advance on their own
+    const bool was_converged = output_converged_;
+    output_converged_ = shown_preview_level_ == FullResolutionLevel &&
+                        (per_pixel_accumulation_ ? active_tiles_.empty()
+                                                 : camera_->GetCumulatedSampleCount() >= config.max_sample_per_pixel);
+    if (output_converged_ && !was_converged)
+    {
+        LogRayStats();
+    }
+
+    const bool is_preview = shown_preview_level_ < FullResolutionLevel;
+    const auto width = is_preview ? preview_levels_[shown_preview_level_].size.x() : resolution_.scene.x();
+    const auto height = is_preview ? preview_levels_[shown_preview_level_].size.y() : resolution_.scene.y();
+
+    // the image is uploaded bottom-up
+    auto output_row = [output, width, height](unsigned j) {
+        return output + static_cast<size_t>(height - 1 - j) * width;
+    };
+
+    const auto exposure = camera_->GetAttribute().exposure;
+
+    if (is_preview)
+    {
+        TaskManager::ParallelFor(0u, height, [&output_row, exposure, width, this](unsigned j) {
+            ToneMapRow(gbuffer_.color.Row(j, 0, width), output_row(j), exposure);
+        }).wait();
+        return;
+    }
+
+    // samples per pixel relative to max_spp, on a log scale: adaptive sampling spends orders of magnitude more on
+    // noisy pixels than on flat ones
+    if (config.debug_mode == RenderConfig::DebugMode::SampleDensity)
+    {
+        const auto max_sample_count = static_cast<float>(std::max(config.max_sample_per_pixel, 1u));
+        const auto scale = 1.f / std::log2(1.f + max_sample_count);
+        const auto uniform_sample_count = camera_->GetCumulatedSampleCount();
+
+        TaskManager::ParallelFor(0u, height, [&, this](unsigned j) {
+            auto *row = output_row(j);
+            for (auto i = 0u; i < width; i++)
+            {
+                const auto sample_count = per_pixel_accumulation_ ? pixel_sample_count_(i, j) : uniform_sample_count;
+                const auto density = std::log2(1.f + static_cast<float>(sample_count)) * scale;
+                row[i] = utilities::ConcatVector(utilities::VisualizeHeat(density), 1.f).cast<Half>();
+            }
+        }).wait();
+        return;
+    }
+
+    // FinishPath already mapped the cost to [0, 1]
+    if (config.debug_mode == RenderConfig::DebugMode::TraversalCost)
+    {
+        TaskManager::ParallelFor(0u, height, [&output_row, width, this](unsigned j) {
+            auto *row = output_row(j);
+            for (auto i = 0u; i < width; i++)
+            {
+                const auto cost = std::clamp(frame_buffer_(i, j).x(), 0.f, 1.f);
+                row[i] = utilities::ConcatVector(utilities::VisualizeHeat(cost), 1.f).cast<Half>();
+            }
+        }).wait();
+        return;
+    }
+
+    const auto &image = image_filtered_ ? atrous_filter_.GetOutput() : frame_buffer_;
+    TaskManager::ParallelFor(0u, height, [&output_row, &image, exposure](unsigned j) {
+        ToneMapRow(image.Row(j), output_row(j), exposure);
     }).wait();
 }
 } // namespace sparkle
@@ -0,0 +1,281 @@
+#include "renderer/resource/LightTree.h"
+
+#include "core/Exception.h"
+#include "core/Profiler.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace sparkle
+{
+namespace
+{
+// the largest float below 1, so that a rescaled u stays in [0, 1)
+constexpr Scalar OneMinusEpsilon = 1.f - std::numeric_limits<Scalar>::epsilon() * 0.5f;
+} // namespace
+
+void LightTree::SetTriangles(const PrimitiveRenderProxy *primitive, std::vector<Triangle> &&triangles)
+{
+    if (triangles.empty())
+    {
+        RemoveTriangles(primitive);
+        return;
+    }
+
+    dirty_ = true;
+
+    if (auto found = emitter_slots_.find(primitive); found != emitter_slots_.end())
+    {
+        emitters_[found->second].triangles = std::move(triangles);
+        return;
+    }
+
+    emitter_slots_.emplace(primitive, static_cast<uint32_t>(emitters_.size()));
+    emitters_.push_back({.primitive = primitive, .triangles = std::move(triangles)});
+}
+
+void LightTree::RemoveTriangles(const PrimitiveRenderProxy *primitive)
+{
+    auto found = emitter_slots_.find(primitive);
+    if (found == emitter_slots_.end())
+    {
+        return;
+    }
+
+    dirty_ = true;
+
+    const auto slot = found->second;
+    emitter_slots_.erase(found);
+    if (slot + 1 != emitters_.size())
+    {
+        emitters_[slot] = std::move(emitters_.back());
+        emitter_slots_[emitters_[slot].primitive] = slot;
+    }
+    emitters_.pop_back();
+}
+
+void LightTree::Build()
+{
+    if (!dirty_)
+    {
+        return;
+    }
+
+    PROFILE_SCOPE("LightTree::Build");
+
+    dirty_ = false;
+
+    lights_.clear();
+    nodes_.clear();
+    first_lights_.clear();
+
+    for (const auto &[primitive, triangles] : emitters_)
+    {
+        first_lights_.emplace(primitive, static_cast<uint32_t>(lights_.size()));
+
+        for (auto face = 0u; face < triangles.size(); face++)
+        {
+            const auto &triangle = triangles[face];
+            const Vector3 cross = triangle.edge1.cross(triangle.edge2);
+            const Scalar area = cross.norm() * 0.5f;
+
+            lights_.push_back({.v0 = triangle.v0,
+                               .edge1 = triangle.edge1,
+                               .edge2 = triangle.edge2,
+                               .normal = area > 0.f ? Vector3(cross / (area * 2.f)) : Zeros,
+                               .area = area,
+                               .power = triangle.radiance * area,
+                               .primitive = primitive,
+                               .face = face,
+                               .trail = 0});
+        }
+    }
+
+    if (lights_.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> order(lights_.size());
+    std::iota(order.begin(), order.end(), 0u);
+
+    nodes_.reserve(lights_.size() * 2 - 1);
+    nodes_.emplace_back();
+    BuildNode(0, order, 0, static_cast<uint32_t>(order.size()), 0, 0);
+}
+
+void LightTree::BuildNode(uint32_t node_index, std::vector<uint32_t> &order, uint32_t begin, uint32_t end,
+                          uint64_t trail, unsigned depth)
+{
+    ASSERT(depth < MaxDepth);
+
+    auto get_centroid = [this](uint32_t light) -> Vector3 {
+        const auto &l = lights_[light];
+        return l.v0 + (l.edge1 + l.edge2) / 3.f;
+    };
+
+    Vector3 min = Ones * std::numeric_limits<Scalar>::max();
+    Vector3 max = -min;
+    Vector3 centroid_min = min;
+    Vector3 centroid_max = max;
+    Scalar power = 0.f;
+    for (auto i = begin; i < end; i++)
+    {
+        const auto &light = lights_[order[i]];
+        for (const Vector3 &vertex : {light.v0, Vector3(light.v0 + light.edge1), Vector3(light.v0 + light.edge2)})
+        {
+            min = min.cwiseMin(vertex);
+            max = max.cwiseMax(vertex);
+        }
+
+        const Vector3 centroid = get_centroid(order[i]);
+        centroid_min = centroid_min.cwiseMin(centroid);
+        centroid_max = centroid_max.cwiseMax(centroid);
+        power += light.power;
+    }
+
+    if (end - begin == 1)
+    {
+        lights_[order[begin]].trail = trail;
+        nodes_[node_index] = {.min = min, .max = max, .power = power, .index = order[begin], .is_leaf = true};
+        return;
+    }
+
+    // median split along the widest spread of centroids
+    Eigen::Index axis;
+    (centroid_max - centroid_min).maxCoeff(&axis);
+    const auto mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [&get_centroid, axis](uint32_t a, uint32_t b) {
+                         return get_centroid(a)[axis] < get_centroid(b)[axis];
+                     });
+
+    const auto first_child = static_cast<uint32_t>(nodes_.size());
+    nodes_.resize(nodes_.size() + 2);
+    BuildNode(first_child, order, begin, mid, trail, depth + 1);
+    BuildNode(first_child + 1, order, mid, end, trail | (1ull << depth), depth + 1);
+
+    nodes_[node_index] = {.min = min, .max = max, .power = power, .index = first_child, .is_leaf = false};
+}
+
+uint32_t LightTree::FindLight(const PrimitiveRenderProxy *primitive, uint32_t face) const
+{
+    auto found = first_lights_.find(primitive);
+    if (found == first_lights_.end() || face >= lights_.size())
+    {
+        return InvalidLight;
+    }
+
+    const auto light = found->second + face;
+    return light < lights_.size() && lights_[light].primitive == primitive ? light : InvalidLight;
+}
+
+Scalar LightTree::Importance(const Node &node, const Vector3 &position, const Vector3 &normal)
+{
+    if (node.power <= 0.f)
+    {
+        return 0.f;
+    }
+
+    const Vector3 center = (node.min + node.max) * 0.5f;
+    const Scalar radius_sqr = (node.max - center).squaredNorm();
+    const Vector3 to_center = center - position;
+    const Scalar distance_sqr = to_center.squaredNorm();
+
+    // the smallest angle between the normal and any direction into the node's bounding sphere. both sides count, as
+    // transmissive surfaces receive from below
+    Scalar cos_bound = 1.f;
+    if (distance_sqr > radius_sqr && !normal.isZero())
+    {
+        const Scalar cos_theta = std::min(std::abs(normal.dot(to_center)) / std::sqrt(distance_sqr), 1.f);
+        const Scalar sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+        const Scalar sin_bound = std::sqrt(radius_sqr / distance_sqr);
+        const Scalar cos_spread = std::sqrt(1.f - radius_sqr / distance_sqr);
+
+        // cos(max(theta - spread, 0))
+        cos_bound = cos_theta >= cos_spread ? 1.f : cos_theta * cos_spread + sin_theta * sin_bound;
+    }
+
+    return node.power * std::max(cos_bound, 0.f) / std::max({distance_sqr, radius_sqr, Eps});
+}
+
+uint32_t LightTree::Select(const Vector3 &position, const Vector3 &normal, Scalar u, Scalar &pmf) const
+{
+    pmf = 0.f;
+    if (nodes_.empty() || Importance(nodes_[0], position, normal) <= 0.f)
+    {
+        return InvalidLight;
+    }
+
+    pmf = 1.f;
+    const Node *node = &nodes_[0];
+    while (!node->is_leaf)
+    {
+        const auto &left = nodes_[node->index];
+        const auto &right = nodes_[node->index + 1];
+        const Scalar left_importance = Importance(left, position, normal);
+        const Scalar right_importance = Importance(right, position, normal);
+        if (left_importance + right_importance <= 0.f)
+        {
+            pmf = 0.f;
+            return InvalidLight;
+        }
+
+        // u is rescaled at every level, so one number drives the whole descent
+        const Scalar p_left = left_importance / (left_importance + right_importance);
+        if (u < p_left)
+        {
+            u = std::min(u / p_left, OneMinusEpsilon);
+            pmf *= p_left;
+            node = &left;
+        }
+        else
+        {
+            u = std::min((u - p_left) / (1.f - p_left), OneMinusEpsilon);
+            pmf *= 1.f - p_left;
+            node = &right;
+        }
+    }
+
+    return node->index;
+}
+
+Scalar LightTree::Pmf(const Vector3 &position, const Vector3 &normal, uint32_t light) const
+{
+    if (nodes_.empty() || Importance(nodes_[0], position, normal) <= 0.f)
+    {
+        return 0.f;
+    }
+
+    const auto trail = lights_[light].trail;
+
+    Scalar pmf = 1.f;
+    const Node *node = &nodes_[0];
+    for (auto depth = 0u; !node->is_leaf; depth++)
+    {
+        const auto &left = nodes_[node->index];
+        const auto &right = nodes_[node->index + 1];
+        const Scalar left_importance = Importance(left, position, normal);
+        const Scalar right_importance = Importance(right, position, normal);
+        if (left_importance + right_importance <= 0.f)
+        {
+            return 0.f;
+        }
+
+        const Scalar p_left = left_importance / (left_importance + right_importance);
+        if ((trail >> depth) & 1u)
+        {
+            pmf *= 1.f - p_left;
+            node = &right;
+        }
+        else
+        {
+            pmf *= p_left;
+            node = &left;
+        }
+    }
+
+    ASSERT_EQUAL(node->index, light);
+    return pmf;
+}
+} // namespace sparkle
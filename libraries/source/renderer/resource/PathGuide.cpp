@@ -0,0 +1,126 @@
+#include "renderer/resource/PathGuide.h"
+
+#include "core/Profiler.h"
+#include "core/math/Utilities.h"
+#include "core/task/TaskManager.h"
+
+#include <algorithm>
+
+namespace sparkle
+{
+namespace
+{
+constexpr Scalar BinSolidAngle = 4.f * Pi / static_cast<Scalar>(PathGuide::BinCount);
+
+// atomic<float>::fetch_add is not available everywhere yet
+void AtomicAdd(std::atomic<float> &target, float value)
+{
+    float current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+    {
+    }
+}
+} // namespace
+
+void PathGuide::Reset(const AABB &bounds)
+{
+    PROFILE_SCOPE("PathGuide::Reset");
+
+    training_ = std::make_unique<TrainingCell[]>(CellCount);
+    sampling_.assign(CellCount, {});
+
+    const Scalar extent = bounds.IsValid() ? bounds.Size().maxCoeff() : 0.f;
+    grid_origin_ = bounds.IsValid() ? bounds.Min() : Zeros;
+    inv_cell_size_ = extent > Eps ? GridResolution / extent : 1.f;
+}
+
+uint32_t PathGuide::GetCell(const Vector3 &position) const
+{
+    const Vector3 grid_position = (position - grid_origin_) * inv_cell_size_;
+    const auto x = static_cast<uint32_t>(static_cast<int32_t>(std::floor(grid_position.x())));
+    const auto y = static_cast<uint32_t>(static_cast<int32_t>(std::floor(grid_position.y())));
+    const auto z = static_cast<uint32_t>(static_cast<int32_t>(std::floor(grid_position.z())));
+
+    // Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects", 2003
+    return ((x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u)) & (CellCount - 1);
+}
+
+unsigned PathGuide::GetBin(const Vector3 &direction)
+{
+    const auto cos_theta = (direction.z() + 1.f) * 0.5f;
+    const auto cos_theta_bin =
+        std::min(static_cast<unsigned>(cos_theta * static_cast<Scalar>(CosThetaBinCount)), CosThetaBinCount - 1);
+    const auto phi = std::atan2(direction.y(), direction.x()) + Pi;
+    const auto phi_bin =
+        std::min(static_cast<unsigned>(phi * InvPi * 0.5f * static_cast<Scalar>(PhiBinCount)), PhiBinCount - 1);
+    return cos_theta_bin * PhiBinCount + phi_bin;
+}
+
+void PathGuide::Record(uint32_t cell, const Vector3 &direction, Scalar weight)
+{
+    auto &training = training_[cell];
+    AtomicAdd(training.bins[GetBin(direction)], weight);
+    training.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PathGuide::Update()
+{
+    PROFILE_SCOPE("PathGuide::Update");
+
+    constexpr unsigned CellsPerTask = 256;
+    TaskManager::ParallelFor(0u, CellCount / CellsPerTask, [this](unsigned task) {
+        for (auto cell = task * CellsPerTask; cell < (task + 1) * CellsPerTask; cell++)
+        {
+            const auto &training = training_[cell];
+            auto &sampling = sampling_[cell];
+
+            float total = 0.f;
+            for (auto bin = 0u; bin < BinCount; bin++)
+            {
+                total += training.bins[bin].load(std::memory_order_relaxed);
+                sampling.cdf[bin] = total;
+            }
+
+            sampling.trained = total > 0.f && training.count.load(std::memory_order_relaxed) >= MinTrainingCount;
+            if (!sampling.trained)
+            {
+                continue;
+            }
+
+            const float scale = (1.f - UniformShare) / total;
+            for (auto bin = 0u; bin < BinCount; bin++)
+            {
+                sampling.cdf[bin] = sampling.cdf[bin] * scale + UniformShare * static_cast<Scalar>(bin + 1) / BinCount;
+            }
+            sampling.cdf.back() = 1.f;
+        }
+    }).wait();
+}
+
+Vector3 PathGuide::Sample(uint32_t cell, Scalar u_bin, const Vector2 &u, Scalar &pdf) const
+{
+    const auto &cdf = sampling_[cell].cdf;
+    const auto bin = static_cast<unsigned>(
+        std::min<ptrdiff_t>(std::upper_bound(cdf.begin(), cdf.end(), u_bin) - cdf.begin(), BinCount - 1));
+
+    const auto probability = cdf[bin] - (bin > 0 ? cdf[bin - 1] : 0.f);
+    pdf = probability / BinSolidAngle;
+
+    // uniform in cos(theta) and phi is uniform in solid angle
+    const auto cos_theta_bin = bin / PhiBinCount;
+    const auto phi_bin = bin % PhiBinCount;
+    const auto cos_theta =
+        (static_cast<Scalar>(cos_theta_bin) + u.x()) / static_cast<Scalar>(CosThetaBinCount) * 2.f - 1.f;
+    const auto phi = (static_cast<Scalar>(phi_bin) + u.y()) / static_cast<Scalar>(PhiBinCount) * 2.f * Pi - Pi;
+    const auto sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+
+    return {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+}
+
+Scalar PathGuide::Pdf(uint32_t cell, const Vector3 &direction) const
+{
+    const auto &cdf = sampling_[cell].cdf;
+    const auto bin = GetBin(direction);
+    return (cdf[bin] - (bin > 0 ? cdf[bin - 1] : 0.f)) / BinSolidAngle;
+}
+} // namespace sparkle
@@ -0,0 +1,128 @@
+#include "renderer/resource/SkySamplingCookJob.h"
+
+#include "core/Exception.h"
+#include "core/Logger.h"
+#include "core/math/Utilities.h"
+#include "core/task/TaskManager.h"
+#include "io/Image.h"
+
+#include <cstring>
+
+namespace sparkle
+{
+SkySamplingCookJob::SkySamplingCookJob(std::shared_ptr<const Image2DCube> sky_map) : sky_map_(std::move(sky_map))
+{
+    ASSERT(sky_map_->GetWidth() == sky_map_->GetHeight());
+
+    sky_map_hash_ = sky_map_->GetContentHash();
+}
+
+std::string SkySamplingCookJob::GetSourceName() const
+{
+    return sky_map_->GetName();
+}
+
+CookJobResult SkySamplingCookJob::Execute()
+{
+    constexpr uint32_t FaceCount = Image2DCube::FaceId::Count;
+    constexpr size_t CellCount = static_cast<size_t>(FaceCount) * Resolution * Resolution;
+
+    // texels averaged per cell along each axis
+    const uint32_t texels_per_cell = std::max(1u, sky_map_->GetWidth() / Resolution);
+    const auto sample_resolution = static_cast<Scalar>(Resolution * texels_per_cell);
+
+    // the weight of a cell is the light it sends: luminance times its solid angle
+    std::vector<Scalar> weights(CellCount);
+
+    TaskManager::ParallelFor(0u, FaceCount * Resolution, [&, this](unsigned row_index) {
+        const auto face_id = static_cast<Image2DCube::FaceId>(row_index / Resolution);
+        const unsigned y = row_index % Resolution;
+        const auto &face = sky_map_->GetFace(face_id);
+
+        for (unsigned x = 0; x < Resolution; x++)
+        {
+            Scalar luminance = 0.f;
+            for (unsigned j = 0; j < texels_per_cell; j++)
+            {
+                for (unsigned i = 0; i < texels_per_cell; i++)
+                {
+                    const Vector2 uv((static_cast<Scalar>(x * texels_per_cell + i) + 0.5f) / sample_resolution,
+                                     (static_cast<Scalar>(y * texels_per_cell + j) + 0.5f) / sample_resolution);
+                    luminance += std::max(utilities::Luminance(face.Sample(uv)), 0.f);
+                }
+            }
+            luminance /= static_cast<Scalar>(texels_per_cell * texels_per_cell);
+
+            const Scalar u = (static_cast<Scalar>(x) + 0.5f) / Resolution * 2.f - 1.f;
+            const Scalar v = (static_cast<Scalar>(y) + 0.5f) / Resolution * 2.f - 1.f;
+            weights[row_index * Resolution + x] = luminance * SkySamplingTable::GetSolidAngleScale(u, v);
+        }
+
+        cooked_rows_++;
+    }).wait();
+
+    double total_weight = 0.0;
+    for (auto weight : weights)
+    {
+        total_weight += weight;
+    }
+
+    // a black sky still needs a valid distribution
+    if (total_weight <= 0.0)
+    {
+        std::ranges::fill(weights, 1.f);
+        total_weight = static_cast<double>(CellCount);
+    }
+
+    // vose's alias method: every cell of the table is filled up to the average weight by exactly one heavier cell
+    std::vector<SkySamplingTable::Cell> cells(CellCount);
+    std::vector<double> scaled_weights(CellCount);
+    std::vector<uint32_t> light_cells;
+    std::vector<uint32_t> heavy_cells;
+    for (uint32_t cell = 0; cell < CellCount; cell++)
+    {
+        cells[cell].probability = static_cast<float>(weights[cell] / total_weight);
+        scaled_weights[cell] = weights[cell] / total_weight * static_cast<double>(CellCount);
+        (scaled_weights[cell] < 1.0 ? light_cells : heavy_cells).push_back(cell);
+    }
+
+    while (!light_cells.empty() && !heavy_cells.empty())
+    {
+        const auto light = light_cells.back();
+        light_cells.pop_back();
+        const auto heavy = heavy_cells.back();
+
+        cells[light].keep_probability = static_cast<float>(scaled_weights[light]);
+        cells[light].alias = heavy;
+
+        scaled_weights[heavy] -= 1.0 - scaled_weights[light];
+        if (scaled_weights[heavy] < 1.0)
+        {
+            heavy_cells.pop_back();
+            light_cells.push_back(heavy);
+        }
+    }
+
+    // leftovers are full up to rounding error
+    for (auto cell : light_cells)
+    {
+        cells[cell].keep_probability = 1.f;
+        cells[cell].alias = cell;
+    }
+    for (auto cell : heavy_cells)
+    {
+        cells[cell].keep_probability = 1.f;
+        cells[cell].alias = cell;
+    }
+
+    const SkySamplingTable::PayloadHeader header{.resolution = Resolution, .cell_count = CellCount};
+
+    CookPayload payload(sizeof(header) + CellCount * sizeof(SkySamplingTable::Cell));
+    std::memcpy(payload.data(), &header, sizeof(header));
+    std::memcpy(payload.data() + sizeof(header), cells.data(), CellCount * sizeof(SkySamplingTable::Cell));
+
+    Log(Info, "sky sampling table cooked for {}: {} cells", sky_map_->GetName(), CellCount);
+
+    return CookJobResult::Success(std::move(payload));
+}
+} // namespace sparkle
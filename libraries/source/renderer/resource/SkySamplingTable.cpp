@@ -0,0 +1,79 @@
+#include "renderer/resource/SkySamplingTable.h"
+
+#include "core/Exception.h"
+#include "io/Image.h"
+
+#include <cstring>
+
+namespace sparkle
+{
+// area of one cell in face coordinates, which span [-1, 1]
+constexpr Scalar CellArea = (2.f / SkySamplingTable::Resolution) * (2.f / SkySamplingTable::Resolution);
+
+bool SkySamplingTable::LoadFromPayload(const CookPayload &payload)
+{
+    PayloadHeader header{};
+    if (payload.size() < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, payload.data(), sizeof(header));
+
+    const size_t cell_count = static_cast<size_t>(Image2DCube::FaceId::Count) * Resolution * Resolution;
+    if (header.resolution != Resolution || header.cell_count != cell_count ||
+        payload.size() != sizeof(header) + cell_count * sizeof(Cell))
+    {
+        return false;
+    }
+
+    cells_.resize(cell_count);
+    std::memcpy(cells_.data(), payload.data() + sizeof(header), cell_count * sizeof(Cell));
+    return true;
+}
+
+Scalar SkySamplingTable::GetSolidAngleScale(Scalar u, Scalar v)
+{
+    const Scalar d = 1.f + u * u + v * v;
+    return 1.f / (d * std::sqrt(d));
+}
+
+Vector3 SkySamplingTable::Sample(const Vector2 &u_cell, const Vector2 &u_point, Scalar &pdf) const
+{
+    ASSERT(IsValid());
+
+    const auto cell_count = static_cast<uint32_t>(cells_.size());
+    auto cell = std::min(static_cast<uint32_t>(u_cell.x() * static_cast<Scalar>(cell_count)), cell_count - 1);
+    if (u_cell.y() >= cells_[cell].keep_probability)
+    {
+        cell = cells_[cell].alias;
+    }
+
+    const auto face_id = static_cast<Image2DCube::FaceId>(cell / (Resolution * Resolution));
+    const auto y = (cell / Resolution) % Resolution;
+    const auto x = cell % Resolution;
+
+    // uniform within the cell
+    const Scalar u = (static_cast<Scalar>(x) + u_point.x()) / Resolution * 2.f - 1.f;
+    const Scalar v = (static_cast<Scalar>(y) + u_point.y()) / Resolution * 2.f - 1.f;
+
+    pdf = cells_[cell].probability / (CellArea * GetSolidAngleScale(u, v));
+    return Image2DCube::TextureCoordinateToDirection(face_id, u, v);
+}
+
+Scalar SkySamplingTable::Pdf(const Vector3 &direction) const
+{
+    ASSERT(IsValid());
+
+    Vector2 uv;
+    Image2DCube::FaceId face_id;
+    Image2DCube::DirectionToTextureCoordinate(direction, uv, face_id);
+
+    const auto x = std::min(static_cast<uint32_t>(uv.x() * Resolution), Resolution - 1);
+    const auto y = std::min(static_cast<uint32_t>(uv.y() * Resolution), Resolution - 1);
+    const auto cell = (static_cast<uint32_t>(face_id) * Resolution + y) * Resolution + x;
+
+    const Scalar u = uv.x() * 2.f - 1.f;
+    const Scalar v = uv.y() * 2.f - 1.f;
+    return cells_[cell].probability / (CellArea * GetSolidAngleScale(u, v));
+}
+} // namespace sparkle
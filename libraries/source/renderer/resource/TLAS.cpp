@@ -0,0 +1,562 @@
+#include "renderer/resource/TLAS.h"
+
+#include "core/math/Intersection.h"
+#include "core/math/RayStats.h"
+#include "core/task/TaskExecutor.h"
+#include "renderer/proxy/PrimitiveRenderProxy.h"
+
+#include <algorithm>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#include <bvh/v2/default_builder.h>
+#include <bvh/v2/stack.h>
+#pragma GCC diagnostic pop
+
+namespace sparkle
+{
+static_assert(TLAS::MaxDepth + 1 <= RayPacketStackSize, "packets must fit the inline stack when scalar rays do");
+
+static void SetBounds(Node &node, const Vector3 &min, const Vector3 &max)
+{
+    for (auto axis = 0u; axis < 3; axis++)
+    {
+        node.bounds[axis * 2] = min[axis];
+        node.bounds[axis * 2 + 1] = max[axis];
+    }
+}
+
+static Vector3 GetMin(const Node &node)
+{
+    return {node.bounds[0], node.bounds[2], node.bounds[4]};
+}
+
+static Vector3 GetMax(const Node &node)
+{
+    return {node.bounds[1], node.bounds[3], node.bounds[5]};
+}
+
+static Scalar HalfArea(const Vector3 &min, const Vector3 &max)
+{
+    const Vector3 extent = (max - min).cwiseMax(Zeros);
+    return extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x();
+}
+
+// how much a node's surface grows if it has to contain aabb
+static Scalar GetGrowth(const Node &node, const AABB &aabb)
+{
+    const Vector3 min = GetMin(node);
+    const Vector3 max = GetMax(node);
+    return HalfArea(min.cwiseMin(aabb.Min()), max.cwiseMax(aabb.Max())) - HalfArea(min, max);
+}
+
+TLAS::TLAS(const std::vector<PrimitiveRenderProxy *> &primitives) : primitives_(primitives)
+{
+    build_bounds_.resize(primitives_.size());
+    for (size_t i = 0; i < primitives_.size(); ++i)
+    {
+        build_bounds_[i] = primitives_[i]->GetWorldBoundingBox();
+    }
+}
+
+void TLAS::Build()
+{
+    auto num_primitives = primitives_.size();
+
+    built_count_ = num_primitives;
+    updates_since_build_ = 0;
+    depth_ = 0;
+    built_depth_ = 0;
+
+    if (num_primitives == 0)
+    {
+        return;
+    }
+
+    using Vec3 = bvh::v2::Vec<Scalar, 3>;
+    using BBox = bvh::v2::BBox<Scalar, 3>;
+    TaskExecutor executor;
+
+    std::vector<BBox> bboxes(num_primitives);
+    std::vector<Vec3> centers(num_primitives);
+    executor.for_each(0, num_primitives, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const auto &aabb = build_bounds_[i];
+            bboxes[i] = BBox(ToBVHVec3(aabb.Min()), ToBVHVec3(aabb.Max()));
+            centers[i] = ToBVHVec3(aabb.Center());
+        }
+    });
+
+    bvh::v2::DefaultBuilder<Node>::Config config;
+    config.quality = bvh::v2::DefaultBuilder<Node>::Quality::High;
+    bvh_ = bvh::v2::DefaultBuilder<Node>::build(bboxes, centers, config);
+
+    std::vector<PrimitiveRenderProxy *> reordered_geometries(num_primitives);
+    executor.for_each(0, num_primitives, [this, &reordered_geometries](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto j = bvh_.prim_ids[i];
+            reordered_geometries[i] = primitives_[j];
+        }
+    });
+
+    std::swap(reordered_geometries, primitives_);
+
+    slots_.clear();
+    for (size_t i = 0; i < num_primitives; ++i)
+    {
+        slots_[primitives_[i]] = static_cast<uint32_t>(i);
+    }
+
+    LinkNodes();
+    built_depth_ = depth_;
+
+    build_bounds_ = {};
+
+    built_cost_ = ComputeCost();
+    cost_ = built_cost_;
+}
+
+void TLAS::LinkNodes()
+{
+    parents_.assign(bvh_.nodes.size(), InvalidNode);
+    leaves_.assign(primitives_.size(), InvalidNode);
+    depth_ = 0;
+
+    struct Entry
+    {
+        size_t node_id;
+        size_t depth;
+    };
+
+    std::vector<Entry> stack{{.node_id = 0, .depth = 0}};
+    while (!stack.empty())
+    {
+        const auto [node_id, depth] = stack.back();
+        stack.pop_back();
+
+        depth_ = std::max(depth_, depth);
+
+        const auto &node = bvh_.nodes[node_id];
+        if (node.is_leaf())
+        {
+            for (size_t i = node.index.first_id(); i < node.index.first_id() + node.index.prim_count(); ++i)
+            {
+                leaves_[i] = node_id;
+            }
+            continue;
+        }
+
+        for (size_t child_id = node.index.first_id(); child_id < node.index.first_id() + 2; ++child_id)
+        {
+            parents_[child_id] = node_id;
+            stack.push_back({.node_id = child_id, .depth = depth + 1});
+        }
+    }
+}
+
+void TLAS::Insert(PrimitiveRenderProxy *primitive)
+{
+    const auto slot = static_cast<uint32_t>(primitives_.size());
+    primitives_.push_back(primitive);
+    slots_[primitive] = slot;
+    updates_since_build_++;
+
+    const auto aabb = primitive->GetWorldBoundingBox();
+
+    Node leaf;
+    SetBounds(leaf, aabb.Min(), aabb.Max());
+    leaf.index = Node::Index::make_leaf(slot, 1);
+
+    if (bvh_.nodes.empty())
+    {
+        bvh_.nodes.push_back(leaf);
+        parents_.push_back(InvalidNode);
+        leaves_.push_back(0);
+        depth_ = 0;
+        return;
+    }
+
+    size_t node_id = 0;
+    size_t depth = 0;
+    while (!bvh_.nodes[node_id].is_leaf())
+    {
+        const size_t left_id = bvh_.nodes[node_id].index.first_id();
+        const size_t right_id = left_id + 1;
+        node_id = GetGrowth(bvh_.nodes[left_id], aabb) <= GetGrowth(bvh_.nodes[right_id], aabb) ? left_id
+                                                                                                 : right_id;
+        depth++;
+    }
+
+    // the chosen leaf turns into an inner node whose children are its old self and the new leaf
+    const auto first_child = bvh_.nodes.size();
+    const Node sibling = bvh_.nodes[node_id];
+    bvh_.nodes.push_back(sibling);
+    bvh_.nodes.push_back(leaf);
+    bvh_.nodes[node_id].index = Node::Index::make_inner(first_child);
+
+    parents_.push_back(node_id);
+    parents_.push_back(node_id);
+
+    for (size_t i = sibling.index.first_id(); i < sibling.index.first_id() + sibling.index.prim_count(); ++i)
+    {
+        leaves_[i] = first_child;
+    }
+    leaves_.push_back(first_child + 1);
+
+    depth_ = std::max(depth_, depth + 1);
+}
+
+void TLAS::Remove(PrimitiveRenderProxy *primitive)
+{
+    auto found = slots_.find(primitive);
+    if (found == slots_.end())
+    {
+        return;
+    }
+
+    const auto slot = found->second;
+    slots_.erase(found);
+    primitives_[slot] = nullptr;
+    updates_since_build_++;
+
+    const auto leaf_id = leaves_[slot];
+    ASSERT(leaf_id != InvalidNode);
+
+    const auto &leaf = bvh_.nodes[leaf_id];
+    for (size_t i = leaf.index.first_id(); i < leaf.index.first_id() + leaf.index.prim_count(); ++i)
+    {
+        if (primitives_[i])
+        {
+            return;
+        }
+    }
+
+    if (leaf_id == 0)
+    {
+        bvh_.nodes.clear();
+        parents_.clear();
+        depth_ = 0;
+        return;
+    }
+
+    // unlinked nodes stay in the array until the next build
+    const auto parent_id = parents_[leaf_id];
+    const auto first_child = bvh_.nodes[parent_id].index.first_id();
+    const auto sibling_id = leaf_id == first_child ? first_child + 1 : first_child;
+    const Node sibling = bvh_.nodes[sibling_id];
+    bvh_.nodes[parent_id] = sibling;
+
+    // whatever hangs below the sibling now hangs below the parent's slot
+    if (sibling.is_leaf())
+    {
+        for (size_t i = sibling.index.first_id(); i < sibling.index.first_id() + sibling.index.prim_count(); ++i)
+        {
+            leaves_[i] = parent_id;
+        }
+    }
+    else
+    {
+        parents_[sibling.index.first_id()] = parent_id;
+        parents_[sibling.index.first_id() + 1] = parent_id;
+    }
+}
+
+void TLAS::Refit()
+{
+    if (!bvh_.nodes.empty())
+    {
+        RefitNode(0);
+    }
+
+    cost_ = ComputeCost();
+}
+
+bool TLAS::NeedsRebuild() const
+{
+    static constexpr size_t MinUpdatesBeforeRebuild = 64;
+
+    return depth_ > built_depth_ + MaxInsertedDepth ||
+           updates_since_build_ > std::max(built_count_, MinUpdatesBeforeRebuild);
+}
+
+void TLAS::RefitNode(size_t node_id)
+{
+    auto &node = bvh_.nodes[node_id];
+    if (node.is_leaf())
+    {
+        Vector3 min = Ones * std::numeric_limits<Scalar>::max();
+        Vector3 max = Ones * -std::numeric_limits<Scalar>::max();
+        for (size_t i = node.index.first_id(); i < node.index.first_id() + node.index.prim_count(); ++i)
+        {
+            if (primitives_[i])
+            {
+                const auto aabb = primitives_[i]->GetWorldBoundingBox();
+                min = min.cwiseMin(aabb.Min());
+                max = max.cwiseMax(aabb.Max());
+            }
+        }
+        SetBounds(node, min, max);
+        return;
+    }
+
+    const size_t left_id = node.index.first_id();
+    RefitNode(left_id);
+    RefitNode(left_id + 1);
+
+    const auto &left = bvh_.nodes[left_id];
+    const auto &right = bvh_.nodes[left_id + 1];
+    SetBounds(bvh_.nodes[node_id], GetMin(left).cwiseMin(GetMin(right)), GetMax(left).cwiseMax(GetMax(right)));
+}
+
+Scalar TLAS::ComputeCost() const
+{
+    if (bvh_.nodes.empty())
+    {
+        return 0.f;
+    }
+
+    const auto root_area = HalfArea(GetMin(bvh_.nodes[0]), GetMax(bvh_.nodes[0]));
+    if (root_area <= 0.f)
+    {
+        return 0.f;
+    }
+
+    Scalar cost = 0.f;
+    std::vector<size_t> stack{0};
+    while (!stack.empty())
+    {
+        const auto node_id = stack.back();
+        stack.pop_back();
+
+        const auto &node = bvh_.nodes[node_id];
+        const auto area = HalfArea(GetMin(node), GetMax(node));
+        if (node.is_leaf())
+        {
+            cost += area * static_cast<Scalar>(node.index.prim_count());
+            continue;
+        }
+
+        cost += area;
+        stack.push_back(node.index.first_id());
+        stack.push_back(node.index.first_id() + 1);
+    }
+
+    return cost / root_area;
+}
+
+template <bool AnyHit> void TLAS::IntersectInternal(const Ray &ray, Intersection &intersection) const
+{
+    if (bvh_.nodes.empty())
+    {
+        return;
+    }
+
+    static constexpr size_t InvalidId = std::numeric_limits<size_t>::max();
+    static constexpr size_t StackSize = MaxDepth;
+    static constexpr bool UseRobustTraversal = false;
+
+    auto prim_id = InvalidId;
+
+    bvh::v2::Ray<Scalar, 3> bvh_ray(ToBVHVec3(ray.Origin()), ToBVHVec3(ray.Direction()), 0.f, ray.MaxDistance());
+
+    IntersectionCandidate candidate;
+    candidate.t = ray.MaxDistance();
+
+    auto &stats = RayStats::GetThreadLocal();
+
+    auto leaf_fn = [this, &ray, &bvh_ray, &prim_id, &candidate, &stats](size_t begin, size_t end) {
+        stats.leaf_visits++;
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (!primitives_[i])
+            {
+                continue;
+            }
+
+            if (AnyHit ? primitives_[i]->IntersectAnyHit(ray, candidate) : primitives_[i]->Intersect(ray, candidate))
+            {
+                prim_id = i;
+                candidate.primitive = primitives_[i];
+
+                // primitives report world-space t, so instances behind the closest hit are culled
+                bvh_ray.tmax = candidate.t;
+            }
+        }
+        return prim_id != InvalidId;
+    };
+    auto inner_fn = [&stats](auto &&...) { stats.node_visits++; };
+
+    // depth_ bounds the pending nodes, so only a tree deeper than the inline stack pays for a heap allocation
+    if (depth_ <= StackSize)
+    {
+        bvh::v2::SmallStack<Bvh::Index, StackSize> stack;
+        bvh_.intersect<AnyHit, UseRobustTraversal>(bvh_ray, bvh_.get_root().index, stack, leaf_fn, inner_fn);
+    }
+    else
+    {
+        bvh::v2::GrowingStack<Bvh::Index> stack;
+        bvh_.intersect<AnyHit, UseRobustTraversal>(bvh_ray, bvh_.get_root().index, stack, leaf_fn, inner_fn);
+    }
+
+    if (candidate.primitive)
+    {
+        if constexpr (AnyHit)
+        {
+            intersection.Update(ray, candidate.primitive);
+        }
+        else
+        {
+            candidate.primitive->GetIntersection(ray, candidate, intersection);
+        }
+    }
+}
+
+void TLAS::Intersect(const Ray &ray, Intersection &intersection) const
+{
+    IntersectInternal<false>(ray, intersection);
+}
+
+void TLAS::IntersectAnyHit(const Ray &ray, Intersection &intersection) const
+{
+    IntersectInternal<true>(ray, intersection);
+}
+
+template <bool AnyHit>
+void TLAS::IntersectPacketInternal(DefaultRayPacket &packet,
+                                   std::span<Intersection *, DefaultRayPacket::Size> intersections) const
+{
+    if (bvh_.nodes.empty())
+    {
+        return;
+    }
+
+    std::array<IntersectionCandidate, DefaultRayPacket::Size> candidates;
+    ForEachLane(packet.GetActiveMask(),
+                [&packet, &candidates](unsigned lane) { candidates[lane].t = packet.GetMaxDistance(lane); });
+
+    auto leaf_fn = [this, &packet, &candidates](size_t begin, size_t end, RayPacketMask mask) {
+        for (size_t i = begin; i < end && mask; ++i)
+        {
+            if (!primitives_[i])
+            {
+                continue;
+            }
+
+            auto hit_mask = AnyHit ? primitives_[i]->IntersectAnyHitPacket(packet, mask, candidates)
+                                   : primitives_[i]->IntersectPacket(packet, mask, candidates);
+
+            ForEachLane(hit_mask, [this, i, &packet, &mask, &candidates](unsigned lane) {
+                candidates[lane].primitive = primitives_[i];
+
+                // an any-hit lane is done as soon as it hits something
+                if constexpr (AnyHit)
+                {
+                    packet.Deactivate(lane);
+                    mask &= ~(1u << lane);
+                }
+                else
+                {
+                    packet.SetMaxDistance(lane, candidates[lane].t);
+                }
+            });
+        }
+    };
+
+    TraversePacket(bvh_, packet, leaf_fn);
+
+    for (auto lane = 0u; lane < DefaultRayPacket::Size; lane++)
+    {
+        auto &candidate = candidates[lane];
+        if (!candidate.primitive)
+        {
+            continue;
+        }
+
+        const auto &ray = packet.GetRay(lane);
+        if constexpr (AnyHit)
+        {
+            intersections[lane]->Update(ray, candidate.primitive);
+        }
+        else
+        {
+            candidate.primitive->GetIntersection(ray, candidate, *intersections[lane]);
+        }
+    }
+}
+
+template <bool AnyHit>
+void TLAS::IntersectPacket(std::span<const Ray> rays, std::span<Intersection> intersections) const
+{
+    ASSERT(rays.size() <= DefaultRayPacket::Size);
+    ASSERT_EQUAL(rays.size(), intersections.size());
+
+    DefaultRayPacket packet;
+    std::array<Intersection *, DefaultRayPacket::Size> lane_intersections{};
+    for (auto lane = 0u; lane < rays.size(); lane++)
+    {
+        packet.SetRay(lane, &rays[lane]);
+        lane_intersections[lane] = &intersections[lane];
+    }
+
+    IntersectPacketInternal<AnyHit>(packet, lane_intersections);
+}
+
+template <bool AnyHit>
+void TLAS::IntersectStream(std::span<const Ray> rays, std::span<Intersection> intersections) const
+{
+    ASSERT_EQUAL(rays.size(), intersections.size());
+
+    // counting sort by direction octant so that every packet holds rays that traverse the tree in a similar order
+    static constexpr unsigned NumOctants = 8;
+    static thread_local std::vector<uint32_t> sorted_rays;
+    sorted_rays.resize(rays.size());
+
+    std::array<uint32_t, NumOctants + 1> octant_offsets{};
+    auto get_octant = [](const Ray &ray) {
+        const Vector3 direction = ray.Direction();
+        return static_cast<unsigned>(direction.x() < 0) | (static_cast<unsigned>(direction.y() < 0) << 1u) |
+               (static_cast<unsigned>(direction.z() < 0) << 2u);
+    };
+
+    for (const auto &ray : rays)
+    {
+        octant_offsets[get_octant(ray) + 1]++;
+    }
+    for (auto octant = 0u; octant < NumOctants; octant++)
+    {
+        octant_offsets[octant + 1] += octant_offsets[octant];
+    }
+
+    // stable, so coherent (e.g. primary) rays keep their screen-space order within an octant
+    auto octant_cursors = octant_offsets;
+    for (auto i = 0u; i < rays.size(); i++)
+    {
+        sorted_rays[octant_cursors[get_octant(rays[i])]++] = i;
+    }
+
+    for (auto octant = 0u; octant < NumOctants; octant++)
+    {
+        for (auto begin = octant_offsets[octant]; begin < octant_offsets[octant + 1]; begin += DefaultRayPacket::Size)
+        {
+            const auto end = std::min(begin + DefaultRayPacket::Size, octant_offsets[octant + 1]);
+
+            DefaultRayPacket packet;
+            std::array<Intersection *, DefaultRayPacket::Size> lane_intersections{};
+            for (auto i = begin; i < end; i++)
+            {
+                packet.SetRay(i - begin, &rays[sorted_rays[i]]);
+                lane_intersections[i - begin] = &intersections[sorted_rays[i]];
+            }
+
+            IntersectPacketInternal<AnyHit>(packet, lane_intersections);
+        }
+    }
+}
+
+template void TLAS::IntersectPacket<true>(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+template void TLAS::IntersectPacket<false>(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+template void TLAS::IntersectStream<true>(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+template void TLAS::IntersectStream<false>(std::span<const Ray> rays, std::span<Intersection> intersections) const;
+} // namespace sparkle
@@ -239,6 +239,12 @@ void RHIBuffer::UploadImmediate(const void *data)
     UnLock();
 }
 
+void *RHIBuffer::GetDynamicMappedAddress(RHIContext *rhi) const
+{
+    ASSERT(IsDynamic());
+    return dynamic_allocation_.GetMappedAddress(rhi->GetFrameIndex());
+}
+
 void RHIBuffer::Upload(RHIContext *rhi, const void *data)
 {
     if (IsDynamic())
@@ -95,7 +95,7 @@ void SceneManager::GenerateRandomSpheres(Scene &scene, unsigned count)
         // find a suitable random position
         do
         {
-            Vector2 position_xy = sampler::UnitDisk<true>() * spread_radius;
+            Vector2 position_xy = sampler::UnitDisk(sampler::Random2D<true>()) * spread_radius;
             Vector3 position = spread_center + Vector3(position_xy.x(), position_xy.y(), radius);
             node->SetTransform(position, Zeros, Ones * radius);
         } while (scene.BoxCollides(primitive.get()));
@@ -0,0 +1,115 @@
+#include "application/TestCase.h"
+
+#include "application/AppFramework.h"
+#include "core/Logger.h"
+#include "core/math/Sampler.h"
+#include "io/Image.h"
+#include "renderer/resource/SkySamplingCookJob.h"
+#include "renderer/resource/SkySamplingTable.h"
+#include "scene/Scene.h"
+#include "scene/component/light/SkyLight.h"
+
+namespace sparkle
+{
+// the luminance sampling table cooked from the live sky cube: a normalized pdf that agrees with the samples drawn from
+// it, and that favors the bright part of the sky
+class SkySamplingTest : public TestCase
+{
+public:
+    Result OnTick(AppFramework &app) override
+    {
+        const auto *sky_light = app.GetScene()->GetSkyLight();
+        if (sky_light == nullptr || !sky_light->GetCubeMap())
+        {
+            return Result::Pending;
+        }
+
+        const auto &cube = sky_light->GetCubeMap();
+
+        SkySamplingCookJob job(cube);
+        auto result = job.Execute();
+        bool success = Expect(result.IsSuccess(), "cook job produces a payload");
+
+        SkySamplingTable table;
+        success &= Expect(success && table.LoadFromPayload(result.GetPayload()), "payload loads into a table");
+        if (!success)
+        {
+            return Result::Fail;
+        }
+
+        sampler::ReseedCurrentThread(42);
+
+        // uniform directions estimate the integral of the pdf over the sphere
+        constexpr unsigned SampleCount = 1 << 20;
+        double pdf_integral = 0.0;
+        for (unsigned i = 0; i < SampleCount; i++)
+        {
+            Scalar uniform_pdf = 0.f;
+            const Vector3 direction = SampleUniform(uniform_pdf);
+            pdf_integral += table.Pdf(direction) / uniform_pdf;
+        }
+        pdf_integral /= SampleCount;
+        Log(Info, "SkySamplingTest: pdf integrates to {:.4f}", pdf_integral);
+        success &= Expect(std::abs(pdf_integral - 1.0) < 0.05, "pdf integrates to one over the sphere");
+
+        // the pdf a sample reports is the pdf of its direction, and samples land on brighter sky than average
+        unsigned pdf_mismatches = 0;
+        double sampled_luminance = 0.0;
+        double average_luminance = 0.0;
+        for (unsigned i = 0; i < SampleCount; i++)
+        {
+            Scalar pdf = 0.f;
+            const Vector2 u_cell = sampler::Random2D();
+            const Vector2 u_point = sampler::Random2D();
+            const Vector3 direction = table.Sample(u_cell, u_point, pdf);
+            const auto expected_pdf = table.Pdf(direction);
+            pdf_mismatches += std::abs(pdf - expected_pdf) <= 1e-3f * expected_pdf ? 0 : 1;
+
+            sampled_luminance += cube->Sample(direction).sum();
+
+            Scalar uniform_pdf = 0.f;
+            average_luminance += cube->Sample(SampleUniform(uniform_pdf)).sum();
+        }
+        Log(Info, "SkySamplingTest: {} pdf mismatches. mean luminance sampled {:.4f}, uniform {:.4f}", pdf_mismatches,
+            sampled_luminance / SampleCount, average_luminance / SampleCount);
+        // a handful of samples may sit on a cell or face border, where the two lookups can pick neighbours
+        success &= Expect(pdf_mismatches < SampleCount / 1000, "sampled pdf matches the pdf lookup");
+        success &= Expect(sampled_luminance >= average_luminance, "samples favor the bright sky");
+
+        // the path tracer hands the table points from its own sequence, so the table must not draw any itself
+        Scalar first_pdf = 0.f;
+        Scalar second_pdf = 0.f;
+        const Vector3 first = table.Sample(Vector2(0.3f, 0.7f), Vector2(0.2f, 0.9f), first_pdf);
+        (void)sampler::Random2D();
+        const Vector3 second = table.Sample(Vector2(0.3f, 0.7f), Vector2(0.2f, 0.9f), second_pdf);
+        success &= Expect(first == second && first_pdf == second_pdf, "a sample depends on its sample points alone");
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    static Vector3 SampleUniform(Scalar &pdf)
+    {
+        const auto cos_theta = 1.f - 2.f * sampler::RandomUnit();
+        const auto sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+        const auto phi = 2.f * Pi * sampler::RandomUnit();
+        pdf = InvPi * 0.25f;
+        return utilities::SphericalToCartesian(cos_theta, sin_theta, std::cos(phi), std::sin(phi));
+    }
+
+    static bool Expect(bool condition, const char *description)
+    {
+        if (condition)
+        {
+            Log(Info, "SkySamplingTest: PASS: {}", description);
+        }
+        else
+        {
+            Log(Error, "SkySamplingTest: FAIL: {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<SkySamplingTest> sky_sampling_test_registrar("sky_sampling");
+} // namespace sparkle
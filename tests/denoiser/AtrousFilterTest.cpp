@@ -0,0 +1,153 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "core/math/Utilities.h"
+#include "renderer/denoiser/AtrousFilter.h"
+#include "renderer/resource/GBuffer.h"
+
+#include <random>
+
+namespace sparkle
+{
+// the cpu a-trous filter on a synthetic frame: two flat walls meeting at a crease, under per-pixel noise as 4 spp
+// would leave it. the noise must drop without light bleeding across the crease, and pixels without noise, samples or
+// geometry must come out as they went in. runs anywhere: no scene, no RHI
+class AtrousFilterTest : public TestCase
+{
+    static constexpr unsigned Width = 96;
+    static constexpr unsigned Height = 48;
+    static constexpr unsigned EdgeX = Width / 2;
+    static constexpr unsigned SampleCount = 4;
+    // luminance std of one sample
+    static constexpr Scalar SampleNoise = 0.3f;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        SetupGuides();
+
+        bool success = VerifyNoiseReduction();
+        success &= VerifyPassThrough();
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    static Vector3 GetTruth(unsigned i)
+    {
+        return Ones * (i < EdgeX ? 0.2f : 0.8f);
+    }
+
+    void SetupGuides()
+    {
+        gbuffer_.Resize(Width, Height);
+        filter_.Resize(Width, Height);
+
+        for (auto j = 0u; j < Height; j++)
+        {
+            for (auto i = 0u; i < Width; i++)
+            {
+                gbuffer_.world_normal(i, j) = i < EdgeX ? Vector3(0, 0, 1) : Vector3(1, 0, 0);
+                gbuffer_.depth(i, j) = 5.f;
+                gbuffer_.albedo(i, j) = Ones * 0.5f;
+            }
+        }
+    }
+
+    bool VerifyNoiseReduction()
+    {
+        std::mt19937 rng(9);
+        std::normal_distribution<Scalar> noise(0.f, SampleNoise / std::sqrt(static_cast<Scalar>(SampleCount)));
+        const Scalar variance = SampleNoise * SampleNoise / SampleCount;
+
+        auto &input = filter_.GetInput();
+        for (auto j = 0u; j < Height; j++)
+        {
+            for (auto i = 0u; i < Width; i++)
+            {
+                const Vector3 color = GetTruth(i) + Ones * noise(rng);
+                input(i, j) = utilities::ConcatVector(color, variance);
+            }
+        }
+
+        const auto noisy_error = GetError(input);
+        filter_.Apply(gbuffer_);
+        const auto filtered_error = GetError(filter_.GetOutput());
+
+        // nothing of the bright wall may leak into the dark one
+        Scalar edge_mean = 0.f;
+        for (auto j = 0u; j < Height; j++)
+        {
+            edge_mean += filter_.GetOutput()(EdgeX - 1, j).x() / Height;
+        }
+
+        Log(Info, "AtrousFilterTest: rmse {:.4f} -> {:.4f}, dark side of the crease {:.3f}", noisy_error,
+            filtered_error, edge_mean);
+
+        bool success = Expect(filtered_error * 4.f < noisy_error, "4 spp noise drops to under a quarter");
+        success &= Expect(std::abs(edge_mean - GetTruth(0).x()) < 0.03f, "light does not bleed across the crease");
+        return success;
+    }
+
+    bool VerifyPassThrough()
+    {
+        // a converged gradient, a pixel with no samples, and a sky pixel
+        auto &input = filter_.GetInput();
+        for (auto j = 0u; j < Height; j++)
+        {
+            for (auto i = 0u; i < Width; i++)
+            {
+                const Vector3 color = Ones * (static_cast<Scalar>(i + j) * 0.01f);
+                input(i, j) = utilities::ConcatVector(color, 0.f);
+            }
+        }
+        input(3, 3).w() = -1.f;
+        gbuffer_.world_normal(5, 5) = Zeros;
+        input(5, 5).head<3>() = Ones * 100.f;
+
+        filter_.Apply(gbuffer_);
+
+        bool unchanged = true;
+        for (auto j = 0u; j < Height; j++)
+        {
+            for (auto i = 0u; i < Width; i++)
+            {
+                const Vector3 difference = filter_.GetOutput()(i, j).head<3>() - input(i, j).head<3>();
+                unchanged &= difference.cwiseAbs().maxCoeff() < 1e-4f;
+            }
+        }
+        return Expect(unchanged, "converged, empty and sky pixels pass through, and the sky does not spread");
+    }
+
+    static Scalar GetError(const PixelBuffer2D<Vector4> &image)
+    {
+        double squared_error = 0.0;
+        for (auto j = 0u; j < Height; j++)
+        {
+            for (auto i = 0u; i < Width; i++)
+            {
+                squared_error += (image(i, j).head<3>() - GetTruth(i)).squaredNorm() / 3.0;
+            }
+        }
+        return static_cast<Scalar>(std::sqrt(squared_error / (Width * Height)));
+    }
+
+    static bool Expect(bool condition, const char *description)
+    {
+        if (condition)
+        {
+            Log(Info, "AtrousFilterTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "AtrousFilterTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+
+    CPUGBuffer gbuffer_;
+    AtrousFilter filter_;
+};
+
+static TestCaseRegistrar<AtrousFilterTest> atrous_filter_test_registrar("atrous_filter");
+} // namespace sparkle
@@ -0,0 +1,195 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "core/Timer.h"
+#include "io/Image.h"
+
+#include <random>
+
+namespace sparkle
+{
+// tiled texel storage must be invisible to readers, and the random-access sampling throughput of both layouts is
+// logged. runs anywhere: no scene, no RHI
+class TexelLayoutTest : public TestCase
+{
+    static constexpr unsigned BenchmarkSize = 2048;
+    static constexpr unsigned SampleCount = 2000000;
+    static constexpr unsigned ClusterSize = 16;
+    // in texels
+    static constexpr Scalar ClusterRadius = 8.f;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        bool success = VerifyLayout(8, 8);
+        // partial blocks on both edges
+        success &= VerifyLayout(13, 6);
+        success &= VerifyLayout(1, 17);
+        success &= VerifyTiledSampling();
+        success &= VerifyLevels();
+
+        Benchmark();
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    static Image2D CreateNoise(unsigned width, unsigned height, PixelFormat format)
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+
+        Image2D image(width, height, format);
+        for (auto j = 0u; j < height; j++)
+        {
+            for (auto i = 0u; i < width; i++)
+            {
+                image.SetPixel(i, j, Vector3(unit(rng), unit(rng), unit(rng)));
+            }
+        }
+        return image;
+    }
+
+    static bool VerifyLayout(unsigned width, unsigned height)
+    {
+        const auto linear = CreateNoise(width, height, PixelFormat::RGBAFloat);
+        auto tiled = linear;
+        tiled.SetTexelLayout(TexelLayout::Tiled);
+
+        bool same_pixels = true;
+        for (auto j = 0u; j < height; j++)
+        {
+            for (auto i = 0u; i < width; i++)
+            {
+                same_pixels &= tiled.AccessPixel(i, j) == linear.AccessPixel(i, j);
+            }
+        }
+
+        bool success = Expect(same_pixels, std::format("{}x{} tiled texels read back unchanged", width, height));
+        success &= Expect(tiled.IsValid() && tiled.GetStorageSize() % (64 * sizeof(Vector4)) == 0,
+                          std::format("{}x{} tiled storage is padded to whole blocks", width, height));
+
+        tiled.SetTexelLayout(TexelLayout::Linear);
+        success &= Expect(tiled.GetStorageSize() == linear.GetStorageSize() &&
+                              std::equal(tiled.GetRawData(), tiled.GetRawData() + tiled.GetStorageSize(),
+                                         linear.GetRawData()),
+                          std::format("{}x{} converts back to the same linear bytes", width, height));
+        return success;
+    }
+
+    static bool VerifyTiledSampling()
+    {
+        const auto image = CreateNoise(37, 21, PixelFormat::R8G8B8A8Srgb);
+
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<Scalar> uv(0.f, 3.f);
+        std::vector<Vector2> coordinates(1000);
+        std::vector<Vector3> expected(coordinates.size());
+        for (auto i = 0u; i < coordinates.size(); i++)
+        {
+            coordinates[i] = Vector2(uv(rng), uv(rng));
+            expected[i] = image.Sample(coordinates[i]);
+        }
+
+        const auto copy = image;
+        image.EnableTiledSampling();
+
+        bool same_samples = true;
+        for (auto i = 0u; i < coordinates.size(); i++)
+        {
+            same_samples &= image.Sample(coordinates[i]) == expected[i];
+            same_samples &= copy.Sample(coordinates[i]) == expected[i];
+        }
+
+        bool success = Expect(same_samples, "bilinear samples match with tiled sampling enabled, copies included");
+        success &= Expect(image.GetTexelLayout() == TexelLayout::Linear, "the image itself stays linear");
+        return success;
+    }
+
+    static bool VerifyLevels()
+    {
+        const auto image = CreateNoise(24, 10, PixelFormat::RGBAFloat16);
+
+        bool success = true;
+        for (auto level = 1u; level < image.GetLevelCount(); level++)
+        {
+            success &= Expect(image.GetLevel(level).GetTexelLayout() == TexelLayout::Tiled,
+                              std::format("mip level {} is tiled", level));
+        }
+        return success;
+    }
+
+    static void Benchmark()
+    {
+        const auto linear = CreateNoise(BenchmarkSize, BenchmarkSize, PixelFormat::RGBAFloat16);
+        auto tiled = linear;
+        tiled.SetTexelLayout(TexelLayout::Tiled);
+
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+        std::uniform_real_distribution<Scalar> jitter(-ClusterRadius, ClusterRadius);
+
+        // incoherent bounces: every lookup lands somewhere new
+        std::vector<Vector2> scattered(SampleCount);
+        for (auto &coordinate : scattered)
+        {
+            coordinate = Vector2(unit(rng), unit(rng));
+        }
+
+        // neighbouring paths that hit the same area of a texture in no particular order
+        std::vector<Vector2> clustered(SampleCount);
+        for (auto i = 0u; i < SampleCount; i += ClusterSize)
+        {
+            const Vector2 center(unit(rng), unit(rng));
+            for (auto k = i; k < std::min(i + ClusterSize, SampleCount); k++)
+            {
+                clustered[k] = center + Vector2(jitter(rng), jitter(rng)) / static_cast<Scalar>(BenchmarkSize);
+            }
+        }
+
+        auto measure = [](const Image2D &image, const std::vector<Vector2> &coordinates) {
+            Vector3 sum = Zeros;
+            Timer timer;
+            for (const auto &coordinate : coordinates)
+            {
+                sum += image.Sample(coordinate);
+            }
+            const float seconds = timer.ElapsedSecond();
+            // keeps the loop alive
+            Log(Debug, "TexelLayoutTest: checksum {}", sum.sum());
+            return seconds;
+        };
+
+        // touch both once so that page faults do not count against the first one
+        (void)measure(linear, scattered);
+        (void)measure(tiled, scattered);
+
+        for (const auto &[pattern, coordinates] :
+             {std::pair{"scattered", &scattered}, std::pair{"clustered", &clustered}})
+        {
+            const float linear_seconds = measure(linear, *coordinates);
+            const float tiled_seconds = measure(tiled, *coordinates);
+
+            const auto sample_count = static_cast<float>(SampleCount);
+            Log(Info, "TexelLayoutTest: {}x{} fp16 {}, linear {:.2f} Msamples/s, tiled {:.2f} Msamples/s ({:.2f}x)",
+                BenchmarkSize, BenchmarkSize, pattern, sample_count / linear_seconds * 1e-6f,
+                sample_count / tiled_seconds * 1e-6f, linear_seconds / tiled_seconds);
+        }
+    }
+
+    static bool Expect(bool condition, const std::string &description)
+    {
+        if (condition)
+        {
+            Log(Info, "TexelLayoutTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "TexelLayoutTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<TexelLayoutTest> texel_layout_test_registrar("texel_layout");
+} // namespace sparkle
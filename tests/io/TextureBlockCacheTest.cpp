@@ -0,0 +1,123 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "io/TextureBlockCache.h"
+#include "io/TextureCompression.h"
+
+#include <random>
+
+namespace sparkle
+{
+// compressed images sampled block by block must read exactly like their full decode, whatever the cache capacity.
+// runs anywhere: no store, no cooker, no RHI
+class TextureBlockCacheTest : public TestCase
+{
+    // partial blocks on both edges for 4x4 and 6x6 formats
+    static constexpr unsigned Width = 45;
+    static constexpr unsigned Height = 29;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        bool success = true;
+        for (auto family : {TextureCompression::Family::Astc, TextureCompression::Family::Bc})
+        {
+            success &= VerifyFamily(family);
+        }
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    static Image2D MakeSource()
+    {
+        std::vector<uint8_t> pixels(static_cast<size_t>(Width) * Height * 4);
+        for (unsigned y = 0; y < Height; y++)
+        {
+            for (unsigned x = 0; x < Width; x++)
+            {
+                const size_t i = (static_cast<size_t>(y) * Width + x) * 4;
+                pixels[i + 0] = static_cast<uint8_t>((x * 255u) / Width);
+                pixels[i + 1] = static_cast<uint8_t>((y * 255u) / Height);
+                pixels[i + 2] = static_cast<uint8_t>(((x ^ y) * 37u) % 256u);
+                pixels[i + 3] = 255;
+            }
+        }
+        return {Width, Height, PixelFormat::R8G8B8A8Srgb, pixels};
+    }
+
+    static bool VerifyFamily(TextureCompression::Family family)
+    {
+        const std::string label = TextureCompression::GetFamilyName(family);
+
+        const auto payload = TextureCompression::Encode(MakeSource(), TextureCompression::Profile::Color, family);
+        const auto compressed = TextureCompression::CreateImageFromPayload(payload, "texture_block_cache_test");
+        if (!Expect(compressed != nullptr, label + ": payload validates"))
+        {
+            return false;
+        }
+
+        const auto decoded = TextureCompression::Decode(*compressed, 0);
+
+        const auto before = TextureBlockCache::GetStats();
+        bool success = Expect(MatchesDecode(*compressed, decoded), label + ": block reads match the full decode");
+        const auto after = TextureBlockCache::GetStats();
+        success &= Expect(after.hit_count > before.hit_count && after.miss_count > before.miss_count,
+                          label + ": lookups are counted");
+        success &= Expect(after.memory_size > 0, label + ": decoded blocks are accounted for");
+
+        // every block evicts the previous one
+        TextureBlockCache::SetCapacity(1);
+        success &= Expect(MatchesDecode(*compressed, decoded), label + ": a single-block cache still reads correctly");
+        TextureBlockCache::SetCapacity(TextureBlockCache::DefaultCapacity);
+
+        const auto &level = compressed->GetLevel(2);
+        const auto decoded_level = TextureCompression::Decode(*compressed, 2);
+        success &= Expect(IsCompressedFormat(level.GetFormat()), label + ": payload mips stay compressed");
+        success &= Expect(MatchesDecode(level, decoded_level), label + ": payload mips match their decode");
+
+        const auto *chain_begin = compressed->GetRawData();
+        const auto *chain_end = chain_begin + compressed->GetStorageSize();
+        success &= Expect(level.GetRawData() > chain_begin && level.GetRawData() + level.GetStorageSize() <= chain_end,
+                          label + ": payload mips view the payload instead of copying it");
+
+        return success;
+    }
+
+    static bool MatchesDecode(const Image2D &compressed, const Image2D &decoded)
+    {
+        bool same = true;
+        for (auto y = 0u; y < decoded.GetHeight(); y++)
+        {
+            for (auto x = 0u; x < decoded.GetWidth(); x++)
+            {
+                same &= compressed.AccessPixel(x, y) == decoded.AccessPixel(x, y);
+            }
+        }
+
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+        for (auto i = 0u; i < 2000; i++)
+        {
+            const Vector2 uv(unit(rng), unit(rng));
+            same &= compressed.Sample(uv) == decoded.Sample(uv);
+        }
+        return same;
+    }
+
+    static bool Expect(bool condition, const std::string &description)
+    {
+        if (condition)
+        {
+            Log(Info, "TextureBlockCacheTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "TextureBlockCacheTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<TextureBlockCacheTest> texture_block_cache_test_registrar("texture_block_cache");
+} // namespace sparkle
@@ -0,0 +1,165 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "io/Image.h"
+
+namespace sparkle
+{
+class TextureLevelTest : public TestCase
+{
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        bool success = VerifyChain();
+        success &= VerifyOddFold();
+        success &= VerifySrgbAverage();
+        success &= VerifyTrilinear();
+        success &= VerifyWrites();
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    // a checkerboard averages to 0.5 on every level but the first
+    static Image2D CreateChecker(unsigned width, unsigned height)
+    {
+        Image2D image(width, height, PixelFormat::RGBAFloat);
+        for (auto j = 0u; j < height; j++)
+        {
+            for (auto i = 0u; i < width; i++)
+            {
+                const Vector3 color = Ones * static_cast<Scalar>((i + j) % 2);
+                image.SetPixel(i, j, color);
+            }
+        }
+        return image;
+    }
+
+    static bool VerifyChain()
+    {
+        const auto image = CreateChecker(8, 4);
+
+        bool success = Expect(image.GetLevelCount() == 4, "8x4 has four levels down to 1x1");
+        success &= Expect(&image.GetLevel(0) == &image, "level 0 is the image itself");
+
+        for (auto level = 1u; level < image.GetLevelCount(); level++)
+        {
+            const auto &mip = image.GetLevel(level);
+            success &= Expect(mip.GetWidth() == std::max(8u >> level, 1u) &&
+                                  mip.GetHeight() == std::max(4u >> level, 1u),
+                              "level dimensions halve and stop at 1");
+            success &= Expect(std::abs(mip.AccessPixel(0, 0).x() - 0.5f) < 1e-5f, "box filter averages the checker");
+        }
+
+        return success;
+    }
+
+    static bool VerifyOddFold()
+    {
+        // only the last column is lit. it must not be dropped when 5 texels shrink to 2.
+        Image2D image(5, 1, PixelFormat::RGBAFloat);
+        for (auto i = 0u; i < 5; i++)
+        {
+            const Vector3 color = Ones * (i == 4 ? 1.f : 0.f);
+            image.SetPixel(i, 0, color);
+        }
+
+        const auto &mip = image.GetLevel(1);
+        bool success = Expect(mip.GetWidth() == 2, "5 texels shrink to 2");
+        success &= Expect(std::abs(mip.AccessPixel(1, 0).x() - 1.f / 3.f) < 1e-5f,
+                          "the odd texel folds into the last one");
+        return success;
+    }
+
+    static bool VerifySrgbAverage()
+    {
+        Image2D image(2, 2, PixelFormat::R8G8B8A8Srgb);
+        for (auto j = 0u; j < 2; j++)
+        {
+            for (auto i = 0u; i < 2; i++)
+            {
+                const Vector3 color = Ones * static_cast<Scalar>((i + j) % 2);
+                image.SetPixel(i, j, color);
+            }
+        }
+
+        const auto &mip = image.GetLevel(1);
+        const Vector3 linear = mip.Sample(Vector2(0.5f, 0.5f));
+        return Expect(std::abs(linear.x() - 0.5f) < 0.01f, "srgb texels are averaged in linear space");
+    }
+
+    static bool VerifyTrilinear()
+    {
+        const auto image = CreateChecker(16, 16);
+        const Vector2 uv(0.3f, 0.6f);
+
+        bool success = Expect(image.Sample(TextureCoordinate(uv)) == image.Sample(uv), "zero width samples level 0");
+        success &= Expect(image.Sample(TextureCoordinate(uv, 0.5f / 16.f)) == image.Sample(uv),
+                          "sub-texel widths sample level 0");
+        success &= Expect(std::abs(image.Sample(TextureCoordinate(uv, 100.f)).x() - 0.5f) < 1e-5f,
+                          "wide footprints clamp to the coarsest level");
+
+        // halfway between levels 1 and 2 of a checker, both of which are flat 0.5
+        success &= Expect(std::abs(image.Sample(TextureCoordinate(uv, std::exp2(1.5f) / 16.f)).x() - 0.5f) < 1e-5f,
+                          "fractional levels blend neighbouring levels");
+
+        return success;
+    }
+
+    static void Fill(Image2D &image, Scalar value)
+    {
+        for (auto j = 0u; j < image.GetHeight(); j++)
+        {
+            for (auto i = 0u; i < image.GetWidth(); i++)
+            {
+                const Vector3 color = Ones * value;
+                image.SetPixel(i, j, color);
+            }
+        }
+    }
+
+    // the derived levels and the tiled copy follow writes, and copies do not see each other's
+    static bool VerifyWrites()
+    {
+        auto image = CreateChecker(4, 4);
+        image.EnableTiledSampling();
+        const Vector2 uv(0.3f, 0.6f);
+        const auto checker_sample = image.Sample(uv).x();
+        (void)image.GetLevel(1);
+
+        auto copy = image;
+        Fill(copy, 1.f);
+        bool success = Expect(std::abs(copy.GetLevel(1).AccessPixel(0, 0).x() - 1.f) < 1e-5f &&
+                                  std::abs(copy.Sample(uv).x() - 1.f) < 1e-5f,
+                              "a written copy samples its own texels");
+        success &= Expect(std::abs(image.GetLevel(1).AccessPixel(0, 0).x() - 0.5f) < 1e-5f &&
+                              image.Sample(uv).x() == checker_sample,
+                          "writes to a copy leave the original alone");
+
+        Fill(image, 0.25f);
+        success &= Expect(std::abs(image.GetLevel(1).AccessPixel(0, 0).x() - 0.25f) < 1e-5f &&
+                              std::abs(image.Sample(uv).x() - 0.25f) < 1e-5f,
+                          "writes drop the levels and the tiled copy");
+
+        image.EnableTiledSampling();
+        image.SetTexelLayout(TexelLayout::Tiled);
+        success &= Expect(std::abs(image.Sample(uv).x() - 0.25f) < 1e-5f, "layout changes keep sampling right");
+        return success;
+    }
+
+    static bool Expect(bool condition, const char *description)
+    {
+        if (condition)
+        {
+            Log(Info, "TextureLevelTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "TextureLevelTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<TextureLevelTest> texture_level_test_registrar("texture_level");
+} // namespace sparkle
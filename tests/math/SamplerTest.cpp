@@ -0,0 +1,187 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "core/math/Sampler.h"
+#include "renderer/renderer/CPURenderer.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace sparkle
+{
+// the low-discrepancy sequence must be stateless, stratified in every pair of dimensions, integrate with less
+// error than white noise at equal sample counts, and stay stratified across the frames of the cpu renderer. runs
+// anywhere: no scene, no RHI
+class SamplerTest : public TestCase
+{
+    // 2^8 points: a (0, 8, 2)-net in every pair
+    static constexpr unsigned NetLog2 = 8;
+    static constexpr unsigned PixelCount = 256;
+    static constexpr unsigned SampleCount = 64;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        bool success = VerifyStateless();
+        success &= VerifyStratification();
+        success &= VerifyConvergence();
+        success &= VerifyFrameSequence();
+
+        // leave the thread on white noise for whoever runs next
+        sampler::ReseedCurrentThread(0);
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    static bool VerifyStateless()
+    {
+        sampler::StartSequenceSample(7, 13);
+        const auto first = sampler::RandomUnit();
+        const Vector2 pair = sampler::Random2D();
+        sampler::SetDimension(9);
+        const auto ninth = sampler::RandomUnit();
+
+        // read back out of order
+        sampler::StartSequenceSample(7, 13);
+        sampler::SetDimension(9);
+        bool success = Expect(sampler::RandomUnit() == ninth, "a dimension reads the same whatever came before");
+        sampler::SetDimension(2);
+        success &= Expect(sampler::Random2D() == pair, "2d draws start at an even dimension");
+        sampler::SetDimension(0);
+        success &= Expect(sampler::RandomUnit() == first, "dimension 0 reads the same after a jump back");
+
+        sampler::StartSequenceSample(8, 13);
+        success &= Expect(sampler::RandomUnit() != first, "pixels draw from different sequences");
+        return success;
+    }
+
+    static bool VerifyStratification()
+    {
+        bool stratified = true;
+        bool in_range = true;
+        for (auto pair = 0u; pair < 4; pair++)
+        {
+            std::vector<Vector2> points(1u << NetLog2);
+            for (auto i = 0u; i < points.size(); i++)
+            {
+                sampler::StartSequenceSample(3, i);
+                sampler::SetDimension(pair * 2);
+                points[i] = sampler::Random2D();
+                in_range &= points[i].minCoeff() >= 0.f && points[i].maxCoeff() < 1.f;
+            }
+
+            // every elementary interval of 2^-8 area holds exactly one point, whatever its aspect
+            for (auto x_log2 = 0u; x_log2 <= NetLog2; x_log2++)
+            {
+                const auto x_cells = 1u << x_log2;
+                const auto y_cells = 1u << (NetLog2 - x_log2);
+                std::vector<unsigned> counts(points.size(), 0);
+                for (const auto &point : points)
+                {
+                    const auto x = static_cast<unsigned>(point.x() * static_cast<Scalar>(x_cells));
+                    const auto y = static_cast<unsigned>(point.y() * static_cast<Scalar>(y_cells));
+                    counts[y * x_cells + x]++;
+                }
+                stratified &= std::ranges::all_of(counts, [](unsigned count) { return count == 1; });
+            }
+        }
+
+        bool success = Expect(in_range, "samples lie in [0, 1)");
+        success &= Expect(stratified, "the first 256 samples of every pair form a (0, 8, 2)-net");
+        return success;
+    }
+
+    // quarter disk area by rejection, the kind of discontinuous integrand a visibility test produces
+    template <typename Draw> static double MeanSquaredError(const Draw &draw)
+    {
+        double squared_error = 0.0;
+        for (auto pixel = 0u; pixel < PixelCount; pixel++)
+        {
+            unsigned inside = 0;
+            for (auto i = 0u; i < SampleCount; i++)
+            {
+                const Vector2 u = draw(pixel, i);
+                inside += u.squaredNorm() < 1.f ? 1 : 0;
+            }
+            const double error = static_cast<double>(inside) / SampleCount - Pi * 0.25;
+            squared_error += error * error;
+        }
+        return squared_error / PixelCount;
+    }
+
+    static bool VerifyConvergence()
+    {
+        const double sobol_error = MeanSquaredError([](unsigned pixel, unsigned i) {
+            sampler::StartSequenceSample(pixel, i);
+            sampler::SetDimension(4);
+            return sampler::Random2D();
+        });
+        const double random_error = MeanSquaredError([](unsigned pixel, unsigned i) {
+            sampler::ReseedCurrentThread(pixel + i * PixelCount);
+            return sampler::Random2D();
+        });
+
+        Log(Info, "SamplerTest: quarter disk at {} spp, rmse sobol {:.5f}, random {:.5f}", SampleCount,
+            std::sqrt(sobol_error), std::sqrt(random_error));
+        // white noise needs about 4x the samples to halve its error, sobol far fewer
+        return Expect(sobol_error * 4.0 < random_error, "sobol integrates with a fraction of the white noise error");
+    }
+
+    // empty cells of a 16 x 16 grid over the pixel jitter of 256 samples, drawn from the sequence indices the cpu
+    // renderer gives consecutive frames of a pixel when it accumulates uniformly. index_stride > 1 reads the
+    // sequence the way frames would if they advanced by more than the samples they trace
+    static unsigned CountEmptyJitterCells(unsigned index_stride)
+    {
+        constexpr unsigned GridSize = 16;
+        constexpr uint32_t PixelIndex = 1234;
+        constexpr uint32_t PixelJitterDimension = 0;
+
+        std::vector<unsigned> counts(GridSize * GridSize, 0);
+        uint32_t dispatched_sample_count = 0;
+        for (auto frame = 0u; frame < GridSize * GridSize / CPURenderer::UniformSamplesPerFrame; frame++)
+        {
+            // CPURenderer::BeginAccumulation, then CPURenderer::RenderTile
+            const auto frame_seed = dispatched_sample_count * index_stride;
+            dispatched_sample_count += CPURenderer::UniformSamplesPerFrame;
+            for (auto pass = 0u; pass < CPURenderer::UniformSamplesPerFrame; pass++)
+            {
+                sampler::StartSequenceSample(PixelIndex, frame_seed + pass * index_stride);
+                sampler::SetDimension(PixelJitterDimension);
+                const Vector2 jitter = sampler::Random2D();
+                const auto x = static_cast<unsigned>(jitter.x() * static_cast<Scalar>(GridSize));
+                const auto y = static_cast<unsigned>(jitter.y() * static_cast<Scalar>(GridSize));
+                counts[y * GridSize + x]++;
+            }
+        }
+        return static_cast<unsigned>(std::ranges::count(counts, 0u));
+    }
+
+    static bool VerifyFrameSequence()
+    {
+        const auto empty_cells = CountEmptyJitterCells(1);
+        const auto strided_empty_cells = CountEmptyJitterCells(4);
+        Log(Info, "SamplerTest: empty jitter cells over 256 frames: {}, reading every 4th index: {}", empty_cells,
+            strided_empty_cells);
+
+        bool success = Expect(empty_cells == 0, "consecutive frames of a pixel cover every jitter stratum");
+        success &= Expect(strided_empty_cells > 0, "a strided read of the sequence would lose the strata");
+        return success;
+    }
+
+    static bool Expect(bool condition, const char *description)
+    {
+        if (condition)
+        {
+            Log(Info, "SamplerTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "SamplerTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<SamplerTest> sampler_test_registrar("low_discrepancy_sampler");
+} // namespace sparkle
@@ -0,0 +1,210 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "core/Timer.h"
+#include "core/math/BVH.h"
+#include "core/math/Ray.h"
+#include "core/math/WideBVH.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#include <bvh/v2/default_builder.h>
+#include <bvh/v2/stack.h>
+#include <bvh/v2/thread_pool.h>
+#pragma GCC diagnostic pop
+
+#include <random>
+
+namespace sparkle
+{
+// wide bvh (4 and 8) against the binary bvh it is collapsed from, on a synthetic triangle soup:
+// closest hits must agree, and the throughput of each layout is logged. runs anywhere: no scene, no RHI
+class WideBvhTest : public TestCase
+{
+    static constexpr unsigned TriangleCount = 50000;
+    static constexpr unsigned RayCount = 200000;
+
+    struct Hit
+    {
+        Scalar t = std::numeric_limits<Scalar>::max();
+        uint32_t face_idx = UINT_MAX;
+    };
+
+    using Triangle = WideTriangleBVH<4>::Triangle;
+
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        GenerateScene();
+
+        std::vector<Hit> binary_hits(rays_.size());
+        const float binary_seconds = TraceBinary(binary_hits);
+
+        bool success = true;
+        success &= VerifyWidth<4>(binary_hits, binary_seconds);
+        success &= VerifyWidth<8>(binary_hits, binary_seconds);
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+    void GenerateScene()
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+        auto random_point = [&]() { return Vector3(unit(rng), unit(rng), unit(rng)); };
+
+        triangles_.resize(TriangleCount);
+        std::vector<bvh::v2::BBox<Scalar, 3>> bboxes(TriangleCount);
+        std::vector<bvh::v2::Vec<Scalar, 3>> centers(TriangleCount);
+        for (auto i = 0u; i < TriangleCount; i++)
+        {
+            const Vector3 v0 = random_point() * 2.f - Vector3::Ones();
+            const Vector3 v1 = v0 + (random_point() - Vector3::Constant(0.5f)) * 0.05f;
+            const Vector3 v2 = v0 + (random_point() - Vector3::Constant(0.5f)) * 0.05f;
+
+            triangles_[i] = {.p0 = v0, .e1 = v1 - v0, .e2 = v2 - v0};
+
+            const Vector3 min = v0.cwiseMin(v1).cwiseMin(v2);
+            const Vector3 max = v0.cwiseMax(v1).cwiseMax(v2);
+            bboxes[i] = bvh::v2::BBox<Scalar, 3>(ToBVHVec3(min), ToBVHVec3(max));
+            centers[i] = ToBVHVec3((min + max) / 2);
+        }
+
+        bvh::v2::ThreadPool thread_pool;
+        bvh::v2::DefaultBuilder<Node>::Config config;
+        config.quality = bvh::v2::DefaultBuilder<Node>::Quality::High;
+        binary_ = bvh::v2::DefaultBuilder<Node>::build(thread_pool, bboxes, centers, config);
+
+        // rays from a surrounding sphere towards the soup, so most of them hit something
+        rays_.resize(RayCount);
+        for (auto &ray : rays_)
+        {
+            const Vector3 origin = (random_point() - Vector3::Constant(0.5f)).normalized() * 3.f;
+            const Vector3 target = random_point() - Vector3::Constant(0.5f);
+            ray.Reset(origin, (target - origin).normalized());
+        }
+    }
+
+    // the same moller-trumbore as the mesh BLAS
+    bool IntersectTriangle(const Ray &ray, uint32_t face_idx, Hit &hit) const
+    {
+        const auto &triangle = triangles_[face_idx];
+        const Vector3 h = ray.Direction().cross(triangle.e2);
+        const auto a = triangle.e1.dot(h);
+        if (std::abs(a) < Eps)
+        {
+            return false;
+        }
+
+        const Vector3 s = ray.Origin() - triangle.p0;
+        const auto f = 1.f / a;
+        const auto u = f * s.dot(h);
+        if (u < 0.f || u > 1.f)
+        {
+            return false;
+        }
+
+        const Vector3 q = s.cross(triangle.e1);
+        const auto v = f * ray.Direction().dot(q);
+        if (v < 0.f || u + v > 1.f)
+        {
+            return false;
+        }
+
+        const auto t = f * triangle.e2.dot(q);
+        if (t > Eps && t < hit.t)
+        {
+            hit = {.t = t, .face_idx = face_idx};
+            return true;
+        }
+        return false;
+    }
+
+    float TraceBinary(std::vector<Hit> &hits) const
+    {
+        Timer timer;
+        for (auto i = 0u; i < rays_.size(); i++)
+        {
+            const auto &ray = rays_[i];
+            bvh::v2::Ray<Scalar, 3> bvh_ray(ToBVHVec3(ray.Origin()), ToBVHVec3(ray.Direction()));
+            bvh::v2::SmallStack<Bvh::Index, 64> stack;
+            binary_.intersect<false, false>(bvh_ray, binary_.get_root().index, stack, [&](size_t begin, size_t end) {
+                bool found = false;
+                for (auto prim = begin; prim < end; prim++)
+                {
+                    if (IntersectTriangle(ray, static_cast<uint32_t>(binary_.prim_ids[prim]), hits[i]))
+                    {
+                        bvh_ray.tmax = hits[i].t;
+                        found = true;
+                    }
+                }
+                return found;
+            });
+        }
+        return timer.ElapsedSecond();
+    }
+
+    template <unsigned Width> bool VerifyWidth(const std::vector<Hit> &binary_hits, float binary_seconds) const
+    {
+        Timer build_timer;
+        WideTriangleBVH<Width> wide;
+        wide.Build(binary_, [this](uint32_t face_idx) {
+            const auto &triangle = triangles_[face_idx];
+            return typename WideTriangleBVH<Width>::Triangle{.p0 = triangle.p0, .e1 = triangle.e1, .e2 = triangle.e2};
+        });
+        const auto build_ms = build_timer.ElapsedMilliSecond();
+
+        std::vector<Hit> hits(rays_.size());
+        Timer timer;
+        for (auto i = 0u; i < rays_.size(); i++)
+        {
+            auto &hit = hits[i];
+            wide.template Intersect<false>(rays_[i], [&hit](Scalar t, Scalar /*u*/, Scalar /*v*/, uint32_t face_idx) {
+                if (t >= hit.t)
+                {
+                    return false;
+                }
+                hit = {.t = t, .face_idx = face_idx};
+                return true;
+            });
+        }
+        const float seconds = timer.ElapsedSecond();
+
+        unsigned mismatches = 0;
+        for (auto i = 0u; i < rays_.size(); i++)
+        {
+            const bool same_miss = binary_hits[i].face_idx == UINT_MAX && hits[i].face_idx == UINT_MAX;
+            const bool same_hit = binary_hits[i].face_idx != UINT_MAX && hits[i].face_idx != UINT_MAX &&
+                                  std::abs(binary_hits[i].t - hits[i].t) <= 1e-5f * binary_hits[i].t;
+            mismatches += (same_miss || same_hit) ? 0 : 1;
+        }
+
+        const auto ray_count = static_cast<float>(rays_.size());
+        Log(Info, "WideBvhTest: binary {:.2f} Mrays/s, bvh{} {:.2f} Mrays/s ({:.2f}x)", ray_count / binary_seconds * 1e-6f,
+            Width, ray_count / seconds * 1e-6f, binary_seconds / seconds);
+        Log(Info, "WideBvhTest: bvh{} has {} nodes, {} clusters, {} KB, collapsed in {} ms", Width, wide.GetNodeCount(),
+            wide.GetClusterCount(), wide.GetMemorySize() / 1024, build_ms);
+
+        return Expect(mismatches == 0,
+                      std::format("bvh{} closest hits match binary ({} mismatches)", Width, mismatches));
+    }
+
+    static bool Expect(bool condition, const std::string &description)
+    {
+        if (condition)
+        {
+            Log(Info, "WideBvhTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "WideBvhTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+
+    std::vector<Triangle> triangles_;
+    std::vector<Ray> rays_;
+    Bvh binary_;
+};
+
+static TestCaseRegistrar<WideBvhTest> wide_bvh_test_registrar("wide_bvh");
+} // namespace sparkle
@@ -0,0 +1,194 @@
+#include "application/TestCase.h"
+
+#include "application/AppFramework.h"
+#include "application/RenderFramework.h"
+#include "core/ConfigManager.h"
+#include "core/ConfigValue.h"
+#include "core/FileManager.h"
+#include "core/Logger.h"
+#include "core/Timer.h"
+#include "renderer/proxy/SceneRenderProxy.h"
+#include "renderer/renderer/CPURenderer.h"
+
+#include <nlohmann/json.hpp>
+
+#if PLATFORM_WINDOWS
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wnonportable-system-include-path"
+#include <Windows.h> // NOLINT
+#include <psapi.h>   // NOLINT
+#pragma clang diagnostic pop
+#else
+#include <sys/resource.h>
+#endif
+
+namespace sparkle
+{
+static ConfigValue<uint32_t> config_bench_frames("bench_frames", "full resolution frames cpu_bench measures", "test",
+                                                 32, false);
+static ConfigValue<uint32_t> config_bench_warmup("bench_warmup_frames",
+                                                 "frames cpu_bench traces before it starts measuring", "test", 4,
+                                                 false);
+static ConfigValue<std::string> config_bench_output("bench_output", "where cpu_bench writes its json results", "test",
+                                                    "bench/cpu_bench.json", false);
+
+// Throughput of the cpu path tracer on the loaded scene: traces a fixed number of frames and writes Mrays/s, the time
+// of every pass, the rays by type with their traversal work, the bvh build time and the peak resident memory as json
+// to [external-storage-path]/bench_output. Runs headless. The seed follows random_seed_offset, so two runs of the same
+// build trace the same rays.
+//
+// Usage: --test_case cpu_bench --pipeline cpu --headless true [--scene <path>] [--bench_frames 32]
+class CpuBenchTest : public TestCase
+{
+public:
+    void OnEnforceConfigs() override
+    {
+        EnforceConfig("pipeline", std::string("cpu"));
+        // both change the work of a frame as they go
+        EnforceConfig("dynamic_spp", false);
+        EnforceConfig("progressive_preview", false);
+    }
+
+    Result OnTick(AppFramework &app) override
+    {
+        switch (phase_)
+        {
+        case Phase::Load:
+            if (!app.GetRenderFramework()->IsSceneFullyLoaded())
+            {
+                return Result::Pending;
+            }
+            warmup_begin_ = CPURenderer::GetStats().frame_count;
+            phase_ = Phase::Warmup;
+            return Result::Pending;
+
+        case Phase::Warmup:
+            if (CPURenderer::GetStats().frame_count - warmup_begin_ < config_bench_warmup.Get())
+            {
+                return Result::Pending;
+            }
+            begin_ = CPURenderer::GetStats();
+            timer_.Reset();
+            phase_ = Phase::Measure;
+            return Result::Pending;
+
+        case Phase::Measure: {
+            const auto end = CPURenderer::GetStats();
+            if (end.frame_count - begin_.frame_count < config_bench_frames.Get())
+            {
+                return Result::Pending;
+            }
+            return Report(end, timer_.ElapsedSecond()) ? Result::Pass : Result::Fail;
+        }
+
+        default:
+            return Result::Pending;
+        }
+    }
+
+    [[nodiscard]] uint32_t GetDefaultTimeoutFrames() const override
+    {
+        return 100000;
+    }
+
+private:
+    enum class Phase : uint8_t
+    {
+        Load,
+        Warmup,
+        Measure,
+    };
+
+    [[nodiscard]] bool Report(const CPURenderer::Stats &end, float seconds) const
+    {
+        const auto frame_count = end.frame_count - begin_.frame_count;
+        const auto rays = end.rays - begin_.rays;
+        const auto ray_count = rays.GetRayCount();
+        const auto base_pass_ms = end.base_pass_ms - begin_.base_pass_ms;
+        if (ray_count == 0 || base_pass_ms <= 0.0)
+        {
+            Log(Error, "{}: no rays were traced in {} frames", GetName(), frame_count);
+            return false;
+        }
+
+        auto per_frame = [frame_count](double total) { return total / static_cast<double>(frame_count); };
+        auto per_ray = [ray_count](uint64_t count) {
+            return static_cast<double>(count) / static_cast<double>(ray_count);
+        };
+
+        auto &configs = ConfigManager::Instance();
+        nlohmann::json result = {
+            {"scene", configs.GetConfig<std::string>("scene")->Get()},
+            {"width", configs.GetConfig<uint32_t>("width")->Get()},
+            {"height", configs.GetConfig<uint32_t>("height")->Get()},
+            {"random_seed_offset", configs.GetConfig<uint32_t>("random_seed_offset")->Get()},
+            {"frames", frame_count},
+            {"seconds", seconds},
+            {"rays", ray_count},
+            // rays are only traced in the base pass
+            {"mrays_per_second", static_cast<double>(ray_count) / base_pass_ms * 1e-3},
+            {"pass_ms",
+             {{"BasePass", per_frame(base_pass_ms)},
+              {"DenoisePass", per_frame(end.denoise_pass_ms - begin_.denoise_pass_ms)},
+              {"FilterPass", per_frame(end.filter_pass_ms - begin_.filter_pass_ms)},
+              {"ToneMappingPass", per_frame(end.tone_mapping_pass_ms - begin_.tone_mapping_pass_ms)}}},
+            // per frame, and traversal work per ray
+            {"ray_stats",
+             {{"camera_rays", per_frame(static_cast<double>(rays.camera_rays))},
+              {"bounce_rays", per_frame(static_cast<double>(rays.bounce_rays))},
+              {"shadow_rays", per_frame(static_cast<double>(rays.shadow_rays))},
+              {"bounces", per_frame(static_cast<double>(rays.bounces))},
+              {"roulette_terminations", per_frame(static_cast<double>(rays.roulette_terminations))},
+              {"nodes_per_ray", per_ray(rays.node_visits)},
+              {"leaves_per_ray", per_ray(rays.leaf_visits)},
+              {"triangles_per_ray", per_ray(rays.triangle_tests)}}},
+            {"bvh_build_ms", SceneRenderProxy::GetBVHBuildTime()},
+            {"peak_rss_mb", GetPeakResidentMegaBytes()}};
+
+        const auto raw_data = result.dump(4);
+        Log(Info, "{}: {}", GetName(), result.dump());
+
+        const auto &written = FileManager::GetNativeFileManager()->Write(Path::External(config_bench_output.Get()),
+                                                                        raw_data.data(), raw_data.size());
+        if (written.empty())
+        {
+            Log(Error, "{}: failed to write {}", GetName(), config_bench_output.Get());
+            return false;
+        }
+
+        Log(Info, "{}: results saved to {}", GetName(), written);
+        return true;
+    }
+
+    static double GetPeakResidentMegaBytes()
+    {
+#if PLATFORM_WINDOWS
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return 0.0;
+        }
+        return static_cast<double>(counters.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0.0;
+        }
+#if defined(__APPLE__)
+        // bytes on apple platforms, kilobytes everywhere else
+        return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+        return static_cast<double>(usage.ru_maxrss) / 1024.0;
+#endif
+#endif
+    }
+
+    Phase phase_ = Phase::Load;
+    uint64_t warmup_begin_ = 0;
+    CPURenderer::Stats begin_;
+    Timer timer_;
+};
+
+static TestCaseRegistrar<CpuBenchTest> cpu_bench_registrar("cpu_bench");
+} // namespace sparkle
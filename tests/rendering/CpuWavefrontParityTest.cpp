@@ -0,0 +1,122 @@
+#include "application/TestCase.h"
+
+#include "application/AppFramework.h"
+#include "application/RenderFramework.h"
+#include "core/Logger.h"
+#include "core/task/TaskManager.h"
+#include "renderer/proxy/CameraRenderProxy.h"
+#include "renderer/proxy/SceneRenderProxy.h"
+#include "scene/Scene.h"
+
+#include <memory>
+
+namespace sparkle
+{
+// the cpu path tracer must render the same image whether cpu_wavefront shades the hits of a bounce in material order
+// or in screen order. screenshots a converged accumulation with cpu_wavefront off, turns it on at runtime, restarts
+// the accumulation and screenshots it again. tests/rendering/cpu_wavefront_parity_test.py drives this test and
+// requires the two screenshots to be identical.
+//
+// only the shading order changes at runtime: the tile size cpu_wavefront picks at startup stays as it is. adaptive
+// sampling stops tracing once every tile is done, so both screenshots show a final image no matter when they are taken
+//
+// Usage: --test_case cpu_wavefront_parity [--scene <path>]
+class CpuWavefrontParityTest : public TestCase
+{
+public:
+    // give the config change and the restarted accumulation a few frames to reach the render thread
+    static constexpr uint32_t SettleFrames = 10;
+
+    void OnEnforceConfigs() override
+    {
+        EnforceConfig("pipeline", std::string("cpu"));
+        EnforceConfig("cpu_wavefront", false);
+        EnforceConfig("adaptive_sampling", true);
+        EnforceConfig("max_spp", 32u);
+        // these change the work of a frame with the time it takes, or let paths share what they learn
+        EnforceConfig("dynamic_spp", false);
+        EnforceConfig("progressive_preview", false);
+        EnforceConfig("cpu_path_guiding", false);
+    }
+
+    Result OnTick(AppFramework &app) override
+    {
+        auto *render_framework = app.GetRenderFramework();
+
+        switch (stage_)
+        {
+        case Stage::WaitScreenOrder:
+            if (render_framework->IsReadyForAutoScreenshot())
+            {
+                screenshot_ = render_framework->RequestTakeScreenshot("cpu_wavefront_off");
+                stage_ = Stage::WaitScreenOrderScreenshot;
+            }
+            break;
+
+        case Stage::WaitScreenOrderScreenshot:
+            if (screenshot_->IsCompleted())
+            {
+                EnforceConfig("cpu_wavefront", true);
+                settle_frame_ = frame_ + SettleFrames;
+                stage_ = Stage::WaitConfig;
+            }
+            break;
+
+        case Stage::WaitConfig:
+            if (frame_ >= settle_frame_)
+            {
+                auto *scene = app.GetScene();
+                TaskManager::RunInRenderThread([scene] { scene->GetRenderProxy()->GetCamera()->MarkPixelDirty(); });
+
+                settle_frame_ = frame_ + SettleFrames;
+                stage_ = Stage::WaitMaterialOrder;
+            }
+            break;
+
+        case Stage::WaitMaterialOrder:
+            if (frame_ >= settle_frame_ && render_framework->IsReadyForAutoScreenshot())
+            {
+                screenshot_ = render_framework->RequestTakeScreenshot("cpu_wavefront_on");
+                stage_ = Stage::WaitMaterialOrderScreenshot;
+            }
+            break;
+
+        case Stage::WaitMaterialOrderScreenshot:
+            if (screenshot_->IsCompleted())
+            {
+                Log(Info, "{}: captured both shading orders", GetName());
+                return Result::Pass;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        return Result::Pending;
+    }
+
+    [[nodiscard]] uint32_t GetDefaultTimeoutFrames() const override
+    {
+        return 100000;
+    }
+
+private:
+    enum class Stage : uint8_t
+    {
+        WaitScreenOrder,
+        WaitScreenOrderScreenshot,
+        WaitConfig,
+        WaitMaterialOrder,
+        WaitMaterialOrderScreenshot,
+    };
+
+    Stage stage_ = Stage::WaitScreenOrder;
+
+    std::shared_ptr<ScreenshotRequest> screenshot_;
+
+    uint32_t settle_frame_ = 0;
+};
+
+static TestCaseRegistrar<CpuWavefrontParityTest> cpu_wavefront_parity_registrar("cpu_wavefront_parity");
+} // namespace sparkle
@@ -0,0 +1,127 @@
+#include "application/TestCase.h"
+
+#include "application/AppFramework.h"
+#include "application/RenderFramework.h"
+#include "core/Logger.h"
+#include "core/math/Intersection.h"
+#include "io/Mesh.h"
+#include "renderer/proxy/PrimitiveRenderProxy.h"
+#include "renderer/proxy/SceneRenderProxy.h"
+#include "renderer/resource/LightTree.h"
+#include "scene/Scene.h"
+#include "scene/component/primitive/MeshPrimitive.h"
+#include "scene/component/primitive/SpherePrimitive.h"
+#include "scene/material/LambertianMaterial.h"
+#include "scene/material/MaterialManager.h"
+
+namespace sparkle
+{
+// an emissive sphere must stay out of the light tree: its tessellation lies inside the analytic surface, so shadow
+// rays towards it would hit the sphere itself. its hits name no face, so mis never weighs them against a triangle of
+// the tessellation. an emissive cube next to it is sampled face by face as before.
+class EmissiveSphereLightTest : public TestCase
+{
+public:
+    void OnEnforceConfigs() override
+    {
+        // the light tree only backs the cpu path tracer
+        EnforceConfig("pipeline", std::string("cpu"));
+    }
+
+    Result OnTick(AppFramework &app) override
+    {
+        if (!app.GetRenderFramework()->IsSceneFullyLoaded())
+        {
+            return Result::Pending;
+        }
+
+        if (!sphere_)
+        {
+            SpawnLights(app.GetScene());
+            return Result::Pending;
+        }
+
+        auto *sphere = static_cast<PrimitiveRenderProxy *>(sphere_->GetRenderProxy());
+        auto *cube = static_cast<PrimitiveRenderProxy *>(cube_->GetRenderProxy());
+        const auto *lights = app.GetScene()->GetRenderProxy()->GetLightTree();
+        // the cube's lights show up once the scene proxy has built its bvh and light tree
+        if (sphere == nullptr || cube == nullptr || lights == nullptr ||
+            lights->FindLight(cube, 0) == LightTree::InvalidLight)
+        {
+            return Result::Pending;
+        }
+
+        bool success = Expect(lights->FindLight(sphere, 0) == LightTree::InvalidLight,
+                              "analytic spheres are not sampled on their tessellation");
+
+        const auto sphere_hit = Trace(*sphere, SpherePosition);
+        success &= Expect(sphere_hit.IsHit() && sphere_hit.GetFace() == Intersection::NoFace,
+                          "sphere hits report no face");
+        success &= Expect(lights->FindLight(sphere, sphere_hit.GetFace()) == LightTree::InvalidLight,
+                          "sphere hits find no light to weigh against");
+
+        const auto cube_hit = Trace(*cube, CubePosition);
+        const auto cube_light = lights->FindLight(cube, cube_hit.GetFace());
+        success &= Expect(cube_hit.IsHit() && cube_light != LightTree::InvalidLight &&
+                              lights->GetLight(cube_light).face == cube_hit.GetFace(),
+                          "mesh hits find the light of the face they landed on");
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    // far from anything the default scene holds
+    static inline const Vector3 SpherePosition{100.f, 100.f, 50.f};
+    static inline const Vector3 CubePosition{110.f, 100.f, 50.f};
+
+    void SpawnLights(Scene *scene)
+    {
+        auto material = MaterialManager::Instance().CreateMaterial<LambertianMaterial>(
+            {.emissive_color = Ones * 10.f, .name = "EmissiveSphereLightTest"});
+
+        auto [sphere_node, sphere] = MakeNodeWithComponent<SpherePrimitive>(scene, scene->GetRootNode(), "lamp sphere");
+        sphere_node->SetTransform(SpherePosition, Zeros, Ones);
+        sphere->SetMaterial(material);
+        sphere_ = sphere;
+
+        auto [cube_node, cube] =
+            MakeNodeWithComponent<MeshPrimitive>(scene, scene->GetRootNode(), "lamp cube", Mesh::GetUnitCube());
+        cube_node->SetTransform(CubePosition, Zeros, Ones);
+        cube->SetMaterial(material);
+        cube_ = cube;
+    }
+
+    // closest hit of a ray fired at center along +x from outside the primitive
+    static Intersection Trace(PrimitiveRenderProxy &primitive, const Vector3 &center)
+    {
+        Ray ray;
+        ray.Reset(center - Right * 5.f, Right);
+
+        Intersection intersection;
+        IntersectionCandidate candidate;
+        if (primitive.Intersect(ray, candidate))
+        {
+            primitive.GetIntersection(ray, candidate, intersection);
+        }
+        return intersection;
+    }
+
+    bool Expect(bool condition, const char *description) const
+    {
+        if (condition)
+        {
+            Log(Info, "{}: OK - {}", GetName(), description);
+        }
+        else
+        {
+            Log(Error, "{}: FAILED - {}", GetName(), description);
+        }
+        return condition;
+    }
+
+    std::shared_ptr<SpherePrimitive> sphere_;
+    std::shared_ptr<MeshPrimitive> cube_;
+};
+
+static TestCaseRegistrar<EmissiveSphereLightTest> emissive_sphere_light_registrar("emissive_sphere_light");
+} // namespace sparkle
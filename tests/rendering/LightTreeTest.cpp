@@ -0,0 +1,183 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "renderer/resource/LightTree.h"
+
+#include <random>
+#include <vector>
+
+namespace sparkle
+{
+// the light tree must pick every emissive triangle with the probability it reports, prefer the lights that matter to
+// a point, and follow primitives coming and going. runs anywhere: no scene, no RHI
+class LightTreeTest : public TestCase
+{
+    static constexpr unsigned GridSize = 8;
+    static constexpr unsigned SelectCount = 50000;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        LightTree tree;
+        tree.SetTriangles(GetPanel(), MakeGrid(Vector3(0.f, 0.f, 2.f), 0.5f, 1.f));
+        tree.SetTriangles(GetLamp(), MakeGrid(Vector3(20.f, 0.f, 2.f), 0.05f, 50.f));
+        tree.Build();
+
+        bool success = Expect(tree.GetLightCount() == GridSize * GridSize * 4, "every triangle becomes a light");
+        success &= VerifyLookup(tree);
+        success &= VerifyDistribution(tree);
+        success &= VerifyImportance(tree);
+
+        tree.RemoveTriangles(GetLamp());
+        tree.Build();
+        success &= Expect(tree.GetLightCount() == GridSize * GridSize * 2 &&
+                              tree.FindLight(GetLamp(), 0) == LightTree::InvalidLight,
+                          "removed primitives take their lights with them");
+        success &= VerifyDistribution(tree);
+
+        tree.RemoveTriangles(GetPanel());
+        tree.Build();
+        Scalar pmf;
+        success &= Expect(tree.IsEmpty() && tree.Select(Zeros, Up, 0.5f, pmf) == LightTree::InvalidLight,
+                          "an empty tree picks nothing");
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    // the tree only uses primitives as keys
+    static const PrimitiveRenderProxy *GetPanel()
+    {
+        static const int panel = 0;
+        return reinterpret_cast<const PrimitiveRenderProxy *>(&panel);
+    }
+
+    static const PrimitiveRenderProxy *GetLamp()
+    {
+        static const int lamp = 0;
+        return reinterpret_cast<const PrimitiveRenderProxy *>(&lamp);
+    }
+
+    // GridSize x GridSize quads facing down, two triangles each
+    static std::vector<LightTree::Triangle> MakeGrid(const Vector3 &corner, Scalar cell_size, Scalar radiance)
+    {
+        std::vector<LightTree::Triangle> triangles;
+        for (auto j = 0u; j < GridSize; j++)
+        {
+            for (auto i = 0u; i < GridSize; i++)
+            {
+                const Vector3 origin =
+                    corner + Vector3(static_cast<Scalar>(i), static_cast<Scalar>(j), 0.f) * cell_size;
+                const Vector3 x = Vector3::UnitX() * cell_size;
+                const Vector3 y = Vector3::UnitY() * cell_size;
+                triangles.push_back({.v0 = origin, .edge1 = y, .edge2 = x, .radiance = radiance});
+                triangles.push_back({.v0 = origin + x + y, .edge1 = -x, .edge2 = -y, .radiance = radiance});
+            }
+        }
+        return triangles;
+    }
+
+    static bool VerifyLookup(const LightTree &tree)
+    {
+        bool found = true;
+        for (auto face = 0u; face < GridSize * GridSize * 2; face++)
+        {
+            for (const auto *primitive : {GetPanel(), GetLamp()})
+            {
+                const auto light = tree.FindLight(primitive, face);
+                found &= light != LightTree::InvalidLight && tree.GetLight(light).primitive == primitive &&
+                         tree.GetLight(light).face == face;
+            }
+        }
+
+        bool success = Expect(found, "hits map back to their lights by primitive and face");
+        success &= Expect(tree.FindLight(GetPanel(), GridSize * GridSize * 2) == LightTree::InvalidLight,
+                          "faces past the end are no lights");
+        success &= Expect(std::abs(tree.GetLight(0).area - 0.125f) < 1e-6f &&
+                              std::abs(tree.GetLight(0).normal.z() + 1.f) < 1e-6f,
+                          "lights know their area and normal");
+        return success;
+    }
+
+    static bool VerifyDistribution(const LightTree &tree)
+    {
+        std::mt19937 rng(23);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+
+        bool normalized = true;
+        bool consistent = true;
+        Scalar max_frequency_error = 0.f;
+        // a point with no normal receives from everywhere
+        for (const auto &[position, normal] :
+             {std::pair{Vector3(1.f, 1.f, 0.f), Up}, std::pair{Vector3(5.f, 3.f, 0.f), Right},
+              std::pair{Vector3(25.f, -4.f, 6.f), Vector3(Zeros)}})
+        {
+            Scalar total = 0.f;
+            std::vector<Scalar> pmfs(tree.GetLightCount());
+            for (auto light = 0u; light < tree.GetLightCount(); light++)
+            {
+                pmfs[light] = tree.Pmf(position, normal, light);
+                total += pmfs[light];
+            }
+            normalized &= std::abs(total - 1.f) < 1e-4f;
+
+            std::vector<unsigned> counts(tree.GetLightCount(), 0);
+            for (auto i = 0u; i < SelectCount; i++)
+            {
+                Scalar pmf;
+                const auto light = tree.Select(position, normal, unit(rng), pmf);
+                consistent &= light != LightTree::InvalidLight && std::abs(pmf - pmfs[light]) <= 1e-5f;
+                counts[light]++;
+            }
+
+            for (auto light = 0u; light < tree.GetLightCount(); light++)
+            {
+                const auto frequency = static_cast<Scalar>(counts[light]) / SelectCount;
+                max_frequency_error = std::max(max_frequency_error, std::abs(frequency - pmfs[light]));
+            }
+        }
+
+        Log(Info, "LightTreeTest: largest gap between pick frequency and pmf {:.4f}", max_frequency_error);
+        bool success = Expect(normalized, "pmfs over all lights sum to one");
+        success &= Expect(consistent, "Select reports the pmf of Pmf");
+        success &= Expect(max_frequency_error < 0.01f, "lights are picked as often as their pmf says");
+        return success;
+    }
+
+    static bool VerifyImportance(const LightTree &tree)
+    {
+        auto lamp_share = [&tree](const Vector3 &position, const Vector3 &normal) {
+            Scalar share = 0.f;
+            for (auto light = 0u; light < tree.GetLightCount(); light++)
+            {
+                share += tree.GetLight(light).primitive == GetLamp() ? tree.Pmf(position, normal, light) : 0.f;
+            }
+            return share;
+        };
+
+        // the panel emits twice the power of the lamp: 16 x 1 against 0.16 x 50
+        const auto under_panel = lamp_share(Vector3(2.f, 2.f, 0.f), Up);
+        const auto under_lamp = lamp_share(Vector3(20.2f, 0.2f, 0.f), Up);
+        Log(Info, "LightTreeTest: lamp share under the panel {:.3f}, under the lamp {:.3f}", under_panel, under_lamp);
+
+        bool success = Expect(under_panel < 0.1f, "points mostly pick the lights close to them");
+        success &= Expect(under_lamp > 0.9f, "small bright lights win where they are close");
+        return success;
+    }
+
+    static bool Expect(bool condition, const char *description)
+    {
+        if (condition)
+        {
+            Log(Info, "LightTreeTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "LightTreeTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<LightTreeTest> light_tree_test_registrar("light_tree");
+} // namespace sparkle
@@ -0,0 +1,159 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "renderer/resource/PathGuide.h"
+
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace sparkle
+{
+// the guide must learn concurrently without losing records, sample what it learnt, and agree with its own pdf.
+// runs anywhere: no scene, no RHI
+class PathGuideTest : public TestCase
+{
+    static constexpr unsigned ThreadCount = 4;
+    static constexpr unsigned RecordsPerThread = 2000;
+    static constexpr unsigned SampleCount = 20000;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        PathGuide guide;
+        guide.Reset(AABB(Ones * 0.5f, Ones * 0.5f));
+
+        bool success = VerifyTrainingThreshold(guide);
+        success &= VerifyConcurrentTraining(guide);
+        success &= VerifySampling(guide);
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    // most light comes from just above the horizon on +x, some from straight up
+    static Vector3 GetLightDirection()
+    {
+        return Vector3(0.95f, 0.05f, 0.3f).normalized();
+    }
+
+    static Vector3 GetSkyDirection()
+    {
+        return Vector3(0.f, 0.1f, 0.99f).normalized();
+    }
+
+    static bool VerifyTrainingThreshold(PathGuide &guide)
+    {
+        const auto cell = guide.GetCell(Vector3(0.1f, 0.1f, 0.1f));
+        for (auto i = 0u; i + 1 < PathGuide::MinTrainingCount; i++)
+        {
+            guide.Record(cell, GetLightDirection(), 1.f);
+        }
+        guide.Update();
+        bool success = Expect(!guide.IsTrained(cell), "a cell with too few records is left to the bsdf");
+
+        guide.Record(cell, GetLightDirection(), 1.f);
+        guide.Update();
+        success &= Expect(guide.IsTrained(cell), "a cell guides once it has enough records");
+
+        const auto far_cell = guide.GetCell(Vector3(0.9f, 0.9f, 0.9f));
+        success &= Expect(far_cell != cell && !guide.IsTrained(far_cell), "distant cells learn on their own");
+        return success;
+    }
+
+    static bool VerifyConcurrentTraining(PathGuide &guide)
+    {
+        const auto cell = guide.GetCell(Vector3(0.5f, 0.5f, 0.5f));
+
+        // half of the threads bring three times the radiance of the other half, all into the same cell
+        std::vector<std::thread> threads;
+        for (auto t = 0u; t < ThreadCount; t++)
+        {
+            threads.emplace_back([&guide, cell, t]() {
+                const bool bright = t % 2 == 0;
+                for (auto i = 0u; i < RecordsPerThread; i++)
+                {
+                    guide.Record(cell, bright ? GetLightDirection() : GetSkyDirection(), bright ? 3.f : 1.f);
+                }
+            });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        guide.Update();
+
+        // the uniform share is the same in every bin
+        const auto uniform = guide.Pdf(cell, -GetSkyDirection());
+        const auto ratio =
+            (guide.Pdf(cell, GetLightDirection()) - uniform) / (guide.Pdf(cell, GetSkyDirection()) - uniform);
+        Log(Info, "PathGuideTest: learnt radiance ratio {:.4f}, expected 3", ratio);
+        return Expect(std::abs(ratio - 3.f) < 1e-3f, "concurrent records are all counted");
+    }
+
+    static bool VerifySampling(const PathGuide &guide)
+    {
+        const auto cell = guide.GetCell(Vector3(0.5f, 0.5f, 0.5f));
+
+        std::mt19937 rng(17);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+
+        // midpoints of equal-area patches, several per bin. exact for a piecewise constant pdf
+        constexpr unsigned CosThetaSteps = PathGuide::CosThetaBinCount * 4;
+        constexpr unsigned PhiSteps = PathGuide::PhiBinCount * 4;
+        double pdf_integral = 0.0;
+        for (auto j = 0u; j < CosThetaSteps; j++)
+        {
+            for (auto i = 0u; i < PhiSteps; i++)
+            {
+                const auto cos_theta = (static_cast<Scalar>(j) + 0.5f) / CosThetaSteps * 2.f - 1.f;
+                const auto phi = (static_cast<Scalar>(i) + 0.5f) / PhiSteps * 2.f * Pi;
+                const auto sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+                const Vector3 direction(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+                pdf_integral += guide.Pdf(cell, direction);
+            }
+        }
+        pdf_integral *= 4.0 * Pi / (CosThetaSteps * PhiSteps);
+
+        bool consistent = true;
+        unsigned learnt_count = 0;
+        const auto light_bin = PathGuide::GetBin(GetLightDirection());
+        const auto sky_bin = PathGuide::GetBin(GetSkyDirection());
+        for (auto i = 0u; i < SampleCount; i++)
+        {
+            Scalar pdf;
+            const Vector3 direction = guide.Sample(cell, unit(rng), Vector2(unit(rng), unit(rng)), pdf);
+            consistent &= std::abs(direction.norm() - 1.f) < 1e-4f;
+            consistent &= std::abs(pdf - guide.Pdf(cell, direction)) <= 1e-4f * pdf;
+
+            const auto bin = PathGuide::GetBin(direction);
+            learnt_count += bin == light_bin || bin == sky_bin ? 1 : 0;
+        }
+
+        const auto learnt_share = static_cast<Scalar>(learnt_count) / SampleCount;
+        Log(Info, "PathGuideTest: pdf integral {:.4f}, share of samples in learnt bins {:.4f}", pdf_integral,
+            learnt_share);
+
+        bool success = Expect(std::abs(pdf_integral - 1.0) < 1e-4, "the pdf integrates to one over the sphere");
+        success &= Expect(consistent, "sampled directions are unit length and report the pdf of Pdf");
+        success &= Expect(learnt_share > 1.f - PathGuide::UniformShare - 0.01f,
+                          "samples follow the learnt radiance, apart from the uniform share");
+        return success;
+    }
+
+    static bool Expect(bool condition, const char *description)
+    {
+        if (condition)
+        {
+            Log(Info, "PathGuideTest: OK - {}", description);
+        }
+        else
+        {
+            Log(Error, "PathGuideTest: FAILED - {}", description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<PathGuideTest> path_guide_test_registrar("path_guide");
+} // namespace sparkle
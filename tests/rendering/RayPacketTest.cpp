@@ -0,0 +1,230 @@
+#include "application/TestCase.h"
+
+#include "application/AppFramework.h"
+#include "application/RenderFramework.h"
+#include "core/Logger.h"
+#include "core/math/Intersection.h"
+#include "core/math/RayPacket.h"
+#include "core/task/TaskManager.h"
+#include "renderer/proxy/PrimitiveRenderProxy.h"
+#include "renderer/proxy/SceneRenderProxy.h"
+#include "scene/Scene.h"
+
+#include <atomic>
+#include <format>
+#include <random>
+#include <vector>
+
+namespace sparkle
+{
+// packet and stream traversal of the loaded scene must find exactly what the scalar path finds: the same t, primitive
+// and face for closest hits, and the same verdict for any-hit. rays come in coherent groups and incoherent ones, some
+// cut short by their max distance and some leaving the scene without a hit. runs on the render thread, which owns the
+// scene's bvh
+class RayPacketTest : public TestCase
+{
+    static constexpr unsigned GroupCount = 4096;
+
+public:
+    void OnEnforceConfigs() override
+    {
+        // the scene keeps its cpu bvh only for the cpu path tracer
+        EnforceConfig("pipeline", std::string("cpu"));
+    }
+
+    Result OnTick(AppFramework &app) override
+    {
+        if (!app.GetRenderFramework()->IsSceneFullyLoaded() || task_pending_.load(std::memory_order_acquire))
+        {
+            return Result::Pending;
+        }
+
+        if (done_)
+        {
+            return failed_.load(std::memory_order_acquire) ? Result::Fail : Result::Pass;
+        }
+
+        auto *scene = app.GetScene();
+        task_pending_.store(true, std::memory_order_release);
+        TaskManager::RunInRenderThread([this, scene] {
+            Verify(*scene->GetRenderProxy());
+            task_pending_.store(false, std::memory_order_release);
+        });
+        done_ = true;
+
+        return Result::Pending;
+    }
+
+private:
+    void Verify(const SceneRenderProxy &scene)
+    {
+        std::vector<Vector3> centers;
+        Vector3 scene_min = Ones * std::numeric_limits<Scalar>::max();
+        Vector3 scene_max = Ones * -std::numeric_limits<Scalar>::max();
+        for (const auto *primitive : scene.GetPrimitives())
+        {
+            const auto bound = primitive->GetWorldBoundingBox();
+            centers.push_back(bound.Center());
+            scene_min = scene_min.cwiseMin(bound.Min());
+            scene_max = scene_max.cwiseMax(bound.Max());
+        }
+
+        if (centers.empty())
+        {
+            Expect(false, "the scene has primitives to trace");
+            return;
+        }
+
+        const auto rays = MakeRays(centers, scene_min, scene_max);
+
+        bool success = VerifyClosestHit(scene, rays);
+        success &= VerifyAnyHit(scene, rays);
+
+        if (!success)
+        {
+            failed_.store(true, std::memory_order_release);
+        }
+    }
+
+    // even groups are coherent: one origin outside the scene, directions spread a little around a primitive. odd
+    // groups go anywhere from anywhere around the scene, so many miss. a third of all rays stop short of the scene's
+    // extent
+    std::vector<Ray> MakeRays(const std::vector<Vector3> &centers, const Vector3 &scene_min, const Vector3 &scene_max)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+        std::uniform_int_distribution<size_t> pick(0, centers.size() - 1);
+        std::normal_distribution<Scalar> normal;
+
+        const Vector3 extent = (scene_max - scene_min).cwiseMax(Ones * Eps);
+        const Scalar diagonal = extent.norm();
+        auto random_point = [&](Scalar margin) {
+            const Vector3 unit_point(unit(rng), unit(rng), unit(rng));
+            return scene_min - extent * margin + unit_point.cwiseProduct(extent * (1.f + 2.f * margin));
+        };
+        auto random_direction = [&]() { return Vector3(normal(rng), normal(rng), normal(rng)).normalized(); };
+
+        std::vector<Ray> rays(GroupCount * DefaultRayPacket::Size);
+        for (auto group = 0u; group < GroupCount; group++)
+        {
+            const bool coherent = group % 2 == 0;
+            const Vector3 origin = (scene_min + scene_max) / 2.f + random_direction() * diagonal;
+            const Vector3 target = centers[pick(rng)];
+            for (auto lane = 0u; lane < DefaultRayPacket::Size; lane++)
+            {
+                const auto max_distance =
+                    unit(rng) < 1.f / 3.f ? unit(rng) * diagonal * 1.5f : std::numeric_limits<Scalar>::max();
+
+                auto &ray = rays[group * DefaultRayPacket::Size + lane];
+                if (coherent)
+                {
+                    const Vector3 jitter = random_direction() * diagonal * 0.01f;
+                    ray.Reset(origin, (target + jitter - origin).normalized(), max_distance);
+                }
+                else
+                {
+                    ray.Reset(random_point(0.5f), random_direction(), max_distance);
+                }
+            }
+        }
+        return rays;
+    }
+
+    bool VerifyClosestHit(const SceneRenderProxy &scene, const std::vector<Ray> &rays)
+    {
+        std::vector<Intersection> scalar(rays.size());
+        std::vector<Intersection> packet(rays.size());
+        std::vector<Intersection> stream(rays.size());
+
+        for (auto i = 0u; i < rays.size(); i++)
+        {
+            scene.Intersect<false>(rays[i], scalar[i]);
+        }
+        for (auto begin = 0u; begin < rays.size(); begin += DefaultRayPacket::Size)
+        {
+            scene.IntersectPacket<false>(std::span(rays).subspan(begin, DefaultRayPacket::Size),
+                                         std::span(packet).subspan(begin, DefaultRayPacket::Size));
+        }
+        scene.IntersectStream<false>(rays, stream);
+
+        unsigned hits = 0;
+        unsigned packet_mismatches = 0;
+        unsigned stream_mismatches = 0;
+        for (auto i = 0u; i < rays.size(); i++)
+        {
+            hits += scalar[i].IsHit() ? 1 : 0;
+            packet_mismatches += IsSameHit(scalar[i], packet[i]) ? 0 : 1;
+            stream_mismatches += IsSameHit(scalar[i], stream[i]) ? 0 : 1;
+        }
+
+        Log(Info, "{}: {} of {} rays hit", GetName(), hits, rays.size());
+
+        bool success = Expect(hits > 0 && hits < rays.size(), "rays both hit and miss");
+        success &= Expect(packet_mismatches == 0,
+                          std::format("packets find the scalar closest hits ({} mismatches)", packet_mismatches));
+        success &= Expect(stream_mismatches == 0,
+                          std::format("streams find the scalar closest hits ({} mismatches)", stream_mismatches));
+        return success;
+    }
+
+    bool VerifyAnyHit(const SceneRenderProxy &scene, const std::vector<Ray> &rays)
+    {
+        std::vector<Intersection> scalar(rays.size());
+        std::vector<Intersection> packet(rays.size());
+        std::vector<Intersection> stream(rays.size());
+
+        for (auto i = 0u; i < rays.size(); i++)
+        {
+            scene.Intersect<true>(rays[i], scalar[i]);
+        }
+        for (auto begin = 0u; begin < rays.size(); begin += DefaultRayPacket::Size)
+        {
+            scene.IntersectPacket<true>(std::span(rays).subspan(begin, DefaultRayPacket::Size),
+                                        std::span(packet).subspan(begin, DefaultRayPacket::Size));
+        }
+        scene.IntersectStream<true>(rays, stream);
+
+        unsigned packet_mismatches = 0;
+        unsigned stream_mismatches = 0;
+        for (auto i = 0u; i < rays.size(); i++)
+        {
+            packet_mismatches += scalar[i].IsHit() == packet[i].IsHit() ? 0 : 1;
+            stream_mismatches += scalar[i].IsHit() == stream[i].IsHit() ? 0 : 1;
+        }
+
+        bool success = Expect(packet_mismatches == 0,
+                              std::format("packets agree on any-hit occlusion ({} mismatches)", packet_mismatches));
+        success &= Expect(stream_mismatches == 0,
+                          std::format("streams agree on any-hit occlusion ({} mismatches)", stream_mismatches));
+        return success;
+    }
+
+    static bool IsSameHit(const Intersection &a, const Intersection &b)
+    {
+        if (!a.IsHit() || !b.IsHit())
+        {
+            return a.IsHit() == b.IsHit();
+        }
+        return a.GetPrimitive() == b.GetPrimitive() && a.T() == b.T() && a.GetFace() == b.GetFace();
+    }
+
+    bool Expect(bool condition, const std::string &description) const
+    {
+        if (condition)
+        {
+            Log(Info, "{}: OK - {}", GetName(), description);
+        }
+        else
+        {
+            Log(Error, "{}: FAILED - {}", GetName(), description);
+        }
+        return condition;
+    }
+
+    std::atomic<bool> task_pending_{false};
+    std::atomic<bool> failed_{false};
+    bool done_ = false;
+};
+
+static TestCaseRegistrar<RayPacketTest> ray_packet_registrar("ray_packet");
+} // namespace sparkle
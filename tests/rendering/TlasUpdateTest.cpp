@@ -0,0 +1,408 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "core/math/Intersection.h"
+#include "renderer/proxy/PrimitiveRenderProxy.h"
+#include "renderer/resource/TLAS.h"
+
+#include <format>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace sparkle
+{
+// a tlas that follows insertions, removals and moves must trace exactly like one freshly built from the same
+// primitives, scalar and packet alike, even when it grows deeper than the inline traversal stacks. it must be rebuilt
+// once insertions deepen it too much, which happens when a scene streams into an empty tree in the worst order, but a
+// fresh build must never ask for another one, however skewed the scene. runs anywhere: no scene, no RHI
+class TlasUpdateTest : public TestCase
+{
+    static constexpr unsigned PoolSize = 2048;
+    static constexpr unsigned StreamFrames = 128;
+    static constexpr unsigned StreamPerFrame = 8;
+    static constexpr unsigned RandomFrames = 400;
+    static constexpr unsigned CheckInterval = 8;
+    static constexpr unsigned RayCount = 2048;
+    static constexpr Scalar BallRadius = 0.02f;
+    // deeper than both the scalar and the packet inline stacks
+    static constexpr unsigned ChainLength = 80;
+    static constexpr unsigned NestedCount = 64;
+
+    // analytic sphere whose world bounds follow MoveTo, so the tlas sees a primitive without any rhi behind it
+    class Ball : public PrimitiveRenderProxy
+    {
+    public:
+        explicit Ball(Scalar radius = BallRadius)
+            : PrimitiveRenderProxy("TlasUpdateTest", AABB(Zeros, Ones * radius)), radius_(radius)
+        {
+        }
+
+        void MoveTo(const Vector3 &center)
+        {
+            UpdateTransform(Transform(center, Zeros, Ones));
+            OnTransformDirty(nullptr);
+        }
+
+        bool Intersect(const Ray &ray, IntersectionCandidate &candidate) const override
+        {
+            return IntersectInternal<false>(ray, candidate);
+        }
+
+        bool IntersectAnyHit(const Ray &ray, IntersectionCandidate &candidate) const override
+        {
+            return IntersectInternal<true>(ray, candidate);
+        }
+
+        void GetIntersection(const Ray &ray, const IntersectionCandidate &candidate,
+                             Intersection &intersection) override
+        {
+            const Vector3 normal = (ray.At(candidate.t) - GetTransform().GetTranslation()).normalized();
+            intersection.Update(ray, this, candidate.t, normal, utilities::GetPossibleMajorAxis(normal));
+        }
+
+    private:
+        template <bool AnyHit> bool IntersectInternal(const Ray &ray, IntersectionCandidate &candidate) const
+        {
+            const Vector3 center_to_origin = ray.Origin() - GetTransform().GetTranslation();
+            const auto half_b = ray.Direction().dot(center_to_origin);
+            const auto c = center_to_origin.squaredNorm() - radius_ * radius_;
+            const auto discriminant = half_b * half_b - c;
+            if (discriminant < 0)
+            {
+                return false;
+            }
+
+            const auto sqrt_discriminant = std::sqrt(discriminant);
+            const auto t = -half_b + (c >= 0 ? -sqrt_discriminant : sqrt_discriminant);
+            if (t <= 0 || !candidate.IsCloserHit(t))
+            {
+                return false;
+            }
+
+            if constexpr (!AnyHit)
+            {
+                candidate.t = t;
+            }
+            return true;
+        }
+
+        Scalar radius_;
+    };
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        pool_.resize(PoolSize);
+        for (auto &ball : pool_)
+        {
+            ball = std::make_unique<Ball>();
+        }
+        is_live_.assign(PoolSize, false);
+
+        bool success = VerifyDeepChain();
+        success &= VerifySkewedBuild();
+        success &= VerifyStreaming();
+        success &= VerifyRandomUpdates();
+
+        Log(Info, "{}: {} rebuilds, deepest tree traced had depth {}", GetName(), rebuild_count_, max_depth_);
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    // balls inserted in order along x each land below the last one, so without a rebuild the tree turns into a chain
+    // deeper than the inline stacks. rays along the chain keep a pending node on every level
+    bool VerifyDeepChain()
+    {
+        tlas_ = std::make_unique<TLAS>(std::vector<PrimitiveRenderProxy *>{});
+        tlas_->Build();
+
+        for (auto id = 0u; id < ChainLength; id++)
+        {
+            pool_[id]->MoveTo(Vector3(static_cast<Scalar>(id) * 2.f / ChainLength - 1.f, 0.f, 0.f));
+            Insert(id);
+        }
+        tlas_->Refit();
+
+        Log(Info, "{}: chain of {} insertions has depth {}", GetName(), ChainLength, tlas_->GetDepth());
+
+        bool success = Expect(tlas_->GetDepth() > RayPacketStackSize, "the chain is deeper than the inline stacks");
+        success &= Expect(tlas_->NeedsRebuild(), "the chain asks for a rebuild");
+
+        // half of the packets look down the chain from either end, the other half come from anywhere
+        std::uniform_real_distribution<Scalar> jitter(-BallRadius, BallRadius);
+        auto rays = MakeRays(GetLivePrimitives());
+        for (auto i = 0u; i < rays.size() / 2; i++)
+        {
+            const Scalar side = i % (2 * DefaultRayPacket::Size) < DefaultRayPacket::Size ? 1.f : -1.f;
+            rays[i].Reset(Vector3(side * 1.5f, jitter(rng_), jitter(rng_)), Vector3(-side, 0.f, 0.f));
+        }
+
+        success &= VerifyTrace("deep chain", rays);
+
+        for (auto id = 0u; id < ChainLength; id++)
+        {
+            Remove(id);
+        }
+        return success;
+    }
+
+    // nested spheres that all touch the origin and grow by a constant factor, so the sah build peels them off one by
+    // one into a lopsided tree. however deep it is, the scene must not rebuild it again on the next update
+    bool VerifySkewedBuild()
+    {
+        std::vector<std::unique_ptr<Ball>> balls;
+        std::vector<PrimitiveRenderProxy *> primitives;
+        for (auto i = 0u; i < NestedCount; i++)
+        {
+            const auto radius = BallRadius * std::pow(1.25f, static_cast<Scalar>(i));
+            balls.push_back(std::make_unique<Ball>(radius));
+            balls.back()->MoveTo(Vector3(radius, 0.f, 0.f));
+            primitives.push_back(balls.back().get());
+        }
+
+        TLAS skewed(primitives);
+        skewed.Build();
+
+        Log(Info, "{}: skewed build of {} spheres has depth {}", GetName(), NestedCount, skewed.GetDepth());
+
+        bool success = Expect(!skewed.NeedsRebuild(), "a fresh skewed build does not ask for a rebuild");
+
+        // what the next SceneRenderProxy::UpdateBVH does to it when a sphere moves
+        balls.front()->MoveTo(Vector3(BallRadius, BallRadius, 0.f));
+        skewed.Refit();
+        success &= Expect(!skewed.NeedsRebuild(), "a refit skewed build does not ask for a rebuild");
+        return success;
+    }
+
+    // balls arrive sorted along x, so every insertion lands next to the last one and the tree degenerates into a list
+    bool VerifyStreaming()
+    {
+        tlas_ = std::make_unique<TLAS>(std::vector<PrimitiveRenderProxy *>{});
+        tlas_->Build();
+
+        bool success = true;
+        for (auto frame = 0u; frame < StreamFrames; frame++)
+        {
+            for (auto i = 0u; i < StreamPerFrame; i++)
+            {
+                const auto id = frame * StreamPerFrame + i;
+                const auto x = static_cast<Scalar>(id) / static_cast<Scalar>(StreamFrames * StreamPerFrame);
+                pool_[id]->MoveTo(Vector3(x * 2.f - 1.f, 0.f, 0.f));
+                Insert(id);
+            }
+
+            EndFrame();
+
+            success &= Expect(tlas_->GetDepth() <= tlas_->GetBuiltDepth() + TLAS::MaxInsertedDepth,
+                              std::format("streamed tree is rebuilt before insertions deepen it too much (frame {})",
+                                          frame));
+
+            if (frame % CheckInterval == CheckInterval - 1)
+            {
+                success &= VerifyTrace(std::format("stream frame {}", frame));
+            }
+        }
+        return success;
+    }
+
+    // inserts, removes and moves in every frame, starting from the streamed tree
+    bool VerifyRandomUpdates()
+    {
+        std::uniform_int_distribution<unsigned> pick(0, PoolSize - 1);
+        std::uniform_int_distribution<unsigned> op_count(0, 6);
+
+        bool success = true;
+        for (auto frame = 0u; frame < RandomFrames; frame++)
+        {
+            for (auto i = op_count(rng_); i > 0; i--)
+            {
+                const auto id = pick(rng_);
+                if (!is_live_[id])
+                {
+                    pool_[id]->MoveTo(RandomPoint());
+                    Insert(id);
+                }
+            }
+
+            for (auto i = op_count(rng_); i > 0; i--)
+            {
+                const auto id = pick(rng_);
+                if (is_live_[id])
+                {
+                    Remove(id);
+                }
+            }
+
+            for (auto i = op_count(rng_); i > 0; i--)
+            {
+                const auto id = pick(rng_);
+                if (is_live_[id])
+                {
+                    pool_[id]->MoveTo(RandomPoint());
+                }
+            }
+
+            EndFrame();
+
+            success &= Expect(tlas_->GetDepth() <= tlas_->GetBuiltDepth() + TLAS::MaxInsertedDepth,
+                              std::format("updated tree is rebuilt before insertions deepen it too much (frame {})",
+                                          frame));
+
+            if (frame % CheckInterval == CheckInterval - 1)
+            {
+                success &= VerifyTrace(std::format("random frame {}", frame));
+            }
+        }
+        return success;
+    }
+
+    void Insert(unsigned id)
+    {
+        is_live_[id] = true;
+        tlas_->Insert(pool_[id].get());
+    }
+
+    void Remove(unsigned id)
+    {
+        is_live_[id] = false;
+        tlas_->Remove(pool_[id].get());
+    }
+
+    [[nodiscard]] std::vector<PrimitiveRenderProxy *> GetLivePrimitives() const
+    {
+        std::vector<PrimitiveRenderProxy *> primitives;
+        for (auto id = 0u; id < PoolSize; id++)
+        {
+            if (is_live_[id])
+            {
+                primitives.push_back(pool_[id].get());
+            }
+        }
+        return primitives;
+    }
+
+    // what SceneRenderProxy::UpdateBVH does once the changes of a frame are in
+    void EndFrame()
+    {
+        if (tlas_->NeedsRebuild())
+        {
+            tlas_ = std::make_unique<TLAS>(GetLivePrimitives());
+            tlas_->Build();
+            rebuild_count_++;
+            return;
+        }
+
+        tlas_->Refit();
+    }
+
+    // coherent groups share an origin and spread a little around a live ball, incoherent ones go anywhere. half of
+    // them are cut off short, and many leave the cloud without hitting anything
+    [[nodiscard]] std::vector<Ray> MakeRays(const std::vector<PrimitiveRenderProxy *> &live)
+    {
+        std::uniform_real_distribution<Scalar> unit(0.f, 1.f);
+        std::uniform_int_distribution<size_t> pick(0, live.size() - 1);
+
+        std::vector<Ray> rays(RayCount);
+        for (auto group = 0u; group < RayCount / DefaultRayPacket::Size; group++)
+        {
+            const bool coherent = group % 2 == 0;
+            const Vector3 origin = RandomPoint() * 1.5f;
+            const Vector3 target = live[pick(rng_)]->GetTransform().GetTranslation();
+            for (auto lane = 0u; lane < DefaultRayPacket::Size; lane++)
+            {
+                const Vector3 direction =
+                    coherent ? (target + RandomPoint() * 0.05f - origin).normalized() : RandomDirection();
+                const auto max_distance = unit(rng_) < 0.5f ? std::numeric_limits<Scalar>::max() : unit(rng_) * 2.f;
+                rays[group * DefaultRayPacket::Size + lane].Reset(origin, direction, max_distance);
+            }
+        }
+        return rays;
+    }
+
+    bool VerifyTrace(const std::string &when)
+    {
+        return VerifyTrace(when, MakeRays(GetLivePrimitives()));
+    }
+
+    bool VerifyTrace(const std::string &when, const std::vector<Ray> &rays)
+    {
+        TLAS fresh(GetLivePrimitives());
+        fresh.Build();
+
+        max_depth_ = std::max(max_depth_, tlas_->GetDepth());
+
+        std::vector<Intersection> expected(rays.size());
+        std::vector<Intersection> scalar(rays.size());
+        std::vector<Intersection> packet(rays.size());
+        for (auto i = 0u; i < rays.size(); i++)
+        {
+            fresh.Intersect(rays[i], expected[i]);
+            tlas_->Intersect(rays[i], scalar[i]);
+        }
+        for (auto begin = 0u; begin < rays.size(); begin += DefaultRayPacket::Size)
+        {
+            tlas_->IntersectPacket<false>(std::span(rays).subspan(begin, DefaultRayPacket::Size),
+                                          std::span(packet).subspan(begin, DefaultRayPacket::Size));
+        }
+
+        unsigned scalar_mismatches = 0;
+        unsigned packet_mismatches = 0;
+        unsigned hits = 0;
+        for (auto i = 0u; i < rays.size(); i++)
+        {
+            scalar_mismatches += IsSameHit(expected[i], scalar[i]) ? 0 : 1;
+            packet_mismatches += IsSameHit(expected[i], packet[i]) ? 0 : 1;
+            hits += expected[i].IsHit() ? 1 : 0;
+        }
+
+        bool success = Expect(hits > 0 && hits < rays.size(), std::format("{}: rays both hit and miss", when));
+        success &= Expect(scalar_mismatches == 0, std::format("{}: scalar traces like a fresh build ({} mismatches)",
+                                                              when, scalar_mismatches));
+        success &= Expect(packet_mismatches == 0, std::format("{}: packets trace like a fresh build ({} mismatches)",
+                                                              when, packet_mismatches));
+        return success;
+    }
+
+    static bool IsSameHit(const Intersection &a, const Intersection &b)
+    {
+        if (!a.IsHit() || !b.IsHit())
+        {
+            return a.IsHit() == b.IsHit();
+        }
+        return a.GetPrimitive() == b.GetPrimitive() && a.T() == b.T() && a.GetFace() == b.GetFace();
+    }
+
+    Vector3 RandomPoint()
+    {
+        std::uniform_real_distribution<Scalar> unit(-1.f, 1.f);
+        return {unit(rng_), unit(rng_), unit(rng_)};
+    }
+
+    Vector3 RandomDirection()
+    {
+        std::normal_distribution<Scalar> normal;
+        return Vector3(normal(rng_), normal(rng_), normal(rng_)).normalized();
+    }
+
+    bool Expect(bool condition, const std::string &description) const
+    {
+        // per-frame checks only speak up when they fail
+        if (!condition)
+        {
+            Log(Error, "{}: FAILED - {}", GetName(), description);
+        }
+        return condition;
+    }
+
+    std::mt19937 rng_{42};
+    std::vector<std::unique_ptr<Ball>> pool_;
+    std::vector<bool> is_live_;
+    std::unique_ptr<TLAS> tlas_;
+    unsigned rebuild_count_ = 0;
+    size_t max_depth_ = 0;
+};
+
+static TestCaseRegistrar<TlasUpdateTest> tlas_update_registrar("tlas_update");
+} // namespace sparkle
@@ -0,0 +1,126 @@
+#include "application/TestCase.h"
+
+#include "core/Logger.h"
+#include "renderer/renderer/CPURenderer.h"
+
+#include <format>
+#include <random>
+#include <vector>
+
+namespace sparkle
+{
+// the row kernel of the cpu tone mapping pass must write the same fp16 values as tone mapping every pixel on its own
+// and casting the result, over hdr input from zero and negatives up to values close to overflowing the curve. rows of
+// every length up to a few simd widths are run, so the vectorized body and its tail are both covered. runs anywhere:
+// no scene, no RHI
+class ToneMapTest : public TestCase
+{
+    static constexpr unsigned MaxRowLength = 37;
+
+public:
+    Result OnTick(AppFramework & /*app*/) override
+    {
+        const auto inputs = MakeInputs();
+
+        bool success = true;
+        for (const float exposure : {1.f, 0.25f, 3.7f})
+        {
+            success &= VerifyExposure(inputs, exposure);
+        }
+
+        return success ? Result::Pass : Result::Fail;
+    }
+
+private:
+    // the per-pixel ACESFilm the row kernel replaced, followed by the cast of Image2D::SetPixel
+    static Vector4h ToneMapPixel(const Vector4 &hdr, float exposure)
+    {
+        constexpr Scalar A = 2.51f;
+        constexpr Scalar B = 0.03f;
+        constexpr Scalar C = 2.43f;
+        constexpr Scalar D = 0.59f;
+        constexpr Scalar E = 0.14f;
+
+        const auto color = hdr.head<3>().array() * exposure;
+        const Vector3 ldr = utilities::Clamp((color * (color * A + B)) / (color * (color * C + D) + E), 0, 1);
+        return utilities::ConcatVector(ldr, 1.f).cast<Half>();
+    }
+
+    // past ~1e18 the curve squares into infinity and divides it by itself, which no hdr buffer holds
+    static std::vector<Vector4> MakeInputs()
+    {
+        std::vector<Scalar> values = {0.f,
+                                      -0.f,
+                                      -1e-3f,
+                                      -1.f,
+                                      -1e15f,
+                                      std::numeric_limits<Scalar>::denorm_min(),
+                                      std::numeric_limits<Scalar>::min(),
+                                      1e-6f,
+                                      0.5f,
+                                      1.f,
+                                      16.f,
+                                      65504.f,
+                                      1e8f,
+                                      1e15f};
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<Scalar> linear(-0.1f, 4.f);
+        std::uniform_real_distribution<Scalar> exponent(-8.f, 15.f);
+        for (auto i = 0u; i < 2000; i++)
+        {
+            values.push_back(linear(rng));
+            values.push_back(std::pow(10.f, exponent(rng)));
+        }
+
+        // every value shows up in every channel, alpha included
+        std::vector<Vector4> inputs;
+        for (auto i = 0u; i < values.size(); i++)
+        {
+            inputs.emplace_back(values[i], values[(i + 1) % values.size()], values[(i + 2) % values.size()],
+                                values[(i + 3) % values.size()]);
+        }
+        return inputs;
+    }
+
+    bool VerifyExposure(const std::vector<Vector4> &inputs, float exposure) const
+    {
+        std::vector<Vector4h> output(inputs.size());
+
+        unsigned mismatches = 0;
+        size_t begin = 0;
+        for (auto length = 1u; begin < inputs.size(); length = length % MaxRowLength + 1)
+        {
+            const auto row = std::span(inputs).subspan(begin, std::min<size_t>(length, inputs.size() - begin));
+            CPURenderer::ToneMapRow(row, output.data() + begin, exposure);
+
+            for (auto i = begin; i < begin + row.size(); i++)
+            {
+                const Vector4h expected = ToneMapPixel(inputs[i], exposure);
+                // exact values: a signed zero from either side counts as zero
+                mismatches += (expected.array() == output[i].array()).all() ? 0 : 1;
+            }
+            begin += row.size();
+        }
+
+        return Expect(mismatches == 0, std::format("exposure {}: the row kernel matches per-pixel tone mapping ({} of "
+                                                   "{} pixels differ)",
+                                                   exposure, mismatches, inputs.size()));
+    }
+
+    bool Expect(bool condition, const std::string &description) const
+    {
+        if (condition)
+        {
+            Log(Info, "{}: OK - {}", GetName(), description);
+        }
+        else
+        {
+            Log(Error, "{}: FAILED - {}", GetName(), description);
+        }
+        return condition;
+    }
+};
+
+static TestCaseRegistrar<ToneMapTest> tone_map_registrar("cpu_tone_map");
+} // namespace sparkle
@@ -0,0 +1,79 @@
+"""Check the results of a cpu_bench run, optionally against a baseline run of the same scene."""
+
+import argparse
+import json
+import os
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, SCRIPT_DIR)
+from render_test_support import SUPPORTED_FRAMEWORKS, get_screenshot_dir  # noqa: E402
+
+PASSES = ("BasePass", "DenoisePass", "FilterPass", "ToneMappingPass")
+
+
+def find_results(framework, output):
+    # bench_output is relative to the external storage path, which holds the screenshots directory
+    path = os.path.join(os.path.dirname(get_screenshot_dir(framework)), output)
+    if not os.path.isfile(path):
+        raise FileNotFoundError(f"Bench results not found: {path}")
+
+    print(f"Found bench results: {path}", flush=True)
+    return path
+
+
+def load_results(path):
+    with open(path, encoding="utf-8") as results_file:
+        results = json.load(results_file)
+
+    missing = [key for key in ("mrays_per_second", "pass_ms", "bvh_build_ms", "peak_rss_mb") if key not in results]
+    missing += [name for name in PASSES if name not in results.get("pass_ms", {})]
+    if missing:
+        raise ValueError(f"{path} lacks {', '.join(missing)}")
+    if results["mrays_per_second"] <= 0:
+        raise ValueError(f"{path} traced no rays")
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--framework", required=True, choices=SUPPORTED_FRAMEWORKS)
+    parser.add_argument("--output", default="bench/cpu_bench.json",
+                        help="the app's --bench_output")
+    parser.add_argument("--baseline", help="results of an earlier run to compare against")
+    parser.add_argument("--max_regression", type=float, default=0.1,
+                        help="largest tolerated loss of Mrays/s against the baseline, as a fraction")
+    args = parser.parse_args()
+
+    try:
+        results = load_results(find_results(args.framework, args.output))
+        baseline = load_results(args.baseline) if args.baseline else None
+    except (FileNotFoundError, ValueError) as error:
+        print(f"FAIL: {error}", flush=True)
+        return 1
+
+    print(f"  {results['mrays_per_second']:.2f} Mrays/s, bvh build {results['bvh_build_ms']:.1f} ms, "
+          f"peak rss {results['peak_rss_mb']:.0f} MB", flush=True)
+    for name in PASSES:
+        print(f"  {name}: {results['pass_ms'][name]:.2f} ms", flush=True)
+    if "ray_stats" in results:
+        ray_stats = results["ray_stats"]
+        print(f"  per ray: {ray_stats['nodes_per_ray']:.1f} nodes, {ray_stats['leaves_per_ray']:.1f} leaves, "
+              f"{ray_stats['triangles_per_ray']:.1f} triangles", flush=True)
+
+    if baseline is None:
+        print("PASS", flush=True)
+        return 0
+
+    ratio = results["mrays_per_second"] / baseline["mrays_per_second"]
+    print(f"  {ratio:.3f}x the baseline's {baseline['mrays_per_second']:.2f} Mrays/s", flush=True)
+    if ratio < 1.0 - args.max_regression:
+        print(f"FAIL: throughput dropped by more than {args.max_regression:.0%}", flush=True)
+        return 1
+
+    print("PASS", flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,102 @@
+"""CPU wavefront shading order parity test.
+
+Runs the app with --test_case cpu_wavefront_parity, which screenshots a converged cpu render
+with cpu_wavefront off, turns it on and screenshots the restarted accumulation. Paths carry
+their own random state, so shading the hits of a bounce in material order must not change a
+single pixel.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+PROJECT_ROOT = os.path.dirname(os.path.dirname(SCRIPT_DIR))
+
+sys.path.insert(0, SCRIPT_DIR)
+import render_test_support  # noqa: E402
+
+SCREEN_ORDER_NAME = "cpu_wavefront_off.png"
+MATERIAL_ORDER_NAME = "cpu_wavefront_on.png"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Run the cpu wavefront parity test case and require identical screenshots.")
+    parser.add_argument("--framework", required=True,
+                        choices=render_test_support.SUPPORTED_FRAMEWORKS)
+    parser.add_argument("--scene")
+    parser.add_argument("--headless", action="store_true")
+    parser.add_argument("--skip_build", action="store_true")
+    parser.add_argument("--skip_run", action="store_true",
+                        help="Skip running the app (use existing screenshots)")
+
+    return parser.parse_known_args()
+
+
+def build_and_run(args, other_args):
+    run_py = os.path.join(PROJECT_ROOT, "run.py")
+    run_cmd = [sys.executable, run_py, "--framework", args.framework]
+    if args.skip_build:
+        run_cmd.append("--skip_build")
+    run_cmd += ["--test_case", "cpu_wavefront_parity",
+                "--clear_screenshots", "true"] + other_args
+    if args.headless:
+        run_cmd += ["--headless", "true"]
+    if args.scene:
+        run_cmd += ["--scene", args.scene]
+
+    print(f"Running: {' '.join(run_cmd)}", flush=True)
+    result = subprocess.run(run_cmd, cwd=PROJECT_ROOT)
+    print(f"App exited with code {result.returncode}", flush=True)
+    if result.returncode != 0:
+        sys.exit(1)
+
+
+def find_screenshots(framework):
+    screenshot_dir = render_test_support.get_screenshot_dir(framework)
+    paths = [os.path.join(screenshot_dir, name)
+             for name in (SCREEN_ORDER_NAME, MATERIAL_ORDER_NAME)]
+    for path in paths:
+        if not os.path.isfile(path):
+            print(f"Screenshot not found: {path}", flush=True)
+            sys.exit(1)
+        print(f"Found screenshot: {path}", flush=True)
+    return paths
+
+
+def main():
+    render_test_support.install_dependencies()
+    args, unknown_args = parse_args()
+
+    if not args.skip_run:
+        build_and_run(args, unknown_args)
+    else:
+        print("Skipping app run, using existing screenshots.")
+
+    screen_order, material_order = find_screenshots(args.framework)
+
+    import numpy as np
+
+    screen_order_image = render_test_support.load_image(screen_order)
+    material_order_image = render_test_support.load_image(material_order)
+    if screen_order_image.shape != material_order_image.shape:
+        print(f"FAIL: image size mismatch: {screen_order_image.shape} vs {material_order_image.shape}")
+        return 1
+
+    # exact: any difference means a path saw another path's random state or shared data
+    differing = np.any(screen_order_image != material_order_image, axis=-1)
+    differing_count = int(np.count_nonzero(differing))
+    if differing_count == 0:
+        print("PASS", flush=True)
+        return 0
+
+    max_difference = float(np.max(np.abs(screen_order_image - material_order_image)))
+    print(f"FAIL: {differing_count} of {differing.size} pixels differ between screen and material "
+          f"shading order (max channel difference {max_difference:.4f})")
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())